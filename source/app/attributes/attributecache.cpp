@@ -0,0 +1,115 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "attributecache.h"
+
+#include "shared/graph/igraph.h"
+#include "shared/utils/threadpool.h"
+
+template<typename E>
+void AttributeColumn::materialise(const Attribute& attribute, const std::vector<E>& elementIds, size_t size)
+{
+    _missing.resize(size, 0);
+
+    switch(_valueType)
+    {
+    case ValueType::Int:    _intValues.resize(size, 0); break;
+    case ValueType::Float:  _floatValues.resize(size, 0.0); break;
+    case ValueType::String: _stringValues.resize(size); break;
+    default: break;
+    }
+
+    if(elementIds.empty())
+        return;
+
+    // Each element is written by exactly one thread, so no synchronisation is required
+    parallel_for(elementIds.begin(), elementIds.end(),
+    [this, &attribute](E elementId)
+    {
+        auto index = indexOf(elementId);
+
+        switch(_valueType)
+        {
+        case ValueType::Int:    _intValues[index] = attribute.valueOf<int>(elementId); break;
+        case ValueType::Float:  _floatValues[index] = attribute.valueOf<double>(elementId); break;
+        case ValueType::String: _stringValues[index] = attribute.valueOf<QString>(elementId); break;
+        default: break;
+        }
+
+        _missing[index] = attribute.valueMissingOf(elementId) ? 1 : 0;
+    });
+}
+
+AttributeColumn::AttributeColumn(const Attribute& attribute, const IGraph& graph) :
+    _elementType(attribute.elementType()),
+    _valueType(attribute.valueType())
+{
+    if(_elementType == ElementType::Node)
+        materialise(attribute, graph.nodeIds(), static_cast<size_t>(static_cast<int>(graph.nextNodeId())));
+    else if(_elementType == ElementType::Edge)
+        materialise(attribute, graph.edgeIds(), static_cast<size_t>(static_cast<int>(graph.nextEdgeId())));
+}
+
+std::shared_ptr<const AttributeColumn> AttributeCache::column(const QString& name) const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto it = _columns.find(name);
+    return it != _columns.end() ? it->second : nullptr;
+}
+
+uint64_t AttributeCache::generation() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _generation;
+}
+
+void AttributeCache::insert(const QString& name,
+    std::shared_ptr<const AttributeColumn> column, uint64_t generation)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Something has changed since the column was materialised
+    if(generation != _generation)
+        return;
+
+    _columns[name] = std::move(column);
+}
+
+void AttributeCache::invalidate(const QString& attributeName)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _generation++;
+
+    for(auto it = _columns.begin(); it != _columns.end();)
+    {
+        if(Attribute::parseAttributeName(it->first)._name == attributeName)
+            it = _columns.erase(it);
+        else
+            ++it;
+    }
+}
+
+void AttributeCache::invalidateAll()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _generation++;
+    _columns.clear();
+}
@@ -0,0 +1,193 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ATTRIBUTECACHE_H
+#define ATTRIBUTECACHE_H
+
+#include "attribute.h"
+
+#include "shared/graph/elementid.h"
+#include "shared/graph/elementtype.h"
+#include "shared/attributes/valuetype.h"
+#include "shared/utils/statistics.h"
+
+#include <QString>
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <limits>
+#include <cstdint>
+#include <type_traits>
+
+class IGraph;
+
+// The values of a node or edge attribute, evaluated once for every element of a
+// graph and stored contiguously, indexed by element id; this makes reading values
+// en masse much cheaper than calling the attribute's value function each time
+class AttributeColumn
+{
+private:
+    ElementType _elementType = ElementType::None;
+    ValueType _valueType = ValueType::Unknown;
+
+    std::vector<int> _intValues;
+    std::vector<double> _floatValues;
+    std::vector<QString> _stringValues;
+    std::vector<uint8_t> _missing;
+
+    template<typename E>
+    void materialise(const Attribute& attribute, const std::vector<E>& elementIds, size_t size);
+
+    template<typename E>
+    static size_t indexOf(E elementId) { return static_cast<size_t>(static_cast<int>(elementId)); }
+
+public:
+    AttributeColumn(const Attribute& attribute, const IGraph& graph);
+
+    ElementType elementType() const { return _elementType; }
+    ValueType valueType() const { return _valueType; }
+
+    template<typename E> int intValueOf(E elementId) const
+    {
+        switch(_valueType)
+        {
+        case ValueType::Int:    return _intValues[indexOf(elementId)];
+        case ValueType::Float:  return static_cast<int>(_floatValues[indexOf(elementId)]);
+        case ValueType::String: return _stringValues[indexOf(elementId)].toInt();
+        default: break;
+        }
+
+        return {};
+    }
+
+    template<typename E> double floatValueOf(E elementId) const
+    {
+        switch(_valueType)
+        {
+        case ValueType::Int:    return static_cast<double>(_intValues[indexOf(elementId)]);
+        case ValueType::Float:  return _floatValues[indexOf(elementId)];
+        case ValueType::String: return _stringValues[indexOf(elementId)].toDouble();
+        default: break;
+        }
+
+        return {};
+    }
+
+    template<typename E> double numericValueOf(E elementId) const
+    {
+        switch(_valueType)
+        {
+        case ValueType::Int:    return static_cast<double>(_intValues[indexOf(elementId)]);
+        case ValueType::Float:  return _floatValues[indexOf(elementId)];
+        default: break;
+        }
+
+        return std::numeric_limits<double>::signaling_NaN();
+    }
+
+    template<typename E> QString stringValueOf(E elementId) const
+    {
+        switch(_valueType)
+        {
+        case ValueType::Int:    return QString::number(_intValues[indexOf(elementId)]);
+        case ValueType::Float:  return QString::number(_floatValues[indexOf(elementId)]);
+        case ValueType::String: return _stringValues[indexOf(elementId)];
+        default: break;
+        }
+
+        return {};
+    }
+
+    template<typename E> bool valueMissingOf(E elementId) const
+    {
+        return _missing[indexOf(elementId)] != 0;
+    }
+
+    // Gathers the values of many elements at once
+    template<typename T, typename E>
+    std::vector<T> valuesOf(std::span<const E> elementIds) const
+    {
+        std::vector<T> values;
+        values.reserve(elementIds.size());
+
+        for(auto elementId : elementIds)
+        {
+            if constexpr(std::is_same_v<T, int>)
+                values.push_back(intValueOf(elementId));
+            else if constexpr(std::is_same_v<T, double>)
+                values.push_back(floatValueOf(elementId));
+            else if constexpr(std::is_same_v<T, QString>)
+                values.push_back(stringValueOf(elementId));
+        }
+
+        return values;
+    }
+
+    template<typename E>
+    std::vector<double> numericValuesOf(std::span<const E> elementIds) const
+    {
+        std::vector<double> values;
+        values.reserve(elementIds.size());
+
+        for(auto elementId : elementIds)
+            values.push_back(numericValueOf(elementId));
+
+        return values;
+    }
+
+    template<typename E>
+    u::Statistics findStatisticsforElements(const std::vector<E>& elementIds,
+        bool storeValues = false) const
+    {
+        return u::findStatisticsFor(elementIds,
+        [this](const auto& elementId)
+        {
+            return floatValueOf(elementId);
+        }, storeValues);
+    }
+};
+
+// Holds the columns of attributes that have been requested, until such time as the
+// attribute's values change; columns are shared, so holders of a column are unaffected
+// by its invalidation
+class AttributeCache
+{
+private:
+    mutable std::mutex _mutex;
+    std::map<QString, std::shared_ptr<const AttributeColumn>> _columns;
+
+    // Incremented on every invalidation, so that columns that were being
+    // materialised concurrently with an invalidation are discarded
+    uint64_t _generation = 0;
+
+public:
+    std::shared_ptr<const AttributeColumn> column(const QString& name) const;
+    uint64_t generation() const;
+
+    void insert(const QString& name, std::shared_ptr<const AttributeColumn> column, uint64_t generation);
+
+    // Invalidates the columns of the named attribute, including
+    // any of its parameterised or edge node variants
+    void invalidate(const QString& attributeName);
+    void invalidateAll();
+};
+
+#endif // ATTRIBUTECACHE_H
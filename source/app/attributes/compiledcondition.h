@@ -0,0 +1,599 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPILEDCONDITION_H
+#define COMPILEDCONDITION_H
+
+#include "conditionfncreator.h"
+#include "attributecache.h"
+
+#include "shared/graph/igraph.h"
+#include "shared/utils/threadpool.h"
+
+#include <boost/variant/static_visitor.hpp>
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+
+#include <QString>
+#include <QRegularExpression>
+
+// A condition, lowered into a flat postfix program whose leaves each evaluate one
+// comparison over every element at once, reading from attribute columns that are
+// materialised once per evaluation, regardless of how often they are referenced;
+// the result is a bitmap, with one bit per element
+template<typename E>
+class CompiledCondition
+{
+public:
+    using Bitmap = std::vector<uint64_t>;
+
+    static bool test(const Bitmap& bitmap, size_t index)
+    {
+        return (bitmap[index >> 6] & (uint64_t{1} << (index & 63))) != 0;
+    }
+
+private:
+    using Columns = std::vector<std::shared_ptr<const AttributeColumn>>;
+    using LeafFn = std::function<void(const Columns&, const std::vector<E>&, Bitmap&)>;
+
+    enum class Opcode { Constant, Leaf, And, Or };
+
+    struct Instruction
+    {
+        Opcode _opcode = Opcode::Constant;
+        bool _constant = false;
+        size_t _leafIndex = 0;
+    };
+
+    std::vector<Instruction> _program;
+    std::vector<LeafFn> _leaves;
+
+    // The attributes that are referenced, in the order of their columns
+    std::vector<Attribute> _attributes;
+    std::map<QString, size_t> _columnIndices;
+
+    const GraphModel* _graphModel = nullptr;
+    bool _valid = false;
+
+    // Evaluates predicate(columns, elementId) for every element, 64 elements at a time
+    template<typename Predicate>
+    static LeafFn leaf(Predicate predicate)
+    {
+        return [predicate](const Columns& columns, const std::vector<E>& elementIds, Bitmap& bitmap)
+        {
+            std::vector<size_t> words(bitmap.size());
+            std::iota(words.begin(), words.end(), 0);
+
+            parallel_for(words.begin(), words.end(),
+            [&](size_t word)
+            {
+                auto first = word * 64;
+                auto last = std::min(first + 64, elementIds.size());
+                uint64_t bits = 0;
+
+                for(auto i = first; i < last; i++)
+                {
+                    if(predicate(columns, elementIds[i]))
+                        bits |= uint64_t{1} << (i - first);
+                }
+
+                bitmap[word] = bits;
+            });
+        };
+    }
+
+    size_t columnIndexFor(const QString& attributeName)
+    {
+        auto it = _columnIndices.find(attributeName);
+        if(it != _columnIndices.end())
+            return it->second;
+
+        auto columnIndex = _attributes.size();
+        _attributes.emplace_back(_graphModel->attributeValueByName(attributeName));
+        _columnIndices.emplace(attributeName, columnIndex);
+
+        return columnIndex;
+    }
+
+    template<typename Compare>
+    static bool numerical(ConditionFnOp::Numerical op, Compare lhs, Compare rhs)
+    {
+        switch(op)
+        {
+        case ConditionFnOp::Numerical::LessThan:            return lhs < rhs;
+        case ConditionFnOp::Numerical::GreaterThan:         return lhs > rhs;
+        case ConditionFnOp::Numerical::LessThanOrEqual:     return lhs <= rhs;
+        case ConditionFnOp::Numerical::GreaterThanOrEqual:  return lhs >= rhs;
+        default: break;
+        }
+
+        return false;
+    }
+
+    template<typename T>
+    static LeafFn attributesEquality(ConditionFnOp::Equality op, size_t lhs, size_t rhs)
+    {
+        bool equal = op == ConditionFnOp::Equality::Equal;
+
+        return leaf([lhs, rhs, equal](const Columns& columns, E elementId)
+        {
+            if constexpr(std::is_same_v<T, QString>)
+                return (columns[lhs]->stringValueOf(elementId) == columns[rhs]->stringValueOf(elementId)) == equal;
+            else if constexpr(std::is_same_v<T, int>)
+                return (columns[lhs]->intValueOf(elementId) == columns[rhs]->intValueOf(elementId)) == equal;
+            else
+                return (columns[lhs]->floatValueOf(elementId) == columns[rhs]->floatValueOf(elementId)) == equal;
+        });
+    }
+
+    template<typename T>
+    static LeafFn equality(ConditionFnOp::Equality op, size_t column, T value)
+    {
+        bool equal = op == ConditionFnOp::Equality::Equal;
+
+        return leaf([column, value, equal](const Columns& columns, E elementId)
+        {
+            if constexpr(std::is_same_v<T, QString>)
+                return (columns[column]->stringValueOf(elementId) == value) == equal;
+            else if constexpr(std::is_same_v<T, int>)
+                return (columns[column]->intValueOf(elementId) == value) == equal;
+            else
+                return (columns[column]->floatValueOf(elementId) == value) == equal;
+        });
+    }
+
+    // The string ops, where the rhs is the same for every element
+    static LeafFn stringOp(ConditionFnOp::String op, size_t column, const QString& value)
+    {
+        switch(op)
+        {
+        case ConditionFnOp::String::Includes:
+            return leaf([column, value](const Columns& columns, E elementId)
+                { return columns[column]->stringValueOf(elementId).contains(value); });
+        case ConditionFnOp::String::Excludes:
+            return leaf([column, value](const Columns& columns, E elementId)
+                { return !columns[column]->stringValueOf(elementId).contains(value); });
+        case ConditionFnOp::String::Starts:
+            return leaf([column, value](const Columns& columns, E elementId)
+                { return columns[column]->stringValueOf(elementId).startsWith(value); });
+        case ConditionFnOp::String::Ends:
+            return leaf([column, value](const Columns& columns, E elementId)
+                { return columns[column]->stringValueOf(elementId).endsWith(value); });
+        case ConditionFnOp::String::MatchesRegex:
+        case ConditionFnOp::String::MatchesRegexCaseInsensitive:
+        {
+            auto reOption = op == ConditionFnOp::String::MatchesRegexCaseInsensitive ?
+                QRegularExpression::CaseInsensitiveOption :
+                QRegularExpression::NoPatternOption;
+
+            // Compiled once, then shared by every thread
+            QRegularExpression re(value, reOption);
+            re.optimize();
+
+            return leaf([column, re](const Columns& columns, E elementId)
+                { return re.match(columns[column]->stringValueOf(elementId)).hasMatch(); });
+        }
+        default: break;
+        }
+
+        return nullptr;
+    }
+
+    // The string ops, where the rhs varies per element
+    static LeafFn attributesStringOp(ConditionFnOp::String op, size_t lhs, size_t rhs)
+    {
+        auto valuesOf = [lhs, rhs](const Columns& columns, E elementId)
+        {
+            return std::make_pair(columns[lhs]->stringValueOf(elementId),
+                columns[rhs]->stringValueOf(elementId));
+        };
+
+        switch(op)
+        {
+        case ConditionFnOp::String::Includes:
+            return leaf([valuesOf](const Columns& columns, E elementId)
+                { auto [l, r] = valuesOf(columns, elementId); return l.contains(r); });
+        case ConditionFnOp::String::Excludes:
+            return leaf([valuesOf](const Columns& columns, E elementId)
+                { auto [l, r] = valuesOf(columns, elementId); return !l.contains(r); });
+        case ConditionFnOp::String::Starts:
+            return leaf([valuesOf](const Columns& columns, E elementId)
+                { auto [l, r] = valuesOf(columns, elementId); return l.startsWith(r); });
+        case ConditionFnOp::String::Ends:
+            return leaf([valuesOf](const Columns& columns, E elementId)
+                { auto [l, r] = valuesOf(columns, elementId); return l.endsWith(r); });
+        case ConditionFnOp::String::MatchesRegex:
+        case ConditionFnOp::String::MatchesRegexCaseInsensitive:
+        {
+            auto reOption = op == ConditionFnOp::String::MatchesRegexCaseInsensitive ?
+                QRegularExpression::CaseInsensitiveOption :
+                QRegularExpression::NoPatternOption;
+
+            // Each pattern is only compiled once, no matter how many elements it
+            // occurs for; the cache is per evaluation so that no locking is needed
+            return [valuesOf, reOption](const Columns& columns, const std::vector<E>& elementIds, Bitmap& bitmap)
+            {
+                std::map<QString, QRegularExpression> regexes;
+
+                for(size_t i = 0; i < elementIds.size(); i++)
+                {
+                    auto [l, r] = valuesOf(columns, elementIds[i]);
+
+                    auto it = regexes.find(r);
+                    if(it == regexes.end())
+                        it = regexes.emplace(r, QRegularExpression(r, reOption)).first;
+
+                    const auto& re = it->second;
+                    if(re.isValid() && re.match(l).hasMatch())
+                        bitmap[i >> 6] |= uint64_t{1} << (i & 63);
+                }
+            };
+        }
+        default: break;
+        }
+
+        return nullptr;
+    }
+
+    LeafFn compileAttributeValue(const Attribute& attribute, size_t column,
+        const GraphTransformConfig::TerminalValue& terminalValue,
+        const GraphTransformConfig::TerminalOp& terminalOp, bool operandsAreSwitched)
+    {
+        CreateConditionFnFor::TerminalValueWrapper value(terminalValue);
+
+        if(const auto* op = std::get_if<ConditionFnOp::Equality>(&terminalOp))
+        {
+            if(attribute.valueType() == value.type())
+            {
+                switch(attribute.valueType())
+                {
+                case ValueType::Float:  return equality(*op, column, std::get<double>(*value));
+                case ValueType::Int:    return equality(*op, column, std::get<int>(*value));
+                case ValueType::String: return equality(*op, column, std::get<QString>(*value));
+                default: return nullptr;
+                }
+            }
+
+            return equality(*op, column, value.toString());
+        }
+
+        if(const auto* numericalOp = std::get_if<ConditionFnOp::Numerical>(&terminalOp))
+        {
+            auto op = *numericalOp;
+
+            // This mirrors the operand switching in CreateConditionFnFor
+            if(operandsAreSwitched)
+            {
+                switch(op)
+                {
+                case ConditionFnOp::Numerical::LessThan:            op = ConditionFnOp::Numerical::GreaterThanOrEqual; break;
+                case ConditionFnOp::Numerical::GreaterThan:         op = ConditionFnOp::Numerical::LessThanOrEqual; break;
+                case ConditionFnOp::Numerical::LessThanOrEqual:     op = ConditionFnOp::Numerical::GreaterThan; break;
+                case ConditionFnOp::Numerical::GreaterThanOrEqual:  op = ConditionFnOp::Numerical::LessThan; break;
+                }
+            }
+
+            if(attribute.valueType() == ValueType::Int)
+            {
+                int intValue = attribute.valueType() == value.type() ?
+                    std::get<int>(*value) : static_cast<int>(value.toDouble());
+
+                return leaf([column, op, intValue](const Columns& columns, E elementId)
+                    { return numerical(op, columns[column]->intValueOf(elementId), intValue); });
+            }
+
+            if(attribute.valueType() == ValueType::Float)
+            {
+                double floatValue = value.toDouble();
+
+                return leaf([column, op, floatValue](const Columns& columns, E elementId)
+                    { return numerical(op, columns[column]->floatValueOf(elementId), floatValue); });
+            }
+
+            return nullptr;
+        }
+
+        if(const auto* op = std::get_if<ConditionFnOp::String>(&terminalOp))
+            return stringOp(*op, column, value.toString());
+
+        return nullptr;
+    }
+
+    LeafFn compileAttributes(const Attribute& lhs, size_t lhsColumn,
+        const Attribute& rhs, size_t rhsColumn,
+        const GraphTransformConfig::TerminalOp& terminalOp)
+    {
+        if(const auto* op = std::get_if<ConditionFnOp::Equality>(&terminalOp))
+        {
+            if(lhs.valueType() == rhs.valueType())
+            {
+                switch(lhs.valueType())
+                {
+                case ValueType::Float:  return attributesEquality<double>(*op, lhsColumn, rhsColumn);
+                case ValueType::Int:    return attributesEquality<int>(*op, lhsColumn, rhsColumn);
+                default: break;
+                }
+            }
+
+            return attributesEquality<QString>(*op, lhsColumn, rhsColumn);
+        }
+
+        if(const auto* numericalOp = std::get_if<ConditionFnOp::Numerical>(&terminalOp))
+        {
+            auto op = *numericalOp;
+
+            // Neither is a string, and every int is exactly representable as a double
+            return leaf([lhsColumn, rhsColumn, op](const Columns& columns, E elementId)
+            {
+                return numerical(op, columns[lhsColumn]->floatValueOf(elementId),
+                    columns[rhsColumn]->floatValueOf(elementId));
+            });
+        }
+
+        if(const auto* op = std::get_if<ConditionFnOp::String>(&terminalOp))
+            return attributesStringOp(*op, lhsColumn, rhsColumn);
+
+        return nullptr;
+    }
+
+    // Returns false if the condition is invalid
+    bool compile(const GraphTransformConfig::Condition& condition)
+    {
+        struct Visitor : public boost::static_visitor<bool>
+        {
+            CompiledCondition* _this;
+
+            explicit Visitor(CompiledCondition* this_) : _this(this_) {}
+
+            bool operator()(GraphTransformConfig::NoCondition) const { return false; }
+
+            bool operator()(const GraphTransformConfig::TerminalCondition& terminalCondition) const
+            {
+                return _this->compileTerminal(terminalCondition);
+            }
+
+            bool operator()(const GraphTransformConfig::UnaryCondition& unaryCondition) const
+            {
+                return _this->compileUnary(unaryCondition);
+            }
+
+            bool operator()(const GraphTransformConfig::CompoundCondition& compoundCondition) const
+            {
+                return _this->compileCompound(compoundCondition);
+            }
+        };
+
+        return boost::apply_visitor(Visitor(this), condition);
+    }
+
+    // Validation is delegated to CreateConditionFnFor, so that exactly the same
+    // conditions are accepted, whichever way they are subsequently evaluated
+    ElementConditionFn<E> conditionFnFor(const GraphTransformConfig::Condition& condition) const
+    {
+        return CreateConditionFnFor::elementType<E>(*_graphModel, condition);
+    }
+
+    void emitConstant(bool constant)
+    {
+        _program.push_back({Opcode::Constant, constant, 0});
+    }
+
+    void emitLeaf(LeafFn leafFn)
+    {
+        _program.push_back({Opcode::Leaf, false, _leaves.size()});
+        _leaves.emplace_back(std::move(leafFn));
+    }
+
+    bool compileTerminal(const GraphTransformConfig::TerminalCondition& terminalCondition)
+    {
+        auto conditionFn = conditionFnFor(terminalCondition);
+        if(conditionFn == nullptr)
+            return false;
+
+        auto attributeNameOf = [](const GraphTransformConfig::TerminalValue& terminalValue)
+        {
+            const auto* string = std::get_if<QString>(&terminalValue);
+            if(string != nullptr && GraphTransformConfigParser::isAttributeName(*string))
+                return *string;
+
+            return QString();
+        };
+
+        auto lhsName = attributeNameOf(terminalCondition._lhs);
+        auto rhsName = attributeNameOf(terminalCondition._rhs);
+
+        LeafFn leafFn;
+
+        if(lhsName.isEmpty() && rhsName.isEmpty())
+        {
+            // Neither side is an attribute, so the result is the same for every element
+            emitConstant(conditionFn(E{}));
+            return true;
+        }
+
+        if(!lhsName.isEmpty() && !rhsName.isEmpty())
+        {
+            auto lhsColumn = columnIndexFor(lhsName);
+            auto rhsColumn = columnIndexFor(rhsName);
+
+            leafFn = compileAttributes(_attributes.at(lhsColumn), lhsColumn,
+                _attributes.at(rhsColumn), rhsColumn, terminalCondition._op);
+        }
+        else if(!lhsName.isEmpty())
+        {
+            auto column = columnIndexFor(lhsName);
+            leafFn = compileAttributeValue(_attributes.at(column), column,
+                terminalCondition._rhs, terminalCondition._op, false);
+        }
+        else
+        {
+            auto column = columnIndexFor(rhsName);
+            leafFn = compileAttributeValue(_attributes.at(column), column,
+                terminalCondition._lhs, terminalCondition._op, true);
+        }
+
+        if(leafFn == nullptr)
+            return false;
+
+        emitLeaf(std::move(leafFn));
+        return true;
+    }
+
+    bool compileUnary(const GraphTransformConfig::UnaryCondition& unaryCondition)
+    {
+        if(conditionFnFor(unaryCondition) == nullptr)
+            return false;
+
+        const auto& attributeName = std::get<QString>(unaryCondition._lhs);
+        auto column = columnIndexFor(attributeName);
+
+        switch(unaryCondition._op)
+        {
+        case ConditionFnOp::Unary::HasValue:
+            emitLeaf(leaf([column](const Columns& columns, E elementId)
+                { return !columns[column]->valueMissingOf(elementId); }));
+            return true;
+
+        default: break;
+        }
+
+        return false;
+    }
+
+    bool compileCompound(const GraphTransformConfig::CompoundCondition& compoundCondition)
+    {
+        auto lhsStart = _program.size();
+        if(!compile(compoundCondition._lhs))
+            return false;
+
+        auto rhsStart = _program.size();
+        if(!compile(compoundCondition._rhs))
+            return false;
+
+        const bool isAnd = compoundCondition._op == ConditionFnOp::Logical::And;
+
+        auto constantAt = [this](size_t start, size_t end) -> std::optional<bool>
+        {
+            if(end - start == 1 && _program.at(start)._opcode == Opcode::Constant)
+                return _program.at(start)._constant;
+
+            return std::nullopt;
+        };
+
+        auto lhsConstant = constantAt(lhsStart, rhsStart);
+        auto rhsConstant = constantAt(rhsStart, _program.size());
+
+        // Fold away any constant operand; leaves that become redundant are simply never executed
+        auto replaceWith = [this, lhsStart](size_t start, size_t end)
+        {
+            std::vector<Instruction> instructions(_program.begin() + static_cast<ptrdiff_t>(start),
+                _program.begin() + static_cast<ptrdiff_t>(end));
+            _program.resize(lhsStart);
+            _program.insert(_program.end(), instructions.begin(), instructions.end());
+        };
+
+        auto foldConstant = [&](std::optional<bool> constant, size_t otherStart, size_t otherEnd)
+        {
+            if(*constant == isAnd)
+                replaceWith(otherStart, otherEnd); // true && x, false || x
+            else
+            {
+                _program.resize(lhsStart);
+                emitConstant(*constant); // false && x, true || x
+            }
+        };
+
+        if(lhsConstant)
+            foldConstant(lhsConstant, rhsStart, _program.size());
+        else if(rhsConstant)
+            foldConstant(rhsConstant, lhsStart, rhsStart);
+        else
+            _program.push_back({isAnd ? Opcode::And : Opcode::Or, false, 0});
+
+        return true;
+    }
+
+public:
+    CompiledCondition(const GraphModel& graphModel, const GraphTransformConfig::Condition& condition) :
+        _graphModel(&graphModel)
+    {
+        _valid = compile(condition);
+    }
+
+    bool isValid() const { return _valid; }
+
+    // Evaluates the condition for each of elementIds, which must be elements of graph
+    Bitmap evaluate(const IGraph& graph, const std::vector<E>& elementIds) const
+    {
+        Q_ASSERT(_valid);
+
+        const auto numWords = (elementIds.size() + 63) / 64;
+
+        Columns columns;
+        columns.reserve(_attributes.size());
+        for(const auto& attribute : _attributes)
+            columns.emplace_back(std::make_shared<const AttributeColumn>(attribute, graph));
+
+        std::vector<Bitmap> stack;
+
+        for(const auto& instruction : _program)
+        {
+            switch(instruction._opcode)
+            {
+            case Opcode::Constant:
+                stack.emplace_back(numWords, instruction._constant ? ~uint64_t{0} : uint64_t{0});
+                break;
+
+            case Opcode::Leaf:
+                stack.emplace_back(numWords, uint64_t{0});
+                if(!elementIds.empty())
+                    _leaves.at(instruction._leafIndex)(columns, elementIds, stack.back());
+                break;
+
+            case Opcode::And:
+            case Opcode::Or:
+            {
+                auto rhs = std::move(stack.back());
+                stack.pop_back();
+                auto& lhs = stack.back();
+
+                for(size_t word = 0; word < numWords; word++)
+                {
+                    if(instruction._opcode == Opcode::And)
+                        lhs[word] &= rhs[word];
+                    else
+                        lhs[word] |= rhs[word];
+                }
+                break;
+            }
+            }
+        }
+
+        Q_ASSERT(stack.size() == 1);
+        return std::move(stack.back());
+    }
+};
+
+#endif // COMPILEDCONDITION_H
@@ -39,6 +39,8 @@
 
 class CreateConditionFnFor
 {
+    template<typename E> friend class CompiledCondition;
+
 private:
     // Helper to make dealing with value variants a bit easier
     class TerminalValueWrapper
@@ -182,7 +184,7 @@ private:
         ElementConditionFn<E> operator()(ConditionFnOp::String op) const
         {
             auto lhs = _lhs;
-            auto rhs = _lhs;
+            auto rhs = _rhs;
 
             Attribute::ValueOfFn<QString, E> valueOfFn = &Attribute::valueOf<QString, E>;
 
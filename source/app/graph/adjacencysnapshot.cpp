@@ -0,0 +1,125 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "adjacencysnapshot.h"
+
+#include "graph.h"
+
+#include <algorithm>
+
+AdjacencySnapshot::AdjacencySnapshot(const Graph& graph, const std::vector<NodeId>& nodeIds) :
+    _nodeIds(nodeIds)
+{
+    const auto numNodes = _nodeIds.size();
+
+    NodeId maxNodeId;
+    if(!_nodeIds.empty())
+        maxNodeId = *std::max_element(_nodeIds.begin(), _nodeIds.end());
+
+    _indices.resize(static_cast<size_t>(static_cast<int>(maxNodeId) + 1), NullIndex);
+    for(size_t i = 0; i < numNodes; i++)
+        _indices[static_cast<size_t>(static_cast<int>(_nodeIds[i]))] = static_cast<Index>(i);
+
+    // A loop appears in both the in and out edges of its node, so half of its
+    // occurrences are treated as out edges and half as in edges
+    auto isOutEdge = [&graph](NodeId nodeId, EdgeId edgeId, int& loopsSeen, int numLoops)
+    {
+        const auto& edge = graph.edgeById(edgeId);
+
+        if(edge.isLoop())
+            return loopsSeen++ >= numLoops / 2;
+
+        return edge.sourceId() == nodeId;
+    };
+
+    auto numLoopsOf = [&graph](NodeId nodeId)
+    {
+        int numLoops = 0;
+
+        for(auto edgeId : graph.edgeIdsForNodeId(nodeId))
+        {
+            if(graph.edgeById(edgeId).isLoop())
+                numLoops++;
+        }
+
+        return numLoops;
+    };
+
+    // First pass: count the entries of each node, so that the
+    // neighbour arrays can be allocated once, with no reshuffling
+    std::vector<size_t> outCounts(numNodes, 0);
+    std::vector<size_t> inCounts(numNodes, 0);
+    std::vector<int> loopCounts(numNodes, 0);
+
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        auto nodeId = _nodeIds[i];
+        loopCounts[i] = numLoopsOf(nodeId);
+
+        int loopsSeen = 0;
+        for(auto edgeId : graph.edgeIdsForNodeId(nodeId))
+        {
+            if(!contains(graph.edgeById(edgeId).oppositeId(nodeId)))
+                continue;
+
+            if(isOutEdge(nodeId, edgeId, loopsSeen, loopCounts[i]))
+                outCounts[i]++;
+            else
+                inCounts[i]++;
+        }
+    }
+
+    _offsets.resize(numNodes + 1);
+    _inOffsets.resize(numNodes);
+
+    size_t offset = 0;
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        _offsets[i] = offset;
+        _inOffsets[i] = offset + outCounts[i];
+        offset += outCounts[i] + inCounts[i];
+    }
+
+    _offsets[numNodes] = offset;
+
+    _neighbours.resize(offset);
+    _edgeIds.resize(offset);
+
+    // Second pass: fill in the entries
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        auto nodeId = _nodeIds[i];
+        auto outPosition = _offsets[i];
+        auto inPosition = _inOffsets[i];
+
+        int loopsSeen = 0;
+        for(auto edgeId : graph.edgeIdsForNodeId(nodeId))
+        {
+            auto oppositeIndex = indexOf(graph.edgeById(edgeId).oppositeId(nodeId));
+            if(oppositeIndex == NullIndex)
+                continue;
+
+            auto& position = isOutEdge(nodeId, edgeId, loopsSeen, loopCounts[i]) ?
+                outPosition : inPosition;
+
+            _neighbours[position] = oppositeIndex;
+            _edgeIds[position] = edgeId;
+            position++;
+        }
+    }
+}
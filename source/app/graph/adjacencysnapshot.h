@@ -0,0 +1,112 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADJACENCYSNAPSHOT_H
+#define ADJACENCYSNAPSHOT_H
+
+#include "shared/graph/elementid.h"
+#include "shared/utils/iterator_range.h"
+
+#include <vector>
+#include <cstddef>
+
+class Graph;
+
+// An immutable compressed sparse row (CSR) representation of a graph's
+// adjacency. Nodes are remapped to a dense index space [0, numNodes())
+// and each node's neighbours are stored contiguously, out edges first,
+// followed by in edges. This is intended for read heavy algorithms that
+// would otherwise be bound by the latency of walking edge lists.
+class AdjacencySnapshot
+{
+public:
+    using Index = int;
+    static const Index NullIndex = -1;
+
+    // Only edges between nodes within nodeIds are included
+    AdjacencySnapshot(const Graph& graph, const std::vector<NodeId>& nodeIds);
+
+    int numNodes() const { return static_cast<int>(_nodeIds.size()); }
+
+    // Each non-loop edge contributes two entries, one for each node
+    int numEntries() const { return static_cast<int>(_neighbours.size()); }
+
+    const std::vector<NodeId>& nodeIds() const { return _nodeIds; }
+    NodeId nodeIdAt(Index index) const { return _nodeIds[static_cast<size_t>(index)]; }
+
+    Index indexOf(NodeId nodeId) const
+    {
+        auto i = static_cast<size_t>(static_cast<int>(nodeId));
+        if(nodeId.isNull() || i >= _indices.size())
+            return NullIndex;
+
+        return _indices[i];
+    }
+
+    bool contains(NodeId nodeId) const { return indexOf(nodeId) != NullIndex; }
+
+    int degree(Index index) const { return static_cast<int>(end(index) - begin(index)); }
+    int outDegree(Index index) const { return static_cast<int>(inBegin(index) - begin(index)); }
+    int inDegree(Index index) const { return static_cast<int>(end(index) - inBegin(index)); }
+
+    auto neighbours(Index index) const
+    {
+        return make_iterator_range(_neighbours.data() + begin(index),
+            _neighbours.data() + end(index));
+    }
+
+    auto outNeighbours(Index index) const
+    {
+        return make_iterator_range(_neighbours.data() + begin(index),
+            _neighbours.data() + inBegin(index));
+    }
+
+    auto inNeighbours(Index index) const
+    {
+        return make_iterator_range(_neighbours.data() + inBegin(index),
+            _neighbours.data() + end(index));
+    }
+
+    // The EdgeIds corresponding, element for element, to neighbours(index)
+    auto edgeIds(Index index) const
+    {
+        return make_iterator_range(_edgeIds.data() + begin(index),
+            _edgeIds.data() + end(index));
+    }
+
+    // Raw access, for loops that want to avoid any abstraction at all;
+    // entries for node i are in [offsets()[i], offsets()[i + 1])
+    const std::vector<size_t>& offsets() const { return _offsets; }
+    const std::vector<Index>& neighbourIndices() const { return _neighbours; }
+    const std::vector<EdgeId>& neighbourEdgeIds() const { return _edgeIds; }
+
+private:
+    std::vector<NodeId> _nodeIds;
+    std::vector<Index> _indices;
+
+    std::vector<size_t> _offsets;
+    std::vector<size_t> _inOffsets;
+    std::vector<Index> _neighbours;
+    std::vector<EdgeId> _edgeIds;
+
+    size_t begin(Index index) const { return _offsets[static_cast<size_t>(index)]; }
+    size_t inBegin(Index index) const { return _inOffsets[static_cast<size_t>(index)]; }
+    size_t end(Index index) const { return _offsets[static_cast<size_t>(index) + 1]; }
+};
+
+#endif // ADJACENCYSNAPSHOT_H
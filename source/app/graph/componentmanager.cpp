@@ -26,14 +26,79 @@
 #include "graphcomponent.h"
 
 #include <map>
+#include <deque>
 #include <queue>
+#include <algorithm>
+
+// A minimal union-find over the indices [0, size())
+class DisjointSets
+{
+private:
+    std::vector<size_t> _parents;
+
+public:
+    size_t add()
+    {
+        _parents.push_back(_parents.size());
+        return _parents.size() - 1;
+    }
+
+    size_t find(size_t index)
+    {
+        while(_parents[index] != index)
+        {
+            // Path halving
+            _parents[index] = _parents[_parents[index]];
+            index = _parents[index];
+        }
+
+        return index;
+    }
+
+    // The set containing child becomes part of the set containing parent
+    void join(size_t child, size_t parent)
+    {
+        child = find(child);
+        parent = find(parent);
+
+        if(child != parent)
+            _parents[child] = parent;
+    }
+};
+
+template<typename T> static void eraseFromSorted(std::vector<T>& sorted, std::vector<T>& values)
+{
+    if(values.empty())
+        return;
+
+    std::sort(values.begin(), values.end());
+
+    auto first = std::lower_bound(sorted.begin(), sorted.end(), values.front());
+    sorted.erase(std::remove_if(first, sorted.end(), [&values](const auto& value)
+    {
+        return std::binary_search(values.begin(), values.end(), value);
+    }), sorted.end());
+}
+
+template<typename T> static void insertIntoSorted(std::vector<T>& sorted, std::vector<T>& values)
+{
+    if(values.empty())
+        return;
+
+    std::sort(values.begin(), values.end());
+
+    // Only the part of sorted beyond the smallest new value needs to be merged
+    auto middle = sorted.insert(sorted.end(), values.begin(), values.end());
+    std::inplace_merge(std::upper_bound(sorted.begin(), middle, values.front()), middle, sorted.end());
+}
 
 ComponentManager::ComponentManager(Graph& graph,
                                    const NodeConditionFn& nodeFilter,
                                    const EdgeConditionFn& edgeFilter) :
     _nextComponentId(0),
     _nodesComponentId(graph),
-    _edgesComponentId(graph)
+    _edgesComponentId(graph),
+    _edgesNodeIds(graph)
 {
     // Ignore all multi-elements
     addNodeFilter([&graph](NodeId nodeId) { return graph.typeOf(nodeId) == MultiElementType::Tail; });
@@ -45,6 +110,28 @@ ComponentManager::ComponentManager(Graph& graph,
     if(edgeFilter)
         addEdgeFilter(edgeFilter);
 
+    // Arbitrary filters may change their results without the graph changing,
+    // in which case the changes recorded below can't be relied upon
+    _hasCustomFilters = nodeFilter != nullptr || edgeFilter != nullptr;
+
+    // These are connected with this as context, so that they're disconnected when a
+    // (possibly short lived) ComponentManager is destroyed before the graph
+    connect(&graph, &Graph::nodeAdded, this, [this](const Graph*, NodeId nodeId)
+        { _pendingChanges._nodesAdded.emplace_back(nodeId); }, Qt::DirectConnection);
+    connect(&graph, &Graph::nodeRemoved, this, [this](const Graph*, NodeId nodeId)
+        { _pendingChanges._nodesRemoved.emplace_back(nodeId); }, Qt::DirectConnection);
+    connect(&graph, &Graph::edgeAdded, this, [this](const Graph*, EdgeId edgeId)
+        { _pendingChanges._edgesAdded.emplace_back(edgeId); }, Qt::DirectConnection);
+    connect(&graph, &Graph::edgeRemoved, this, [this](const Graph*, EdgeId edgeId)
+        { _pendingChanges._edgesRemoved.emplace_back(edgeId); }, Qt::DirectConnection);
+
+    connect(&graph, &Graph::nodesAdded, this, [this](const Graph*, const std::vector<NodeId>& nodeIds)
+        { _pendingChanges._nodesAdded.insert(_pendingChanges._nodesAdded.end(), nodeIds.begin(), nodeIds.end()); },
+        Qt::DirectConnection);
+    connect(&graph, &Graph::edgesAdded, this, [this](const Graph*, const std::vector<EdgeId>& edgeIds)
+        { _pendingChanges._edgesAdded.insert(_pendingChanges._edgesAdded.end(), edgeIds.begin(), edgeIds.end()); },
+        Qt::DirectConnection);
+
     connect(&graph, &Graph::graphChanged, this, &ComponentManager::onGraphChanged, Qt::DirectConnection);
 
     graph.update();
@@ -113,16 +200,159 @@ void ComponentManager::eraseComponentArray(IGraphArray* componentArray)
     _componentArrays.erase(componentArray);
 }
 
+bool ComponentManager::canUpdateIncrementally(const Graph* graph, const Graph::Diff& diff) const
+{
+    // The heads and tails of merged nodes can change without any signal being
+    // emitted, and arbitrary filters may change their results at any time
+    if(_fullUpdateRequired || _hasCustomFilters || _hasMergedNodes || _componentIdsSet.empty())
+        return false;
+
+    // Beyond a certain point it's cheaper to just start from scratch
+    const auto maxIncrementalChanges =
+        static_cast<size_t>(graph->numNodes() + graph->numEdges()) / 8;
+
+    return diff.size() <= maxIncrementalChanges;
+}
+
+// Searches outwards from each of nodeIds in lockstep, a node at a time, through the elements
+// of componentId, combining searches as they meet; once all but one of them has run out of
+// nodes to visit, each search that has is a part of the component which is no longer connected
+// to the rest, so the largest remaining part is never visited in its entirety
+std::vector<std::vector<NodeId>> ComponentManager::disconnectedNodeIds(const Graph* graph,
+    ComponentId componentId, const std::vector<NodeId>& nodeIds) const
+{
+    struct Search
+    {
+        std::vector<NodeId> _nodeIds;
+        std::deque<NodeId> _frontier;
+    };
+
+    std::vector<Search> searches(nodeIds.size());
+    DisjointSets disjointSets;
+    NodeIdMap<size_t> searchOfNodeId;
+    std::vector<size_t> active;
+
+    for(auto nodeId : nodeIds)
+    {
+        auto index = disjointSets.add();
+        searches.at(index)._nodeIds.push_back(nodeId);
+        searches.at(index)._frontier.push_back(nodeId);
+        searchOfNodeId.emplace(nodeId, index);
+        active.push_back(index);
+    }
+
+    std::vector<size_t> exhausted;
+
+    while(active.size() > 1)
+    {
+        for(auto index : active)
+        {
+            // Already combined with another search this round
+            if(disjointSets.find(index) != index || searches.at(index)._frontier.empty())
+                continue;
+
+            auto nodeId = searches.at(index)._frontier.front();
+            searches.at(index)._frontier.pop_front();
+
+            for(auto edgeId : graph->edgeIdsForNodeId(nodeId))
+            {
+                if(_edgesComponentId[edgeId] != componentId)
+                    continue;
+
+                auto oppositeNodeId = graph->edgeById(edgeId).oppositeId(nodeId);
+                auto it = searchOfNodeId.find(oppositeNodeId);
+
+                if(it == searchOfNodeId.end())
+                {
+                    searchOfNodeId.emplace(oppositeNodeId, index);
+                    searches.at(index)._nodeIds.push_back(oppositeNodeId);
+                    searches.at(index)._frontier.push_back(oppositeNodeId);
+                    continue;
+                }
+
+                auto otherIndex = disjointSets.find(it->second);
+                if(otherIndex == index)
+                    continue;
+
+                // The searches have met, so the smaller continues as part of the larger
+                if(searches.at(index)._nodeIds.size() > searches.at(otherIndex)._nodeIds.size())
+                    std::swap(index, otherIndex);
+
+                auto& from = searches.at(index);
+                auto& to = searches.at(otherIndex);
+
+                to._nodeIds.insert(to._nodeIds.end(), from._nodeIds.begin(), from._nodeIds.end());
+                to._frontier.insert(to._frontier.end(), from._frontier.begin(), from._frontier.end());
+                from = {};
+
+                disjointSets.join(index, otherIndex);
+                index = otherIndex;
+            }
+        }
+
+        std::vector<size_t> stillActive;
+
+        for(auto index : active)
+        {
+            if(disjointSets.find(index) != index)
+                continue;
+
+            if(searches.at(index)._frontier.empty())
+                exhausted.push_back(index);
+            else
+                stillActive.push_back(index);
+        }
+
+        active = std::move(stillActive);
+    }
+
+    // If every search ran out of nodes, the largest part is the one that remains
+    if(active.empty() && !exhausted.empty())
+    {
+        auto largest = std::max_element(exhausted.begin(), exhausted.end(),
+        [&searches](auto a, auto b)
+        {
+            return searches.at(a)._nodeIds.size() < searches.at(b)._nodeIds.size();
+        });
+
+        exhausted.erase(largest);
+    }
+
+    std::vector<std::vector<NodeId>> disconnected;
+    disconnected.reserve(exhausted.size());
+
+    for(auto index : exhausted)
+        disconnected.emplace_back(std::move(searches.at(index)._nodeIds));
+
+    return disconnected;
+}
+
 void ComponentManager::update(const Graph* graph)
 {
     if(_debug) qDebug() << "ComponentManager::update begins" << this;
 
     std::unique_lock<std::recursive_mutex> lock(_updateMutex);
 
-    std::map<ComponentId, ComponentIdSet> splitComponents;
-    ComponentIdSet splitComponentIds;
-    std::map<ComponentId, ComponentIdSet> mergedComponents;
-    ComponentIdSet mergedComponentIds;
+    auto diff = std::move(_pendingChanges);
+    _pendingChanges.clear();
+
+    const bool incremental = canUpdateIncrementally(graph, diff);
+    _fullUpdateRequired = false;
+
+    Changes changes;
+
+    if(!incremental || !updateIncrementally(graph, diff, changes))
+        updateFully(graph, changes);
+
+    lock.unlock();
+
+    notifyComponentsChanged(graph, changes);
+
+    if(_debug) qDebug() << "ComponentManager::update ends" << this;
+}
+
+void ComponentManager::updateFully(const Graph* graph, Changes& changes)
+{
     ComponentIdSet componentIds;
 
     NodeArray<ComponentId> newNodesComponentId(*graph);
@@ -149,9 +379,9 @@ void ComponentManager::update(const Graph* graph)
                 queueGraphComponentUpdate(graph, oldComponentId);
                 queueGraphComponentUpdate(graph, newComponentId);
 
-                splitComponents[oldComponentId].insert(oldComponentId);
-                splitComponents[oldComponentId].insert(newComponentId);
-                splitComponentIds.insert(newComponentId);
+                changes._splitComponents[oldComponentId].insert(oldComponentId);
+                changes._splitComponents[oldComponentId].insert(newComponentId);
+                changes._splitComponentIds.insert(newComponentId);
             }
             else
             {
@@ -163,9 +393,9 @@ void ComponentManager::update(const Graph* graph)
                 if(componentIdsAffected.size() > 1)
                 {
                     // More than one old component IDs were observed so components have merged
-                    mergedComponents[oldComponentId].insert(componentIdsAffected.begin(), componentIdsAffected.end());
+                    changes._mergedComponents[oldComponentId].insert(componentIdsAffected.begin(), componentIdsAffected.end());
                     componentIdsAffected.erase(oldComponentId);
-                    mergedComponentIds.insert(componentIdsAffected.begin(), componentIdsAffected.end());
+                    changes._mergedComponentIds.insert(componentIdsAffected.begin(), componentIdsAffected.end());
                 }
             }
         }
@@ -191,54 +421,32 @@ void ComponentManager::update(const Graph* graph)
         componentArray->resize(componentArrayCapacity());
 
     // Search for added or removed components
-    auto componentIdsToBeAdded = u::setDifference(componentIds, _componentIdsSet);
-    auto componentIdsToBeRemoved = u::setDifference(_componentIdsSet, componentIds);
+    changes._componentIdsToBeAdded = u::setDifference(componentIds, _componentIdsSet);
+    changes._componentIdsToBeRemoved = u::setDifference(_componentIdsSet, componentIds);
 
     // Find nodes and edges that have been added or removed
-    std::map<ComponentId, std::vector<NodeId>> nodeIdAdds;
-    std::map<ComponentId, std::vector<EdgeId>> edgeIdAdds;
-    std::map<ComponentId, std::vector<NodeId>> nodeIdRemoves;
-    std::map<ComponentId, std::vector<EdgeId>> edgeIdRemoves;
-
     auto maxNumNodes = std::max(_nodesComponentId.size(), newNodesComponentId.size());
     for(NodeId nodeId(0); nodeId < maxNumNodes; ++nodeId)
     {
         if(_nodesComponentId[nodeId].isNull() && !newNodesComponentId[nodeId].isNull())
-            nodeIdAdds[newNodesComponentId[nodeId]].emplace_back(nodeId);
+            changes._nodeIdAdds[newNodesComponentId[nodeId]].emplace_back(nodeId);
         else if(!_nodesComponentId[nodeId].isNull() && newNodesComponentId[nodeId].isNull())
-            nodeIdRemoves[_nodesComponentId[nodeId]].emplace_back(nodeId);
+            changes._nodeIdRemoves[_nodesComponentId[nodeId]].emplace_back(nodeId);
     }
 
     auto maxNumEdges = std::max(_edgesComponentId.size(), newEdgesComponentId.size());
     for(EdgeId edgeId(0); edgeId < maxNumEdges; ++edgeId)
     {
         if(_edgesComponentId[edgeId].isNull() && !newEdgesComponentId[edgeId].isNull())
-            edgeIdAdds[newEdgesComponentId[edgeId]].emplace_back(edgeId);
+            changes._edgeIdAdds[newEdgesComponentId[edgeId]].emplace_back(edgeId);
         else if(!_edgesComponentId[edgeId].isNull() && newEdgesComponentId[edgeId].isNull())
-            edgeIdRemoves[_edgesComponentId[edgeId]].emplace_back(edgeId);
+            changes._edgeIdRemoves[_edgesComponentId[edgeId]].emplace_back(edgeId);
     }
 
-    // Notify all the merges
-    for(auto& mergee : mergedComponents)
-    {
-        if(_debug) qDebug() << "componentsWillMerge" << mergee.second << "->" << mergee.first;
-        emit componentsWillMerge(graph, ComponentMergeSet(std::move(mergee.second), mergee.first));
-    }
+    notifyComponentsWillChange(graph, changes);
 
-    // Removed components
-    for(auto componentId : componentIdsToBeRemoved)
+    for(auto componentId : changes._componentIdsToBeRemoved)
     {
-        Q_ASSERT(!componentId.isNull());
-        if(_debug) qDebug() << "componentWillBeRemoved" << componentId;
-        bool hasMerged = u::contains(mergedComponentIds, componentId);
-        emit componentWillBeRemoved(graph, componentId, hasMerged);
-
-        if(!hasMerged)
-        {
-            nodeIdRemoves.erase(componentId);
-            edgeIdRemoves.erase(componentId);
-        }
-
         _componentIdsSet.erase(componentId);
         removeGraphComponent(componentId);
     }
@@ -256,73 +464,515 @@ void ComponentManager::update(const Graph* graph)
 
     _updatesRequired.clear();
 
-    std::copy(componentIdsToBeAdded.begin(), componentIdsToBeAdded.end(),
+    std::copy(changes._componentIdsToBeAdded.begin(), changes._componentIdsToBeAdded.end(),
         std::back_inserter(_componentIds));
-    std::copy(componentIdsToBeAdded.begin(), componentIdsToBeAdded.end(),
+    std::copy(changes._componentIdsToBeAdded.begin(), changes._componentIdsToBeAdded.end(),
         std::inserter(_componentIdsSet, _componentIdsSet.begin()));
 
     std::stable_sort(_componentIds.begin(), _componentIds.end(),
-    [this](auto a, auto b)
+        [this](auto a, auto b) { return componentIdLessThan(a, b); });
+
+    if(_hasCustomFilters)
+        return;
+
+    // Subsequent updates may be able to proceed incrementally from here
+    for(auto edgeId : graph->edgeIds())
     {
-        auto componentA = this->componentById(a);
-        auto componentB = this->componentById(b);
+        const auto& edge = graph->edgeById(edgeId);
+        _edgesNodeIds[edgeId] = {edge.sourceId(), edge.targetId()};
+    }
 
-        if(componentA->numNodes() == componentB->numNodes())
-            return a < b;
+    _hasMergedNodes = std::any_of(graph->nodeIds().begin(), graph->nodeIds().end(),
+        [graph](auto nodeId) { return graph->typeOf(nodeId) != MultiElementType::Not; });
+}
 
-        return componentA->numNodes() > componentB->numNodes();
-    });
+// Updates only the components that the changes in diff touch, in place, without visiting any
+// of the rest of the graph; components that the additions join are found using a union-find
+// over the pieces of the components involved, while those that the removals split are found
+// by searching outwards from the nodes that lost edges, only as far as is necessary to tell;
+// returns false, having changed nothing, if the diff doesn't fully describe what happened
+bool ComponentManager::updateIncrementally(const Graph* graph, Graph::Diff& diff, Changes& changes)
+{
+    u::removeDuplicates(diff._nodesAdded);
+    u::removeDuplicates(diff._nodesRemoved);
+    u::removeDuplicates(diff._edgesAdded);
+    u::removeDuplicates(diff._edgesRemoved);
 
-    lock.unlock();
+    auto nodeComponentId = [this](NodeId nodeId)
+    {
+        return static_cast<int>(nodeId) < _nodesComponentId.size() ? _nodesComponentId[nodeId] : ComponentId();
+    };
+
+    auto edgeComponentId = [this](EdgeId edgeId)
+    {
+        return static_cast<int>(edgeId) < _edgesComponentId.size() ? _edgesComponentId[edgeId] : ComponentId();
+    };
 
+    auto isMultiElement = [graph](auto elementId) { return graph->typeOf(elementId) != MultiElementType::Not; };
+
+    // Check that each change is consistent with what we already know; in particular, an
+    // ID that has been removed and reused for a different element, or any change that
+    // involves multi-elements, is dealt with by a full update
+    for(auto nodeId : diff._nodesAdded)
+    {
+        if(!graph->containsNodeId(nodeId) || !nodeComponentId(nodeId).isNull() || isMultiElement(nodeId))
+            return false;
+    }
+
+    for(auto nodeId : diff._nodesRemoved)
+    {
+        if(graph->containsNodeId(nodeId) || nodeComponentId(nodeId).isNull())
+            return false;
+    }
+
+    for(auto edgeId : diff._edgesAdded)
+    {
+        if(!graph->containsEdgeId(edgeId) || !edgeComponentId(edgeId).isNull() || isMultiElement(edgeId))
+            return false;
+
+        const auto& edge = graph->edgeById(edgeId);
+        if(isMultiElement(edge.sourceId()) || isMultiElement(edge.targetId()))
+            return false;
+    }
+
+    for(auto edgeId : diff._edgesRemoved)
+    {
+        auto componentId = edgeComponentId(edgeId);
+        if(graph->containsEdgeId(edgeId) || componentId.isNull() || componentFor(componentId) == nullptr)
+            return false;
+
+        // A tail of a set of parallel edges
+        const auto& componentEdgeIds = componentFor(componentId)->_edgeIds;
+        if(!std::binary_search(componentEdgeIds.begin(), componentEdgeIds.end(), edgeId))
+            return false;
+
+        auto [sourceId, targetId] = _edgesNodeIds[edgeId];
+
+        for(auto nodeId : {sourceId, targetId})
+        {
+            if(graph->containsNodeId(nodeId) && (nodeComponentId(nodeId) != componentId || isMultiElement(nodeId)))
+                return false;
+        }
+
+        // The head of a set of parallel edges, some of which remain
+        if(graph->containsNodeId(sourceId) && graph->containsNodeId(targetId) &&
+            (!graph->edgeIdsBetween(sourceId, targetId).empty() || !graph->edgeIdsBetween(targetId, sourceId).empty()))
+        {
+            return false;
+        }
+    }
+
+    if(_debug) qDebug() << "ComponentManager::update incremental";
+
+    for(auto nodeId : diff._nodesRemoved)
+        changes._nodeIdRemoves[_nodesComponentId[nodeId]].emplace_back(nodeId);
+
+    for(auto edgeId : diff._edgesRemoved)
+        changes._edgeIdRemoves[_edgesComponentId[edgeId]].emplace_back(edgeId);
+
+    // Components whose nodes have all been removed
+    ComponentIdSet removedComponentIds;
+    for(const auto& [componentId, nodeIds] : changes._nodeIdRemoves)
+    {
+        if(componentFor(componentId)->_nodeIds.size() == nodeIds.size())
+            removedComponentIds.insert(componentId);
+    }
+
+    // The remaining nodes that have lost edges; every part of a component
+    // that has split off from the rest must contain at least one of these
+    std::map<ComponentId, std::vector<NodeId>> boundaryNodeIds;
+    for(auto edgeId : diff._edgesRemoved)
+    {
+        for(auto nodeId : {_edgesNodeIds[edgeId].first, _edgesNodeIds[edgeId].second})
+        {
+            if(graph->containsNodeId(nodeId))
+                boundaryNodeIds[_edgesComponentId[edgeId]].emplace_back(nodeId);
+        }
+    }
+
+    // The units from which the updated components are assembled: parts that have split
+    // off from existing components, the remainders of existing components, and new nodes
+    struct Piece
+    {
+        ComponentId _componentId;
+        bool _remainder = false;
+        std::vector<NodeId> _nodeIds;
+        std::vector<EdgeId> _edgeIds;
+    };
+
+    std::vector<Piece> pieces;
+    DisjointSets disjointSets;
+    NodeIdMap<size_t> pieceOfNodeId;
+    ComponentIdMap<size_t> remainderOfComponentId;
+
+    for(auto& [componentId, nodeIds] : boundaryNodeIds)
+    {
+        u::removeDuplicates(nodeIds);
+
+        for(auto& pieceNodeIds : disconnectedNodeIds(graph, componentId, nodeIds))
+        {
+            Piece piece{componentId, false, std::move(pieceNodeIds), {}};
+
+            for(auto nodeId : piece._nodeIds)
+            {
+                pieceOfNodeId.emplace(nodeId, pieces.size());
+
+                for(auto edgeId : graph->edgeIdsForNodeId(nodeId))
+                {
+                    if(_edgesComponentId[edgeId] == componentId)
+                        piece._edgeIds.push_back(edgeId);
+                }
+            }
+
+            u::removeDuplicates(piece._edgeIds);
+            pieces.emplace_back(std::move(piece));
+            disjointSets.add();
+        }
+    }
+
+    for(auto nodeId : diff._nodesAdded)
+    {
+        pieceOfNodeId.emplace(nodeId, pieces.size());
+        pieces.push_back({{}, false, {nodeId}, {}});
+        disjointSets.add();
+    }
+
+    auto pieceOf = [&](NodeId nodeId)
+    {
+        auto it = pieceOfNodeId.find(nodeId);
+        if(it != pieceOfNodeId.end())
+            return it->second;
+
+        auto componentId = _nodesComponentId[nodeId];
+        auto [remainderIt, inserted] = remainderOfComponentId.try_emplace(componentId, pieces.size());
+
+        if(inserted)
+        {
+            pieces.push_back({componentId, true, {}, {}});
+            disjointSets.add();
+        }
+
+        return remainderIt->second;
+    };
+
+    for(auto edgeId : diff._edgesAdded)
+    {
+        const auto& edge = graph->edgeById(edgeId);
+        disjointSets.join(pieceOf(edge.sourceId()), pieceOf(edge.targetId()));
+    }
+
+    std::map<size_t, std::vector<size_t>> piecesOfSet;
+    for(size_t index = 0; index < pieces.size(); index++)
+        piecesOfSet[disjointSets.find(index)].push_back(index);
+
+    std::vector<ComponentId> newComponentIds(pieces.size());
+    ComponentIdSet vacatedComponentIds;
+
+    // Where existing components are joined, the largest keeps its ID and the others merge into it
+    for(const auto& [set, indices] : piecesOfSet)
+    {
+        ComponentId survivingComponentId;
+        size_t maxNumNodes = 0;
+        ComponentIdSet mergers;
+
+        for(auto index : indices)
+        {
+            const auto& piece = pieces.at(index);
+
+            if(!piece._componentId.isNull())
+                mergers.insert(piece._componentId);
+
+            if(!piece._remainder)
+                continue;
+
+            auto numNodes = componentFor(piece._componentId)->_nodeIds.size();
+            if(survivingComponentId.isNull() || numNodes > maxNumNodes ||
+                (numNodes == maxNumNodes && piece._componentId < survivingComponentId))
+            {
+                survivingComponentId = piece._componentId;
+                maxNumNodes = numNodes;
+            }
+        }
+
+        if(survivingComponentId.isNull())
+            continue;
+
+        for(auto index : indices)
+        {
+            newComponentIds.at(index) = survivingComponentId;
+
+            const auto& piece = pieces.at(index);
+            if(piece._remainder && piece._componentId != survivingComponentId)
+                vacatedComponentIds.insert(piece._componentId);
+        }
+
+        if(mergers.size() > 1)
+        {
+            mergers.erase(survivingComponentId);
+            changes._mergedComponentIds.insert(mergers.begin(), mergers.end());
+
+            mergers.insert(survivingComponentId);
+            changes._mergedComponents[survivingComponentId] = std::move(mergers);
+        }
+    }
+
+    // Everything else is a new component, either split off from an existing one or entirely new
+    for(const auto& [set, indices] : piecesOfSet)
+    {
+        if(!newComponentIds.at(indices.front()).isNull())
+            continue;
+
+        ComponentId componentId;
+
+        // If the remainder of the component that a piece split from has merged into
+        // another component, its ID is free, so the piece may as well keep it
+        for(auto index : indices)
+        {
+            auto oldComponentId = pieces.at(index)._componentId;
+
+            if(u::contains(vacatedComponentIds, oldComponentId))
+            {
+                componentId = oldComponentId;
+                vacatedComponentIds.erase(oldComponentId);
+                break;
+            }
+        }
+
+        if(componentId.isNull())
+        {
+            componentId = generateComponentId();
+            setComponentFor(componentId, std::make_unique<GraphComponent>(graph));
+            changes._componentIdsToBeAdded.push_back(componentId);
+
+            for(auto index : indices)
+            {
+                auto oldComponentId = pieces.at(index)._componentId;
+                if(oldComponentId.isNull())
+                    continue;
+
+                changes._splitComponents[oldComponentId].insert(oldComponentId);
+                changes._splitComponents[oldComponentId].insert(componentId);
+                changes._splitComponentIds.insert(componentId);
+            }
+        }
+
+        for(auto index : indices)
+            newComponentIds.at(index) = componentId;
+    }
+
+    removedComponentIds.insert(vacatedComponentIds.begin(), vacatedComponentIds.end());
+    changes._componentIdsToBeRemoved.assign(removedComponentIds.begin(), removedComponentIds.end());
+
+    // Resize the component arrays
+    for(auto* componentArray : _componentArrays)
+        componentArray->resize(componentArrayCapacity());
+
+    notifyComponentsWillChange(graph, changes);
+
+    // The changes to make to the element lists of each remaining component
+    struct Edit
+    {
+        std::vector<NodeId> _erasedNodeIds;
+        std::vector<NodeId> _insertedNodeIds;
+        std::vector<EdgeId> _erasedEdgeIds;
+        std::vector<EdgeId> _insertedEdgeIds;
+    };
+
+    ComponentIdMap<Edit> edits;
+
+    for(auto nodeId : diff._nodesRemoved)
+    {
+        edits[_nodesComponentId[nodeId]]._erasedNodeIds.push_back(nodeId);
+        _nodesComponentId[nodeId].setToNull();
+    }
+
+    for(auto edgeId : diff._edgesRemoved)
+    {
+        edits[_edgesComponentId[edgeId]]._erasedEdgeIds.push_back(edgeId);
+        _edgesComponentId[edgeId].setToNull();
+    }
+
+    for(size_t index = 0; index < pieces.size(); index++)
+    {
+        auto& piece = pieces.at(index);
+        auto oldComponentId = piece._componentId;
+        auto componentId = newComponentIds.at(index);
+
+        if(componentId == oldComponentId)
+            continue;
+
+        if(piece._remainder)
+        {
+            // The part of a merged component that hasn't split off elsewhere
+            const auto* component = componentFor(oldComponentId);
+
+            for(auto nodeId : component->_nodeIds)
+            {
+                if(_nodesComponentId[nodeId] == oldComponentId && !u::containsKey(pieceOfNodeId, nodeId))
+                    piece._nodeIds.push_back(nodeId);
+            }
+
+            for(auto edgeId : component->_edgeIds)
+            {
+                if(_edgesComponentId[edgeId] != oldComponentId ||
+                    u::containsKey(pieceOfNodeId, graph->edgeById(edgeId).sourceId()))
+                {
+                    continue;
+                }
+
+                for(auto mergedEdgeId : graph->mergedEdgeIdsForEdgeId(edgeId))
+                    piece._edgeIds.push_back(mergedEdgeId);
+            }
+        }
+
+        for(auto nodeId : piece._nodeIds)
+            _nodesComponentId[nodeId] = componentId;
+
+        for(auto edgeId : piece._edgeIds)
+            _edgesComponentId[edgeId] = componentId;
+
+        std::vector<EdgeId> edgeIds;
+        std::copy_if(piece._edgeIds.begin(), piece._edgeIds.end(), std::back_inserter(edgeIds),
+            [this](auto edgeId) { return !edgeIdFiltered(edgeId); });
+
+        if(oldComponentId.isNull())
+            changes._nodeIdAdds[componentId].push_back(piece._nodeIds.front());
+        else if(!u::contains(removedComponentIds, oldComponentId))
+        {
+            auto& edit = edits[oldComponentId];
+            edit._erasedNodeIds.insert(edit._erasedNodeIds.end(), piece._nodeIds.begin(), piece._nodeIds.end());
+            edit._erasedEdgeIds.insert(edit._erasedEdgeIds.end(), edgeIds.begin(), edgeIds.end());
+        }
+
+        auto& edit = edits[componentId];
+        edit._insertedNodeIds.insert(edit._insertedNodeIds.end(), piece._nodeIds.begin(), piece._nodeIds.end());
+        edit._insertedEdgeIds.insert(edit._insertedEdgeIds.end(), edgeIds.begin(), edgeIds.end());
+    }
+
+    for(auto edgeId : diff._edgesAdded)
+    {
+        const auto& edge = graph->edgeById(edgeId);
+        auto componentId = _nodesComponentId[edge.sourceId()];
+
+        _edgesComponentId[edgeId] = componentId;
+        _edgesNodeIds[edgeId] = {edge.sourceId(), edge.targetId()};
+
+        edits[componentId]._insertedEdgeIds.push_back(edgeId);
+        changes._edgeIdAdds[componentId].push_back(edgeId);
+    }
+
+    for(auto componentId : changes._componentIdsToBeRemoved)
+    {
+        _componentIdsSet.erase(componentId);
+        removeGraphComponent(componentId);
+        edits.erase(componentId);
+    }
+
+    shrinkComponentsArrayToFit();
+
+    for(auto& [componentId, edit] : edits)
+    {
+        auto* component = componentFor(componentId);
+
+        eraseFromSorted(component->_nodeIds, edit._erasedNodeIds);
+        eraseFromSorted(component->_edgeIds, edit._erasedEdgeIds);
+        insertIntoSorted(component->_nodeIds, edit._insertedNodeIds);
+        insertIntoSorted(component->_edgeIds, edit._insertedEdgeIds);
+    }
+
+    std::copy(changes._componentIdsToBeAdded.begin(), changes._componentIdsToBeAdded.end(),
+        std::inserter(_componentIdsSet, _componentIdsSet.begin()));
+
+    // Reposition only those components that have changed in size
+    _componentIds.erase(std::remove_if(_componentIds.begin(), _componentIds.end(),
+    [&](auto componentId)
+    {
+        return u::contains(removedComponentIds, componentId) || u::containsKey(edits, componentId);
+    }), _componentIds.end());
+
+    for(const auto& [componentId, edit] : edits)
+    {
+        auto it = std::lower_bound(_componentIds.begin(), _componentIds.end(), componentId,
+            [this](auto a, auto b) { return componentIdLessThan(a, b); });
+        _componentIds.insert(it, componentId);
+    }
+
+    return true;
+}
+
+void ComponentManager::notifyComponentsWillChange(const Graph* graph, Changes& changes)
+{
+    // Notify all the merges
+    for(auto& mergee : changes._mergedComponents)
+    {
+        if(_debug) qDebug() << "componentsWillMerge" << mergee.second << "->" << mergee.first;
+        emit componentsWillMerge(graph, ComponentMergeSet(std::move(mergee.second), mergee.first));
+    }
+
+    // Removed components
+    for(auto componentId : changes._componentIdsToBeRemoved)
+    {
+        Q_ASSERT(!componentId.isNull());
+        if(_debug) qDebug() << "componentWillBeRemoved" << componentId;
+        bool hasMerged = u::contains(changes._mergedComponentIds, componentId);
+        emit componentWillBeRemoved(graph, componentId, hasMerged);
+
+        if(!hasMerged)
+        {
+            changes._nodeIdRemoves.erase(componentId);
+            changes._edgeIdRemoves.erase(componentId);
+        }
+    }
+}
+
+void ComponentManager::notifyComponentsChanged(const Graph* graph, Changes& changes)
+{
     // Notify all the new components
-    for(auto componentId : componentIdsToBeAdded)
+    for(auto componentId : changes._componentIdsToBeAdded)
     {
         Q_ASSERT(!componentId.isNull());
         if(_debug) qDebug() << "componentAdded" << componentId;
-        bool hasSplit = u::contains(splitComponentIds, componentId);
+        bool hasSplit = u::contains(changes._splitComponentIds, componentId);
         emit componentAdded(graph, componentId, hasSplit);
 
         if(!hasSplit)
         {
-            nodeIdAdds.erase(componentId);
-            edgeIdAdds.erase(componentId);
+            changes._nodeIdAdds.erase(componentId);
+            changes._edgeIdAdds.erase(componentId);
         }
     }
 
     // Notify all the splits
-    for(auto& splitee : splitComponents)
+    for(auto& splitee : changes._splitComponents)
     {
         if(_debug) qDebug() << "componentSplit" << splitee.first << "->" << splitee.second;
         emit componentSplit(graph, ComponentSplitSet(splitee.first, std::move(splitee.second)));
     }
 
     // Notify node adds and removes
-    for(auto& nodeIdAdd : nodeIdAdds)
+    for(auto& nodeIdAdd : changes._nodeIdAdds)
     {
         for(auto nodeId : nodeIdAdd.second)
             emit nodeAddedToComponent(graph, nodeId, nodeIdAdd.first);
     }
 
-    for(auto& edgeIdAdd : edgeIdAdds)
+    for(auto& edgeIdAdd : changes._edgeIdAdds)
     {
         for(auto edgeId : edgeIdAdd.second)
             emit edgeAddedToComponent(graph, edgeId, edgeIdAdd.first);
     }
 
-    for(auto& nodeIdRemove : nodeIdRemoves)
+    for(auto& nodeIdRemove : changes._nodeIdRemoves)
     {
         for(auto nodeId : nodeIdRemove.second)
             emit nodeRemovedFromComponent(graph, nodeId, nodeIdRemove.first);
     }
 
-    for(auto& edgeIdRemove : edgeIdRemoves)
+    for(auto& edgeIdRemove : changes._edgeIdRemoves)
     {
         for(auto edgeId : edgeIdRemove.second)
             emit edgeRemovedFromComponent(graph, edgeId, edgeIdRemove.first);
     }
-
-    if(_debug) qDebug() << "ComponentManager::update ends" << this;
 }
 
 ComponentId ComponentManager::generateComponentId()
@@ -448,6 +1098,18 @@ void ComponentManager::shrinkComponentsArrayToFit()
     _components.resize(newSize);
 }
 
+// Components are ordered by decreasing size, then by ID
+bool ComponentManager::componentIdLessThan(ComponentId a, ComponentId b) const
+{
+    const auto* componentA = componentFor(a);
+    const auto* componentB = componentFor(b);
+
+    if(componentA->numNodes() == componentB->numNodes())
+        return a < b;
+
+    return componentA->numNodes() > componentB->numNodes();
+}
+
 void ComponentManager::onGraphChanged(const Graph* graph, bool changeOccurred)
 {
     if(_enabled && changeOccurred)
@@ -21,9 +21,11 @@
 
 #include "shared/graph/grapharray.h"
 
+#include "graph.h"
 #include "graphfilter.h"
 
 #include <queue>
+#include <map>
 #include <mutex>
 #include <vector>
 #include <functional>
@@ -33,7 +35,6 @@
 #include <QObject>
 #include <QtGlobal>
 
-class Graph;
 class GraphComponent;
 
 class ComponentSplitSet
@@ -95,6 +96,10 @@ private:
     NodeArray<ComponentId> _nodesComponentId;
     EdgeArray<ComponentId> _edgesComponentId;
 
+    // The nodes each edge joined as of the last update, as these can't be
+    // retrieved from the graph once the edge has been removed from it
+    EdgeArray<std::pair<NodeId, NodeId>> _edgesNodeIds;
+
     mutable std::recursive_mutex _updateMutex;
 
     std::mutex _componentArraysMutex;
@@ -103,6 +108,29 @@ private:
     bool _enabled = true;
     bool _debug = false;
 
+    // Changes to the graph that have occurred since the last update; when
+    // these are few in number, only the components they touch are revisited
+    Graph::Diff _pendingChanges;
+    bool _hasCustomFilters = false;
+    bool _hasMergedNodes = false;
+    bool _fullUpdateRequired = false;
+
+    // What an update has changed, for the purposes of notification
+    struct Changes
+    {
+        std::map<ComponentId, ComponentIdSet> _splitComponents;
+        ComponentIdSet _splitComponentIds;
+        std::map<ComponentId, ComponentIdSet> _mergedComponents;
+        ComponentIdSet _mergedComponentIds;
+        std::vector<ComponentId> _componentIdsToBeAdded;
+        std::vector<ComponentId> _componentIdsToBeRemoved;
+
+        std::map<ComponentId, std::vector<NodeId>> _nodeIdAdds;
+        std::map<ComponentId, std::vector<EdgeId>> _edgeIdAdds;
+        std::map<ComponentId, std::vector<NodeId>> _nodeIdRemoves;
+        std::map<ComponentId, std::vector<EdgeId>> _edgeIdRemoves;
+    };
+
     ComponentId generateComponentId();
     void queueGraphComponentUpdate(const Graph* graph, ComponentId componentId);
     void updateGraphComponents(const Graph* graph);
@@ -112,8 +140,19 @@ private:
     const GraphComponent* componentFor(ComponentId componentId) const;
     void setComponentFor(ComponentId componentId, std::unique_ptr<GraphComponent> graphComponent);
     void shrinkComponentsArrayToFit();
+    bool componentIdLessThan(ComponentId a, ComponentId b) const;
+
+    void requireFullUpdate() { _fullUpdateRequired = true; }
+    bool canUpdateIncrementally(const Graph* graph, const Graph::Diff& diff) const;
+    std::vector<std::vector<NodeId>> disconnectedNodeIds(const Graph* graph, ComponentId componentId,
+                                                         const std::vector<NodeId>& nodeIds) const;
 
     void update(const Graph* graph);
+    void updateFully(const Graph* graph, Changes& changes);
+    bool updateIncrementally(const Graph* graph, Graph::Diff& diff, Changes& changes);
+    void notifyComponentsWillChange(const Graph* graph, Changes& changes);
+    void notifyComponentsChanged(const Graph* graph, Changes& changes);
+
     int componentArrayCapacity() const { return static_cast<int>(_nextComponentId); }
     ComponentIdSet assignConnectedElementsComponentId(const Graph* graph, NodeId rootId, ComponentId componentId,
                                                       NodeArray<ComponentId>& nodesComponentId,
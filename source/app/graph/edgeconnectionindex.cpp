@@ -0,0 +1,157 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "edgeconnectionindex.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+
+uint64_t EdgeConnectionIndex::keyFor(NodeId nodeIdA, NodeId nodeIdB)
+{
+    auto a = static_cast<uint32_t>(static_cast<int>(nodeIdA));
+    auto b = static_cast<uint32_t>(static_cast<int>(nodeIdB));
+    auto lo = std::min(a, b);
+    auto hi = std::max(a, b);
+
+    return (static_cast<uint64_t>(lo) << 32u) | hi;
+}
+
+size_t EdgeConnectionIndex::homeIndexFor(uint64_t key) const
+{
+    // splitmix64's finaliser; node IDs are dense, so the bits need mixing
+    key = (key ^ (key >> 30u)) * 0xbf58476d1ce4e5b9ull;
+    key = (key ^ (key >> 27u)) * 0x94d049bb133111ebull;
+    key = key ^ (key >> 31u);
+
+    return static_cast<size_t>(key) & (_slots.size() - 1);
+}
+
+size_t EdgeConnectionIndex::slotIndexFor(uint64_t key) const
+{
+    Q_ASSERT(!_slots.empty());
+
+    const auto mask = _slots.size() - 1;
+    auto index = homeIndexFor(key);
+
+    while(_slots[index]._key != key && _slots[index]._key != EmptyKey)
+        index = (index + 1) & mask;
+
+    return index;
+}
+
+void EdgeConnectionIndex::rehash(size_t numSlots)
+{
+    Q_ASSERT((numSlots & (numSlots - 1)) == 0);
+
+    auto oldSlots = std::move(_slots);
+    _slots.assign(numSlots, {});
+
+    for(const auto& slot : oldSlots)
+    {
+        if(slot._key != EmptyKey)
+            _slots[slotIndexFor(slot._key)] = slot;
+    }
+}
+
+void EdgeConnectionIndex::erase(size_t index)
+{
+    const auto mask = _slots.size() - 1;
+    auto next = index;
+
+    // Shift back any subsequent entries that would no longer be found
+    // once the slot is empty, rather than leaving a tombstone
+    while(true)
+    {
+        next = (next + 1) & mask;
+
+        if(_slots[next]._key == EmptyKey)
+            break;
+
+        auto home = homeIndexFor(_slots[next]._key);
+
+        bool stayPut = index <= next ?
+            (index < home && home <= next) :
+            (index < home || home <= next);
+
+        if(!stayPut)
+        {
+            _slots[index] = _slots[next];
+            index = next;
+        }
+    }
+
+    _slots[index] = {};
+    _size--;
+}
+
+void EdgeConnectionIndex::clear()
+{
+    _slots.clear();
+    _size = 0;
+}
+
+void EdgeConnectionIndex::reserve(size_t numConnections)
+{
+    // Keep the load factor at or below 3/4
+    size_t numSlots = 16;
+    while(numSlots * 3 < numConnections * 4)
+        numSlots *= 2;
+
+    if(numSlots > _slots.size())
+        rehash(numSlots);
+}
+
+EdgeId EdgeConnectionIndex::find(NodeId nodeIdA, NodeId nodeIdB) const
+{
+    if(_size == 0)
+        return {};
+
+    const auto& slot = _slots[slotIndexFor(keyFor(nodeIdA, nodeIdB))];
+    return slot._key != EmptyKey ? slot._edgeId : EdgeId();
+}
+
+void EdgeConnectionIndex::set(NodeId nodeIdA, NodeId nodeIdB, EdgeId edgeId)
+{
+    auto key = keyFor(nodeIdA, nodeIdB);
+
+    if(edgeId.isNull())
+    {
+        if(_size == 0)
+            return;
+
+        auto index = slotIndexFor(key);
+        if(_slots[index]._key != EmptyKey)
+            erase(index);
+
+        return;
+    }
+
+    if((_size + 1) * 4 > _slots.size() * 3)
+        reserve(_size + 1);
+
+    auto& slot = _slots[slotIndexFor(key)];
+
+    if(slot._key == EmptyKey)
+    {
+        slot._key = key;
+        _size++;
+    }
+
+    slot._edgeId = edgeId;
+}
@@ -0,0 +1,66 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EDGECONNECTIONINDEX_H
+#define EDGECONNECTIONINDEX_H
+
+#include "shared/graph/elementid.h"
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+// Maps each unordered pair of nodes to the first of the edges that connect them.
+// This is an open addressing hash table with linear probing, so it's a single
+// flat allocation that's quick to look up, rebuild and copy.
+class EdgeConnectionIndex
+{
+private:
+    static constexpr uint64_t EmptyKey = std::numeric_limits<uint64_t>::max();
+
+    struct Slot
+    {
+        uint64_t _key = EmptyKey;
+        EdgeId _edgeId;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _size = 0;
+
+    static uint64_t keyFor(NodeId nodeIdA, NodeId nodeIdB);
+    size_t homeIndexFor(uint64_t key) const;
+
+    // The index of the slot containing key, or the empty slot where it would go
+    size_t slotIndexFor(uint64_t key) const;
+
+    void rehash(size_t numSlots);
+    void erase(size_t index);
+
+public:
+    void clear();
+    void reserve(size_t numConnections);
+    size_t size() const { return _size; }
+
+    // Returns a null EdgeId if the nodes aren't connected
+    EdgeId find(NodeId nodeIdA, NodeId nodeIdB) const;
+
+    // Setting a null EdgeId removes the connection
+    void set(NodeId nodeIdA, NodeId nodeIdB, EdgeId edgeId);
+};
+
+#endif // EDGECONNECTIONINDEX_H
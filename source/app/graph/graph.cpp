@@ -78,6 +78,18 @@ Graph::Graph() :
 
     connect(this, &Graph::nodeAdded, [this](const Graph*, NodeId nodeId) { reserveNodeId(nodeId); }); // NOLINT
     connect(this, &Graph::edgeAdded, [this](const Graph*, EdgeId edgeId) { reserveEdgeId(edgeId); }); // NOLINT
+
+    connect(this, &Graph::nodesAdded, [this](const Graph*, const std::vector<NodeId>& nodeIds) // NOLINT
+    {
+        if(!nodeIds.empty())
+            reserveNodeId(*std::max_element(nodeIds.begin(), nodeIds.end()));
+    });
+
+    connect(this, &Graph::edgesAdded, [this](const Graph*, const std::vector<EdgeId>& edgeIds) // NOLINT
+    {
+        if(!edgeIds.empty())
+            reserveEdgeId(*std::max_element(edgeIds.begin(), edgeIds.end()));
+    });
 }
 
 Graph::~Graph() // NOLINT modernize-use-equals-default
@@ -145,6 +157,12 @@ void Graph::disableComponentManagement()
         _componentManager->disable();
 }
 
+void Graph::requireFullComponentUpdate()
+{
+    if(_componentManager != nullptr)
+        _componentManager->requireFullUpdate();
+}
+
 template<typename G, typename C> void dumpGraphToQDebug(const G& graph, const C& component, const int detail)
 {
     qDebug() << component.numNodes() << "nodes" << component.numEdges() << "edges";
@@ -35,6 +35,7 @@
 
 class GraphComponent;
 class ComponentManager;
+class AdjacencySnapshot;
 class ComponentSplitSet;
 class ComponentMergeSet;
 
@@ -166,6 +167,11 @@ public:
 
     virtual EdgeIdDistinctSets edgeIdsForNodeId(NodeId nodeId) const = 0;
 
+    // A compact, read only copy of the graph's adjacency, built on first use
+    // after the graph changes; the returned snapshot remains valid after any
+    // subsequent change, but will no longer reflect the graph
+    virtual std::shared_ptr<const AdjacencySnapshot> adjacencySnapshot() const = 0;
+
     template<typename C> EdgeIdSet edgeIdsForNodeIds(const C& nodeIds) const
     {
         EdgeIdSet edgeIds;
@@ -194,6 +200,40 @@ public:
         return edges;
     }
 
+    struct Diff
+    {
+        std::vector<NodeId> _nodesAdded;
+        std::vector<NodeId> _nodesRemoved;
+        std::vector<EdgeId> _edgesAdded;
+        std::vector<EdgeId> _edgesRemoved;
+
+        bool empty() const
+        {
+            return
+                _nodesAdded.empty() &&
+                _nodesRemoved.empty() &&
+                _edgesAdded.empty() &&
+                _edgesRemoved.empty();
+        }
+
+        size_t size() const
+        {
+            return
+                _nodesAdded.size() +
+                _nodesRemoved.size() +
+                _edgesAdded.size() +
+                _edgesRemoved.size();
+        }
+
+        void clear()
+        {
+            _nodesAdded.clear();
+            _nodesRemoved.clear();
+            _edgesAdded.clear();
+            _edgesRemoved.clear();
+        }
+    };
+
     virtual void reserve(const Graph& other);
 
     void enableComponentManagement();
@@ -294,6 +334,12 @@ protected:
 
     void clear();
 
+    // Components are usually updated incrementally, based on the nodes and edges that have been
+    // added or removed; when the graph changes in a way these signals can't express, such as an
+    // EdgeId being reused for a different edge without any intervening update, this ensures the
+    // components are instead recalculated from scratch
+    void requireFullComponentUpdate();
+
 signals:
     // The signals are listed here in the order in which they are emitted
     void graphWillChange(const Graph*);
@@ -303,6 +349,10 @@ signals:
     void edgeAdded(const Graph*, EdgeId);
     void edgeRemoved(const Graph*, EdgeId);
 
+    // Emitted instead of the individual signals above, when elements are added in bulk
+    void nodesAdded(const Graph*, const std::vector<NodeId>&);
+    void edgesAdded(const Graph*, const std::vector<EdgeId>&);
+
     void componentsWillMerge(const Graph*, const ComponentMergeSet&);
     void componentWillBeRemoved(const Graph*, ComponentId, bool);
     void componentAdded(const Graph*, ComponentId, bool);
@@ -30,6 +30,7 @@
 #include "ui/searchmanager.h"
 
 #include "attributes/attribute.h"
+#include "attributes/attributecache.h"
 
 #include "transform/transformedgraph.h"
 #include "transform/transforminfo.h"
@@ -128,6 +129,7 @@ private:
     UserEdgeData _userEdgeData;
 
     std::map<QString, Attribute> _attributes;
+    AttributeCache _attributeCache;
 
     struct AttributeIdentity
     {
@@ -183,6 +185,35 @@ private:
 
     bool _nodesMaskActive = false;
 
+    Flags<VisualFlags> nodeVisualState(NodeId nodeId) const
+    {
+        Flags<VisualFlags> state;
+
+        auto nodeIsSelected = u::contains(_selectedNodeIds, nodeId);
+        state.setState(VisualFlags::Selected, nodeIsSelected);
+
+        auto isNotFound = !_foundNodeIds.empty() && !u::contains(_foundNodeIds, nodeId);
+        auto isNotHighlighted = !_highlightedNodeIds.empty() && nodeIsSelected &&
+            !u::contains(_highlightedNodeIds, nodeId);
+
+        state.setState(VisualFlags::Unhighlighted, (isNotFound && _nodesMaskActive) || isNotHighlighted);
+
+        return state;
+    }
+
+    // An edge is selected or unhighlighted when either of its nodes is
+    static Flags<VisualFlags> edgeVisualState(Flags<VisualFlags> sourceState, Flags<VisualFlags> targetState)
+    {
+        Flags<VisualFlags> state;
+
+        state.setState(VisualFlags::Selected, sourceState.test(VisualFlags::Selected) ||
+            targetState.test(VisualFlags::Selected));
+        state.setState(VisualFlags::Unhighlighted, sourceState.test(VisualFlags::Unhighlighted) ||
+            targetState.test(VisualFlags::Unhighlighted));
+
+        return state;
+    }
+
     std::set<AttributeChangesTracker*> _attributeChangesTrackers;
 
     bool _visualUpdateRequired = false;
@@ -226,6 +257,8 @@ GraphModel::GraphModel(const QString& name, IPlugin* plugin) :
         if(attributeName.isEmpty())
             return;
 
+        _->_attributeCache.invalidate(attributeName);
+
         for(auto* tracker : _->_attributeChangesTrackers)
             tracker->change(attributeName);
     });
@@ -236,6 +269,8 @@ GraphModel::GraphModel(const QString& name, IPlugin* plugin) :
         if(attributeName.isEmpty())
             return;
 
+        _->_attributeCache.invalidate(attributeName);
+
         for(auto* tracker : _->_attributeChangesTrackers)
             tracker->change(attributeName);
     });
@@ -424,6 +459,10 @@ QString GraphModel::nodeName(NodeId nodeId) const { return _->_nodeNames[nodeId]
 void GraphModel::setNodeName(NodeId nodeId, const QString& name)
 {
     _->_nodeNames[nodeId] = name;
+
+    // Node names may be the source of any number of attributes' values
+    _->_attributeCache.invalidateAll();
+
     updateVisuals();
 }
 
@@ -763,14 +802,16 @@ void GraphModel::buildVisualisations(const QStringList& visualisations)
             }
         }
 
+        auto column = attributeColumn(attributeName);
+
         switch(attribute.elementType())
         {
         case ElementType::Node:
-            nodeVisualisationsBuilder.build(attribute, *channel, visualisationConfig, index, info);
+            nodeVisualisationsBuilder.build(*column, *channel, visualisationConfig, index, info);
             break;
 
         case ElementType::Edge:
-            edgeVisualisationsBuilder.build(attribute, *channel, visualisationConfig, index, info);
+            edgeVisualisationsBuilder.build(*column, *channel, visualisationConfig, index, info);
             break;
 
         default:
@@ -896,6 +937,8 @@ Attribute& GraphModel::createAttribute(QString name, QString* assignedName)
     if(_transformedGraphIsChanging)
         attribute.setFlag(AttributeFlag::Dynamic);
 
+    _->_attributeCache.invalidate(name);
+
     for(auto* tracker : _->_attributeChangesTrackers)
         tracker->add(name);
 
@@ -915,6 +958,7 @@ void GraphModel::replaceAttributes(const std::map<QString, Attribute>& attribute
             qDebug() << "WARNING: attribute doesn't already exist in replaceAttributes" << attributeName;
 
         _->_attributes[attributeName] = attribute;
+        _->_attributeCache.invalidate(attributeName);
     }
 }
 
@@ -924,6 +968,7 @@ void GraphModel::removeAttribute(const QString& name)
         return;
 
     _->_attributes.erase(name);
+    _->_attributeCache.invalidate(name);
 
     for(auto* tracker : _->_attributeChangesTrackers)
         tracker->remove(name);
@@ -986,6 +1031,30 @@ Attribute GraphModel::attributeValueByName(const QString& name) const
     return attribute;
 }
 
+std::shared_ptr<const AttributeColumn> GraphModel::attributeColumn(const QString& name) const
+{
+    if(!attributeExists(name))
+        return nullptr;
+
+    auto column = _->_attributeCache.column(name);
+    if(column != nullptr)
+        return column;
+
+    auto generation = _->_attributeCache.generation();
+    auto attribute = attributeValueByName(name);
+
+    if(attribute.elementType() != ElementType::Node && attribute.elementType() != ElementType::Edge)
+        return nullptr;
+
+    column = std::make_shared<const AttributeColumn>(attribute, graph());
+
+    // The graph is in flux during a transform, so anything materialised now is short lived
+    if(!_transformedGraphIsChanging)
+        _->_attributeCache.insert(name, column, generation);
+
+    return column;
+}
+
 void GraphModel::calculateAttributeRange(const IGraph* graph, Attribute& attribute)
 {
     if(!attribute.testFlag(AttributeFlag::AutoRange))
@@ -1047,13 +1116,19 @@ bool GraphModel::attributeNameIsValid(const QString& attributeName)
 UserNodeData& GraphModel::userNodeData() { return _->_userNodeData; }
 UserEdgeData& GraphModel::userEdgeData() { return _->_userEdgeData; }
 
-void GraphModel::clearHighlightedNodes()
+// The nodes whose membership differs between a and b
+static std::vector<NodeId> changedNodeIds(const NodeIdSet& a, const NodeIdSet& b)
 {
-    if(_->_highlightedNodeIds.empty())
-        return;
+    auto nodeIds = u::setDifference(a, b);
+    auto bNotA = u::setDifference(b, a);
+    nodeIds.insert(nodeIds.end(), bNotA.begin(), bNotA.end());
 
-    _->_highlightedNodeIds.clear();
-    updateVisuals();
+    return nodeIds;
+}
+
+void GraphModel::clearHighlightedNodes()
+{
+    highlightNodes({});
 }
 
 void GraphModel::highlightNodes(const NodeIdSet& nodeIds)
@@ -1061,8 +1136,15 @@ void GraphModel::highlightNodes(const NodeIdSet& nodeIds)
     if(_->_highlightedNodeIds.empty() && nodeIds.empty())
         return;
 
+    auto dirtyNodeIds = changedNodeIds(_->_highlightedNodeIds, nodeIds);
+
+    // Highlighting only affects selected nodes, but when it starts
+    // or stops it affects all of them
+    if(_->_highlightedNodeIds.empty() != nodeIds.empty())
+        dirtyNodeIds.insert(dirtyNodeIds.end(), _->_selectedNodeIds.begin(), _->_selectedNodeIds.end());
+
     _->_highlightedNodeIds = nodeIds;
-    updateVisuals();
+    updateVisualStates(dirtyNodeIds);
 }
 
 void GraphModel::enableVisualUpdates()
@@ -1106,163 +1188,227 @@ void GraphModel::updateVisuals()
     auto edgeSize       = u::interpolate(LimitConstants::minimumEdgeSize(), LimitConstants::maximumEdgeSize(), _->_edgeSize);
     auto meIndicators   = u::pref(QStringLiteral("visuals/showMultiElementIndicators")).toBool();
 
-    auto newNodeVisuals = _->_nodeVisuals;
-    auto newEdgeVisuals = _->_edgeVisuals;
-
-    // Clear all edge flags as we can't know what to
-    // change unless we have the previous state to hand
-    for(auto edgeId : graph().edgeIds())
-        newEdgeVisuals[edgeId]._state.reset(VisualFlags::Selected, VisualFlags::Unhighlighted);
-
-    for(auto nodeId : graph().nodeIds())
+    auto nodeSizeOf = [this, nodeSize](NodeId nodeId)
     {
-        // Size
         if(_->_mappedNodeVisuals[nodeId]._size >= 0.0f)
         {
-            newNodeVisuals[nodeId]._size = mappedSize(
-                LimitConstants::minimumNodeSize(), LimitConstants::maximumNodeSize(),
+            return mappedSize(LimitConstants::minimumNodeSize(), LimitConstants::maximumNodeSize(),
                 nodeSize, _->_mappedNodeVisuals[nodeId]._size);
         }
-        else
-            newNodeVisuals[nodeId]._size = nodeSize;
+
+        return nodeSize;
+    };
+
+    auto findChange = [](const ElementVisual& previous, const ElementVisual& current, Flags<VisualChangeFlags>& change)
+    {
+        bool changed = false;
+
+        auto test = [&](bool differs, VisualChangeFlags flag)
+        {
+            if(differs)
+            {
+                change.set(flag);
+                changed = true;
+            }
+        };
+
+        test(previous._size != current._size, VisualChangeFlags::Size);
+        test(previous._innerColor != current._innerColor ||
+            previous._outerColor != current._outerColor, VisualChangeFlags::Color);
+        test(previous._text != current._text, VisualChangeFlags::Text);
+        test(previous._state != current._state, VisualChangeFlags::State);
+
+        return changed;
+    };
+
+    // Only the visuals that differ are kept, rather than a copy of every one
+    std::vector<std::pair<NodeId, ElementVisual>> changedNodeVisuals;
+    std::vector<std::pair<EdgeId, ElementVisual>> changedEdgeVisuals;
+    Flags<VisualChangeFlags> nodeChange;
+    Flags<VisualChangeFlags> edgeChange;
+
+    for(auto nodeId : graph().nodeIds())
+    {
+        ElementVisual visual;
+
+        // Size
+        visual._size = nodeSizeOf(nodeId);
 
         // Color
         if(!_->_mappedNodeVisuals[nodeId]._outerColor.isValid())
-            newNodeVisuals[nodeId]._outerColor = nodeColor;
+            visual._outerColor = nodeColor;
         else
-            newNodeVisuals[nodeId]._outerColor = _->_mappedNodeVisuals[nodeId]._outerColor;
+            visual._outerColor = _->_mappedNodeVisuals[nodeId]._outerColor;
 
-        newNodeVisuals[nodeId]._innerColor = !meIndicators || graph().typeOf(nodeId) == MultiElementType::Not ?
-            newNodeVisuals[nodeId]._outerColor : multiColor;
+        visual._innerColor = !meIndicators || graph().typeOf(nodeId) == MultiElementType::Not ?
+            visual._outerColor : multiColor;
 
         // Text
         if(!_->_mappedNodeVisuals[nodeId]._text.isEmpty())
-            newNodeVisuals[nodeId]._text = _->_mappedNodeVisuals[nodeId]._text;
+            visual._text = _->_mappedNodeVisuals[nodeId]._text;
         else
-            newNodeVisuals[nodeId]._text = nodeName(nodeId);
-
-        auto nodeIsSelected = u::contains(_->_selectedNodeIds, nodeId);
+            visual._text = nodeName(nodeId);
 
-        newNodeVisuals[nodeId]._state.setState(VisualFlags::Selected, nodeIsSelected);
+        visual._state = _->nodeVisualState(nodeId);
 
-        if(nodeIsSelected)
-        {
-            for(auto edgeId : graph().edgeIdsForNodeId(nodeId))
-                newEdgeVisuals[edgeId]._state.setState(VisualFlags::Selected, nodeIsSelected);
-        }
-
-        auto isNotFound = !_->_foundNodeIds.empty() && !u::contains(_->_foundNodeIds, nodeId);
-        auto isNotHighlighted = !_->_highlightedNodeIds.empty() && nodeIsSelected &&
-            !u::contains(_->_highlightedNodeIds, nodeId);
-
-        auto nodeUnhighlighted = (isNotFound && _->_nodesMaskActive) || isNotHighlighted;
-
-        newNodeVisuals[nodeId]._state.setState(VisualFlags::Unhighlighted, nodeUnhighlighted);
-
-        if(nodeUnhighlighted)
-        {
-            for(auto edgeId : graph().edgeIdsForNodeId(nodeId))
-                newEdgeVisuals[edgeId]._state.set(VisualFlags::Unhighlighted);
-        }
+        if(findChange(_->_nodeVisuals[nodeId], visual, nodeChange))
+            changedNodeVisuals.emplace_back(nodeId, std::move(visual));
     }
 
     for(auto edgeId : graph().edgeIds())
     {
+        ElementVisual visual;
+
         // Size
         if(_->_mappedEdgeVisuals[edgeId]._size >= 0.0f)
         {
-            newEdgeVisuals[edgeId]._size = mappedSize(
+            visual._size = mappedSize(
                 LimitConstants::minimumEdgeSize(), LimitConstants::maximumEdgeSize(),
                 edgeSize, _->_mappedEdgeVisuals[edgeId]._size);
         }
         else
-            newEdgeVisuals[edgeId]._size = edgeSize;
+            visual._size = edgeSize;
 
         // Restrict edgeSize to be no larger than the source or target size
         const auto& edge = graph().edgeById(edgeId);
-        auto minEdgeNodesSize = std::min(newNodeVisuals[edge.sourceId()]._size,
-            newNodeVisuals[edge.targetId()]._size);
-        newEdgeVisuals[edgeId]._size = std::min(newEdgeVisuals[edgeId]._size, minEdgeNodesSize);
+        auto minEdgeNodesSize = std::min(nodeSizeOf(edge.sourceId()), nodeSizeOf(edge.targetId()));
+        visual._size = std::min(visual._size, minEdgeNodesSize);
 
         // Color
         if(!_->_mappedEdgeVisuals[edgeId]._outerColor.isValid())
-            newEdgeVisuals[edgeId]._outerColor = edgeColor;
+            visual._outerColor = edgeColor;
         else
-            newEdgeVisuals[edgeId]._outerColor = _->_mappedEdgeVisuals[edgeId]._outerColor;
+            visual._outerColor = _->_mappedEdgeVisuals[edgeId]._outerColor;
 
-        newEdgeVisuals[edgeId]._innerColor = !meIndicators || graph().typeOf(edgeId) == MultiElementType::Not ?
-            newEdgeVisuals[edgeId]._outerColor : multiColor;
+        visual._innerColor = !meIndicators || graph().typeOf(edgeId) == MultiElementType::Not ?
+            visual._outerColor : multiColor;
 
         // Text
         if(!_->_mappedEdgeVisuals[edgeId]._text.isEmpty())
-            newEdgeVisuals[edgeId]._text = _->_mappedEdgeVisuals[edgeId]._text;
-        else
-            newEdgeVisuals[edgeId]._text.clear();
+            visual._text = _->_mappedEdgeVisuals[edgeId]._text;
+
+        visual._state = GraphModelImpl::edgeVisualState(
+            _->nodeVisualState(edge.sourceId()), _->nodeVisualState(edge.targetId()));
+
+        if(findChange(_->_edgeVisuals[edgeId], visual, edgeChange))
+            changedEdgeVisuals.emplace_back(edgeId, std::move(visual));
     }
 
-    auto findChange = [](const auto& elementIds, const auto& previous, const auto& current)
-    {
-        Flags<VisualChangeFlags> change;
+    if(changedNodeVisuals.empty() && changedEdgeVisuals.empty())
+        return;
 
-        for(auto elementId : elementIds)
-        {
-            if(!change.test(VisualChangeFlags::Size))
-            {
-                change.set(previous[elementId]._size != current[elementId]._size ?
-                    VisualChangeFlags::Size : VisualChangeFlags::None);
-            }
+    emit visualsWillChange();
 
-            if(!change.test(VisualChangeFlags::Color))
-            {
-                change.set(previous[elementId]._innerColor != current[elementId]._innerColor ?
-                    VisualChangeFlags::Color : VisualChangeFlags::None);
+    for(auto& [nodeId, visual] : changedNodeVisuals)
+        _->_nodeVisuals[nodeId] = std::move(visual);
 
-                change.set(previous[elementId]._outerColor != current[elementId]._outerColor ?
-                    VisualChangeFlags::Color : VisualChangeFlags::None);
-            }
+    for(auto& [edgeId, visual] : changedEdgeVisuals)
+        _->_edgeVisuals[edgeId] = std::move(visual);
 
-            if(!change.test(VisualChangeFlags::Text))
-            {
-                change.set(previous[elementId]._text != current[elementId]._text ?
-                    VisualChangeFlags::Text : VisualChangeFlags::None);
-            }
+    emit visualsChanged(*nodeChange, *edgeChange);
+}
 
-            if(!change.test(VisualChangeFlags::State))
-            {
-                change.set(previous[elementId]._state != current[elementId]._state ?
-                    VisualChangeFlags::State : VisualChangeFlags::None);
-            }
-        }
+// Selection, search and highlighting only ever affect the state of the given nodes and
+// their edges, so everything else is left untouched, and the cost is proportional to
+// the number of nodes that may have changed, rather than the size of the graph
+void GraphModel::updateVisualStates(const std::vector<NodeId>& nodeIds)
+{
+    auto lock = mutableGraph().tryLock();
+    if(!lock.owns_lock())
+    {
+        _->_visualUpdateRequired = true;
+        return;
+    }
 
-        return *change;
-    };
+    if(!_visualUpdatesEnabled)
+        return;
 
-    VisualChangeFlags nodeChange = findChange(graph().nodeIds(), _->_nodeVisuals, newNodeVisuals);
-    VisualChangeFlags edgeChange = findChange(graph().edgeIds(), _->_edgeVisuals, newEdgeVisuals);
+    std::vector<std::pair<NodeId, Flags<VisualFlags>>> changedNodeStates;
 
-    if(nodeChange != VisualChangeFlags::None || edgeChange != VisualChangeFlags::None)
+    for(auto nodeId : nodeIds)
     {
-        emit visualsWillChange();
+        if(!graph().containsNodeId(nodeId))
+            continue;
 
-        _->_nodeVisuals = newNodeVisuals;
-        _->_edgeVisuals = newEdgeVisuals;
+        auto state = _->nodeVisualState(nodeId);
+        if(state != _->_nodeVisuals[nodeId]._state)
+            changedNodeStates.emplace_back(nodeId, state);
+    }
+
+    // Edge states are derived from node states, so they can't change on their own
+    if(changedNodeStates.empty())
+        return;
 
-        emit visualsChanged(nodeChange, edgeChange);
+    emit visualsWillChange();
+
+    for(auto [nodeId, state] : changedNodeStates)
+        _->_nodeVisuals[nodeId]._state = state;
+
+    auto edgeChange = VisualChangeFlags::None;
+
+    for(auto [nodeId, state] : changedNodeStates)
+    {
+        for(auto edgeId : graph().edgeIdsForNodeId(nodeId))
+        {
+            const auto& edge = graph().edgeById(edgeId);
+            auto edgeState = GraphModelImpl::edgeVisualState(
+                _->_nodeVisuals[edge.sourceId()]._state,
+                _->_nodeVisuals[edge.targetId()]._state);
+
+            if(edgeState != _->_edgeVisuals[edgeId]._state)
+            {
+                _->_edgeVisuals[edgeId]._state = edgeState;
+                edgeChange = VisualChangeFlags::State;
+            }
+        }
     }
+
+    emit visualsChanged(VisualChangeFlags::State, edgeChange);
 }
 
 void GraphModel::onSelectionChanged(const SelectionManager* selectionManager)
 {
-    _->_selectedNodeIds = selectionManager->selectedNodes();
-    _->_nodesMaskActive = selectionManager->nodesMaskActive();
-    clearHighlightedNodes();
-    updateVisuals();
+    auto selectedNodeIds = selectionManager->selectedNodes();
+    auto nodesMaskActive = selectionManager->nodesMaskActive();
+
+    auto dirtyNodeIds = changedNodeIds(_->_selectedNodeIds, selectedNodeIds);
+
+    // Any highlighting is cleared, which affects the previously selected nodes
+    if(!_->_highlightedNodeIds.empty())
+    {
+        dirtyNodeIds.insert(dirtyNodeIds.end(), _->_selectedNodeIds.begin(), _->_selectedNodeIds.end());
+        _->_highlightedNodeIds.clear();
+    }
+
+    // Masking affects every node that isn't found
+    bool allNodesDirty = nodesMaskActive != _->_nodesMaskActive && !_->_foundNodeIds.empty();
+
+    _->_selectedNodeIds = std::move(selectedNodeIds);
+    _->_nodesMaskActive = nodesMaskActive;
+
+    updateVisualStates(allNodesDirty ? graph().nodeIds() : dirtyNodeIds);
 }
 
 void GraphModel::onFoundNodeIdsChanged(const SearchManager* searchManager)
 {
-    _->_foundNodeIds = searchManager->foundNodeIds();
-    updateVisuals();
+    auto foundNodeIds = searchManager->foundNodeIds();
+
+    std::vector<NodeId> dirtyNodeIds;
+    bool allNodesDirty = false;
+
+    // Found nodes only make a visual difference when the mask is active
+    if(_->_nodesMaskActive)
+    {
+        // Every node is affected when a search starts or stops
+        if(_->_foundNodeIds.empty() != foundNodeIds.empty())
+            allNodesDirty = true;
+        else
+            dirtyNodeIds = changedNodeIds(_->_foundNodeIds, foundNodeIds);
+    }
+
+    _->_foundNodeIds = std::move(foundNodeIds);
+
+    updateVisualStates(allNodesDirty ? graph().nodeIds() : dirtyNodeIds);
 }
 
 void GraphModel::onPreferenceChanged(const QString& name, const QVariant&)
@@ -1275,6 +1421,7 @@ void GraphModel::onPreferenceChanged(const QString& name, const QVariant&)
 
 void GraphModel::onMutableGraphChanged(const Graph* graph)
 {
+    _->_attributeCache.invalidateAll();
     calculateAttributeRanges(graph, _->_attributes);
 }
 
@@ -1284,12 +1431,15 @@ void GraphModel::onTransformedGraphWillChange(const Graph*)
     _->_previousAttributeIdentities = _->currentAttributeIdentities();
 
     removeDynamicAttributes();
+    _->_attributeCache.invalidateAll();
 
     _transformedGraphIsChanging = true;
 }
 
 void GraphModel::onTransformedGraphChanged(const Graph*)
 {
+    _->_attributeCache.invalidateAll();
+
     auto attributeIdentities = _->currentAttributeIdentities();
 
     // Compare with previous attributes
@@ -1323,6 +1473,9 @@ void GraphModel::onTransformedGraphChanged(const Graph*)
 void GraphModel::onAttributesChanged(const QStringList& addedNames, const QStringList& removedNames,
     const QStringList& changedValuesNames)
 {
+    for(const auto& attributeName : u::combine(addedNames, removedNames, changedValuesNames))
+        _->_attributeCache.invalidate(Attribute::parseAttributeName(attributeName)._name);
+
     for(const auto& attributeName : u::combine(addedNames, changedValuesNames))
     {
         auto& attribute = _->_attributes.at(Attribute::parseAttributeName(attributeName)._name);
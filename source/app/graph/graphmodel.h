@@ -58,6 +58,7 @@ class VisualisationInfo;
 class GraphTransformFactory;
 
 class AttributeChangesTracker;
+class AttributeColumn;
 
 class GraphModel : public QObject, public IGraphModel
 {
@@ -91,6 +92,8 @@ private:
     const IElementVisual& nodeVisualImpl(NodeId nodeId) const override;
     const IElementVisual& edgeVisualImpl(EdgeId edgeId) const override;
 
+    void updateVisualStates(const std::vector<NodeId>& nodeIds);
+
 public:
     MutableGraph& mutableGraph();
     const MutableGraph& mutableGraph() const;
@@ -168,6 +171,10 @@ public:
     bool attributeIsValid(const QString& name) const;
     Attribute attributeValueByName(const QString& name) const;
 
+    // The values of a node or edge attribute over the (transformed) graph, evaluated
+    // once and then cached until the attribute or graph changes
+    std::shared_ptr<const AttributeColumn> attributeColumn(const QString& name) const;
+
     static bool attributeNameIsValid(const QString& attributeName);
 
     static void calculateAttributeRange(const IGraph* graph, Attribute& attribute);
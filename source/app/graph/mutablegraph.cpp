@@ -20,8 +20,12 @@
 
 #include "graphcomponent.h"
 #include "componentmanager.h"
+#include "adjacencysnapshot.h"
 
 #include "shared/utils/container.h"
+#include "shared/utils/threadpool.h"
+
+#include <numeric>
 
 MutableGraph::MutableGraph(const MutableGraph& other) // NOLINT bugprone-copy-constructor-init
 {
@@ -98,11 +102,11 @@ std::vector<EdgeId> MutableGraph::edgeIdsBetween(NodeId nodeIdA, NodeId nodeIdB)
 {
     std::vector<EdgeId> edgeIds;
 
-    auto undirectedEdge = UndirectedEdge(nodeIdA, nodeIdB);
-    if(u::contains(_e._connections, undirectedEdge))
+    auto connectionEdgeId = _e._connections.find(nodeIdA, nodeIdB);
+    if(!connectionEdgeId.isNull())
     {
-        const auto& edgeIdDistinctSet = _e._connections.at(undirectedEdge);
-        std::copy(edgeIdDistinctSet.begin(), edgeIdDistinctSet.end(), std::back_inserter(edgeIds));
+        ConstEdgeIdDistinctSet connection(connectionEdgeId, &_e._mergedEdgeIds);
+        std::copy(connection.begin(), connection.end(), std::back_inserter(edgeIds));
     }
 
     return edgeIds;
@@ -110,21 +114,7 @@ std::vector<EdgeId> MutableGraph::edgeIdsBetween(NodeId nodeIdA, NodeId nodeIdB)
 
 EdgeId MutableGraph::firstEdgeIdBetween(NodeId nodeIdA, NodeId nodeIdB) const
 {
-    const auto& nodeA = nodeById(nodeIdA);
-
-    for(auto edgeId : nodeA._outEdgeIds)
-    {
-        if(edgeById(edgeId).targetId() == nodeIdB)
-            return edgeId;
-    }
-
-    for(auto edgeId : nodeA._inEdgeIds)
-    {
-        if(edgeById(edgeId).sourceId() == nodeIdB)
-            return edgeId;
-    }
-
-    return {};
+    return _e._connections.find(nodeIdA, nodeIdB);
 }
 
 bool MutableGraph::edgeExistsBetween(NodeId nodeIdA, NodeId nodeIdB) const
@@ -217,6 +207,7 @@ NodeId MutableGraph::addNode(NodeId nodeId)
     node._id = nodeId;
     node._inEdgeIds.setCollection(&_e._inEdgeIdsCollection);
     node._outEdgeIds.setCollection(&_e._outEdgeIdsCollection);
+    invalidateAdjacencySnapshot();
 
     emit nodeAdded(this, nodeId);
     _updateRequired = true;
@@ -230,6 +221,44 @@ NodeId MutableGraph::addNode(const INode& node)
     return addNode(node.id());
 }
 
+std::vector<NodeId> MutableGraph::addNodesBulk(size_t numNodes)
+{
+    std::vector<NodeId> nodeIds(numNodes);
+    std::iota(nodeIds.begin(), nodeIds.end(), nextNodeId());
+
+    addNodesBulk(nodeIds);
+
+    return nodeIds;
+}
+
+void MutableGraph::addNodesBulk(const std::vector<NodeId>& nodeIds)
+{
+    if(nodeIds.empty())
+        return;
+
+    beginTransaction();
+
+    reserveNodeId(*std::max_element(nodeIds.begin(), nodeIds.end()));
+
+    for(auto nodeId : nodeIds)
+    {
+        Q_ASSERT(!nodeId.isNull());
+        Q_ASSERT(!containsNodeId(nodeId));
+
+        claimNodeId(nodeId);
+        auto& node = nodeBy(nodeId);
+        node._id = nodeId;
+        node._inEdgeIds.setCollection(&_e._inEdgeIdsCollection);
+        node._outEdgeIds.setCollection(&_e._outEdgeIdsCollection);
+    }
+
+    invalidateAdjacencySnapshot();
+
+    emit nodesAdded(this, nodeIds);
+    _updateRequired = true;
+    endTransaction();
+}
+
 void MutableGraph::removeNode(NodeId nodeId)
 {
     Q_ASSERT(containsNodeId(nodeId));
@@ -248,6 +277,7 @@ void MutableGraph::removeNode(NodeId nodeId)
 
     releaseNodeId(nodeId);
     _unusedNodeIds.push_back(nodeId);
+    invalidateAdjacencySnapshot();
 
     emit nodeRemoved(this, nodeId);
     _updateRequired = true;
@@ -312,6 +342,38 @@ EdgeIdDistinctSet MutableGraph::outEdgeIdsForNodeId(NodeId nodeId) const
     return nodeBy(nodeId)._outEdgeIds;
 }
 
+std::shared_ptr<const AdjacencySnapshot> MutableGraph::adjacencySnapshot() const
+{
+    std::unique_lock<std::mutex> lock(_adjacencySnapshotMutex);
+
+    if(_adjacencySnapshot == nullptr)
+    {
+        if(_updateRequired)
+        {
+            // _nodeIds is stale until update() is called, which can't happen from
+            // here, so determine the nodes in use directly
+            std::vector<NodeId> nodeIdsInUse;
+            for(NodeId nodeId(0); nodeId < nextNodeId(); ++nodeId)
+            {
+                if(containsNodeId(nodeId))
+                    nodeIdsInUse.emplace_back(nodeId);
+            }
+
+            _adjacencySnapshot = std::make_shared<AdjacencySnapshot>(*this, nodeIdsInUse);
+        }
+        else
+            _adjacencySnapshot = std::make_shared<AdjacencySnapshot>(*this, _nodeIds);
+    }
+
+    return _adjacencySnapshot;
+}
+
+void MutableGraph::invalidateAdjacencySnapshot()
+{
+    std::unique_lock<std::mutex> lock(_adjacencySnapshotMutex);
+    _adjacencySnapshot = nullptr;
+}
+
 EdgeId MutableGraph::addEdge(NodeId sourceId, NodeId targetId)
 {
     if(!_unusedEdgeIds.empty())
@@ -393,11 +455,9 @@ EdgeId MutableGraph::addEdge(EdgeId edgeId, NodeId sourceId, NodeId targetId)
     nodeBy(sourceId)._outEdgeIds.add(edgeId);
     nodeBy(targetId)._inEdgeIds.add(edgeId);
 
-    auto undirectedEdge = UndirectedEdge(sourceId, targetId);
-    if(!u::contains(_e._connections, undirectedEdge))
-        _e._connections.emplace(undirectedEdge, EdgeIdDistinctSet(&_e._mergedEdgeIds));
-
-    _e._connections[undirectedEdge].add(edgeId);
+    auto connectionEdgeId = _e._connections.find(sourceId, targetId);
+    _e._connections.set(sourceId, targetId, _e._mergedEdgeIds.add(connectionEdgeId, edgeId));
+    invalidateAdjacencySnapshot();
 
     emit edgeAdded(this, edgeId);
     _updateRequired = true;
@@ -411,6 +471,97 @@ EdgeId MutableGraph::addEdge(const IEdge& edge)
     return addEdge(edge.id(), edge.sourceId(), edge.targetId());
 }
 
+std::vector<EdgeId> MutableGraph::addEdgesBulk(const std::vector<NodeId>& sourceIds,
+    const std::vector<NodeId>& targetIds)
+{
+    std::vector<EdgeId> edgeIds(sourceIds.size());
+    std::iota(edgeIds.begin(), edgeIds.end(), nextEdgeId());
+
+    addEdgesBulk(edgeIds, sourceIds, targetIds);
+
+    return edgeIds;
+}
+
+void MutableGraph::addEdgesBulk(const std::vector<EdgeId>& edgeIds,
+    const std::vector<NodeId>& sourceIds, const std::vector<NodeId>& targetIds)
+{
+    Q_ASSERT(sourceIds.size() == edgeIds.size());
+    Q_ASSERT(targetIds.size() == edgeIds.size());
+
+    if(edgeIds.empty())
+        return;
+
+    beginTransaction();
+
+    reserveEdgeId(*std::max_element(edgeIds.begin(), edgeIds.end()));
+    _e._connections.reserve(_e._connections.size() + edgeIds.size());
+
+    for(size_t i = 0; i < edgeIds.size(); i++)
+    {
+        auto edgeId = edgeIds[i];
+        auto sourceId = sourceIds[i];
+        auto targetId = targetIds[i];
+
+        Q_ASSERT(!edgeId.isNull());
+        Q_ASSERT(!containsEdgeId(edgeId));
+        Q_ASSERT(_n._nodeIdsInUse[static_cast<int>(sourceId)]);
+        Q_ASSERT(_n._nodeIdsInUse[static_cast<int>(targetId)]);
+
+        claimEdgeId(edgeId);
+        auto& edge = edgeBy(edgeId);
+        edge._id = edgeId;
+        edge._sourceId = sourceId;
+        edge._targetId = targetId;
+
+        auto connectionEdgeId = _e._connections.find(sourceId, targetId);
+        _e._connections.set(sourceId, targetId, _e._mergedEdgeIds.add(connectionEdgeId, edgeId));
+    }
+
+    // Each node's set of edges only involves the entries of its own edges in the
+    // underlying collection, so the sets of different nodes can be built concurrently
+    auto addToNodes = [this, &edgeIds](const std::vector<NodeId>& nodeIds, EdgeIdDistinctSet Node::* edgeIdsOfNode)
+    {
+        // Group the edges by node, retaining their order
+        std::vector<size_t> offsets(static_cast<size_t>(static_cast<int>(nextNodeId())) + 1, 0);
+        for(auto nodeId : nodeIds)
+            offsets[static_cast<size_t>(static_cast<int>(nodeId)) + 1]++;
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<EdgeId> groupedEdgeIds(edgeIds.size());
+        auto positions = offsets;
+        for(size_t i = 0; i < edgeIds.size(); i++)
+            groupedEdgeIds[positions[static_cast<size_t>(static_cast<int>(nodeIds[i]))]++] = edgeIds[i];
+
+        std::vector<NodeId> nodeIdsWithEdges;
+        for(NodeId nodeId(0); nodeId < nextNodeId(); ++nodeId)
+        {
+            auto index = static_cast<size_t>(static_cast<int>(nodeId));
+            if(offsets[index + 1] > offsets[index])
+                nodeIdsWithEdges.push_back(nodeId);
+        }
+
+        parallel_for(nodeIdsWithEdges.begin(), nodeIdsWithEdges.end(),
+        [&](NodeId nodeId)
+        {
+            auto index = static_cast<size_t>(static_cast<int>(nodeId));
+            auto& edgeIdSet = nodeBy(nodeId).*edgeIdsOfNode;
+
+            for(auto i = offsets[index]; i < offsets[index + 1]; i++)
+                edgeIdSet.add(groupedEdgeIds[i]);
+        });
+    };
+
+    addToNodes(sourceIds, &Node::_outEdgeIds);
+    addToNodes(targetIds, &Node::_inEdgeIds);
+
+    invalidateAdjacencySnapshot();
+
+    emit edgesAdded(this, edgeIds);
+    _updateRequired = true;
+    endTransaction();
+}
+
 void MutableGraph::removeEdge(EdgeId edgeId)
 {
     Q_ASSERT(containsEdgeId(edgeId));
@@ -423,16 +574,14 @@ void MutableGraph::removeEdge(EdgeId edgeId)
     nodeBy(edge.sourceId())._outEdgeIds.remove(edgeId);
     nodeBy(edge.targetId())._inEdgeIds.remove(edgeId);
 
-    auto undirectedEdge = UndirectedEdge(edge.sourceId(), edge.targetId());
-    auto& connection = _e._connections[undirectedEdge];
-    Q_ASSERT(!connection.empty());
-    connection.remove(edgeId);
-
-    if(connection.empty())
-        _e._connections.erase(undirectedEdge);
+    auto connectionEdgeId = _e._connections.find(edge.sourceId(), edge.targetId());
+    Q_ASSERT(!connectionEdgeId.isNull());
+    _e._connections.set(edge.sourceId(), edge.targetId(),
+        _e._mergedEdgeIds.remove(connectionEdgeId, edgeId));
 
     releaseEdgeId(edgeId);
     _unusedEdgeIds.push_back(edgeId);
+    invalidateAdjacencySnapshot();
 
     emit edgeRemoved(this, edgeId);
     _updateRequired = true;
@@ -550,15 +699,14 @@ MutableGraph& MutableGraph::clone(const MutableGraph& other)
         node._outEdgeIds.setCollection(&_e._outEdgeIdsCollection);
     }
 
-    for(auto& connection : _e._connections)
-        connection.second.setCollection(&_e._mergedEdgeIds);
+    invalidateAdjacencySnapshot();
 
     // Signal all the changes based on the diff before we cloned
-    for(NodeId nodeId : diff._nodesAdded)
-        emit nodeAdded(this, nodeId);
+    if(!diff._nodesAdded.empty())
+        emit nodesAdded(this, diff._nodesAdded);
 
-    for(EdgeId edgeId : diff._edgesAdded)
-        emit edgeAdded(this, edgeId);
+    if(!diff._edgesAdded.empty())
+        emit edgesAdded(this, diff._edgesAdded);
 
     for(EdgeId edgeId : diff._edgesRemoved)
         emit edgeRemoved(this, edgeId);
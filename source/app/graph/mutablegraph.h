@@ -20,14 +20,14 @@
 #define MUTABLEGRAPH_H
 
 #include "graph.h"
+#include "edgeconnectionindex.h"
 
 #include "shared/graph/imutablegraph.h"
-#include "shared/graph/undirectededge.h"
 
 #include <deque>
 #include <mutex>
 #include <vector>
-#include <map>
+#include <memory>
 
 class MutableGraph : public Graph, public virtual IMutableGraph
 {
@@ -77,7 +77,9 @@ private:
         EdgeIdDistinctSetCollection _inEdgeIdsCollection;
         EdgeIdDistinctSetCollection _outEdgeIdsCollection;
 
-        std::map<UndirectedEdge, EdgeIdDistinctSet> _connections;
+        // The edges that connect each pair of nodes form a set in _mergedEdgeIds,
+        // the head of which is indexed here
+        EdgeConnectionIndex _connections;
 
         void resize(std::size_t size)
         {
@@ -106,6 +108,10 @@ private:
 
     bool _updateRequired = false;
 
+    mutable std::mutex _adjacencySnapshotMutex;
+    mutable std::shared_ptr<const AdjacencySnapshot> _adjacencySnapshot;
+    void invalidateAdjacencySnapshot();
+
     Node& nodeBy(NodeId nodeId);
     const Node& nodeBy(NodeId nodeId) const;
     void claimNodeId(NodeId nodeId);
@@ -143,6 +149,8 @@ public:
     NodeId addNode() override;
     NodeId addNode(NodeId nodeId) override;
     NodeId addNode(const INode& node) override;
+    std::vector<NodeId> addNodesBulk(size_t numNodes) override;
+    void addNodesBulk(const std::vector<NodeId>& nodeIds) override;
     void removeNode(NodeId nodeId) override;
 
     const std::vector<EdgeId>& edgeIds() const override;
@@ -156,6 +164,8 @@ public:
     EdgeIdDistinctSet inEdgeIdsForNodeId(NodeId nodeId) const;
     EdgeIdDistinctSet outEdgeIdsForNodeId(NodeId nodeId) const;
 
+    std::shared_ptr<const AdjacencySnapshot> adjacencySnapshot() const override;
+
     template<typename C> EdgeIdDistinctSets inEdgeIdsForNodeIds(const C& nodeIds) const
     {
         EdgeIdDistinctSets set;
@@ -181,6 +191,10 @@ public:
     EdgeId addEdge(NodeId sourceId, NodeId targetId) override;
     EdgeId addEdge(EdgeId edgeId, NodeId sourceId, NodeId targetId) override;
     EdgeId addEdge(const IEdge& edge) override;
+    std::vector<EdgeId> addEdgesBulk(const std::vector<NodeId>& sourceIds,
+        const std::vector<NodeId>& targetIds) override;
+    void addEdgesBulk(const std::vector<EdgeId>& edgeIds,
+        const std::vector<NodeId>& sourceIds, const std::vector<NodeId>& targetIds) override;
     void removeEdge(EdgeId edgeId) override;
 
     void contractEdge(EdgeId edgeId) override;
@@ -188,23 +202,6 @@ public:
 
     MutableGraph& operator=(const MutableGraph& other);
 
-    struct Diff
-    {
-        std::vector<NodeId> _nodesAdded;
-        std::vector<NodeId> _nodesRemoved;
-        std::vector<EdgeId> _edgesAdded;
-        std::vector<EdgeId> _edgesRemoved;
-
-        bool empty() const
-        {
-            return
-                _nodesAdded.empty() &&
-                _nodesRemoved.empty() &&
-                _edgesAdded.empty() &&
-                _edgesRemoved.empty();
-        }
-    };
-
     Diff diffTo(const MutableGraph& other);
 
     bool update() override;
@@ -20,38 +20,30 @@
 #define BARNESHUTTREE_H
 
 #include "spatialtree.h"
-#include "shared/utils/fixedsizestack.h"
 
 #include <QVector3D>
 
-#include <functional>
+#include <array>
 
-class AbstractBarnesHutTree : virtual public AbstractSpatialTree
+struct BarnesHutNode : SpatialTreeNode
 {
-public:
-    virtual QVector3D evaluateKernel(const NodeLayoutPositions& nodePositions, NodeId nodeId,
-        const std::function<QVector3D(int, const QVector3D&, float)>& kernel) const = 0;
+    QVector3D _centreOfMass;
+    int _mass = 0;
+    float _sSq = 0.0f;
 };
 
 template<size_t NumDimensions>
-class BarnesHutTree;
-
-template<size_t NumDimensions>
-struct BarnesHutSubVolume : SubVolume<BarnesHutTree<NumDimensions>, NumDimensions> { float _sSq = 0.0f; };
-
-template<size_t NumDimensions>
-class BarnesHutTree :
-    public SpatialTree<BarnesHutTree<NumDimensions>, NumDimensions, BarnesHutSubVolume<NumDimensions>>,
-    public AbstractBarnesHutTree
+class BarnesHutTree : public SpatialTree<NumDimensions, BarnesHutNode>
 {
 private:
     static constexpr float E = 0.0001f;
     static constexpr float E2 = E * E;
 
     // Cycle through different epsilon vectors so that there is enough
-    // variation that the forces don't get stuck in 2 or fewer dimensions
-    mutable size_t _di = 0;
-    QVector3D differenceEpsilon() const
+    // variation that the forces don't get stuck in 2 or fewer dimensions;
+    // the cycle position is per evaluation, so that concurrent evaluations
+    // don't share state and each result is reproducible
+    static QVector3D differenceEpsilon(size_t& di)
     {
         if constexpr(NumDimensions == 3)
         {
@@ -65,8 +57,8 @@ private:
                 {0.0f, 0.0f,   -E},
             }};
 
-            _di = (_di + 1) % vs.size();
-            return vs.at(_di);
+            di = (di + 1) % vs.size();
+            return vs.at(di);
         }
         else if constexpr(NumDimensions == 2)
         {
@@ -78,87 +70,118 @@ private:
                 {0.0f,   -E, 0.0f},
             }};
 
-            _di = (_di + 1) % vs.size();
-            return vs.at(_di);
+            di = (di + 1) % vs.size();
+            return vs.at(di);
         }
     }
 
     float _theta = 0.8f;
-    int _mass = 0;
-    QVector3D _centreOfMass;
 
-    void initialise(const NodeLayoutPositions& nodePositions, const std::vector<NodeId>& nodeIds) override
+    // The nodes are in depth first order, so visiting them in
+    // reverse finds the centres of mass of children before parents
+    void initialiseNodes()
     {
-        _mass = static_cast<int>(nodeIds.size());
-        _centreOfMass = nodePositions.centreOfMass(nodeIds);
+        auto& nodes = this->_nodes;
 
-        for(auto& subVolume : this->_subVolumes)
-            subVolume._sSq = subVolume._boundingBox.maxLength() * subVolume._boundingBox.maxLength();
+        for(auto n = nodes.size(); n-- > 0;)
+        {
+            auto& node = nodes[n];
+            QVector3D sum;
+
+            if(node._leaf)
+            {
+                for(auto point = node._first; point < node._last; point++)
+                    sum += this->_positions[point];
+            }
+            else
+            {
+                for(auto child = n + 1; child < node._next; child = nodes[child]._next)
+                    sum += nodes[child]._centreOfMass * static_cast<float>(nodes[child]._mass);
+            }
+
+            node._mass = static_cast<int>(node._last - node._first);
+            node._centreOfMass = sum / static_cast<float>(node._mass);
+
+            const auto maxLength = this->maxLengthAtLevel(node._level);
+            node._sSq = maxLength * maxLength;
+        }
     }
 
 public:
     BarnesHutTree()
     {
-        this->setMaxNodesPerLeaf(1);
+        this->setMaxPointsPerLeaf(1);
     }
 
     void setTheta(float theta) { _theta = theta; }
 
-    QVector3D evaluateKernel(const NodeLayoutPositions& nodePositions, NodeId nodeId,
-        const std::function<QVector3D(int, const QVector3D&, float)>& kernel) const override
+    template<typename PositionFn>
+    void build(size_t numPoints, const PositionFn& positionFn)
     {
-        const QVector3D& nodePosition = nodePositions.get(nodeId);
-        QVector3D result;
-        FixedSizeStack<const BarnesHutTree*> stack(this->_depthFirstTraversalStackSizeRequirement);
+        SpatialTree<NumDimensions, BarnesHutNode>::build(numPoints, positionFn);
+        initialiseNodes();
+    }
 
-        stack.push(this);
+    // Returns the sum of kernel(mass, difference, distanceSq) over the other points, where
+    // distant groups of points are approximated by their total mass and centre of mass; the
+    // kernel is a template parameter so that it can be inlined into the traversal
+    template<typename Kernel>
+    QVector3D evaluateKernel(size_t index, const Kernel& kernel) const
+    {
+        const auto& nodes = this->_nodes;
+        const auto rank = this->_ranks[index];
+        const QVector3D& position = this->_positions[rank];
 
-        while(!stack.empty())
-        {
-            const BarnesHutTree* subTree = stack.pop();
+        QVector3D result;
+        auto di = index;
 
-            for(int i = 0; i < subTree->_numInternalNodes; i++)
-            {
-                auto subVolume = subTree->_internalNodes.at(i);
+        for(size_t n = 0; n < nodes.size();)
+        {
+            const auto& node = nodes[n];
+            const bool containsPoint = node.contains(rank);
 
-                const QVector3D& centreOfMass = subVolume->_subTree->_centreOfMass;
-                QVector3D difference = (centreOfMass - nodePosition);
-                float distanceSq = difference.lengthSquared();
+            auto mass = node._mass;
+            QVector3D centreOfMass = node._centreOfMass;
 
-                if(distanceSq == 0.0f)
+            if(containsPoint)
+            {
+                if(!node._leaf)
                 {
-                    difference = differenceEpsilon();
-                    distanceSq = E2;
+                    // Never approximate a subvolume that contains the point itself
+                    n++;
+                    continue;
                 }
 
-                const float sOverD = subVolume->_sSq / distanceSq;
+                // Only possible when the leaf's points are indistinguishable
+                // from each other, in which case the point is removed from it
+                mass--;
+                if(mass == 0)
+                {
+                    n = node._next;
+                    continue;
+                }
 
-                if(sOverD > _theta)
-                    stack.push(subVolume->_subTree.get());
-                else
-                    result += kernel(subVolume->_subTree->_mass, difference, distanceSq);
+                centreOfMass = ((centreOfMass * static_cast<float>(node._mass)) - position) /
+                    static_cast<float>(mass);
             }
 
-            for(int i = 0; i < subTree->_numNonEmptyLeaves; i++)
-            {
-                auto subVolume = subTree->_nonEmptyLeaves.at(i);
+            QVector3D difference = centreOfMass - position;
+            float distanceSq = difference.lengthSquared();
 
-                NodeId otherNodeId = subVolume->_nodeIds.front();
-                if(otherNodeId != nodeId)
-                {
-                    const QVector3D& otherNodePosition = nodePositions.get(otherNodeId);
-                    QVector3D difference = otherNodePosition - nodePosition;
-                    float distanceSq = difference.lengthSquared();
-
-                    if(distanceSq == 0.0f)
-                    {
-                        difference = differenceEpsilon();
-                        distanceSq = E2;
-                    }
+            if(distanceSq == 0.0f)
+            {
+                difference = differenceEpsilon(di);
+                distanceSq = E2;
+            }
 
-                    result += kernel(1, difference, distanceSq);
-                }
+            if(!node._leaf && node._sSq / distanceSq > _theta)
+            {
+                n++;
+                continue;
             }
+
+            result += kernel(mass, difference, distanceSq);
+            n = node._next;
         }
 
         return result;
@@ -18,7 +18,6 @@
 
 #include "forcedirectedlayout.h"
 #include "fastinitiallayout.h"
-#include "barneshuttree.h"
 
 #include "graph/graph.h"
 #include "graph/graphmodel.h"
@@ -27,7 +26,9 @@
 #include "shared/utils/preferences.h"
 #include "shared/utils/scopetimer.h"
 
+#include <algorithm>
 #include <cmath>
+#include <iterator>
 
 template<typename T> float meanWeightedAvgBuffer(int start, int end, const T& buffer)
 {
@@ -53,14 +54,9 @@ static QVector3D normalized(const QVector3D& v)
     return {};
 }
 
-void ForceDirectedDisplacement::computeAndDamp()
+float ForceDirectedDisplacement::computeAndDamp(QVector3D& next)
 {
-    _next = _repulsive + _attractive;
-    _nextLength = _next.length();
-
-    // Reset for next iteration
-    _repulsive = {};
-    _attractive = {};
+    float nextLength = next.length();
 
     // The following computation encouragements movements where the
     // direction is constant and discourages movements when it changes
@@ -68,138 +64,231 @@ void ForceDirectedDisplacement::computeAndDamp()
     const float MAX_DISPLACEMENT = 10.0f;
 
     // Filter large displacements that can induce instability
-    if(_nextLength > MAX_DISPLACEMENT)
+    if(nextLength > MAX_DISPLACEMENT)
     {
-        _nextLength = MAX_DISPLACEMENT;
-        _next = normalized(_next) * _nextLength;
+        nextLength = MAX_DISPLACEMENT;
+        next = normalized(next) * nextLength;
     }
 
-    if(_previousLength > 0.0f && _nextLength > 0.0f)
+    if(_previousLength > 0.0f && nextLength > 0.0f)
     {
-        const float dotProduct = QVector3D::dotProduct(_previous / _previousLength, _next / _nextLength);
+        const float dotProduct = QVector3D::dotProduct(_previous / _previousLength, next / nextLength);
 
         // http://www.wolframalpha.com/input/?i=plot+0.5x%5E2%2B1.2x%2B1+from+x%3D-1to1
         const float f = (0.5f * dotProduct * dotProduct) + (1.2f * dotProduct) + 1.0f;
 
-        if(_nextLength > (_previousLength * f))
+        if(nextLength > (_previousLength * f))
         {
-            const float r = _previousLength / _nextLength;
-            _next *= (f * r);
+            const float r = _previousLength / nextLength;
+            next *= (f * r);
         }
     }
 
-    _previous = _next;
+    _previous = next;
     _previousLength = _previous.length();
+
+    return nextLength;
 }
 
 // This is a fairly arbitrary function that was arrived at through experimentation. The parameters
 // shortRange and longRange affect the emphasis that the result places on local forces and global
 // forces, respectively.
-static float repulse(const float distanceSq, const float shortRange, const float longRange)
+float ForceDirectedLayout::repulse(const float distanceSq, const float shortRange, const float longRange)
 {
     return ((distanceSq * distanceSq * longRange) + shortRange) /
         ((distanceSq * distanceSq * distanceSq) + 0.0001f);
 }
 
+ForceDirectedLayout::ForceDirectedLayout(const Graph& graph,
+    const IGraphComponent& graphComponent, ForceDirectedDisplacements& displacements,
+    NodeLayoutPositions& positions, Layout::Dimensionality dimensionalityMode,
+    const LayoutSettings* settings, bool deterministic) :
+    Layout(graphComponent, positions, settings, Iterative::Yes,
+        Dimensionality::TwoOrThreeDee, 0.4f, 4),
+    _graph(&graph),
+    _displacements(&displacements),
+    _deterministic(deterministic),
+    _hasBeenFlattened(dimensionalityMode == Layout::Dimensionality::TwoDee)
+{
+    // Layouts come and go with their components, so the connection must go with them
+    connect(&graph, &Graph::graphChanged, this, [this] { _adjacencyChanged = true; }, Qt::DirectConnection);
+}
+
+void ForceDirectedLayout::updateAdjacency()
+{
+    if(!_adjacencyChanged.exchange(false) && _adjacency != nullptr)
+        return;
+
+    auto componentNodeIds = nodeIds();
+
+    // The order of a component's nodes depends on how it came to be, so
+    // impose one that depends only on the nodes themselves
+    if(_deterministic)
+        std::sort(componentNodeIds.begin(), componentNodeIds.end());
+
+    _adjacency = std::make_unique<AdjacencySnapshot>(*_graph, componentNodeIds);
+
+    const auto numNodes = static_cast<size_t>(_adjacency->numNodes());
+    _positions.resize(numNodes);
+    _repulsive.resize(numNodes);
+    _attractive.resize(numNodes);
+    _displacementLengths.resize(numNodes);
+}
+
+// Each node gathers the forces from its own neighbours, meaning no two threads
+// ever write to the same node, and the order of summation is always the same
+void ForceDirectedLayout::computeAttractiveForces()
+{
+    const auto& layoutNodeIds = _adjacency->nodeIds();
+    const auto* offsets = _adjacency->offsets().data();
+    const auto* neighbours = _adjacency->neighbourIndices().data();
+    const auto* x = _positions._x.data();
+    const auto* y = _positions._y.data();
+    const auto* z = _positions._z.data();
+
+    parallel_for(layoutNodeIds.begin(), layoutNodeIds.end(),
+    [&, first = layoutNodeIds.begin()](std::vector<NodeId>::const_iterator it)
+    {
+        if(cancelled())
+            return;
+
+        const auto i = static_cast<size_t>(std::distance(first, it));
+        float ax = 0.0f;
+        float ay = 0.0f;
+        float az = 0.0f;
+
+        for(auto o = offsets[i]; o < offsets[i + 1]; o++)
+        {
+            const auto j = static_cast<size_t>(neighbours[o]);
+
+            // Loops exert no force
+            if(j == i)
+                continue;
+
+            const float dx = x[j] - x[i];
+            const float dy = y[j] - y[i];
+            const float dz = z[j] - z[i];
+            const float force = attract((dx * dx) + (dy * dy) + (dz * dz));
+
+            ax += force * dx;
+            ay += force * dy;
+            az += force * dz;
+        }
+
+        _attractive._x[i] = ax;
+        _attractive._y[i] = ay;
+        _attractive._z[i] = az;
+    });
+}
+
+void ForceDirectedLayout::initialLayout(Dimensionality dimensionality)
+{
+    FastInitialLayout fastInitialLayout(graphComponent(), positions());
+    fastInitialLayout.execute(true, dimensionality);
+}
+
 void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensionality)
 {
     SCOPE_TIMER_MULTISAMPLES(50)
 
     if(firstIteration)
     {
-        FastInitialLayout initialLayout(graphComponent(), positions());
-        initialLayout.execute(firstIteration, dimensionality);
+        initialLayout(dimensionality);
 
         for(NodeId nodeId : nodeIds())
             _displacements->at(nodeId)._previous = {};
     }
 
-    std::unique_ptr<AbstractBarnesHutTree> barnesHutTree;
+    updateAdjacency();
+
+    const bool threeDee = dimensionality == Dimensionality::ThreeDee;
 
-    if(dimensionality == Dimensionality::ThreeDee)
+    if(threeDee && _hasBeenFlattened)
     {
-        if(_hasBeenFlattened)
+        // If we're in 3D mode but have previously been in 2D mode,
+        // then all of the nodes will have 0 for their Z coordinate,
+        // meaning there is no mathematical way for forces to be
+        // computed along the Z-axis, so to mitigate this we jiggle
+        // the Z coordinate up and down a small amount in order to
+        // force the nodes out of the XY-plane
+        float jiggle = 0.1f;
+        for(auto nodeId : _adjacency->nodeIds())
         {
-            // If we're in 3D mode but have previously been in 2D mode,
-            // then all of the nodes will have 0 for their Z coordinate,
-            // meaning there is no mathematical way for forces to be
-            // computed along the Z-axis, so to mitigate this we jiggle
-            // the Z coordinate up and down a small amount in order to
-            // force the nodes out of the XY-plane
-            float jiggle = 0.1f;
-            for(auto nodeId : graphComponent().nodeIds())
-            {
-                auto position = positions().get(nodeId);
-                position.setZ(jiggle);
-                positions().set(nodeId, position);
-
-                jiggle = -jiggle;
-            }
-
-            _hasBeenFlattened = false;
+            auto position = positions().get(nodeId);
+            position.setZ(jiggle);
+            positions().set(nodeId, position);
+
+            jiggle = -jiggle;
         }
 
-        barnesHutTree = std::make_unique<BarnesHutTree3D>();
+        _hasBeenFlattened = false;
     }
-    else if(dimensionality == Dimensionality::TwoDee)
-    {
+    else if(!threeDee)
         _hasBeenFlattened = true;
-        barnesHutTree = std::make_unique<BarnesHutTree2D>();
-    }
 
-    barnesHutTree->build(graphComponent(), positions());
+    const auto& layoutNodeIds = _adjacency->nodeIds();
+    const auto numNodes = layoutNodeIds.size();
+
+    for(size_t i = 0; i < numNodes; i++)
+        _positions.set(i, positions().get(layoutNodeIds[i]));
+
+    auto positionAt = [this](size_t i) { return _positions.at(i); };
+
+    if(threeDee)
+        _barnesHutTree3D.build(numNodes, positionAt);
+    else
+        _barnesHutTree2D.build(numNodes, positionAt);
 
     const float SHORT_RANGE = _settings->value(QStringLiteral("ShortRangeRepulseTerm"));
     const float LONG_RANGE = 0.01f + _settings->value(QStringLiteral("LongRangeRepulseTerm"));
 
-    // Repulsive forces
-    auto repulsiveResults = parallel_for(nodeIds().begin(), nodeIds().end(),
-    [this, &barnesHutTree, SHORT_RANGE, LONG_RANGE](NodeId nodeId)
+    auto repulsionKernel = [SHORT_RANGE, LONG_RANGE](int mass, const QVector3D& difference, float distanceSq)
+    {
+        return difference * (static_cast<float>(mass) * repulse(distanceSq, SHORT_RANGE, LONG_RANGE));
+    };
+
+    // Repulsive forces; nodes are visited in the tree's spatially coherent
+    // order, so that consecutive evaluations traverse similar parts of it
+    const auto& treeOrder = threeDee ? _barnesHutTree3D.order() : _barnesHutTree2D.order();
+    auto repulsiveResults = parallel_for(treeOrder.begin(), treeOrder.end(),
+    [this, threeDee, repulsionKernel](size_t i)
     {
         if(cancelled())
             return;
 
-        _displacements->at(nodeId)._repulsive -= barnesHutTree->evaluateKernel(positions(), nodeId,
-        [SHORT_RANGE, LONG_RANGE](int mass, const QVector3D& difference, float distanceSq)
-        {
-            return difference * (static_cast<float>(mass) * repulse(distanceSq, SHORT_RANGE, LONG_RANGE));
-        });
+        _repulsive.set(i, -(threeDee ?
+            _barnesHutTree3D.evaluateKernel(i, repulsionKernel) :
+            _barnesHutTree2D.evaluateKernel(i, repulsionKernel)));
     }, ThreadPool::NonBlocking);
 
     // Attractive forces
-    auto attractiveResults = parallel_for(edgeIds().begin(), edgeIds().end(),
-    [this](EdgeId edgeId)
-    {
-        if(cancelled())
-            return;
-
-        const IEdge& edge = graphComponent().graph().edgeById(edgeId);
-        if(!edge.isLoop())
-        {
-            const QVector3D difference = positions().get(edge.targetId()) - positions().get(edge.sourceId());
-            float distanceSq = difference.lengthSquared();
-            const float force = distanceSq * 0.001f;
-
-            _displacements->at(edge.targetId())._attractive -= (force * difference);
-            _displacements->at(edge.sourceId())._attractive += (force * difference);
-        }
-    }, ThreadPool::NonBlocking);
+    computeAttractiveForces();
 
     repulsiveResults.wait();
-    attractiveResults.wait();
 
     if(cancelled())
         return;
 
-    parallel_for(nodeIds().begin(), nodeIds().end(),
-    [this](NodeId nodeId)
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        _repulsive._x[i] += _attractive._x[i];
+        _repulsive._y[i] += _attractive._y[i];
+        _repulsive._z[i] += _attractive._z[i];
+    }
+
+    parallel_for(layoutNodeIds.begin(), layoutNodeIds.end(),
+    [this, first = layoutNodeIds.begin()](std::vector<NodeId>::const_iterator it)
     {
-        _displacements->at(nodeId).computeAndDamp();
+        const auto i = static_cast<size_t>(std::distance(first, it));
+
+        auto displacement = _repulsive.at(i);
+        _displacementLengths[i] = _displacements->at(*it).computeAndDamp(displacement);
+        _repulsive.set(i, displacement);
     });
 
     // Apply the forces
-    for(auto nodeId : nodeIds())
-        positions().set(nodeId, positions().get(nodeId) + _displacements->at(nodeId)._next);
+    for(size_t i = 0; i < numNodes; i++)
+        positions().set(layoutNodeIds[i], _positions.at(i) + _repulsive.at(i));
 
     // There are three main phases which decide when to stop the layout.
     // The phases operate primarily on the stddev of the forces within the graph
@@ -218,20 +307,20 @@ void ForceDirectedLayout::execute(bool firstIteration, Dimensionality dimensiona
 
     // Calculate force averages
     float deltaForceTotal = 0.0f;
-    for(auto nodeId : nodeIds())
-        deltaForceTotal += _displacements->at(nodeId)._nextLength;
+    for(auto displacementLength : _displacementLengths)
+        deltaForceTotal += displacementLength;
 
-    _forceMean = deltaForceTotal / static_cast<float>(nodeIds().size());
+    _forceMean = deltaForceTotal / static_cast<float>(numNodes);
 
     // Calculate Standard Deviation
     float variance = 0.0f;
-    for(auto nodeId : nodeIds())
+    for(auto displacementLength : _displacementLengths)
     {
-        float d = _displacements->at(nodeId)._nextLength - _forceMean;
+        float d = displacementLength - _forceMean;
         variance += (d * d);
     }
 
-    _forceStdDeviation = std::sqrt(variance / static_cast<float>(nodeIds().size()));
+    _forceStdDeviation = std::sqrt(variance / static_cast<float>(numNodes));
     switch(_changeDetectionPhase)
     {
         case ChangeDetectionPhase::Initial:
@@ -362,7 +451,9 @@ ForceDirectedLayoutFactory::ForceDirectedLayoutFactory(GraphModel* graphModel) :
 std::unique_ptr<Layout> ForceDirectedLayoutFactory::create(ComponentId componentId,
     NodeLayoutPositions& nodePositions, Layout::Dimensionality dimensionalityMode)
 {
-    const auto* component = _graphModel->graph().componentById(componentId);
-    return std::make_unique<ForceDirectedLayout>(*component, _displacements,
-        nodePositions, dimensionalityMode, &_layoutSettings);
+    const auto& graph = _graphModel->graph();
+    const auto* component = graph.componentById(componentId);
+    return std::make_unique<ForceDirectedLayout>(graph, *component, _displacements,
+        nodePositions, dimensionalityMode, &_layoutSettings,
+        u::pref(QStringLiteral("misc/deterministicLayout")).toBool());
 }
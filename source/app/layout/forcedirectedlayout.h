@@ -20,28 +20,57 @@
 #define FORCEDIRECTEDLAYOUT_H
 
 #include "layout.h"
+#include "barneshuttree.h"
 #include "graph/componentmanager.h"
+#include "graph/adjacencysnapshot.h"
 #include "shared/utils/circularbuffer.h"
 
 #include <QVector3D>
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
+class Graph;
+
+// The displacement state that persists between iterations, and layouts
 struct ForceDirectedDisplacement
 {
-    QVector3D _repulsive;
-    QVector3D _attractive;
-
     QVector3D _previous;
-    QVector3D _next;
     float _previousLength = 0.0f;
-    float _nextLength = 0.0f;
 
-    void computeAndDamp();
+    // Damps next with respect to the previous displacement, which it then
+    // replaces; returns the length of next prior to damping
+    float computeAndDamp(QVector3D& next);
 };
 
 using ForceDirectedDisplacements = NodeArray<ForceDirectedDisplacement>;
 
+// Vectors stored as a structure of arrays, so that the per iteration loops
+// over them touch contiguous memory and are amenable to vectorisation
+struct ForceDirectedVectors
+{
+    std::vector<float> _x;
+    std::vector<float> _y;
+    std::vector<float> _z;
+
+    void resize(size_t size)
+    {
+        _x.resize(size);
+        _y.resize(size);
+        _z.resize(size);
+    }
+
+    QVector3D at(size_t index) const { return {_x[index], _y[index], _z[index]}; }
+
+    void set(size_t index, const QVector3D& v)
+    {
+        _x[index] = v.x();
+        _y[index] = v.y();
+        _z[index] = v.z();
+    }
+};
+
 class ForceDirectedLayout : public Layout
 {
     Q_OBJECT
@@ -65,8 +94,23 @@ private:
 
     ChangeDetectionPhase _changeDetectionPhase = ChangeDetectionPhase::Initial;
 
+    const Graph* _graph;
     ForceDirectedDisplacements* _displacements;
 
+    // Component local adjacency; the vectors below are indexed in its terms
+    std::unique_ptr<AdjacencySnapshot> _adjacency;
+    std::atomic<bool> _adjacencyChanged = true;
+    bool _deterministic = false;
+
+    ForceDirectedVectors _positions;
+    ForceDirectedVectors _repulsive;
+    ForceDirectedVectors _attractive;
+    std::vector<float> _displacementLengths;
+
+    // Rebuilt every iteration, but kept so that their storage is reused
+    BarnesHutTree2D _barnesHutTree2D;
+    BarnesHutTree3D _barnesHutTree3D;
+
     float _forceStdDeviation = 0;
     float _forceMean = 0;
     float _prevUnstableStdDev = 0;
@@ -81,28 +125,40 @@ private:
     void initialChangeDetection();
     void finishChangeDetection();
 
+    void updateAdjacency();
+    void computeAttractiveForces();
+
+protected:
+    const Graph& graph() const { return *_graph; }
+
+    // Places the nodes before the first iteration
+    virtual void initialLayout(Dimensionality dimensionality);
+
 public:
-    ForceDirectedLayout(const IGraphComponent& graphComponent,
+    // When deterministic is set, the result for a given graph and starting
+    // positions does not depend on the history of the component's node order
+    ForceDirectedLayout(const Graph& graph,
+                        const IGraphComponent& graphComponent,
                         ForceDirectedDisplacements& displacements,
                         NodeLayoutPositions& positions,
                         Layout::Dimensionality dimensionalityMode,
-                        const LayoutSettings* settings) :
-        Layout(graphComponent, positions, settings, Iterative::Yes,
-            Dimensionality::TwoOrThreeDee, 0.4f, 4),
-        _displacements(&displacements),
-        _hasBeenFlattened(dimensionalityMode == Layout::Dimensionality::TwoDee)
-    {}
+                        const LayoutSettings* settings,
+                        bool deterministic = false);
 
     bool finished() const override { return _changeDetectionPhase == ChangeDetectionPhase::Finished; }
     void unfinish() override;
 
     void execute(bool firstIteration, Dimensionality dimensionality) override;
+
+    // The magnitudes of the forces between two nodes, per unit of the difference between them
+    static float repulse(float distanceSq, float shortRange, float longRange);
+    static float attract(float distanceSq) { return distanceSq * 0.001f; }
 };
 
 class ForceDirectedLayoutFactory : public LayoutFactory
 {
-private:
-    ForceDirectedDisplacements _displacements;
+protected:
+    ForceDirectedDisplacements _displacements; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
 
 public:
     explicit ForceDirectedLayoutFactory(GraphModel* graphModel);
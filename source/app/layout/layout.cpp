@@ -19,6 +19,7 @@
 #include "layout.h"
 #include "shared/utils/thread.h"
 #include "shared/utils/container.h"
+#include "shared/utils/threadpool.h"
 
 #include "graph/graph.h"
 #include "graph/graphmodel.h"
@@ -26,8 +27,15 @@
 
 #include <QDebug>
 
+#include <vector>
+#include <optional>
+
 template<> constexpr bool EnableBitMaskOperators<Layout::Dimensionality> = true;
 
+// Components with fewer nodes than this are laid out in batches of at least this many nodes
+static const int MAX_SMALL_COMPONENT_NUM_NODES = 1000;
+static const int SMALL_COMPONENT_BATCH_NUM_NODES = 1000;
+
 static bool layoutIsFinished(const Layout& layout)
 {
     return layout.finished() || layout.graphComponent().numNodes() == 1;
@@ -205,30 +213,90 @@ bool LayoutThread::workToDo() const
     return _layoutPotentiallyRequired || !allLayoutsFinished();
 }
 
-void LayoutThread::run()
+void LayoutThread::executeLayouts()
 {
-    emit pausedChanged();
+    struct Execution
+    {
+        Layout* _layout;
+        bool _firstIteration;
+    };
 
-    do
+    std::vector<Execution> smallExecutions;
+    std::vector<Execution> largeExecutions;
+    bool flatten = false;
+
+    for(auto& [componentId, layout] : _layouts)
     {
-        u::setCurrentThreadName(QStringLiteral("Layout >"));
+        if(layoutIsFinished(*layout))
+            continue;
 
-        for(auto& [componentId, layout] : _layouts)
+        // If we're in 2D mode and the layout can handle it, flatten the positions
+        if(_dimensionalityMode == Layout::Dimensionality::TwoDee &&
+           (layout->dimensionality() & _dimensionalityMode))
         {
-            if(layoutIsFinished(*layout))
-                continue;
+            flatten = true;
+        }
 
-            if(_dimensionalityMode == Layout::Dimensionality::TwoDee &&
-               (layout->dimensionality() & _dimensionalityMode))
-            {
-                // If we're in 2D mode and the layout can handle it, flatten the positions
-                _nodeLayoutPositions.flatten();
-            }
+        Execution execution{layout.get(), !_executedAtLeastOnce.get(componentId)};
+        _executedAtLeastOnce.set(componentId, true);
 
-            layout->execute(!_executedAtLeastOnce.get(componentId), _dimensionalityMode);
-            _executedAtLeastOnce.set(componentId, true);
+        if(layout->graphComponent().numNodes() < MAX_SMALL_COMPONENT_NUM_NODES)
+            smallExecutions.push_back(execution);
+        else
+            largeExecutions.push_back(execution);
+    }
+
+    if(flatten)
+        _nodeLayoutPositions.flatten();
+
+    // Small components are batched such that each pool task lays out a number of them,
+    // one after another, with their own loops executing serially; scheduling the loops
+    // of each component on the pool would otherwise cost more than the layout itself
+    std::vector<std::vector<Execution>> batches;
+    int batchNumNodes = 0;
+    for(const auto& execution : smallExecutions)
+    {
+        if(batches.empty() || batchNumNodes >= SMALL_COMPONENT_BATCH_NUM_NODES)
+        {
+            batches.emplace_back();
+            batchNumNodes = 0;
         }
 
+        batches.back().push_back(execution);
+        batchNumNodes += execution._layout->graphComponent().numNodes();
+    }
+
+    auto dimensionalityMode = _dimensionalityMode;
+    auto executeBatch = [dimensionalityMode](const std::vector<Execution>& batch)
+    {
+        ThreadPool::SerialScope serialScope;
+
+        for(const auto& execution : batch)
+            execution._layout->execute(execution._firstIteration, dimensionalityMode);
+    };
+
+    std::optional<ThreadPool::Results<decltype(batches.cbegin()), decltype(executeBatch)>> batchResults;
+    if(!batches.empty())
+        batchResults = parallel_for(batches.cbegin(), batches.cend(), executeBatch, ThreadPool::NonBlocking);
+
+    // Meanwhile, large components are laid out in turn, each in parallel with itself
+    for(const auto& execution : largeExecutions)
+        execution._layout->execute(execution._firstIteration, _dimensionalityMode);
+
+    if(batchResults)
+        batchResults->wait();
+}
+
+void LayoutThread::run()
+{
+    emit pausedChanged();
+
+    do
+    {
+        u::setCurrentThreadName(QStringLiteral("Layout >"));
+
+        executeLayouts();
+
         {
             std::unique_lock<NodePositions> lock(_graphModel->nodePositions());
             _graphModel->nodePositions().update(_nodeLayoutPositions);
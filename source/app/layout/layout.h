@@ -246,6 +246,7 @@ private:
     bool workToDo() const;
     void uncancel();
     void unfinish();
+    void executeLayouts();
     void run();
 
     void addComponent(ComponentId componentId);
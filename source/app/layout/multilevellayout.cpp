@@ -0,0 +1,391 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "multilevellayout.h"
+
+#include "graph/graph.h"
+#include "graph/graphmodel.h"
+#include "graph/adjacencysnapshot.h"
+
+#include "shared/utils/threadpool.h"
+#include "shared/utils/preferences.h"
+#include "shared/utils/scopetimer.h"
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+using Index = AdjacencySnapshot::Index;
+const Index NullIndex = AdjacencySnapshot::NullIndex;
+
+// Smaller components converge quickly enough from FastInitialLayout anyway
+const size_t MinNodesForMultilevel = 1000;
+
+// Coarsening stops once a level is this small, or when it fails to shrink the graph by much
+const size_t CoarsestNumNodes = 50;
+const float MaxCoarseningRatio = 0.8f;
+
+const int CoarsestIterations = 300;
+const int RefinementIterations = 30;
+
+// One level of the hierarchy, as compressed sparse rows; an edge's weight is the number of
+// edges between the members of its nodes, and a node's weight is its number of members
+struct Level
+{
+    std::vector<size_t> _offsets{0};
+    std::vector<Index> _neighbours;
+    std::vector<float> _edgeWeights;
+    std::vector<float> _nodeWeights;
+
+    // The node of the next coarser level that each node is merged into
+    std::vector<Index> _parents;
+
+    size_t numNodes() const { return _offsets.size() - 1; }
+    size_t degree(size_t node) const { return _offsets[node + 1] - _offsets[node]; }
+};
+
+// Builds a level one node at a time, merging any duplicate edges of the node
+class LevelBuilder
+{
+private:
+    Level* _level;
+    std::vector<size_t> _entries;
+
+public:
+    LevelBuilder(Level& level, size_t numNodes) :
+        _level(&level), _entries(numNodes, std::numeric_limits<size_t>::max())
+    {}
+
+    void addEdge(Index node, Index neighbour, float weight)
+    {
+        // Loops exert no force
+        if(neighbour == node)
+            return;
+
+        // Entries made for earlier nodes precede the current node's offset
+        auto& entry = _entries[static_cast<size_t>(neighbour)];
+        if(entry < _level->_neighbours.size() && entry >= _level->_offsets.back())
+        {
+            _level->_edgeWeights[entry] += weight;
+            return;
+        }
+
+        entry = _level->_neighbours.size();
+        _level->_neighbours.push_back(neighbour);
+        _level->_edgeWeights.push_back(weight);
+    }
+
+    void endNode(float weight)
+    {
+        _level->_offsets.push_back(_level->_neighbours.size());
+        _level->_nodeWeights.push_back(weight);
+    }
+};
+
+Level finestLevel(const AdjacencySnapshot& adjacency)
+{
+    Level level;
+    const auto numNodes = static_cast<size_t>(adjacency.numNodes());
+    LevelBuilder builder(level, numNodes);
+
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        auto node = static_cast<Index>(i);
+        for(auto neighbour : adjacency.neighbours(node))
+            builder.addEdge(node, neighbour, 1.0f);
+
+        builder.endNode(1.0f);
+    }
+
+    return level;
+}
+
+// Heavy edge matching; each node is paired with the unmatched neighbour that it is most
+// strongly connected to, relative to their sizes. Nodes left without a partner join the
+// group of their most strongly connected neighbour instead, so that star-like structures,
+// which matching alone barely shrinks, collapse quickly.
+Level coarsen(Level& fine)
+{
+    const auto numNodes = fine.numNodes();
+    auto& parents = fine._parents;
+    parents.assign(numNodes, NullIndex);
+
+    // Low degree nodes have the fewest options, so they choose first
+    std::vector<Index> order(numNodes);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&fine](Index a, Index b)
+    {
+        return fine.degree(static_cast<size_t>(a)) < fine.degree(static_cast<size_t>(b));
+    });
+
+    auto strongestNeighbour = [&fine, &parents](size_t v, bool matched)
+    {
+        auto strongest = NullIndex;
+        float strongestScore = 0.0f;
+
+        for(auto entry = fine._offsets[v]; entry < fine._offsets[v + 1]; entry++)
+        {
+            auto u = static_cast<size_t>(fine._neighbours[entry]);
+            if((parents[u] != NullIndex) != matched)
+                continue;
+
+            auto score = fine._edgeWeights[entry] / (fine._nodeWeights[v] * fine._nodeWeights[u]);
+            if(score > strongestScore)
+            {
+                strongest = fine._neighbours[entry];
+                strongestScore = score;
+            }
+        }
+
+        return strongest;
+    };
+
+    Index numCoarseNodes = 0;
+    for(auto node : order)
+    {
+        auto v = static_cast<size_t>(node);
+        if(parents[v] != NullIndex)
+            continue;
+
+        auto partner = strongestNeighbour(v, false);
+        if(partner == NullIndex)
+            continue;
+
+        parents[v] = numCoarseNodes;
+        parents[static_cast<size_t>(partner)] = numCoarseNodes;
+        numCoarseNodes++;
+    }
+
+    // Every neighbour of a node that is still unmatched must itself be matched
+    for(size_t v = 0; v < numNodes; v++)
+    {
+        if(parents[v] != NullIndex)
+            continue;
+
+        auto neighbour = strongestNeighbour(v, true);
+        parents[v] = neighbour != NullIndex ? parents[static_cast<size_t>(neighbour)] : numCoarseNodes++;
+    }
+
+    const auto numCoarse = static_cast<size_t>(numCoarseNodes);
+
+    // Group the fine nodes by the coarse node they are merged into
+    std::vector<size_t> memberOffsets(numCoarse + 1, 0);
+    for(auto parent : parents)
+        memberOffsets[static_cast<size_t>(parent) + 1]++;
+
+    std::partial_sum(memberOffsets.begin(), memberOffsets.end(), memberOffsets.begin());
+
+    std::vector<Index> members(numNodes);
+    auto nextMember = memberOffsets;
+    for(size_t v = 0; v < numNodes; v++)
+        members[nextMember[static_cast<size_t>(parents[v])]++] = static_cast<Index>(v);
+
+    Level coarse;
+    LevelBuilder builder(coarse, numCoarse);
+
+    for(size_t c = 0; c < numCoarse; c++)
+    {
+        float weight = 0.0f;
+
+        for(auto m = memberOffsets[c]; m < memberOffsets[c + 1]; m++)
+        {
+            auto v = static_cast<size_t>(members[m]);
+            weight += fine._nodeWeights[v];
+
+            for(auto entry = fine._offsets[v]; entry < fine._offsets[v + 1]; entry++)
+            {
+                builder.addEdge(static_cast<Index>(c), parents[static_cast<size_t>(fine._neighbours[entry])],
+                    fine._edgeWeights[entry]);
+            }
+        }
+
+        builder.endNode(weight);
+    }
+
+    return coarse;
+}
+
+float meanEdgeLength(const Level& level, const std::vector<QVector3D>& positions)
+{
+    if(level._neighbours.empty())
+        return 0.0f;
+
+    double total = 0.0;
+    for(size_t v = 0; v < level.numNodes(); v++)
+    {
+        for(auto entry = level._offsets[v]; entry < level._offsets[v + 1]; entry++)
+            total += (positions[static_cast<size_t>(level._neighbours[entry])] - positions[v]).length();
+    }
+
+    return static_cast<float>(total / static_cast<double>(level._neighbours.size()));
+}
+
+// The same forces and damping as ForceDirectedLayout, for a fixed number of iterations
+template<size_t NumDimensions>
+void refine(const Level& level, std::vector<QVector3D>& positions, int iterations,
+    float shortRange, float longRange, const Cancellable& cancellable)
+{
+    const auto numNodes = level.numNodes();
+
+    std::vector<ForceDirectedDisplacement> displacements(numNodes);
+    std::vector<QVector3D> forces(numNodes);
+    BarnesHutTree<NumDimensions> barnesHutTree;
+
+    auto repulsionKernel = [shortRange, longRange](int mass, const QVector3D& difference, float distanceSq)
+    {
+        return difference * (static_cast<float>(mass) *
+            ForceDirectedLayout::repulse(distanceSq, shortRange, longRange));
+    };
+
+    for(int iteration = 0; iteration < iterations; iteration++)
+    {
+        if(cancellable.cancelled())
+            return;
+
+        barnesHutTree.build(numNodes, [&positions](size_t i) { return positions[i]; });
+
+        const auto& treeOrder = barnesHutTree.order();
+        parallel_for(treeOrder.begin(), treeOrder.end(), [&](size_t i)
+        {
+            auto force = -barnesHutTree.evaluateKernel(i, repulsionKernel);
+
+            for(auto entry = level._offsets[i]; entry < level._offsets[i + 1]; entry++)
+            {
+                auto difference = positions[static_cast<size_t>(level._neighbours[entry])] - positions[i];
+                force += difference * ForceDirectedLayout::attract(difference.lengthSquared());
+            }
+
+            displacements[i].computeAndDamp(force);
+            forces[i] = force;
+        });
+
+        for(size_t i = 0; i < numNodes; i++)
+            positions[i] += forces[i];
+    }
+}
+} // namespace
+
+void MultilevelLayout::initialLayout(Dimensionality dimensionality)
+{
+    if(nodeIds().size() < MinNodesForMultilevel)
+    {
+        ForceDirectedLayout::initialLayout(dimensionality);
+        return;
+    }
+
+    SCOPE_TIMER_MULTISAMPLES(5)
+
+    // Sorted, so that the result depends only on the nodes themselves
+    auto componentNodeIds = nodeIds();
+    std::sort(componentNodeIds.begin(), componentNodeIds.end());
+    AdjacencySnapshot adjacency(graph(), componentNodeIds);
+
+    std::vector<Level> levels;
+    levels.emplace_back(finestLevel(adjacency));
+
+    while(levels.back().numNodes() > CoarsestNumNodes)
+    {
+        auto coarse = coarsen(levels.back());
+
+        if(static_cast<float>(coarse.numNodes()) >
+            static_cast<float>(levels.back().numNodes()) * MaxCoarseningRatio)
+        {
+            break;
+        }
+
+        levels.emplace_back(std::move(coarse));
+    }
+
+    if(levels.size() == 1)
+    {
+        ForceDirectedLayout::initialLayout(dimensionality);
+        return;
+    }
+
+    const bool threeDee = dimensionality == Dimensionality::ThreeDee;
+    const float shortRange = _settings->value(QStringLiteral("ShortRangeRepulseTerm"));
+    const float longRange = 0.01f + _settings->value(QStringLiteral("LongRangeRepulseTerm"));
+
+    std::mt19937 generator(static_cast<std::mt19937::result_type>(componentNodeIds.size()));
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    auto randomOffset = [&](float radius)
+    {
+        auto x = distribution(generator);
+        auto y = distribution(generator);
+        auto z = threeDee ? distribution(generator) : 0.0f;
+
+        return QVector3D(x, y, z) * radius;
+    };
+
+    // The coarsest level starts from a random placement
+    std::vector<QVector3D> levelPositions(levels.back().numNodes());
+    const auto spread = 10.0f * std::sqrt(static_cast<float>(levelPositions.size()));
+    for(auto& position : levelPositions)
+        position = randomOffset(spread);
+
+    for(auto l = levels.size() - 1; ; l--)
+    {
+        if(cancelled())
+            return;
+
+        const auto& level = levels.at(l);
+
+        if(l < levels.size() - 1)
+        {
+            // Prolong the coarser level's layout; members start near their group's position
+            const auto& coarser = levels.at(l + 1);
+            auto radius = 0.1f * meanEdgeLength(coarser, levelPositions);
+            if(radius <= 0.0f)
+                radius = 1.0f;
+
+            std::vector<QVector3D> finePositions(level.numNodes());
+            for(size_t v = 0; v < level.numNodes(); v++)
+                finePositions[v] = levelPositions[static_cast<size_t>(level._parents[v])] + randomOffset(radius);
+
+            levelPositions = std::move(finePositions);
+        }
+
+        // The finest level is refined by the iterations of the layout proper
+        if(l == 0)
+            break;
+
+        auto iterations = l == levels.size() - 1 ? CoarsestIterations : RefinementIterations;
+
+        if(threeDee)
+            refine<3>(level, levelPositions, iterations, shortRange, longRange, *this);
+        else
+            refine<2>(level, levelPositions, iterations, shortRange, longRange, *this);
+    }
+
+    for(size_t i = 0; i < levelPositions.size(); i++)
+        positions().set(adjacency.nodeIdAt(static_cast<Index>(i)), levelPositions[i]);
+}
+
+std::unique_ptr<Layout> MultilevelLayoutFactory::create(ComponentId componentId,
+    NodeLayoutPositions& nodePositions, Layout::Dimensionality dimensionalityMode)
+{
+    const auto& graph = _graphModel->graph();
+    const auto* component = graph.componentById(componentId);
+    return std::make_unique<MultilevelLayout>(graph, *component, _displacements,
+        nodePositions, dimensionalityMode, &_layoutSettings,
+        u::pref(QStringLiteral("misc/deterministicLayout")).toBool());
+}
@@ -0,0 +1,52 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MULTILEVELLAYOUT_H
+#define MULTILEVELLAYOUT_H
+
+#include "forcedirectedlayout.h"
+
+// A force directed layout whose initial placement is found by repeatedly coarsening the
+// component, laying out the coarsest graph, then interpolating and refining the layout
+// at each finer level in turn, in the manner of FM³ and sfdp. Thereafter, it iterates in
+// exactly the same way as ForceDirectedLayout, but from a layout that is already close to
+// converged, which for large components saves a great many full size iterations.
+class MultilevelLayout : public ForceDirectedLayout
+{
+    Q_OBJECT
+
+protected:
+    void initialLayout(Dimensionality dimensionality) override;
+
+public:
+    using ForceDirectedLayout::ForceDirectedLayout;
+};
+
+class MultilevelLayoutFactory : public ForceDirectedLayoutFactory
+{
+public:
+    explicit MultilevelLayoutFactory(GraphModel* graphModel) :
+        ForceDirectedLayoutFactory(graphModel)
+    {}
+
+    QString name() const override { return QStringLiteral("Multilevel"); }
+    QString displayName() const override { return QObject::tr("Multilevel Force Directed"); }
+    std::unique_ptr<Layout> create(ComponentId componentId, NodeLayoutPositions& nodePositions,
+        Layout::Dimensionality dimensionalityMode) override;
+};
+
+#endif // MULTILEVELLAYOUT_H
@@ -19,316 +19,245 @@
 #ifndef SPATIALTREE_H
 #define SPATIALTREE_H
 
-#include "shared/graph/igraphcomponent.h"
-#include "maths/boundingbox.h"
-#include "nodepositions.h"
 #include "shared/utils/scopetimer.h"
-#include "shared/utils/threadpool.h"
 
 #include <QVector3D>
-#include <QColor>
+#include <QtGlobal>
 
-#include <functional>
 #include <vector>
-#include <memory>
-#include <stack>
 #include <array>
-#include <cstdlib>
-
-class AbstractSpatialTree
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+struct SpatialTreeNode
 {
-public:
-    virtual ~AbstractSpatialTree() = default;
-    virtual void build(const IGraphComponent& graph, const NodeLayoutPositions& nodePositions) = 0;
-};
+    // The node's points are [_first, _last) in Morton order
+    uint32_t _first = 0;
+    uint32_t _last = 0;
 
-template<size_t NumDimensions>
-using BoundingBox = typename std::conditional_t<NumDimensions == 3,
-    BoundingBox3D, typename std::conditional_t<NumDimensions == 2,
-    BoundingBox2D, void>>;
+    // The index of the next node, in depth first order, that isn't a descendant of this one
+    uint32_t _next = 0;
 
-template<typename TreeType, size_t NumDimensions>
-struct SubVolume
-{
-    BoundingBox<NumDimensions> _boundingBox;
-    std::vector<NodeId> _nodeIds;
-    std::unique_ptr<TreeType> _subTree;
+    // How many times the tree's bounding box has been halved to give the node's
+    int _level = 0;
     bool _leaf = true;
-    bool _empty = true;
-
-    // Floating point precision means that it becomes impossible to
-    // divide a bounding box beyond a certain minimum size. We don't
-    // want to allow that to happen, obviously, so this is a means
-    // to detect whether it would and avoid subdivision if so
-    bool divisible() const
-    {
-        const auto cx = _boundingBox.centre().x();
-        const auto xh = _boundingBox.xLength() * 0.5f;
-
-        if(cx + xh == cx || cx - xh == cx)
-            return false;
-
-        const auto cy = _boundingBox.centre().y();
-        const auto yh = _boundingBox.yLength() * 0.5f;
 
-        if(cy + yh == cy || cy - yh == cy)
-            return false;
-
-        if constexpr(NumDimensions == 3)
-        {
-            const auto cz = _boundingBox.centre().z();
-            const auto zh = _boundingBox.zLength() * 0.5f;
-
-            if(cz + zh == cz || cz - zh == cz)
-                return false; // NOLINT
-        }
-
-        return true;
-    }
+    bool contains(uint32_t point) const { return point >= _first && point < _last; }
 };
 
-// Use the CRT pattern so we can create instances of subclasses by default constructor
-template<typename TreeType, size_t NumDimensions, typename SubVolumeType = SubVolume<TreeType, NumDimensions>>
-class SpatialTree : virtual public AbstractSpatialTree
+// A linear quadtree (NumDimensions = 2) or octree (NumDimensions = 3). The points are sorted
+// by the Morton codes of their positions, which makes the points of every subvolume
+// contiguous, and the subvolumes are stored in a flat array in depth first order. Building
+// the tree therefore involves no per subvolume allocation, and traversing it walks forwards
+// through memory. Subvolumes that would only have a single child are elided, so a node's
+// level is that of the smallest subvolume that contains all of its points.
+template<size_t NumDimensions, typename NodeType = SpatialTreeNode>
+class SpatialTree
 {
-private:
-    static constexpr size_t NumSubVolumes()
-    {
-        size_t v = 1;
+    static_assert(NumDimensions == 2 || NumDimensions == 3);
 
-        for(auto i = 0ul; i < NumDimensions; i++)
-            v *= 2;
-
-        return v;
-    }
-
-    BoundingBox<NumDimensions> _boundingBox;
-
-protected:
-    size_t _depthFirstTraversalStackSizeRequirement = 0; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
-    std::array<SubVolumeType, NumSubVolumes()> _subVolumes = {}; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
-
-    std::array<const SubVolumeType*, NumSubVolumes()> _nonEmptyLeaves = {}; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
-    int _numNonEmptyLeaves = 0; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
-
-    std::array<const SubVolumeType*, NumSubVolumes()> _internalNodes = {}; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
-    int _numInternalNodes = 0; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
+public:
+    // The number of times each axis can be halved, such that a Morton code fits in 64 bits
+    static constexpr int MaxLevel = NumDimensions == 3 ? 21 : 32;
 
 private:
-    unsigned int _maxNodesPerLeaf = 1;
-
-    // Temporary data structure used in the creation of the tree
-    struct NewTree
-    {
-        SpatialTree* _tree;
-        std::vector<NodeId> _nodeIds;
+    static constexpr int NumCodeBits = static_cast<int>(NumDimensions) * MaxLevel;
 
-        NewTree(SpatialTree* tree, const std::vector<NodeId>& nodeIds) noexcept : // NOLINT
-            _tree(tree), _nodeIds(nodeIds)
-        {}
+    unsigned int _maxPointsPerLeaf = 1;
 
-        NewTree(SpatialTree* tree, std::vector<NodeId>&& nodeIds) noexcept :
-            _tree(tree), _nodeIds(std::move(nodeIds))
-        {}
+    std::vector<uint64_t> _codes;
+    std::vector<uint64_t> _scratchCodes;
+    std::vector<uint32_t> _scratchOrder;
 
-        NewTree(const NewTree& other) = default;
-        NewTree& operator=(const NewTree& other) = default;
-        NewTree(NewTree&& other) = default; // NOLINT
-        NewTree& operator=(NewTree&& other) = default; // NOLINT
-    };
-
-    void initialiseSubVolumes()
+    // Spreads the bits of v apart, such that there are NumDimensions - 1 zeroes between each
+    static uint64_t spreadBits(uint64_t v)
     {
-        const auto cx = _boundingBox.centre().x();
-        const auto cy = _boundingBox.centre().y();
-        const auto xh = _boundingBox.xLength() * 0.5f;
-        const auto yh = _boundingBox.yLength() * 0.5f;
-
         if constexpr(NumDimensions == 3)
         {
-            const auto cz = _boundingBox.centre().z();
-            const auto zh = _boundingBox.zLength() * 0.5f;
-
-            // clang-format off
-            _subVolumes[0]._boundingBox = {{cx - xh, cy - yh, cz - zh}, {cx,      cy,      cz     }};
-            _subVolumes[1]._boundingBox = {{cx,      cy - yh, cz - zh}, {cx + xh, cy,      cz     }};
-            _subVolumes[2]._boundingBox = {{cx - xh, cy,      cz - zh}, {cx,      cy + yh, cz     }};
-            _subVolumes[3]._boundingBox = {{cx,      cy,      cz - zh}, {cx + xh, cy + yh, cz     }};
-
-            _subVolumes[4]._boundingBox = {{cx - xh, cy - yh, cz     }, {cx,      cy,      cz + zh}};
-            _subVolumes[5]._boundingBox = {{cx,      cy - yh, cz     }, {cx + xh, cy,      cz + zh}};
-            _subVolumes[6]._boundingBox = {{cx - xh, cy,      cz     }, {cx,      cy + yh, cz + zh}};
-            _subVolumes[7]._boundingBox = {{cx,      cy,      cz     }, {cx + xh, cy + yh, cz + zh}};
-            // clang-format on
+            v &= 0x1FFFFFull;
+            v = (v | (v << 32u)) & 0x1F00000000FFFFull;
+            v = (v | (v << 16u)) & 0x1F0000FF0000FFull;
+            v = (v | (v << 8u))  & 0x100F00F00F00F00Full;
+            v = (v | (v << 4u))  & 0x10C30C30C30C30C3ull;
+            v = (v | (v << 2u))  & 0x1249249249249249ull;
         }
-        else if constexpr(NumDimensions == 2)
+        else
         {
-            // clang-format off
-            _subVolumes[0]._boundingBox = {{cx - xh, cy - yh}, {cx,      cy,    }};
-            _subVolumes[1]._boundingBox = {{cx,      cy - yh}, {cx + xh, cy,    }};
-            _subVolumes[2]._boundingBox = {{cx - xh, cy,    }, {cx,      cy + yh}};
-            _subVolumes[3]._boundingBox = {{cx,      cy,    }, {cx + xh, cy + yh}};
-            // clang-format on
+            v &= 0xFFFFFFFFull;
+            v = (v | (v << 16u)) & 0x0000FFFF0000FFFFull;
+            v = (v | (v << 8u))  & 0x00FF00FF00FF00FFull;
+            v = (v | (v << 4u))  & 0x0F0F0F0F0F0F0F0Full;
+            v = (v | (v << 2u))  & 0x3333333333333333ull;
+            v = (v | (v << 1u))  & 0x5555555555555555ull;
         }
 
-        for(auto& subVolume : _subVolumes)
-            Q_ASSERT(subVolume._boundingBox.valid());
+        return v;
     }
 
-    void distributeNodesOverSubVolumes(const NodeLayoutPositions& nodePositions, const std::vector<NodeId>& nodeIds)
+    // Least significant digit radix sort of _codes, carrying _order along with them
+    void sortByCode()
     {
-        initialiseSubVolumes();
+        const auto numPoints = _codes.size();
+        _scratchCodes.resize(numPoints);
+        _scratchOrder.resize(numPoints);
 
-        bool distinctPositions = false;
-        QVector3D lastPosition = nodePositions.get(nodeIds[0]);
-
-        // Distribute NodeIds over SubVolumes
-        for(NodeId nodeId : nodeIds)
+        for(unsigned int shift = 0; shift < 64; shift += 8)
         {
-            const QVector3D& nodePosition = nodePositions.get(nodeId);
-            SubVolumeType& subVolume = subVolumeForPoint(nodePosition);
+            std::array<size_t, 256> offsets{};
+            for(auto code : _codes)
+                offsets.at((code >> shift) & 0xFFu)++;
 
-            subVolume._nodeIds.push_back(nodeId);
+            // Every code has the same digit, so this pass would do nothing
+            if(std::find(offsets.begin(), offsets.end(), numPoints) != offsets.end())
+                continue;
 
-            if(!distinctPositions)
+            std::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), size_t{0});
+
+            for(size_t i = 0; i < numPoints; i++)
             {
-                if(nodePosition != lastPosition)
-                    distinctPositions = true;
-                else
-                    lastPosition = nodePosition;
+                auto destination = offsets.at((_codes[i] >> shift) & 0xFFu)++;
+                _scratchCodes[destination] = _codes[i];
+                _scratchOrder[destination] = _order[i];
             }
+
+            std::swap(_codes, _scratchCodes);
+            std::swap(_order, _scratchOrder);
         }
+    }
+
+    void buildNode(uint32_t first, uint32_t last, int level)
+    {
+        const auto index = _nodes.size();
+        auto& node = _nodes.emplace_back();
+        node._first = first;
+        node._last = last;
+
+        const auto firstCode = _codes[first];
+        const auto lastCode = _codes[last - 1];
 
-        // Decide if the SubVolumes need further sub-division
-        for(auto& subVolume : _subVolumes)
+        if(last - first > _maxPointsPerLeaf && firstCode != lastCode)
         {
-            if(subVolume._nodeIds.empty())
-                continue;
+            // Skip to the level at which the node's points first differ
+            auto commonBits = std::countl_zero(firstCode ^ lastCode) - (64 - NumCodeBits);
+            level = std::max(level, commonBits / static_cast<int>(NumDimensions));
 
-            if(subVolume._nodeIds.size() > _maxNodesPerLeaf &&
-               subVolume.divisible() && distinctPositions)
-            {
-                // Subdivide
-                subVolume._subTree = std::make_unique<TreeType>();
-                subVolume._subTree->_boundingBox = subVolume._boundingBox;
+            node._level = level;
+            node._leaf = false;
 
-                subVolume._leaf = false;
-                _internalNodes.at(_numInternalNodes++) = &subVolume;
-            }
-            else
+            // Each child's codes share the next NumDimensions bits
+            const auto shift = static_cast<unsigned int>((MaxLevel - level - 1) * static_cast<int>(NumDimensions));
+            const auto begin = _codes.begin();
+
+            for(auto childFirst = first; childFirst < last;)
             {
-                subVolume._empty = false;
-                _nonEmptyLeaves.at(_numNonEmptyLeaves++) = &subVolume;
+                auto prefix = _codes[childFirst] >> shift;
+                auto childLast = static_cast<uint32_t>(std::upper_bound(begin + childFirst, begin + last, prefix,
+                    [shift](uint64_t value, uint64_t code) { return value < (code >> shift); }) - begin);
+
+                buildNode(childFirst, childLast, level + 1);
+                childFirst = childLast;
             }
         }
+        else
+            _nodes[index]._level = level;
+
+        _nodes[index]._next = static_cast<uint32_t>(_nodes.size());
     }
 
-    // The second parameter and superset of _subVolumes[x]._nodeIds are the
-    // same, at the point when this is called
-    virtual void initialise(const NodeLayoutPositions&, const std::vector<NodeId>&) {}
+protected:
+    std::array<float, NumDimensions> _extents = {}; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
 
-    void build(const std::vector<NodeId>& nodeIds, const NodeLayoutPositions& nodePositions)
-    {
-        SCOPE_TIMER_MULTISAMPLES(50)
+    // Original point index, for each position in Morton order, and vice versa
+    std::vector<uint32_t> _order; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
+    std::vector<uint32_t> _ranks; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
 
-        std::vector<NewTree> newTrees;
-        newTrees.emplace_back(this, nodeIds);
+    std::vector<QVector3D> _positions; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
+    std::vector<NodeType> _nodes; // NOLINT cppcoreguidelines-non-private-member-variables-in-classes
 
-        while(!newTrees.empty())
-        {
-            auto results = parallel_for(newTrees.begin(), newTrees.end(),
-            [&nodePositions](typename std::vector<NewTree>::iterator it)
-            {
-                auto* subTree = it->_tree;
-                const auto& nodeIdsToDistribute = it->_nodeIds;
+    void setMaxPointsPerLeaf(unsigned int maxPointsPerLeaf) { _maxPointsPerLeaf = maxPointsPerLeaf; }
 
-                subTree->distributeNodesOverSubVolumes(nodePositions, nodeIdsToDistribute);
+    // The length of the longest side of the subvolumes at the given level
+    float maxLengthAtLevel(int level) const
+    {
+        return std::ldexp(*std::max_element(_extents.begin(), _extents.end()), -level);
+    }
 
-                std::vector<NewTree> newChildTrees;
-                for(int i = 0; i < subTree->_numInternalNodes; i++)
-                {
-                    const auto* subVolume = subTree->_internalNodes.at(i);
-                    newChildTrees.emplace_back(subVolume->_subTree.get(),
-                        std::move(subVolume->_nodeIds));
-                }
+public:
+    // positionFn(i) gives the position of point i, for i in [0, numPoints); the tree's
+    // storage is reused between builds, so rebuilding the same tree is cheap
+    template<typename PositionFn>
+    void build(size_t numPoints, const PositionFn& positionFn)
+    {
+        SCOPE_TIMER_MULTISAMPLES(50)
 
-                subTree->initialise(nodePositions, nodeIdsToDistribute);
+        _nodes.clear();
+        _positions.resize(numPoints);
+        _codes.resize(numPoints);
+        _order.resize(numPoints);
+        _ranks.resize(numPoints);
 
-                return newChildTrees;
-            });
+        if(numPoints == 0)
+            return;
 
-            // subTrees has now been processsed, but may have resulted in more subTrees
-            newTrees.clear();
-            newTrees.insert(newTrees.end(), std::make_move_iterator(results.begin()),
-                std::make_move_iterator(results.end()));
-        }
+        std::array<float, NumDimensions> min{};
+        std::array<float, NumDimensions> max{};
+        min.fill(std::numeric_limits<float>::max());
+        max.fill(std::numeric_limits<float>::lowest());
 
-        std::stack<const SpatialTree*> stack;
-        stack.push(this);
-        _depthFirstTraversalStackSizeRequirement = 1;
-        while(!stack.empty())
+        for(size_t i = 0; i < numPoints; i++)
         {
-            const SpatialTree* subTree = stack.top();
-            stack.pop();
+            _positions[i] = positionFn(i);
 
-            for(int i = 0; i < subTree->_numInternalNodes; i++)
+            for(size_t d = 0; d < NumDimensions; d++)
             {
-                const auto* subVolume = subTree->_internalNodes.at(i);
-                stack.push(subVolume->_subTree.get());
-                _depthFirstTraversalStackSizeRequirement =
-                    std::max(_depthFirstTraversalStackSizeRequirement, stack.size());
+                min.at(d) = std::min(min.at(d), _positions[i][static_cast<int>(d)]);
+                max.at(d) = std::max(max.at(d), _positions[i][static_cast<int>(d)]);
             }
         }
-    }
-
-    SubVolumeType& subVolumeForPoint(const QVector3D& point)
-    {
-        size_t i = 0;
-        QVector3D diff = point - _boundingBox.centre();
 
-        if constexpr(NumDimensions == 3)
+        // Each axis is quantised to MaxLevel bits, across the bounding box
+        const auto numCells = std::ldexp(1.0, MaxLevel);
+        std::array<double, NumDimensions> scales{};
+        for(size_t d = 0; d < NumDimensions; d++)
         {
-            if(diff.z() >= 0.0f)
-                i += 4;
+            _extents.at(d) = max.at(d) - min.at(d);
+            scales.at(d) = _extents.at(d) > 0.0f ? numCells / static_cast<double>(_extents.at(d)) : 0.0;
         }
 
-        if(diff.y() >= 0.0f)
-            i += 2;
-
-        if(diff.x() >= 0.0f)
-            i += 1;
-
-        Q_ASSERT(i < NumSubVolumes());
-        SubVolumeType& subVolume = _subVolumes.at(i);
-
-        if(!subVolume._leaf)
-            return subVolume._subTree->subVolumeForPoint(point);
+        const auto maxCell = static_cast<uint64_t>(numCells) - 1;
+        for(size_t i = 0; i < numPoints; i++)
+        {
+            uint64_t code = 0;
+            for(size_t d = 0; d < NumDimensions; d++)
+            {
+                auto cell = static_cast<uint64_t>(static_cast<double>(
+                    _positions[i][static_cast<int>(d)] - min.at(d)) * scales.at(d));
 
-        return subVolume;
-    }
+                code |= spreadBits(std::min(cell, maxCell)) << d;
+            }
 
-    const SubVolumeType& subVolumeForPoint(const QVector3D& point) const
-    {
-        return subVolumeForPoint(point);
-    }
+            _codes[i] = code;
+            _order[i] = static_cast<uint32_t>(i);
+        }
 
-protected:
-    void setMaxNodesPerLeaf(unsigned int maxNodesPerLeaf) { _maxNodesPerLeaf = maxNodesPerLeaf; }
+        sortByCode();
 
-public:
-    void build(const IGraphComponent& graph, const NodeLayoutPositions& nodePositions) override
-    {
-        if constexpr(NumDimensions == 2)
+        for(size_t rank = 0; rank < numPoints; rank++)
         {
-            auto boundingBox3D = nodePositions.boundingBox(graph.nodeIds());
-            _boundingBox = {boundingBox3D.min().toVector2D(), boundingBox3D.max().toVector2D()};
+            _ranks[_order[rank]] = static_cast<uint32_t>(rank);
+            _positions[rank] = positionFn(_order[rank]);
         }
-        else if constexpr(NumDimensions == 3)
-            _boundingBox = nodePositions.boundingBox(graph.nodeIds());
 
-        Q_ASSERT(_boundingBox.valid());
-        build(graph.nodeIds(), nodePositions);
+        buildNode(0, static_cast<uint32_t>(numPoints), 0);
     }
+
+    // The order in which the points are stored, which is spatially coherent
+    const std::vector<uint32_t>& order() const { return _order; }
 };
 
 #endif // SPATIALTREE_H
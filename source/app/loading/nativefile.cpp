@@ -0,0 +1,379 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nativefile.h"
+
+#include "shared/utils/container.h"
+#include "shared/utils/threadpool.h"
+
+#include <zlib.h>
+
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <limits>
+
+// Modelled on the PNG signature; the non-ASCII first byte stops the file
+// being mistaken for text and the line endings detect transfer mangling
+static const std::array<char, 8> Magic = {'\x89', 'G', 'N', 'F', '\r', '\n', '\x1a', '\n'};
+
+enum class Encoding : uint8_t
+{
+    Stored,
+    DeflateBlocks
+};
+
+// Sections are held in a QByteArray, whose size is an int
+static const uint64_t MaxSectionSize = static_cast<uint64_t>(std::numeric_limits<int>::max());
+
+// Large enough for good compression ratios, small enough to split a section
+// across all the threads
+static const uint64_t BlockSize = 1u << 20u;
+
+static uint64_t numBlocksFor(uint64_t size) { return (size + BlockSize - 1) / BlockSize; }
+
+// A compressed section is its uncompressed size, followed by the compressed
+// size of each block, and then the blocks themselves
+static bool compressBlocks(const QByteArray& data, int level, QByteArray& compressed)
+{
+    const auto size = static_cast<uint64_t>(data.size());
+    const auto numBlocks = numBlocksFor(size);
+
+    std::vector<uint64_t> blockIndices(numBlocks);
+    std::iota(blockIndices.begin(), blockIndices.end(), 0);
+
+    std::vector<std::vector<Bytef>> blocks(numBlocks);
+    std::atomic<bool> failed(false);
+
+    parallel_for(blockIndices.begin(), blockIndices.end(),
+    [&](uint64_t blockIndex)
+    {
+        const auto offset = blockIndex * BlockSize;
+        const auto blockSize = static_cast<uLong>(std::min(BlockSize, size - offset));
+
+        auto& block = blocks.at(blockIndex);
+        auto compressedSize = compressBound(blockSize);
+        block.resize(compressedSize);
+
+        if(compress2(block.data(), &compressedSize,
+            reinterpret_cast<const Bytef*>(data.constData() + offset), // NOLINT
+            blockSize, level) != Z_OK)
+        {
+            failed = true;
+            return;
+        }
+
+        block.resize(compressedSize);
+    });
+
+    if(failed)
+        return false;
+
+    std::vector<uint64_t> blockSizes;
+    blockSizes.reserve(numBlocks);
+
+    for(const auto& block : blocks)
+        blockSizes.push_back(block.size());
+
+    const auto totalBlockSize = std::accumulate(blockSizes.begin(), blockSizes.end(), uint64_t{0});
+
+    BinaryWriter writer(compressed);
+    writer.write(size);
+    writer.write(blockSizes);
+
+    if(writer.overflowed() || totalBlockSize > MaxSectionSize - static_cast<uint64_t>(compressed.size()))
+        return false;
+
+    compressed.reserve(compressed.size() + static_cast<int>(totalBlockSize));
+
+    for(const auto& block : blocks)
+        compressed.append(reinterpret_cast<const char*>(block.data()), static_cast<int>(block.size())); // NOLINT
+
+    return true;
+}
+
+static bool decompressBlocks(const char* data, size_t size, QByteArray& decompressed)
+{
+    BinaryReader reader(data, size);
+
+    uint64_t decompressedSize = 0;
+    std::vector<uint64_t> blockSizes;
+
+    if(!reader.read(decompressedSize) || !reader.read(blockSizes))
+        return false;
+
+    // Reject anything that can't be held in a QByteArray, rather than truncating the
+    // buffer size and then decompressing beyond its end
+    if(decompressedSize > MaxSectionSize)
+        return false;
+
+    if(blockSizes.size() != numBlocksFor(decompressedSize))
+        return false;
+
+    if(blockSizes.empty())
+    {
+        decompressed.clear();
+        return decompressedSize == 0;
+    }
+
+    // The blocks follow the header immediately
+    const auto headerSize = sizeof(uint64_t) * (2 + blockSizes.size());
+
+    std::vector<uint64_t> blockOffsets;
+    blockOffsets.reserve(blockSizes.size());
+
+    uint64_t offset = headerSize;
+    for(auto blockSize : blockSizes)
+    {
+        if(blockSize > size - offset)
+            return false;
+
+        blockOffsets.push_back(offset);
+        offset += blockSize;
+    }
+
+    decompressed.resize(static_cast<int>(decompressedSize));
+
+    std::vector<uint64_t> blockIndices(blockSizes.size());
+    std::iota(blockIndices.begin(), blockIndices.end(), 0);
+
+    std::atomic<bool> failed(false);
+
+    parallel_for(blockIndices.begin(), blockIndices.end(),
+    [&](uint64_t blockIndex)
+    {
+        const auto decompressedOffset = blockIndex * BlockSize;
+        const auto expectedSize = static_cast<uLong>(std::min(BlockSize, decompressedSize - decompressedOffset));
+        auto blockSize = expectedSize;
+
+        if(uncompress(reinterpret_cast<Bytef*>(decompressed.data() + decompressedOffset), &blockSize, // NOLINT
+            reinterpret_cast<const Bytef*>(data + blockOffsets.at(blockIndex)), // NOLINT
+            static_cast<uLong>(blockSizes.at(blockIndex))) != Z_OK || blockSize != expectedSize)
+        {
+            failed = true;
+        }
+    });
+
+    return !failed;
+}
+
+bool NativeFile::hasMagic(const char* data, size_t size)
+{
+    return size >= Magic.size() && std::equal(Magic.begin(), Magic.end(), data);
+}
+
+bool NativeFile::readHeader(const QByteArray& leadingBytes, QByteArray& header)
+{
+    const auto size = static_cast<size_t>(leadingBytes.size());
+
+    if(!hasMagic(leadingBytes.constData(), size))
+        return false;
+
+    BinaryReader reader(leadingBytes.constData() + Magic.size(), size - Magic.size());
+    return reader.read(header);
+}
+
+bool NativeFileWriter::write(const QByteArray& byteArray)
+{
+    return _file.write(byteArray) == byteArray.size();
+}
+
+bool NativeFileWriter::open(const QByteArray& header)
+{
+    if(!_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray byteArray(Magic.data(), static_cast<int>(Magic.size()));
+    BinaryWriter(byteArray).write(header);
+
+    return write(byteArray);
+}
+
+bool NativeFileWriter::writeSection(const QString& name, const QByteArray& data)
+{
+    Q_ASSERT(std::none_of(_sections.begin(), _sections.end(),
+        [&name](const auto& section) { return section._name == name; }));
+
+    const auto offset = static_cast<uint64_t>(_file.pos());
+
+    if(_compressionLevel != 0 && !data.isEmpty())
+    {
+        QByteArray compressed;
+
+        if(!compressBlocks(data, _compressionLevel, compressed))
+            return false;
+
+        // Don't bother with compression unless there is some benefit
+        if(compressed.size() < data.size())
+        {
+            _sections.push_back({name, static_cast<uint8_t>(Encoding::DeflateBlocks),
+                offset, static_cast<uint64_t>(compressed.size())});
+
+            return write(compressed);
+        }
+    }
+
+    _sections.push_back({name, static_cast<uint8_t>(Encoding::Stored),
+        offset, static_cast<uint64_t>(data.size())});
+
+    return write(data);
+}
+
+bool NativeFileWriter::close()
+{
+    const auto indexOffset = static_cast<uint64_t>(_file.pos());
+
+    QByteArray byteArray;
+    BinaryWriter writer(byteArray);
+
+    writer.write(static_cast<uint64_t>(_sections.size()));
+    for(const auto& section : _sections)
+    {
+        writer.write(section._name);
+        writer.write(section._encoding);
+        writer.write(section._offset);
+        writer.write(section._size);
+    }
+
+    writer.write(indexOffset);
+
+    if(!write(byteArray))
+        return false;
+
+    _file.close();
+    return true;
+}
+
+bool NativeFileReader::open()
+{
+    if(!_file.open(QIODevice::ReadOnly))
+        return false;
+
+    _size = static_cast<size_t>(_file.size());
+
+    if(const auto* map = _file.map(0, _file.size()); map != nullptr)
+        _data = reinterpret_cast<const char*>(map); // NOLINT
+    else
+    {
+        // Not everything can be mapped, so fall back to reading it all in
+        _fileContents = _file.readAll();
+        _data = _fileContents.constData();
+        _size = static_cast<size_t>(_fileContents.size());
+    }
+
+    if(!NativeFile::hasMagic(_data, _size))
+        return false;
+
+    BinaryReader headerReader(_data + Magic.size(), _size - Magic.size());
+    if(!headerReader.read(_header))
+        return false;
+
+    uint64_t indexOffset = 0;
+
+    if(_size < Magic.size() + sizeof(indexOffset))
+        return false;
+
+    BinaryReader(_data + _size - sizeof(indexOffset), sizeof(indexOffset)).read(indexOffset);
+
+    if(indexOffset >= _size - sizeof(indexOffset))
+        return false;
+
+    BinaryReader indexReader(_data + indexOffset, _size - sizeof(indexOffset) - indexOffset);
+
+    uint64_t numSections = 0;
+    if(!indexReader.read(numSections))
+        return false;
+
+    for(uint64_t i = 0; i < numSections; i++)
+    {
+        QString name;
+        Section section;
+
+        if(!indexReader.read(name) || !indexReader.read(section._encoding) ||
+            !indexReader.read(section._offset) || !indexReader.read(section._size))
+        {
+            return false;
+        }
+
+        if(section._encoding > static_cast<uint8_t>(Encoding::DeflateBlocks))
+            return false;
+
+        if(section._offset > indexOffset || section._size > indexOffset - section._offset)
+            return false;
+
+        _sections.emplace(name, section);
+    }
+
+    return true;
+}
+
+bool NativeFileReader::hasSection(const QString& name) const
+{
+    return u::contains(_sections, name);
+}
+
+const char* NativeFileReader::sectionData(const QString& name, size_t& size) const
+{
+    size = 0;
+
+    auto it = _sections.find(name);
+    if(it == _sections.end())
+        return nullptr;
+
+    const auto& section = it->second;
+
+    if(section._encoding == static_cast<uint8_t>(Encoding::Stored))
+    {
+        size = static_cast<size_t>(section._size);
+        return _data + section._offset;
+    }
+
+    auto decompressedIt = _decompressedSections.find(name);
+    if(decompressedIt == _decompressedSections.end())
+    {
+        QByteArray decompressed;
+
+        if(!decompressBlocks(_data + section._offset, static_cast<size_t>(section._size), decompressed))
+            return nullptr;
+
+        decompressedIt = _decompressedSections.emplace(name, std::move(decompressed)).first;
+    }
+
+    size = static_cast<size_t>(decompressedIt->second.size());
+    return decompressedIt->second.constData();
+}
+
+BinaryReader NativeFileReader::section(const QString& name) const
+{
+    size_t size = 0;
+    const auto* data = sectionData(name, size);
+
+    return {data, size};
+}
+
+QByteArray NativeFileReader::sectionBytes(const QString& name) const
+{
+    size_t size = 0;
+    const auto* data = sectionData(name, size);
+
+    if(data == nullptr)
+        return {};
+
+    return {data, static_cast<int>(size)};
+}
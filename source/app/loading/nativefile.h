@@ -0,0 +1,114 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NATIVEFILE_H
+#define NATIVEFILE_H
+
+#include "shared/utils/binarystream.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+// The binary container used by native files from version 7 onwards. The file
+// consists of a magic number, a (small) JSON header, then a series of named
+// sections, followed by an index of the sections and finally the offset of the
+// index. Sections can therefore be written as they are produced, and on loading,
+// accessed directly from a memory mapping of the file, in any order. Sections
+// are compressed as independent blocks, so that (de)compression is parallel.
+namespace NativeFile
+{
+    bool hasMagic(const char* data, size_t size);
+
+    // Reads the header from the first bytes of a file, if it is of this format
+    bool readHeader(const QByteArray& leadingBytes, QByteArray& header);
+} // namespace NativeFile
+
+class NativeFileWriter
+{
+private:
+    struct Section
+    {
+        QString _name;
+        uint8_t _encoding = 0;
+        uint64_t _offset = 0;
+        uint64_t _size = 0;
+    };
+
+    QFile _file;
+    int _compressionLevel;
+    std::vector<Section> _sections;
+
+    bool write(const QByteArray& byteArray);
+
+public:
+    // compressionLevel is as per zlib, i.e. 0 (none) to 9 (best), or -1 for its default
+    explicit NativeFileWriter(const QString& filePath, int compressionLevel = -1) :
+        _file(filePath), _compressionLevel(compressionLevel)
+    {}
+
+    bool open(const QByteArray& header);
+    bool writeSection(const QString& name, const QByteArray& data);
+    bool close();
+};
+
+class NativeFileReader
+{
+private:
+    QFile _file;
+    QByteArray _fileContents;
+    const char* _data = nullptr;
+    size_t _size = 0;
+
+    QByteArray _header;
+
+    struct Section
+    {
+        uint8_t _encoding = 0;
+        uint64_t _offset = 0;
+        uint64_t _size = 0;
+    };
+
+    std::map<QString, Section> _sections;
+
+    // Compressed sections, once decompressed, are kept until the reader is destroyed
+    mutable std::map<QString, QByteArray> _decompressedSections;
+
+    const char* sectionData(const QString& name, size_t& size) const;
+
+public:
+    explicit NativeFileReader(const QString& filePath) :
+        _file(filePath)
+    {}
+
+    bool open();
+
+    const QByteArray& header() const { return _header; }
+
+    bool hasSection(const QString& name) const;
+
+    // The returned readers remain valid for the lifetime of the NativeFileReader
+    BinaryReader section(const QString& name) const;
+    QByteArray sectionBytes(const QString& name) const;
+};
+
+#endif // NATIVEFILE_H
@@ -18,6 +18,7 @@
 
 #include "nativeloader.h"
 #include "nativesaver.h"
+#include "nativefile.h"
 
 #include "application.h"
 
@@ -192,15 +193,30 @@ struct Header
     int _pluginDataVersion = -1;
 };
 
-static bool parseHeader(const QUrl& url, Header* header = nullptr)
+static json binaryFileHeader(const QString& filePath)
 {
-    if(!url.isLocalFile())
-        return false;
+    QFile file(filePath);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return {};
+
+    // Allow for the magic number and size that precede the header
+    const int MaxPreambleSize = 32;
+    auto leadingBytes = file.read(NativeSaver::MaxHeaderSize + MaxPreambleSize);
+
+    QByteArray headerByteArray;
+    if(!NativeFile::readHeader(leadingBytes, headerByteArray))
+        return {};
+
+    return json::parse(headerByteArray.begin(), headerByteArray.end(), nullptr, false);
+}
 
+static json jsonFileHeader(const QString& filePath)
+{
     QByteArray byteArray;
 
-    if(!load(url.toLocalFile(), byteArray, NativeSaver::MaxHeaderSize))
-        return false;
+    if(!load(filePath, byteArray, NativeSaver::MaxHeaderSize))
+        return {};
 
     // byteArray now has a JSON fragment that hopefully includes the header
     QString fragment(byteArray);
@@ -236,7 +252,19 @@ static bool parseHeader(const QUrl& url, Header* header = nullptr)
 
     QString headerString = fragment.left(position);
     auto headerByteArray = headerString.toUtf8();
-    json jsonHeader = json::parse(headerByteArray.begin(), headerByteArray.end(), nullptr, false);
+    return json::parse(headerByteArray.begin(), headerByteArray.end(), nullptr, false);
+}
+
+static bool parseHeader(const QUrl& url, Header* header = nullptr)
+{
+    if(!url.isLocalFile())
+        return false;
+
+    auto jsonHeader = binaryFileHeader(url.toLocalFile());
+
+    // Versions prior to 7 are a single (possibly compressed) JSON document
+    if(jsonHeader.is_discarded() || jsonHeader.is_null())
+        jsonHeader = jsonFileHeader(url.toLocalFile());
 
     if(jsonHeader.is_discarded() || jsonHeader.is_null() || !jsonHeader.is_object())
         return false;
@@ -281,6 +309,9 @@ bool Loader::parse(const QUrl& url, IGraphModel* igraphModel)
         return false;
     }
 
+    if(version >= 7)
+        return parseBinary(url.toLocalFile(), header._pluginDataVersion, graphModel);
+
     QByteArray byteArray;
 
     if(!load(url.toLocalFile(), byteArray, -1, &graphModel->mutableGraph(), this))
@@ -378,6 +409,46 @@ bool Loader::parse(const QUrl& url, IGraphModel* igraphModel)
             return false;
     }
 
+    if(!parseContent(jsonBody, version, graphModel))
+        return false;
+
+    if(!u::contains(jsonBody, "pluginData"))
+        return false;
+
+    const auto& pluginDataJsonValue = jsonBody["pluginData"];
+
+    QByteArray pluginData;
+
+    if(pluginDataJsonValue.is_object() || pluginDataJsonValue.is_array())
+        pluginData = QByteArray::fromStdString(pluginDataJsonValue.dump());
+    else if(pluginDataJsonValue.is_string())
+        pluginData = QByteArray::fromHex(QByteArray::fromStdString(pluginDataJsonValue));
+    else
+        return false;
+
+    if(!loadPluginData(pluginData, header._pluginDataVersion, graphModel))
+        return false;
+
+    const auto* pluginUiDataKey = version >= 2 ? "pluginUiData" : "ui";
+    if(u::contains(jsonBody, pluginUiDataKey))
+    {
+        const auto& pluginUiDataJsonValue = jsonBody[pluginUiDataKey];
+
+        if(pluginUiDataJsonValue.is_object() || pluginUiDataJsonValue.is_array())
+            _pluginUiData = QByteArray::fromStdString(pluginUiDataJsonValue.dump());
+        else if(pluginUiDataJsonValue.is_string())
+            _pluginUiData = QByteArray::fromHex(QByteArray::fromStdString(pluginUiDataJsonValue));
+        else
+            return false;
+
+        _pluginUiDataVersion = header._pluginDataVersion;
+    }
+
+    return true;
+}
+
+bool Loader::parseContent(const json& jsonBody, int version, GraphModel* graphModel)
+{
     if(u::contains(jsonBody, "transforms"))
     {
         for(const auto& transform : jsonBody["transforms"])
@@ -530,48 +601,153 @@ bool Loader::parse(const QUrl& url, IGraphModel* igraphModel)
             return false;
     }
 
-    if(!u::contains(jsonBody, "pluginData"))
+    return true;
+}
+
+bool Loader::loadPluginData(const QByteArray& pluginData, int pluginDataVersion, GraphModel* graphModel)
+{
+    if(pluginDataVersion > _pluginInstance->plugin()->dataVersion())
+    {
+        setFailureReason(QObject::tr("Produced using a newer version of the plugin '%1'. Please upgrade.")
+            .arg(_pluginInstance->plugin()->name()));
         return false;
+    }
 
-    const auto& pluginDataJsonValue = jsonBody["pluginData"];
+    if(!_pluginInstance->load(pluginData, pluginDataVersion, graphModel->mutableGraph(), *this))
+    {
+        setFailureReason(_pluginInstance->failureReason());
+        return false;
+    }
 
-    QByteArray pluginData;
+    return true;
+}
 
-    if(pluginDataJsonValue.is_object() || pluginDataJsonValue.is_array())
-        pluginData = QByteArray::fromStdString(pluginDataJsonValue.dump());
-    else if(pluginDataJsonValue.is_string())
-        pluginData = QByteArray::fromHex(QByteArray::fromStdString(pluginDataJsonValue));
-    else
+bool Loader::parseBinary(const QString& filePath, int pluginDataVersion, GraphModel* graphModel)
+{
+    auto& graph = graphModel->mutableGraph();
+
+    NativeFileReader file(filePath);
+
+    if(!file.open())
         return false;
 
-    if(header._pluginDataVersion > _pluginInstance->plugin()->dataVersion())
+    std::vector<int32_t> nodeIds;
+
     {
-        setFailureReason(QObject::tr("Produced using a newer version of the plugin '%1'. Please upgrade.")
-            .arg(_pluginInstance->plugin()->name()));
+        graph.setPhase(QObject::tr("Graph"));
+
+        std::vector<int32_t> edgeIds;
+        std::vector<int32_t> sourceIds;
+        std::vector<int32_t> targetIds;
+
+        auto reader = file.section(QStringLiteral("graph"));
+        if(!reader.read(nodeIds) || !reader.read(edgeIds) ||
+            !reader.read(sourceIds) || !reader.read(targetIds))
+        {
+            return false;
+        }
+
+        if(sourceIds.size() != edgeIds.size() || targetIds.size() != edgeIds.size())
+            return false;
+
+        auto isValidId = [](int32_t id) { return id >= 0; };
+        if(!std::all_of(nodeIds.begin(), nodeIds.end(), isValidId) ||
+            !std::all_of(edgeIds.begin(), edgeIds.end(), isValidId))
+        {
+            return false;
+        }
+
+        // Duplicate IDs can only come from a corrupt file
+        if(!u::hasUniqueValues(nodeIds) || !u::hasUniqueValues(edgeIds))
+            return false;
+
+        setProgress(-1);
+
+        std::vector<NodeId> graphNodeIds(nodeIds.begin(), nodeIds.end());
+        std::vector<EdgeId> graphEdgeIds(edgeIds.begin(), edgeIds.end());
+        std::vector<NodeId> graphSourceIds(sourceIds.begin(), sourceIds.end());
+        std::vector<NodeId> graphTargetIds(targetIds.begin(), targetIds.end());
+
+        graph.addNodesBulk(graphNodeIds);
+
+        auto nodeExists = [&graph](NodeId nodeId) { return graph.containsNodeId(nodeId); };
+        if(!std::all_of(graphSourceIds.begin(), graphSourceIds.end(), nodeExists) ||
+            !std::all_of(graphTargetIds.begin(), graphTargetIds.end(), nodeExists))
+        {
+            return false;
+        }
+
+        graph.addEdgesBulk(graphEdgeIds, graphSourceIds, graphTargetIds);
+    }
+
+    if(cancelled())
         return false;
+
+    if(file.hasSection(QStringLiteral("nodeNames")))
+    {
+        std::vector<QString> nodeNames;
+
+        auto reader = file.section(QStringLiteral("nodeNames"));
+        if(!reader.read(nodeNames) || nodeNames.size() != nodeIds.size())
+            return false;
+
+        for(size_t i = 0; i < nodeIds.size(); i++)
+            graphModel->setNodeName(nodeIds.at(i), nodeNames.at(i));
     }
 
-    if(!_pluginInstance->load(pluginData, header._pluginDataVersion, graphModel->mutableGraph(), *this))
+    graph.setPhase(QObject::tr("Attributes"));
+
+    if(file.hasSection(QStringLiteral("userNodeData")))
     {
-        setFailureReason(_pluginInstance->failureReason());
-        return false;
+        auto reader = file.section(QStringLiteral("userNodeData"));
+        if(!graphModel->userNodeData().load(reader, *this))
+            return false;
     }
 
-    const auto* pluginUiDataKey = version >= 2 ? "pluginUiData" : "ui";
-    if(u::contains(jsonBody, pluginUiDataKey))
+    if(file.hasSection(QStringLiteral("userEdgeData")))
     {
-        const auto& pluginUiDataJsonValue = jsonBody[pluginUiDataKey];
+        auto reader = file.section(QStringLiteral("userEdgeData"));
+        if(!graphModel->userEdgeData().load(reader, *this))
+            return false;
+    }
 
-        if(pluginUiDataJsonValue.is_object() || pluginUiDataJsonValue.is_array())
-            _pluginUiData = QByteArray::fromStdString(pluginUiDataJsonValue.dump());
-        else if(pluginUiDataJsonValue.is_string())
-            _pluginUiData = QByteArray::fromHex(QByteArray::fromStdString(pluginUiDataJsonValue));
-        else
+    if(file.hasSection(QStringLiteral("positions")))
+    {
+        std::vector<float> positions;
+
+        auto reader = file.section(QStringLiteral("positions"));
+        if(!reader.read(positions) || positions.size() != nodeIds.size() * 3)
             return false;
 
-        _pluginUiDataVersion = header._pluginDataVersion;
+        _nodePositions = std::make_unique<ExactNodePositions>(graph);
+
+        for(size_t i = 0; i < nodeIds.size(); i++)
+        {
+            _nodePositions->set(nodeIds.at(i), QVector3D(
+                positions.at((i * 3) + 0),
+                positions.at((i * 3) + 1),
+                positions.at((i * 3) + 2)));
+        }
     }
 
+    const auto contentByteArray = file.sectionBytes(QStringLiteral("content"));
+    auto jsonContent = json::parse(contentByteArray.begin(), contentByteArray.end(), nullptr, false);
+
+    if(jsonContent.is_discarded() || !jsonContent.is_object())
+        return false;
+
+    if(!parseContent(jsonContent, NativeSaver::Version, graphModel))
+        return false;
+
+    if(!file.hasSection(QStringLiteral("pluginData")))
+        return false;
+
+    if(!loadPluginData(file.sectionBytes(QStringLiteral("pluginData")), pluginDataVersion, graphModel))
+        return false;
+
+    _pluginUiData = file.sectionBytes(QStringLiteral("pluginUiData"));
+    _pluginUiDataVersion = pluginDataVersion;
+
     return true;
 }
 
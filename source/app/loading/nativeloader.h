@@ -34,9 +34,13 @@
 #include <QStringList>
 #include <QByteArray>
 
+#include <json_helper.h>
+
 #include <memory>
 #include <map>
 
+class GraphModel;
+
 class Loader : public IParser
 {
 private:
@@ -69,6 +73,10 @@ private:
 
     QString _log;
 
+    bool parseContent(const json& jsonBody, int version, GraphModel* graphModel);
+    bool loadPluginData(const QByteArray& pluginData, int pluginDataVersion, GraphModel* graphModel);
+    bool parseBinary(const QString& filePath, int pluginDataVersion, GraphModel* graphModel);
+
 public:
     bool parse(const QUrl& url, IGraphModel* igraphModel) override;
     void setPluginInstance(IPluginInstance* pluginInstance);
@@ -17,13 +17,12 @@
  */
 
 #include "nativesaver.h"
-#include "jsongraphsaver.h"
+#include "nativefile.h"
 
-#include "shared/graph/grapharray_json.h"
 
 #include "shared/plugins/iplugin.h"
 #include "shared/utils/iterator_range.h"
-#include "shared/utils/scope_exit.h"
+#include "shared/utils/binarystream.h"
 #include "shared/utils/string.h"
 #include "shared/loading/userelementdata.h"
 
@@ -32,79 +31,13 @@
 
 #include "ui/document.h"
 
-#include <QDataStream>
-#include <QFile>
 #include <QStringList>
 
 #include <vector>
 
-#include <zlib.h>
-
-const int NativeSaver::Version = 6;
+const int NativeSaver::Version = 7;
 const int NativeSaver::MaxHeaderSize = 1 << 12;
 
-static bool compress(const QByteArray& byteArray, const QString& filePath, Progressable& progressable)
-{
-    QFile file(filePath);
-
-    if(!file.open(QIODevice::WriteOnly))
-        return false;
-
-    uint64_t totalBytes = byteArray.size();
-    uint64_t bytePosition = 0;
-    QDataStream input(byteArray);
-    QDataStream output(&file);
-
-    z_stream zstream = {};
-    auto ret = deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
-                            MAX_WBITS + 16, // 16 means write gzip header/trailer
-                            8, Z_DEFAULT_STRATEGY);
-    if(ret != Z_OK)
-        return false;
-
-    auto atExit = std::experimental::make_scope_exit([&zstream] { deflateEnd(&zstream); });
-    Q_UNUSED(atExit);
-
-    int flush = Z_ERRNO;
-
-    do
-    {
-        const int ChunkSize = 1 << 14;
-        std::vector<unsigned char> inBuffer(ChunkSize);
-
-        auto numBytes = input.readRawData(reinterpret_cast<char*>(inBuffer.data()), ChunkSize); // NOLINT
-
-        bytePosition += numBytes;
-        progressable.setProgress(static_cast<int>((bytePosition * 100u) / totalBytes));
-
-        zstream.avail_in = numBytes;
-        zstream.next_in = static_cast<z_const Bytef*>(inBuffer.data());
-        flush = input.atEnd() ? Z_FINISH : Z_NO_FLUSH;
-
-        do
-        {
-            std::vector<unsigned char> outBuffer(ChunkSize);
-            zstream.avail_out = ChunkSize;
-            zstream.next_out = static_cast<Bytef*>(outBuffer.data());
-
-            ret = deflate(&zstream, flush);
-            if(ret == Z_STREAM_ERROR)
-                return false;
-
-            numBytes = ChunkSize - static_cast<int>(zstream.avail_out);
-            if(output.writeRawData(reinterpret_cast<const char*>(outBuffer.data()), numBytes) !=
-               numBytes) // NOLINT
-                return false;
-
-        } while(zstream.avail_out == 0);
-        Q_ASSERT(zstream.avail_in == 0);
-
-    } while(flush != Z_FINISH);
-    Q_ASSERT(ret == Z_STREAM_END);
-
-    return true;
-}
-
 static json bookmarksAsJson(const Document& document)
 {
     json jsonObject = json::object();
@@ -166,8 +99,6 @@ static json enrichmentTableModelAsJson(const EnrichmentTableModel& table)
 
 bool NativeSaver::save()
 {
-    json jsonArray;
-
     auto* graphModel = dynamic_cast<GraphModel*>(_document->graphModel());
 
     Q_ASSERT(graphModel != nullptr);
@@ -181,31 +112,108 @@ bool NativeSaver::save()
     header["pluginName"] = graphModel->pluginName();
     header["pluginDataVersion"] = graphModel->pluginDataVersion();
     header["appVersion"] = VERSION;
-    jsonArray.emplace_back(header);
+
+    auto headerByteArray = QByteArray::fromStdString(header.dump());
 
     // The header must fit within a certain size, which is the maximum the loader will look at
-    if(json({header}).dump().size() > MaxHeaderSize)
+    if(headerByteArray.size() > MaxHeaderSize)
         return false;
 
-    json content;
+    NativeFileWriter file(_fileUrl.toLocalFile());
 
-    content["graph"] = JSONGraphSaver::graphAsJson(graph, *this);
-    content["nodeNames"] = u::graphArrayAsJson(graphModel->nodeNames(), graph.nodeIds(), this);
+    if(!file.open(headerByteArray))
+        return false;
 
-    content["userNodeData"] = graphModel->userNodeData().save(graph, graph.nodeIds(), *this);
-    content["userEdgeData"] = graphModel->userEdgeData().save(graph, graph.edgeIds(), *this);
+    // Each section is built in memory then written out immediately,
+    // so at most one section's worth of data is held at a time
+    auto writeSection = [&file](const QString& name, const auto& writeFn)
+    {
+        QByteArray byteArray;
+        BinaryWriter writer(byteArray);
+        writeFn(writer);
 
-    json layout;
+        // Sections are limited to the maximum size of a QByteArray
+        if(writer.overflowed())
+            return false;
 
-    layout["algorithm"] = _document->layoutName();
-    layout["settings"] = layoutSettingsAsJson(*_document);
+        return file.writeSection(name, byteArray);
+    };
+
+    const auto& nodeIds = graph.nodeIds();
+    const auto& edgeIds = graph.edgeIds();
 
-    layout["positions"] = u::graphArrayAsJson(graphModel->nodePositions(), graph.nodeIds(), this,
-    [](const auto& v)
+    graph.setPhase(QObject::tr("Graph"));
+    if(!writeSection(QStringLiteral("graph"), [&](BinaryWriter& writer)
     {
-        return json({v.x(), v.y(), v.z()});
-    });
+        std::vector<int32_t> nodeIdValues(nodeIds.begin(), nodeIds.end());
+        std::vector<int32_t> edgeIdValues(edgeIds.begin(), edgeIds.end());
+        std::vector<int32_t> sourceIdValues;
+        std::vector<int32_t> targetIdValues;
 
+        sourceIdValues.reserve(edgeIds.size());
+        targetIdValues.reserve(edgeIds.size());
+
+        for(auto edgeId : edgeIds)
+        {
+            const auto& edge = graph.edgeById(edgeId);
+            sourceIdValues.push_back(static_cast<int32_t>(edge.sourceId()));
+            targetIdValues.push_back(static_cast<int32_t>(edge.targetId()));
+        }
+
+        writer.write(nodeIdValues);
+        writer.write(edgeIdValues);
+        writer.write(sourceIdValues);
+        writer.write(targetIdValues);
+    })) return false;
+
+    // Per node values are written in the same order as the node ids in the graph section
+    graph.setPhase(QObject::tr("Node Names"));
+    if(!writeSection(QStringLiteral("nodeNames"), [&](BinaryWriter& writer)
+    {
+        std::vector<QString> nodeNames;
+        nodeNames.reserve(nodeIds.size());
+
+        for(auto nodeId : nodeIds)
+            nodeNames.emplace_back(graphModel->nodeName(nodeId));
+
+        writer.write(nodeNames);
+    })) return false;
+
+    graph.setPhase(QObject::tr("Attributes"));
+    if(!writeSection(QStringLiteral("userNodeData"), [&](BinaryWriter& writer)
+        { graphModel->userNodeData().save(writer, nodeIds, *this); }))
+    {
+        return false;
+    }
+
+    if(!writeSection(QStringLiteral("userEdgeData"), [&](BinaryWriter& writer)
+        { graphModel->userEdgeData().save(writer, edgeIds, *this); }))
+    {
+        return false;
+    }
+
+    graph.setPhase(QObject::tr("Positions"));
+    if(!writeSection(QStringLiteral("positions"), [&](BinaryWriter& writer)
+    {
+        std::vector<float> positions;
+        positions.reserve(nodeIds.size() * 3);
+
+        for(auto nodeId : nodeIds)
+        {
+            const auto position = graphModel->nodePositions().get(nodeId);
+            positions.push_back(position.x());
+            positions.push_back(position.y());
+            positions.push_back(position.z());
+        }
+
+        writer.write(positions);
+    })) return false;
+
+    json content;
+
+    json layout;
+    layout["algorithm"] = _document->layoutName();
+    layout["settings"] = layoutSettingsAsJson(*_document);
     layout["paused"] = _document->layoutPauseState() == LayoutPauseState::Paused;
     content["layout"] = layout;
 
@@ -234,31 +242,22 @@ bool NativeSaver::save()
     if(uiDataJson.is_object() || uiDataJson.is_array())
         content["ui"] = uiDataJson;
 
+    if(!file.writeSection(QStringLiteral("content"), QByteArray::fromStdString(content.dump())))
+        return false;
+
+    // Plugin data is opaque, so it's stored exactly as is
     graph.setPhase(graphModel->pluginName());
     auto pluginData = _pluginInstance->save(graph, *this);
 
     setProgress(-1);
 
-    auto pluginDataJson = json::parse(pluginData.begin(), pluginData.end(), nullptr, false);
-
-    // If the plugin data is itself JSON, just whack it in
-    // as is, but if it's not, hex encode it
-    if(!pluginDataJson.is_discarded() && (pluginDataJson.is_object() || pluginDataJson.is_array()))
-        content["pluginData"] = pluginDataJson;
-    else
-        content["pluginData"] = QString(pluginData.toHex());
-
-    auto pluginUiDataJson = json::parse(_pluginUiData.begin(), _pluginUiData.end(), nullptr, false);
-
-    if(!pluginUiDataJson.is_discarded() && (pluginUiDataJson.is_object() || pluginUiDataJson.is_array()))
-        content["pluginUiData"] = pluginUiDataJson;
-    else
-        content["pluginUiData"] = QString(_pluginUiData.toHex());
+    if(!file.writeSection(QStringLiteral("pluginData"), pluginData))
+        return false;
 
-    jsonArray.emplace_back(content);
+    if(!file.writeSection(QStringLiteral("pluginUiData"), _pluginUiData))
+        return false;
 
-    graph.setPhase(QObject::tr("Compressing"));
-    return compress(QByteArray::fromStdString(jsonArray.dump()), _fileUrl.toLocalFile(), *this);
+    return file.close();
 }
 
 std::unique_ptr<ISaver> NativeSaverFactory::create(const QUrl& url, Document* document,
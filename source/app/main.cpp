@@ -342,6 +342,9 @@ int start(int argc, char *argv[])
 
     u::definePref(QStringLiteral("misc/disableHubbles"),                    false);
 
+    u::definePref(QStringLiteral("misc/deterministicLayout"),               false);
+    u::definePref(QStringLiteral("misc/multilevelLayout"),                  false);
+
     u::definePref(QStringLiteral("misc/hasSeenTutorial"),                   false);
 
     u::definePref(QStringLiteral("misc/autoBackgroundUpdateCheck"),         true);
@@ -85,6 +85,8 @@ GraphRenderer::GraphRenderer(GraphModel* graphModel,
 
     connect(graph, &Graph::nodeAdded, this, &GraphRenderer::onNodeAdded, Qt::DirectConnection);
     connect(graph, &Graph::edgeAdded, this, &GraphRenderer::onEdgeAdded, Qt::DirectConnection);
+    connect(graph, &Graph::nodesAdded, this, &GraphRenderer::onNodesAdded, Qt::DirectConnection);
+    connect(graph, &Graph::edgesAdded, this, &GraphRenderer::onEdgesAdded, Qt::DirectConnection);
     connect(graph, &Graph::nodeAddedToComponent, this, &GraphRenderer::onNodeAddedToComponent, Qt::DirectConnection);
     connect(graph, &Graph::edgeAddedToComponent, this, &GraphRenderer::onEdgeAddedToComponent, Qt::DirectConnection);
 
@@ -586,6 +588,18 @@ void GraphRenderer::onEdgeAdded(const Graph*, EdgeId edgeId)
     _hiddenEdges.set(edgeId, true);
 }
 
+void GraphRenderer::onNodesAdded(const Graph*, const std::vector<NodeId>& nodeIds)
+{
+    for(auto nodeId : nodeIds)
+        _hiddenNodes.set(nodeId, true);
+}
+
+void GraphRenderer::onEdgesAdded(const Graph*, const std::vector<EdgeId>& edgeIds)
+{
+    for(auto edgeId : edgeIds)
+        _hiddenEdges.set(edgeId, true);
+}
+
 void GraphRenderer::onNodeAddedToComponent(const Graph*, NodeId nodeId, ComponentId)
 {
     _hiddenNodes.set(nodeId, true);
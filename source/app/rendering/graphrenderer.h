@@ -148,6 +148,8 @@ public:
 private slots:
     void onNodeAdded(const Graph*, NodeId nodeId);
     void onEdgeAdded(const Graph*, EdgeId edgeId);
+    void onNodesAdded(const Graph*, const std::vector<NodeId>& nodeIds);
+    void onEdgesAdded(const Graph*, const std::vector<EdgeId>& edgeIds);
     void onNodeAddedToComponent(const Graph*, NodeId nodeId, ComponentId);
     void onEdgeAddedToComponent(const Graph*, EdgeId edgeId, ComponentId);
 
@@ -27,6 +27,7 @@
 #include "shared/utils/string.h"
 
 #include <functional>
+#include <vector>
 
 TransformedGraph::TransformedGraph(GraphModel& graphModel, const MutableGraph& source) :
     _graphModel(&graphModel),
@@ -53,16 +54,42 @@ TransformedGraph::TransformedGraph(GraphModel& graphModel, const MutableGraph& s
     connect(_source, &Graph::nodeRemoved,  [this](const Graph*, NodeId nodeId) { _nodesState[nodeId].remove(); });
     connect(_source, &Graph::nodeAdded,    [this](const Graph*, NodeId nodeId) { _nodesState[nodeId].add(); });
     connect(_source, &Graph::edgeRemoved,  [this](const Graph*, EdgeId edgeId) { _edgesState[edgeId].remove(); });
-    connect(_source, &Graph::edgeAdded,    [this](const Graph*, EdgeId edgeId) { _edgesState[edgeId].add(); });
+    connect(_source, &Graph::edgeAdded,    [this](const Graph*, EdgeId edgeId) { markEdgeAdded(edgeId); });
 
     connect(&_target, &Graph::nodeRemoved, [this](const Graph*, NodeId nodeId) { _nodesState[nodeId].remove(); });
     connect(&_target, &Graph::nodeAdded,   [this](const Graph*, NodeId nodeId) { _nodesState[nodeId].add(); });
     connect(&_target, &Graph::edgeRemoved, [this](const Graph*, EdgeId edgeId) { _edgesState[edgeId].remove(); });
-    connect(&_target, &Graph::edgeAdded,   [this](const Graph*, EdgeId edgeId) { _edgesState[edgeId].add(); });
+    connect(&_target, &Graph::edgeAdded,   [this](const Graph*, EdgeId edgeId) { markEdgeAdded(edgeId); });
+
+    // Bulk additions, including those made by MutableGraph::clone, are signalled en masse
+    for(const auto* graph : {static_cast<const Graph*>(_source), static_cast<const Graph*>(&_target)})
+    {
+        connect(graph, &Graph::nodesAdded, [this](const Graph*, const std::vector<NodeId>& nodeIds)
+        {
+            for(auto nodeId : nodeIds)
+                _nodesState[nodeId].add();
+        });
+
+        connect(graph, &Graph::edgesAdded, [this](const Graph*, const std::vector<EdgeId>& edgeIds)
+        {
+            for(auto edgeId : edgeIds)
+                markEdgeAdded(edgeId);
+        });
+    }
 
     addTransform(std::make_unique<IdentityTransform>());
 }
 
+void TransformedGraph::markEdgeAdded(EdgeId edgeId)
+{
+    // An EdgeId that is removed then added again nets out to no change at all, but it
+    // may now refer to an edge between different nodes, which can't then be signalled
+    if(_edgesState[edgeId].removed())
+        requireFullComponentUpdate();
+
+    _edgesState[edgeId].add();
+}
+
 void TransformedGraph::cancelRebuild()
 {
     std::unique_lock<std::mutex> lock(_currentTransformMutex);
@@ -273,28 +300,41 @@ void TransformedGraph::onTargetGraphChanged(const Graph*)
 {
     // Let everything know what changed; note the signals won't necessarily happen in the order
     // in which the changes originally occurred, but adding nodes and edges, then removing edges
-    // and nodes ensures that the receivers get a sane view at all times
+    // and nodes ensures that the receivers get a sane view at all times; additions are
+    // signalled in bulk, as a rebuild can add the entire graph
+    std::vector<NodeId> addedNodeIds;
     for(NodeId nodeId(0); nodeId < _nodesState.size(); ++nodeId)
     {
         if(!_previousNodesState[nodeId].added() && _nodesState[nodeId].added())
-        {
-            emit nodeAdded(this, nodeId);
-            _changeSignalsEmitted = true;
-        }
+            addedNodeIds.push_back(nodeId);
+    }
+
+    if(!addedNodeIds.empty())
+    {
+        emit nodesAdded(this, addedNodeIds);
+        _changeSignalsEmitted = true;
     }
 
+    std::vector<EdgeId> addedEdgeIds;
+    std::vector<EdgeId> removedEdgeIds;
     for(EdgeId edgeId(0); edgeId < _edgesState.size(); ++edgeId)
     {
         if(!_previousEdgesState[edgeId].added() && _edgesState[edgeId].added())
-        {
-            emit edgeAdded(this, edgeId);
-            _changeSignalsEmitted = true;
-        }
+            addedEdgeIds.push_back(edgeId);
         else if(!_previousEdgesState[edgeId].removed() && _edgesState[edgeId].removed())
-        {
-            emit edgeRemoved(this, edgeId);
-            _changeSignalsEmitted = true;
-        }
+            removedEdgeIds.push_back(edgeId);
+    }
+
+    if(!addedEdgeIds.empty())
+    {
+        emit edgesAdded(this, addedEdgeIds);
+        _changeSignalsEmitted = true;
+    }
+
+    for(auto edgeId : removedEdgeIds)
+    {
+        emit edgeRemoved(this, edgeId);
+        _changeSignalsEmitted = true;
     }
 
     for(NodeId nodeId(0); nodeId < _nodesState.size(); ++nodeId)
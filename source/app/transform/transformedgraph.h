@@ -75,6 +75,7 @@ public:
     int multiplicityOf(EdgeId edgeId) const override { return _target.multiplicityOf(edgeId); }
 
     EdgeIdDistinctSets edgeIdsForNodeId(NodeId nodeId) const override { return _target.edgeIdsForNodeId(nodeId); }
+    std::shared_ptr<const AdjacencySnapshot> adjacencySnapshot() const override { return _target.adjacencySnapshot(); }
 
     std::vector<EdgeId> edgeIdsBetween(NodeId nodeIdA, NodeId nodeIdB) const override { return _target.edgeIdsBetween(nodeIdA, nodeIdB); }
     EdgeId firstEdgeIdBetween(NodeId nodeIdA, NodeId nodeIdB) const override { return _target.firstEdgeIdBetween(nodeIdA, nodeIdB); }
@@ -147,6 +148,7 @@ private:
     EdgeArray<State> _previousEdgesState;
 
     void rebuild();
+    void markEdgeAdded(EdgeId edgeId);
 
     void setCurrentTransform(GraphTransform* currentTransform);
 
@@ -20,108 +20,165 @@
 
 #include "transform/transformedgraph.h"
 #include "graph/graphmodel.h"
+#include "graph/adjacencysnapshot.h"
 
 #include "shared/graph/grapharray.h"
 #include "shared/utils/threadpool.h"
 
 #include <cstdint>
-#include <stack>
-#include <queue>
-#include <map>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <random>
 #include <thread>
+#include <memory>
 
-void BetweennessTransform::apply(TransformedGraph& target) const
+namespace
 {
-    target.setPhase(QStringLiteral("Betweenness"));
-    target.setProgress(0);
+using Index = AdjacencySnapshot::Index;
 
-    const auto& nodeIds = target.nodeIds();
-    const auto& edgeIds = target.edgeIds();
-    std::atomic_int progress(0);
-
-    struct BetweennessArrays
+// Brandes' algorithm, with all of its working storage allocated once per thread
+// and indexed densely, so that each source only costs the nodes it reaches
+struct Brandes
+{
+    explicit Brandes(const AdjacencySnapshot& adjacency) :
+        _adjacency(&adjacency),
+        _distance(static_cast<size_t>(adjacency.numNodes()), -1),
+        _sigma(static_cast<size_t>(adjacency.numNodes()), 0.0),
+        _delta(static_cast<size_t>(adjacency.numNodes()), 0.0),
+        _nodeBetweenness(static_cast<size_t>(adjacency.numNodes()), 0.0),
+        _entryBetweenness(static_cast<size_t>(adjacency.numEntries()), 0.0)
     {
-        explicit BetweennessArrays(TransformedGraph& graph) :
-            nodeBetweenness(graph, 0.0),
-            edgeBetweenness(graph, 0.0)
-        {}
-
-        NodeArray<double> nodeBetweenness;
-        EdgeArray<double> edgeBetweenness;
-    };
+        _order.reserve(static_cast<size_t>(adjacency.numNodes()));
+    }
 
-    std::vector<BetweennessArrays> betweennessArrays(
-        std::thread::hardware_concurrency(),
-        BetweennessArrays{target});
+    const AdjacencySnapshot* _adjacency;
 
-    parallel_for(nodeIds.begin(), nodeIds.end(),
-    [&](const NodeId nodeId, size_t threadIndex)
-    {
-        auto& arrays = betweennessArrays.at(threadIndex);
-        auto& _nodeBetweenness = arrays.nodeBetweenness;
-        auto& _edgeBetweenness = arrays.edgeBetweenness;
+    std::vector<Index> _order;
+    std::vector<int> _distance;
+    std::vector<double> _sigma;
+    std::vector<double> _delta;
 
-        // Brandes algorithm
-        NodeArray<std::vector<NodeId>> predecessors(target);
-        NodeArray<int64_t> sigma(target, 0);
-        NodeArray<int64_t> distance(target, -1);
-        NodeArray<double> delta(target, 0.0);
+    // Edges are accumulated per adjacency entry, and combined at the end
+    std::vector<double> _nodeBetweenness;
+    std::vector<double> _entryBetweenness;
 
-        std::stack<NodeId> stack;
-        std::queue<NodeId> queue;
+    void accumulateFrom(Index source, double scale)
+    {
+        const auto& offsets = _adjacency->offsets();
+        const auto& neighbours = _adjacency->neighbourIndices();
 
-        sigma[nodeId] = 1.0;
-        distance[nodeId] = 0;
-        queue.push(nodeId);
+        auto s = static_cast<size_t>(source);
+        _sigma[s] = 1.0;
+        _distance[s] = 0;
+        _order.push_back(source);
 
-        while(!queue.empty() && !cancelled())
+        // Breadth first, using _order as the queue
+        for(size_t head = 0; head < _order.size(); head++)
         {
-            auto other = queue.front();
-            queue.pop();
-            stack.push(other);
+            auto v = static_cast<size_t>(_order[head]);
 
-            for(auto neighbour : target.neighboursOf(other))
+            for(auto entry = offsets[v]; entry < offsets[v + 1]; entry++)
             {
-                if(distance[neighbour] < 0)
-                {
-                    queue.push(neighbour);
-                    distance[neighbour] = distance[other] + 1;
-                }
+                auto w = static_cast<size_t>(neighbours[entry]);
 
-                if(distance[neighbour] == distance[other] + 1)
+                if(_distance[w] < 0)
                 {
-                    sigma[neighbour] += sigma[other];
-                    predecessors[neighbour].push_back(other);
+                    _distance[w] = _distance[v] + 1;
+                    _order.push_back(static_cast<Index>(w));
                 }
+
+                if(_distance[w] == _distance[v] + 1)
+                    _sigma[w] += _sigma[v];
             }
         }
 
-        while(!stack.empty() && !cancelled())
+        // Any neighbour one step closer to the source is a predecessor
+        for(auto it = _order.rbegin(); it != _order.rend(); ++it)
         {
-            auto other = stack.top();
-            stack.pop();
+            auto w = static_cast<size_t>(*it);
 
-            for(auto predecessor : predecessors[other])
+            for(auto entry = offsets[w]; entry < offsets[w + 1]; entry++)
             {
-                auto d = (static_cast<double>(sigma[predecessor]) /
-                    static_cast<double>(sigma[other])) * (1.0 + delta[other]);
+                auto v = static_cast<size_t>(neighbours[entry]);
 
-                for(auto edgeId : target.edgeIdsBetween(predecessor, other))
-                    _edgeBetweenness[edgeId] += d;
+                if(_distance[v] != _distance[w] - 1)
+                    continue;
 
-                delta[predecessor] += d;
+                auto d = (_sigma[v] / _sigma[w]) * (1.0 + _delta[w]);
+                _entryBetweenness[entry] += d * scale;
+                _delta[v] += d;
             }
 
-            if(other != nodeId)
-                _nodeBetweenness[other] += delta[other];
+            if(w != s)
+                _nodeBetweenness[w] += _delta[w] * scale;
+        }
+
+        for(auto index : _order)
+        {
+            auto i = static_cast<size_t>(index);
+            _distance[i] = -1;
+            _sigma[i] = 0.0;
+            _delta[i] = 0.0;
+        }
+
+        _order.clear();
+    }
+};
+} // namespace
+
+void BetweennessTransform::apply(TransformedGraph& target) const
+{
+    target.setPhase(QStringLiteral("Betweenness"));
+    target.setProgress(0);
+
+    auto adjacency = target.adjacencySnapshot();
+    const auto numNodes = adjacency->numNodes();
+
+    std::vector<Index> sources(static_cast<size_t>(numNodes));
+    std::iota(sources.begin(), sources.end(), 0);
+
+    // Sampling sources gives an unbiased estimate, once scaled by numNodes / numSamples
+    double scale = 1.0;
+    if(config().parameterHasValue(QStringLiteral("Method"), QStringLiteral("Sampled")))
+    {
+        auto numSamples = static_cast<size_t>(std::get<int>(
+            config().parameterByName(QStringLiteral("Samples"))->_value));
+
+        if(numSamples < sources.size())
+        {
+            // Fixed seed, so that reapplying the transform gives the same result
+            std::mt19937 generator(static_cast<std::mt19937::result_type>(numNodes));
+            std::shuffle(sources.begin(), sources.end(), generator);
+
+            sources.resize(numSamples);
+            std::sort(sources.begin(), sources.end());
+
+            scale = static_cast<double>(numNodes) / static_cast<double>(numSamples);
         }
+    }
+
+    std::vector<std::unique_ptr<Brandes>> brandes(std::thread::hardware_concurrency());
+    std::atomic_int progress(0);
+
+    if(!sources.empty())
+    {
+        parallel_for(sources.begin(), sources.end(),
+        [&](Index source, size_t threadIndex)
+        {
+            if(cancelled())
+                return;
+
+            auto& threadBrandes = brandes.at(threadIndex);
+            if(threadBrandes == nullptr)
+                threadBrandes = std::make_unique<Brandes>(*adjacency);
 
-        progress++;
-        target.setProgress(progress.load() * 100 / static_cast<int>(target.numNodes()));
+            threadBrandes->accumulateFrom(source, scale);
 
-        if(cancelled())
-            return;
-    });
+            progress++;
+            target.setProgress(progress.load() * 100 / static_cast<int>(sources.size()));
+        });
+    }
 
     target.setProgress(-1);
 
@@ -130,13 +187,18 @@ void BetweennessTransform::apply(TransformedGraph& target) const
 
     NodeArray<double> nodeBetweenness(target, 0.0);
     EdgeArray<double> edgeBetweenness(target, 0.0);
-    for(const auto& arrays : betweennessArrays)
+    const auto& neighbourEdgeIds = adjacency->neighbourEdgeIds();
+
+    for(const auto& threadBrandes : brandes)
     {
-        for(auto nodeId : nodeIds)
-            nodeBetweenness[nodeId] += arrays.nodeBetweenness[nodeId];
+        if(threadBrandes == nullptr)
+            continue;
+
+        for(Index index = 0; index < numNodes; index++)
+            nodeBetweenness[adjacency->nodeIdAt(index)] += threadBrandes->_nodeBetweenness[static_cast<size_t>(index)];
 
-        for(auto edgeId : edgeIds)
-            edgeBetweenness[edgeId] += arrays.edgeBetweenness[edgeId];
+        for(size_t entry = 0; entry < neighbourEdgeIds.size(); entry++)
+            edgeBetweenness[neighbourEdgeIds[entry]] += threadBrandes->_entryBetweenness[entry];
     }
 
     _graphModel->createAttribute(QObject::tr("Node Betweenness"))
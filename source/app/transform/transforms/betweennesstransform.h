@@ -50,6 +50,27 @@ public:
     }
     QString category() const override { return QObject::tr("Metrics"); }
     ElementType elementType() const override { return ElementType::None; }
+
+    GraphTransformParameters parameters() const override
+    {
+        return
+        {
+            GraphTransformParameter::create("Method")
+                .setType(ValueType::StringList)
+                .setDescription(QObject::tr("Exact considers the shortest paths from every node, "
+                    "which becomes slow for large graphs. Sampled estimates betweenness from the "
+                    "shortest paths of a random subset of the nodes."))
+                .setInitialValue(QStringList{"Exact", "Sampled"}),
+
+            GraphTransformParameter::create("Samples")
+                .setType(ValueType::Int)
+                .setDescription(QObject::tr("When sampling, the number of nodes whose shortest paths "
+                    "are considered. More samples give a more accurate estimate, more slowly."))
+                .setInitialValue(1000)
+                .setMin(1)
+        };
+    }
+
     DefaultVisualisations defaultVisualisations() const override
     {
         return
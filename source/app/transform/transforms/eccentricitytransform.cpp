@@ -19,94 +19,404 @@
 #include "eccentricitytransform.h"
 #include "transform/transformedgraph.h"
 #include "graph/graphmodel.h"
+#include "graph/adjacencysnapshot.h"
+
+#include "shared/graph/grapharray.h"
 #include "shared/utils/threadpool.h"
 
-#include <map>
-#include <queue>
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <bit>
+#include <thread>
+#include <memory>
 
-void EccentricityTransform::apply(TransformedGraph& target) const
+namespace
 {
-    target.setPhase(QStringLiteral("Eccentricity"));
-    calculateDistances(target);
-}
+using Index = AdjacencySnapshot::Index;
+using SourceBits = uint64_t;
 
-void EccentricityTransform::calculateDistances(TransformedGraph& target) const
+const size_t SourcesPerSearch = 64;
+
+using Eccentricities = std::array<int, SourcesPerSearch>;
+
+// Breadth first searches from up to 64 sources at once, where bit i of a node's bitset
+// corresponds to source i. Each level is found by pushing the bitsets of the previous
+// level's nodes to their neighbours, so a single pass over the edges of the frontier
+// advances every search, and nodes the searches don't reach are never touched
+class MultiSourceBFS
 {
-    // Setup the contiguous ids
-    NodeIdMap<int> nodeIdToMatrixIndex;
-    for(auto nodeId : target.nodeIds())
-    {
-        auto size = static_cast<int>(nodeIdToMatrixIndex.size());
-        nodeIdToMatrixIndex[nodeId] = size;
-    }
+private:
+    const AdjacencySnapshot* _adjacency;
 
-    NodeArray<int> maxDistances(target);
+    std::vector<SourceBits> _seen;
+    std::vector<SourceBits> _frontier;
+    std::vector<SourceBits> _next;
 
-    target.setProgress(0);
+    std::vector<Index> _frontierNodes;
+    std::vector<Index> _nextNodes;
+    std::vector<Index> _reachedNodes;
 
-    const auto& nodeIds = target.nodeIds();
-    std::atomic_int progress(0);
-    parallel_for(nodeIds.begin(), nodeIds.end(),
-    [this, &maxDistances, &progress, &target](const NodeId source)
+public:
+    explicit MultiSourceBFS(const AdjacencySnapshot& adjacency) :
+        _adjacency(&adjacency),
+        _seen(static_cast<size_t>(adjacency.numNodes()), 0),
+        _frontier(static_cast<size_t>(adjacency.numNodes()), 0),
+        _next(static_cast<size_t>(adjacency.numNodes()), 0)
+    {}
+
+    // Returns the eccentricity of each source; visitFn(node, sources, distance) is called
+    // for each level at which a node is reached, with the sources that reach it there
+    template<typename VisitFn>
+    Eccentricities search(const Index* sources, size_t numSources,
+        const Cancellable& cancellable, const VisitFn& visitFn)
     {
-        if(cancelled())
-            return;
+        Q_ASSERT(numSources <= SourcesPerSearch);
+        Eccentricities eccentricities{};
+
+        const auto& offsets = _adjacency->offsets();
+        const auto& neighbours = _adjacency->neighbourIndices();
 
-        NodeArray<int> distance(target);
-        NodeArray<bool> visited(target);
+        for(size_t i = 0; i < numSources; i++)
+        {
+            auto s = static_cast<size_t>(sources[i]); // NOLINT
 
-        auto comparator = [&distance](NodeId a, NodeId b){ return distance[a] > distance[b]; };
-        std::priority_queue<NodeId, std::vector<NodeId>, decltype(comparator)> queue(comparator);
+            if(_seen[s] == 0)
+            {
+                _frontierNodes.push_back(sources[i]); // NOLINT
+                _reachedNodes.push_back(sources[i]); // NOLINT
+            }
 
-        for(auto nodeId : target.nodeIds())
-            distance[nodeId] = std::numeric_limits<int>::max();
+            _seen[s] |= SourceBits{1} << i;
+            _frontier[s] = _seen[s];
+        }
 
-        queue.push(source);
-        distance[source] = 0;
+        for(auto source : _frontierNodes)
+            visitFn(source, _frontier[static_cast<size_t>(source)], 0);
 
-        while(!queue.empty())
+        for(int distance = 1; !_frontierNodes.empty(); distance++)
         {
-            if(cancelled())
-                return;
+            if(cancellable.cancelled())
+                break;
+
+            for(auto node : _frontierNodes)
+            {
+                auto v = static_cast<size_t>(node);
+                auto bits = _frontier[v];
+
+                for(auto entry = offsets[v]; entry < offsets[v + 1]; entry++)
+                {
+                    auto w = static_cast<size_t>(neighbours[entry]);
+                    auto newBits = bits & ~(_seen[w] | _next[w]);
+
+                    if(newBits == 0)
+                        continue;
+
+                    if(_next[w] == 0)
+                        _nextNodes.push_back(neighbours[entry]);
+
+                    _next[w] |= newBits;
+                }
+
+                _frontier[v] = 0;
+            }
+
+            SourceBits reached = 0;
+            for(auto node : _nextNodes)
+            {
+                auto w = static_cast<size_t>(node);
+
+                if(_seen[w] == 0)
+                    _reachedNodes.push_back(node);
+
+                _seen[w] |= _next[w];
+                _frontier[w] = _next[w];
+                _next[w] = 0;
 
-            auto nodeId = queue.top();
-            queue.pop();
+                reached |= _frontier[w];
+                visitFn(node, _frontier[w], distance);
+            }
+
+            // A source's eccentricity is the furthest distance at which it reaches anything
+            for(auto bits = reached; bits != 0; bits &= bits - 1)
+                eccentricities.at(static_cast<size_t>(std::countr_zero(bits))) = distance;
+
+            std::swap(_frontierNodes, _nextNodes);
+            _nextNodes.clear();
+        }
+
+        for(auto node : _reachedNodes)
+        {
+            auto i = static_cast<size_t>(node);
+            _seen[i] = 0;
+            _frontier[i] = 0;
+            _next[i] = 0;
+        }
+
+        _reachedNodes.clear();
+        _frontierNodes.clear();
+        _nextNodes.clear();
 
-            if(visited.get(nodeId))
-                continue;
+        return eccentricities;
+    }
+};
+
+// Sources that are close to each other reach most nodes at similar distances, and so share
+// frontiers; a breadth first order over the whole graph puts such sources in the same search
+std::vector<Index> breadthFirstOrder(const AdjacencySnapshot& adjacency)
+{
+    const auto numNodes = static_cast<size_t>(adjacency.numNodes());
+
+    std::vector<Index> order;
+    order.reserve(numNodes);
+    std::vector<bool> visited(numNodes, false);
 
-            visited.set(nodeId, true);
+    for(size_t root = 0; root < numNodes; root++)
+    {
+        if(visited[root])
+            continue;
+
+        visited[root] = true;
+        order.push_back(static_cast<Index>(root));
 
-            auto nodeWeight = distance[nodeId];
-            for(EdgeId edgeId : target.edgeIdsForNodeId(nodeId))
+        for(auto head = order.size() - 1; head < order.size(); head++)
+        {
+            for(auto neighbour : adjacency.neighbours(order[head]))
             {
-                NodeId adjacentNodeId = target.edgeById(edgeId).oppositeId(nodeId);
-                const int adjacentNodeWeight = 1;
-                if(!visited.get(adjacentNodeId) && (nodeWeight + adjacentNodeWeight < distance[adjacentNodeId]))
+                auto n = static_cast<size_t>(neighbour);
+
+                if(!visited[n])
                 {
-                    distance[adjacentNodeId] = nodeWeight + adjacentNodeWeight;
-                    queue.push(adjacentNodeId);
+                    visited[n] = true;
+                    order.push_back(neighbour);
                 }
             }
         }
+    }
+
+    return order;
+}
+
+void atomicMax(std::atomic<int>& target, int value)
+{
+    auto current = target.load(std::memory_order_relaxed);
+    while(value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+void atomicMin(std::atomic<int>& target, int value)
+{
+    auto current = target.load(std::memory_order_relaxed);
+    while(value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+class EccentricityCalculator
+{
+private:
+    const AdjacencySnapshot* _adjacency;
+    TransformedGraph* _target;
+    const Cancellable* _cancellable;
+
+    std::vector<std::unique_ptr<MultiSourceBFS>> _searches;
+
+    MultiSourceBFS& search(size_t threadIndex)
+    {
+        auto& search = _searches.at(threadIndex);
+        if(search == nullptr)
+            search = std::make_unique<MultiSourceBFS>(*_adjacency);
+
+        return *search;
+    }
+
+    static std::vector<size_t> searchStarts(size_t numSources)
+    {
+        std::vector<size_t> starts;
+        for(size_t start = 0; start < numSources; start += SourcesPerSearch)
+            starts.push_back(start);
+
+        return starts;
+    }
+
+    void setProgress(size_t numDone) const
+    {
+        _target->setProgress(static_cast<int>((numDone * 100) /
+            static_cast<size_t>(_adjacency->numNodes())));
+    }
+
+public:
+    EccentricityCalculator(const AdjacencySnapshot& adjacency,
+        TransformedGraph& target, const Cancellable& cancellable) :
+        _adjacency(&adjacency), _target(&target), _cancellable(&cancellable),
+        _searches(std::thread::hardware_concurrency())
+    {}
+
+    // Searches from every node
+    std::vector<int> fromAllSources()
+    {
+        const auto numNodes = static_cast<size_t>(_adjacency->numNodes());
+        std::vector<int> eccentricities(numNodes, 0);
+
+        auto sources = breadthFirstOrder(*_adjacency);
+        auto starts = searchStarts(numNodes);
+        std::atomic<size_t> numDone(0);
+
+        parallel_for(starts.begin(), starts.end(),
+        [&](size_t start, size_t threadIndex)
+        {
+            if(_cancellable->cancelled())
+                return;
+
+            auto numSources = std::min(SourcesPerSearch, numNodes - start);
+            auto searchEccentricities = search(threadIndex).search(&sources[start],
+                numSources, *_cancellable, [](Index, SourceBits, int) {});
+
+            for(size_t i = 0; i < numSources; i++)
+                eccentricities[static_cast<size_t>(sources[start + i])] = searchEccentricities.at(i);
+
+            setProgress(numDone += numSources);
+        });
+
+        return eccentricities;
+    }
+
+    // Takes and Kosters' bounding eccentricities algorithm; a search from a node with
+    // eccentricity e bounds the eccentricity of a node at distance d to between
+    // max(d, e - d) and e + d, and once the bounds of a node meet, it needn't be
+    // searched from. The nodes with the largest upper and the smallest lower bounds
+    // are chosen as sources, as they tend to tighten the bounds of the others the most
+    std::vector<int> byBounding()
+    {
+        const auto numNodes = static_cast<size_t>(_adjacency->numNodes());
+        const auto maxSources = _searches.size() * SourcesPerSearch;
+
+        std::vector<std::atomic<int>> lowerBounds(numNodes);
+        std::vector<std::atomic<int>> upperBounds(numNodes);
+        for(size_t i = 0; i < numNodes; i++)
+        {
+            lowerBounds[i] = 0;
+            upperBounds[i] = std::numeric_limits<int>::max();
+        }
+
+        std::vector<Index> unresolved(numNodes);
+        std::iota(unresolved.begin(), unresolved.end(), 0);
+
+        auto byDegree = [this](Index a, Index b) { return _adjacency->degree(a) > _adjacency->degree(b); };
+
+        auto largestUpperBound = [&](Index a, Index b)
+        {
+            auto ua = upperBounds[static_cast<size_t>(a)].load();
+            auto ub = upperBounds[static_cast<size_t>(b)].load();
+            return ua != ub ? ua > ub : byDegree(a, b);
+        };
+
+        auto smallestLowerBound = [&](Index a, Index b)
+        {
+            auto la = lowerBounds[static_cast<size_t>(a)].load();
+            auto lb = lowerBounds[static_cast<size_t>(b)].load();
+            return la != lb ? la < lb : byDegree(a, b);
+        };
 
-        int maxDistance = 0;
-        for(auto nodeId : target.nodeIds())
+        while(!unresolved.empty())
         {
-            if(distance[nodeId] != std::numeric_limits<int>::max())
-                maxDistance = std::max(distance[nodeId], maxDistance);
+            if(_cancellable->cancelled())
+                break;
+
+            // Half of the sources by each criterion
+            auto numSources = std::min(maxSources, unresolved.size());
+            if(numSources < unresolved.size())
+            {
+                auto half = unresolved.begin() + static_cast<std::ptrdiff_t>(numSources / 2);
+                auto last = unresolved.begin() + static_cast<std::ptrdiff_t>(numSources);
+
+                std::nth_element(unresolved.begin(), half, unresolved.end(), largestUpperBound);
+                std::nth_element(half, last, unresolved.end(), smallestLowerBound);
+            }
+
+            auto starts = searchStarts(numSources);
+
+            parallel_for(starts.begin(), starts.end(),
+            [&](size_t start, size_t threadIndex)
+            {
+                if(_cancellable->cancelled())
+                    return;
+
+                const auto* sources = &unresolved[start];
+                auto numSearchSources = std::min(SourcesPerSearch, numSources - start);
+                auto& bfs = search(threadIndex);
+
+                // The eccentricities of the sources are needed to bound
+                // the others, so the search is made a second time to do so
+                auto sourceEccentricities = bfs.search(sources, numSearchSources,
+                    *_cancellable, [](Index, SourceBits, int) {});
+
+                bfs.search(sources, numSearchSources, *_cancellable,
+                [&](Index node, SourceBits bits, int distance)
+                {
+                    int lowerBound = 0;
+                    int upperBound = std::numeric_limits<int>::max();
+
+                    for(; bits != 0; bits &= bits - 1)
+                    {
+                        auto eccentricity = sourceEccentricities.at(static_cast<size_t>(std::countr_zero(bits)));
+
+                        lowerBound = std::max({lowerBound, distance, eccentricity - distance});
+                        upperBound = std::min(upperBound, eccentricity + distance);
+                    }
+
+                    atomicMax(lowerBounds[static_cast<size_t>(node)], lowerBound);
+                    atomicMin(upperBounds[static_cast<size_t>(node)], upperBound);
+                });
+            });
+
+            // Every source is resolved, so this always makes progress
+            unresolved.erase(std::remove_if(unresolved.begin(), unresolved.end(), [&](Index node)
+            {
+                auto i = static_cast<size_t>(node);
+                return lowerBounds[i] >= upperBounds[i];
+            }), unresolved.end());
+
+            setProgress(numNodes - unresolved.size());
         }
 
-        maxDistances[source] = maxDistance;
-        progress++;
-        target.setProgress(progress.load() * 100 / static_cast<int>(target.numNodes()));
-    });
+        std::vector<int> eccentricities(numNodes);
+        for(size_t i = 0; i < numNodes; i++)
+            eccentricities[i] = lowerBounds[i];
+
+        return eccentricities;
+    }
+};
+} // namespace
+
+void EccentricityTransform::apply(TransformedGraph& target) const
+{
+    target.setPhase(QStringLiteral("Eccentricity"));
+    target.setProgress(0);
+
+    auto adjacency = target.adjacencySnapshot();
+
+    std::vector<int> eccentricities;
+    if(adjacency->numNodes() > 0)
+    {
+        EccentricityCalculator calculator(*adjacency, target, *this);
+
+        if(config().parameterHasValue(QStringLiteral("Method"), QStringLiteral("Bounding")))
+            eccentricities = calculator.byBounding();
+        else
+            eccentricities = calculator.fromAllSources();
+    }
 
     target.setProgress(-1);
 
     if(cancelled())
         return;
 
+    NodeArray<int> maxDistances(target);
+    for(size_t i = 0; i < eccentricities.size(); i++)
+        maxDistances[adjacency->nodeIdAt(static_cast<Index>(i))] = eccentricities[i];
+
     _graphModel->createAttribute(QObject::tr("Node Eccentricity"))
         .setDescription(QObject::tr("A node's eccentricity is the length of the shortest path to the furthest node."))
         .setIntValueFn([maxDistances](NodeId nodeId) { return maxDistances[nodeId]; })
@@ -30,7 +30,6 @@ public:
 
 private:
     GraphModel* _graphModel = nullptr;
-    void calculateDistances(TransformedGraph& target) const;
 };
 
 class EccentricityTransformFactory : public GraphTransformFactory
@@ -49,6 +48,21 @@ public:
     }
     QString category() const override { return QObject::tr("Metrics"); }
     ElementType elementType() const override { return ElementType::None; }
+
+    GraphTransformParameters parameters() const override
+    {
+        return
+        {
+            GraphTransformParameter::create("Method")
+                .setType(ValueType::StringList)
+                .setDescription(QObject::tr("All Sources performs a breadth first search from every node. "
+                    "Bounding searches from a few nodes at a time, using the results to bound the "
+                    "eccentricities of the others, until every one is known. Both give the same "
+                    "result, but Bounding is usually much faster for large graphs."))
+                .setInitialValue(QStringList{"All Sources", "Bounding"})
+        };
+    }
+
     DefaultVisualisations defaultVisualisations() const override
     {
         return {{"Node Eccentricity", ValueType::Float, {AttributeFlag::VisualiseByComponent}, QObject::tr("Colour")}};
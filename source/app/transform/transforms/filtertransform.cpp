@@ -19,6 +19,7 @@
 #include "filtertransform.h"
 #include "transform/transformedgraph.h"
 #include "attributes/conditionfncreator.h"
+#include "attributes/compiledcondition.h"
 
 #include "graph/graphmodel.h"
 #include "graph/graphcomponent.h"
@@ -42,19 +43,21 @@ void FilterTransform::apply(TransformedGraph& target) const
     {
     case ElementType::Node:
     {
-        auto conditionFn = CreateConditionFnFor::node(*_graphModel, config()._condition);
-        if(conditionFn == nullptr)
+        CompiledCondition<NodeId> condition(*_graphModel, config()._condition);
+        if(!condition.isValid())
         {
             addAlert(AlertType::Error, QObject::tr("Invalid condition"));
             return;
         }
 
+        const auto& nodeIds = target.nodeIds();
+        auto results = condition.evaluate(target, nodeIds);
         std::vector<NodeId> removees;
 
-        for(auto nodeId : target.nodeIds())
+        for(size_t i = 0; i < nodeIds.size(); i++)
         {
-            if(u::exclusiveOr(conditionFn(nodeId), _invert))
-                removees.push_back(nodeId);
+            if(u::exclusiveOr(CompiledCondition<NodeId>::test(results, i), _invert))
+                removees.push_back(nodeIds[i]);
         }
 
         auto numRemovees = static_cast<uint64_t>(removees.size());
@@ -69,19 +72,21 @@ void FilterTransform::apply(TransformedGraph& target) const
 
     case ElementType::Edge:
     {
-        auto conditionFn = CreateConditionFnFor::edge(*_graphModel, config()._condition);
-        if(conditionFn == nullptr)
+        CompiledCondition<EdgeId> condition(*_graphModel, config()._condition);
+        if(!condition.isValid())
         {
             addAlert(AlertType::Error, QObject::tr("Invalid condition"));
             return;
         }
 
+        const auto& edgeIds = target.edgeIds();
+        auto results = condition.evaluate(target, edgeIds);
         std::vector<EdgeId> removees;
 
-        for(auto edgeId : target.edgeIds())
+        for(size_t i = 0; i < edgeIds.size(); i++)
         {
-            if(u::exclusiveOr(conditionFn(edgeId), _invert))
-                removees.push_back(edgeId);
+            if(u::exclusiveOr(CompiledCondition<EdgeId>::test(results, i), _invert))
+                removees.push_back(edgeIds[i]);
         }
 
         auto numRemovees = static_cast<uint64_t>(removees.size());
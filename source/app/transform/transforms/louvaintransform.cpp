@@ -21,324 +21,679 @@
 #include "transform/transformedgraph.h"
 
 #include "shared/graph/grapharray.h"
-#include "shared/utils/container.h"
+#include "shared/utils/threadpool.h"
 
 #include "graph/graphmodel.h"
+#include "graph/adjacencysnapshot.h"
 
-#include <map>
 #include <vector>
 #include <algorithm>
+#include <numeric>
+#include <memory>
+#include <thread>
 #include <cmath>
 
-// https://arxiv.org/abs/0803.0476
+// Louvain: https://arxiv.org/abs/0803.0476
+// Leiden: https://arxiv.org/abs/1810.08473
 
-void LouvainTransform::apply(TransformedGraph& target) const
+namespace
 {
-    auto resolution = 1.0 - std::get<double>(
-        config().parameterByName(QStringLiteral("Granularity"))->_value);
+using Index = AdjacencySnapshot::Index;
+const Index NullIndex = AdjacencySnapshot::NullIndex;
 
-    const auto minResolution = 0.5;
-    const auto maxResolution = 30.0;
+// Nodes are moved in batches; the moves within a batch are evaluated
+// in parallel against the state at the start of the batch, then applied
+const size_t BatchSize = 4096;
 
-    const auto logMin = std::log10(minResolution);
-    const auto logMax = std::log10(maxResolution);
-    const auto logRange = logMax - logMin;
+// Each sweep must improve quality, but only by a vanishingly
+// small amount in the worst case, so give up eventually
+const int MaxSweeps = 64;
 
-    resolution = std::pow(10.0f, logMin + (resolution * logRange));
+// One level of the community hierarchy, in compressed sparse row form. Loops
+// are not stored as entries, but are included in the weighted degrees.
+struct WeightedGraph
+{
+    std::vector<size_t> _offsets{0};
+    std::vector<Index> _neighbours;
+    std::vector<double> _weights;
+    std::vector<double> _degrees;
 
-    using CommunityId = NodeId; // Slight Hack, be careful with this
+    size_t numNodes() const { return _degrees.size(); }
+};
 
-    const auto& edgeIds = target.edgeIds();
-    EdgeArray<double> weights(target, 1.0);
+// Accumulates edge weight by community; only the communities touched are
+// reset afterwards, so the storage can be reused without clearing all of it
+struct CommunityWeights
+{
+    std::vector<double> _weights;
+    std::vector<char> _touched;
+    std::vector<Index> _communities;
 
-    if(_weighted)
+    explicit CommunityWeights(size_t size) :
+        _weights(size, 0.0), _touched(size, 0)
+    {}
+
+    void add(Index community, double weight)
     {
-        if(config().attributeNames().empty())
+        auto c = static_cast<size_t>(community);
+
+        if(_touched[c] == 0)
         {
-            addAlert(AlertType::Error, QObject::tr("Invalid parameter"));
-            return;
+            _touched[c] = 1;
+            _communities.push_back(community);
         }
 
-        auto attribute = _graphModel->attributeValueByName(
-            config().attributeNames().front());
+        _weights[c] += weight;
+    }
 
-        for(auto edgeId : edgeIds)
-            weights[edgeId] = attribute.numericValueOf(edgeId);
+    double weightOf(Index community) const { return _weights[static_cast<size_t>(community)]; }
+
+    void clear()
+    {
+        for(auto community : _communities)
+        {
+            auto c = static_cast<size_t>(community);
+            _weights[c] = 0.0;
+            _touched[c] = 0;
+        }
+
+        _communities.clear();
     }
+};
 
-    double totalWeight = std::accumulate(edgeIds.begin(), edgeIds.end(), 0.0,
-    [&weights](double d, EdgeId edgeId)
+// Relabels communities to be contiguous from 0, in order of first
+// appearance, returning the number of communities
+size_t relabel(std::vector<Index>& communities)
+{
+    std::vector<Index> labels(communities.size(), NullIndex);
+    Index nextLabel = 0;
+
+    for(auto& community : communities)
     {
-        return d + weights[edgeId];
-    });
+        auto& label = labels[static_cast<size_t>(community)];
+        if(label == NullIndex)
+            label = nextLabel++;
 
-    std::vector<NodeArray<CommunityId>> iterations;
-    size_t progressIteration = 1;
-    target.setPhase(QStringLiteral("Louvain Initialising"));
+        community = label;
+    }
+
+    return static_cast<size_t>(nextLabel);
+}
+
+// The indices of each community's members, grouped contiguously; the members
+// of community c are in [offsets[c], offsets[c + 1])
+void groupByCommunity(const std::vector<Index>& communities, size_t numCommunities,
+    std::vector<size_t>& offsets, std::vector<Index>& members)
+{
+    offsets.assign(numCommunities + 1, 0);
+    for(auto community : communities)
+        offsets[static_cast<size_t>(community) + 1]++;
 
-    NodeArray<CommunityId> communities(target);
-    NodeArray<double> weightedDegrees(target);
-    std::map<CommunityId, int> communityDegrees;
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-    auto add = [&](CommunityId community, NodeId nodeId)
+    auto positions = offsets;
+    members.resize(communities.size());
+    for(size_t i = 0; i < communities.size(); i++)
+        members[positions[static_cast<size_t>(communities[i])]++] = static_cast<Index>(i);
+}
+
+class CommunityDetection
+{
+private:
+    TransformedGraph* _target;
+    const Cancellable* _cancellable;
+    double _resolution;
+    double _totalWeight;
+    size_t _maxNumNodes;
+
+    std::vector<std::unique_ptr<CommunityWeights>> _communityWeights;
+
+    CommunityWeights& communityWeights(size_t threadIndex)
     {
-        communities[nodeId] = community;
-        communityDegrees[community] += static_cast<int>(weightedDegrees[nodeId]);
-    };
+        auto& communityWeights = _communityWeights.at(threadIndex);
+        if(communityWeights == nullptr)
+            communityWeights = std::make_unique<CommunityWeights>(_maxNumNodes);
+
+        return *communityWeights;
+    }
 
-    auto remove = [&](CommunityId community, NodeId nodeId)
+    // The change in quality from joining a community of communityDegree
+    // total weighted degree, to which there is weight edge weight
+    double gain(double weight, double communityDegree, double degree) const
     {
-        communities[nodeId].setToNull();
-        communityDegrees[community] -= static_cast<int>(weightedDegrees[nodeId]);
-    };
+        return (_resolution * weight) - ((communityDegree * degree) / _totalWeight);
+    }
 
-    auto relabel = [&](MutableGraph& graph)
+    // Leiden only merges (nodes and) refined communities that are sufficiently
+    // connected to the rest of the community in which they reside
+    bool wellConnected(double externalWeight, double degree, double communityDegree) const
     {
-        std::map<CommunityId, CommunityId> idMap;
-        CommunityId nextCommunityId = 0;
+        return externalWeight >= (degree * (communityDegree - degree)) / (_resolution * _totalWeight);
+    }
+
+public:
+    CommunityDetection(TransformedGraph& target, const Cancellable& cancellable,
+        double resolution, double totalWeight, size_t maxNumNodes) :
+        _target(&target), _cancellable(&cancellable),
+        _resolution(resolution), _totalWeight(totalWeight), _maxNumNodes(maxNumNodes),
+        _communityWeights(std::thread::hardware_concurrency())
+    {}
+
+    bool cancelled() const { return _cancellable->cancelled(); }
+
+    void moveNodes(const WeightedGraph& graph, std::vector<Index>& communities, int level)
+    {
+        const auto numNodes = graph.numNodes();
+
+        std::vector<double> communityDegrees(numNodes, 0.0);
+        std::vector<int> communitySizes(numNodes, 0);
 
-        for(auto nodeId : graph.nodeIds())
+        for(size_t i = 0; i < numNodes; i++)
         {
-            if(graph.typeOf(nodeId) == MultiElementType::Tail)
-                continue;
+            auto c = static_cast<size_t>(communities[i]);
+            communityDegrees[c] += graph._degrees[i];
+            communitySizes[c]++;
+        }
 
-            auto oldCommunityId = communities[nodeId];
+        std::vector<Index> nodes(numNodes);
+        std::iota(nodes.begin(), nodes.end(), 0);
 
-            if(!u::contains(idMap, oldCommunityId))
-                communities[nodeId] = idMap[oldCommunityId] = nextCommunityId++;
-            else
-                communities[nodeId] = idMap.at(oldCommunityId);
+        // There are as many labels as there are nodes, so
+        // an unused one is always available to a node that leaves
+        std::vector<Index> emptyCommunities;
+        for(size_t c = 0; c < numNodes; c++)
+        {
+            if(communitySizes[c] == 0)
+                emptyCommunities.push_back(static_cast<Index>(c));
         }
-    };
 
-    auto coarsen = [&](MutableGraph& graph)
-    {
-        MutableGraph coarseGraph;
-        EdgeArray<double> newWeights(target, 0.0);
+        std::vector<Index> moves(numNodes);
 
-        coarseGraph.performTransaction([&](IMutableGraph&)
+        for(int sweep = 1; sweep <= MaxSweeps; sweep++)
         {
-            // Create a node for each community
-            for(auto nodeId : graph.nodeIds())
+            _target->setPhase(QStringLiteral("Louvain Iteration %1.%2")
+                .arg(QString::number(level), QString::number(sweep)));
+
+            size_t numMoves = 0;
+
+            for(size_t batchStart = 0; batchStart < numNodes; batchStart += BatchSize)
             {
-                if(graph.typeOf(nodeId) == MultiElementType::Tail)
-                    continue;
+                if(cancelled())
+                    return;
 
-                auto newNodeId = communities[nodeId];
+                auto batchBegin = nodes.begin() + static_cast<std::ptrdiff_t>(batchStart);
+                auto batchEnd = nodes.begin() + static_cast<std::ptrdiff_t>(std::min(batchStart + BatchSize, numNodes));
 
-                if(coarseGraph.containsNodeId(newNodeId))
-                    continue;
+                parallel_for(batchBegin, batchEnd,
+                [&](Index node, size_t threadIndex)
+                {
+                    auto i = static_cast<size_t>(node);
+                    auto& weights = communityWeights(threadIndex);
 
-                coarseGraph.reserveNodeId(newNodeId);
-                auto assignedNodeId = coarseGraph.addNode(newNodeId);
-                Q_ASSERT(assignedNodeId == newNodeId);
-            }
+                    for(auto entry = graph._offsets[i]; entry < graph._offsets[i + 1]; entry++)
+                        weights.add(communities[static_cast<size_t>(graph._neighbours[entry])], graph._weights[entry]);
 
-            uint64_t edgeIndex = 0;
+                    const auto degree = graph._degrees[i];
+                    const auto community = communities[i];
+                    const auto c = static_cast<size_t>(community);
 
-            // Create an edge between community nodes for each
-            // pair of connected communities in the base graph
-            for(auto edgeId : graph.edgeIds())
-            {
-                target.setProgress(static_cast<int>((edgeIndex++ * 100) / graph.numEdges()));
+                    auto bestCommunity = community;
+                    auto bestGain = gain(weights.weightOf(community), communityDegrees[c] - degree, degree);
 
-                if(cancelled())
-                    break;
+                    // Moving to an empty community is also an option, for which the gain is 0
+                    if(communitySizes[c] > 1 && bestGain < 0.0)
+                    {
+                        bestCommunity = NullIndex;
+                        bestGain = 0.0;
+                    }
+
+                    for(auto neighbourCommunity : weights._communities)
+                    {
+                        auto n = static_cast<size_t>(neighbourCommunity);
+
+                        if(neighbourCommunity == community)
+                            continue;
+
+                        // Two singletons may otherwise swap with each other indefinitely
+                        if(communitySizes[c] == 1 && communitySizes[n] == 1 && neighbourCommunity > community)
+                            continue;
+
+                        auto neighbourGain = gain(weights.weightOf(neighbourCommunity), communityDegrees[n], degree);
+                        if(neighbourGain > bestGain)
+                        {
+                            bestGain = neighbourGain;
+                            bestCommunity = neighbourCommunity;
+                        }
+                    }
+
+                    weights.clear();
+                    moves[i] = bestCommunity;
+                });
+
+                // Earlier moves in the batch may have made a move worse than staying put, so
+                // each is checked against the current state before it's applied; this ensures
+                // quality always increases, which would otherwise oscillate indefinitely
+                for(auto it = batchBegin; it != batchEnd; ++it)
+                {
+                    auto i = static_cast<size_t>(*it);
+                    auto from = static_cast<size_t>(communities[i]);
+
+                    if(moves[i] == communities[i])
+                        continue;
+
+                    double fromWeight = 0.0;
+                    double toWeight = 0.0;
 
-                const auto& edge = graph.edgeById(edgeId);
-                auto sourceId = communities.at(edge.sourceId());
-                auto targetId = communities.at(edge.targetId());
-                double newWeight = weights[edgeId];
+                    for(auto entry = graph._offsets[i]; entry < graph._offsets[i + 1]; entry++)
+                    {
+                        auto neighbourCommunity = communities[static_cast<size_t>(graph._neighbours[entry])];
+
+                        if(neighbourCommunity == communities[i])
+                            fromWeight += graph._weights[entry];
+                        else if(neighbourCommunity == moves[i])
+                            toWeight += graph._weights[entry];
+                    }
+
+                    const auto degree = graph._degrees[i];
+                    auto stayGain = gain(fromWeight, communityDegrees[from] - degree, degree);
+                    auto moveGain = moves[i] != NullIndex ?
+                        gain(toWeight, communityDegrees[static_cast<size_t>(moves[i])], degree) : 0.0;
 
-                auto newEdgeId = coarseGraph.firstEdgeIdBetween(sourceId, targetId);
-                if(newEdgeId.isNull())
-                    newEdgeId = coarseGraph.addEdge(sourceId, targetId);
+                    if(moveGain <= stayGain)
+                        continue;
+
+                    if(moves[i] == NullIndex)
+                    {
+                        // The node may already be alone, if the rest of the community has left
+                        if(communitySizes[from] == 1)
+                            continue;
 
-                newWeights[newEdgeId] += newWeight;
+                        // Communities that have since been joined are stale entries
+                        while(communitySizes[static_cast<size_t>(emptyCommunities.back())] != 0)
+                            emptyCommunities.pop_back();
+
+                        moves[i] = emptyCommunities.back();
+                        emptyCommunities.pop_back();
+                    }
+
+                    auto to = static_cast<size_t>(moves[i]);
+
+                    communityDegrees[from] -= degree;
+                    communityDegrees[to] += degree;
+                    communitySizes[from]--;
+                    communitySizes[to]++;
+
+                    if(communitySizes[from] == 0)
+                        emptyCommunities.push_back(communities[i]);
+
+                    communities[i] = moves[i];
+                    numMoves++;
+                }
+
+                _target->setProgress(static_cast<int>((std::distance(nodes.begin(), batchEnd) * 100) /
+                    static_cast<std::ptrdiff_t>(numNodes)));
             }
-        });
 
-        graph = coarseGraph;
-        weights = newWeights;
-    };
+            _target->setProgress(-1);
 
-    auto moveNodes = [&](MutableGraph& graph)
+            if(numMoves == 0)
+                break;
+        }
+    }
+
+    // Splits each community into refined communities, each of which is connected;
+    // communities are independent of each other, so are refined in parallel
+    std::vector<Index> refine(const WeightedGraph& graph, const std::vector<Index>& communities,
+        size_t numCommunities)
     {
-        if(cancelled())
-            return false;
+        const auto numNodes = graph.numNodes();
 
-        CommunityId nextCommunityId = 0;
-        for(auto nodeId : graph.nodeIds())
-        {
-            if(graph.typeOf(nodeId) == MultiElementType::Tail)
-                continue;
+        std::vector<size_t> offsets;
+        std::vector<Index> members;
+        groupByCommunity(communities, numCommunities, offsets, members);
 
-            for(auto edgeId : graph.nodeById(nodeId).edgeIds())
-                weightedDegrees[nodeId] += weights[edgeId];
+        std::vector<Index> refined(numNodes);
+        std::iota(refined.begin(), refined.end(), 0);
 
-            add(nextCommunityId++, nodeId);
-        }
+        std::vector<double> refinedDegrees = graph._degrees;
+        std::vector<int> refinedSizes(numNodes, 1);
+
+        // The weight of the edges from each refined community
+        // to the remainder of the community that contains it
+        std::vector<double> externalWeights(numNodes, 0.0);
+
+        std::vector<Index> communityIndices(numCommunities);
+        std::iota(communityIndices.begin(), communityIndices.end(), 0);
 
-        size_t subProgressIteration = 1;
-        bool modified = false;
-        bool improved = false;
-        do
+        parallel_for(communityIndices.begin(), communityIndices.end(),
+        [&](Index community, size_t threadIndex)
         {
-            improved = false;
-            target.setProgress(0);
-            uint64_t nodeIndex = 0;
+            if(cancelled())
+                return;
 
-            target.setPhase(QStringLiteral("Louvain Iteration %1.%2")
-                .arg(QString::number(progressIteration), QString::number(subProgressIteration++)));
+            auto membersBegin = members.begin() + static_cast<std::ptrdiff_t>(offsets[static_cast<size_t>(community)]);
+            auto membersEnd = members.begin() + static_cast<std::ptrdiff_t>(offsets[static_cast<size_t>(community) + 1]);
 
-            for(auto nodeId : graph.nodeIds())
+            double communityDegree = 0.0;
+            for(auto it = membersBegin; it != membersEnd; ++it)
             {
-                target.setProgress(static_cast<int>((nodeIndex++ * 100) / graph.numNodes()));
+                auto i = static_cast<size_t>(*it);
+                communityDegree += graph._degrees[i];
 
-                if(graph.typeOf(nodeId) == MultiElementType::Tail)
-                    continue;
-
-                std::map<CommunityId, double> neighbourCommunityWeights;
-                for(auto edgeId : graph.nodeById(nodeId).edgeIds())
+                for(auto entry = graph._offsets[i]; entry < graph._offsets[i + 1]; entry++)
                 {
-                    auto neighbourNodeId = graph.edgeById(edgeId).oppositeId(nodeId);
+                    if(communities[static_cast<size_t>(graph._neighbours[entry])] == community)
+                        externalWeights[i] += graph._weights[entry];
+                }
+            }
 
-                    // Skip loop edges
-                    if(neighbourNodeId == nodeId)
-                        continue;
+            auto& weights = communityWeights(threadIndex);
 
-                    if(graph.typeOf(neighbourNodeId) == MultiElementType::Tail)
-                        continue;
+            for(auto it = membersBegin; it != membersEnd; ++it)
+            {
+                auto node = *it;
+                auto i = static_cast<size_t>(node);
+                const auto degree = graph._degrees[i];
 
-                    auto neighbourCommunityId = communities.at(neighbourNodeId);
+                // Only nodes that remain singletons are merged
+                if(refined[i] != node || refinedSizes[i] != 1)
+                    continue;
 
-                    neighbourCommunityWeights[neighbourCommunityId] += weights[edgeId];
-                }
+                if(!wellConnected(externalWeights[i], degree, communityDegree))
+                    continue;
 
-                auto communityId = communities[nodeId];
-                remove(communityId, nodeId);
+                for(auto entry = graph._offsets[i]; entry < graph._offsets[i + 1]; entry++)
+                {
+                    auto neighbour = static_cast<size_t>(graph._neighbours[entry]);
+                    if(communities[neighbour] == community)
+                        weights.add(refined[neighbour], graph._weights[entry]);
+                }
 
-                double maxDeltaQ = 0.0;
-                auto newCommunityId = communityId;
+                auto bestRefined = NullIndex;
+                double bestGain = 0.0;
 
-                for(auto [neighbourCommunityId, weight] : neighbourCommunityWeights)
+                for(auto candidate : weights._communities)
                 {
-                    auto communityWeight = communityDegrees.at(neighbourCommunityId);
-                    auto nodeWeight = weightedDegrees[nodeId];
+                    auto r = static_cast<size_t>(candidate);
 
-                    auto deltaQ = (resolution * weight) -
-                        ((communityWeight * nodeWeight) / totalWeight);
+                    if(candidate == node || !wellConnected(externalWeights[r], refinedDegrees[r], communityDegree))
+                        continue;
 
-                    if(deltaQ > maxDeltaQ)
+                    auto candidateGain = gain(weights.weightOf(candidate), refinedDegrees[r], degree);
+                    if(candidateGain >= 0.0 && (bestRefined == NullIndex || candidateGain > bestGain))
                     {
-                        maxDeltaQ = deltaQ;
-                        newCommunityId = neighbourCommunityId;
+                        bestGain = candidateGain;
+                        bestRefined = candidate;
                     }
                 }
 
-                add(newCommunityId, nodeId);
+                if(bestRefined != NullIndex)
+                {
+                    auto r = static_cast<size_t>(bestRefined);
 
-                if(newCommunityId != communityId)
-                    improved = modified = true;
+                    externalWeights[r] += externalWeights[i] - (2.0 * weights.weightOf(bestRefined));
+                    refinedDegrees[r] += degree;
+                    refinedSizes[r]++;
+                    refined[i] = bestRefined;
+                }
 
-                if(cancelled())
-                    break;
+                weights.clear();
             }
+        });
 
-            target.setProgress(-1);
-        }
-        while(improved && !cancelled());
+        return refined;
+    }
 
-        return modified;
-    };
+    // Collapses each aggregate into a single node, summing
+    // the weights of the edges between pairs of aggregates
+    WeightedGraph aggregate(const WeightedGraph& graph, const std::vector<Index>& aggregates,
+        size_t numAggregates)
+    {
+        std::vector<size_t> offsets;
+        std::vector<Index> members;
+        groupByCommunity(aggregates, numAggregates, offsets, members);
 
-    MutableGraph graph(target.mutableGraph());
+        WeightedGraph coarseGraph;
+        coarseGraph._degrees.resize(numAggregates, 0.0);
 
-    bool finished = false;
-    do // NOLINT bugprone-infinite-loop
-    {
-        target.setProgress(-1);
+        std::vector<std::vector<std::pair<Index, double>>> rows(numAggregates);
 
-        communities.resetElements();
-        weightedDegrees.resetElements();
-        communityDegrees.clear();
+        std::vector<Index> aggregateIndices(numAggregates);
+        std::iota(aggregateIndices.begin(), aggregateIndices.end(), 0);
 
-        finished = !moveNodes(graph);
+        parallel_for(aggregateIndices.begin(), aggregateIndices.end(),
+        [&](Index aggregate, size_t threadIndex)
+        {
+            if(cancelled())
+                return;
+
+            auto a = static_cast<size_t>(aggregate);
+            auto& weights = communityWeights(threadIndex);
+            double degree = 0.0;
+
+            for(auto m = offsets[a]; m < offsets[a + 1]; m++)
+            {
+                auto i = static_cast<size_t>(members[m]);
+                degree += graph._degrees[i];
+
+                for(auto entry = graph._offsets[i]; entry < graph._offsets[i + 1]; entry++)
+                {
+                    auto neighbourAggregate = aggregates[static_cast<size_t>(graph._neighbours[entry])];
+                    if(neighbourAggregate != aggregate)
+                        weights.add(neighbourAggregate, graph._weights[entry]);
+                }
+            }
+
+            auto& row = rows[a];
+            row.reserve(weights._communities.size());
+
+            for(auto neighbourAggregate : weights._communities)
+                row.emplace_back(neighbourAggregate, weights.weightOf(neighbourAggregate));
+
+            weights.clear();
+            coarseGraph._degrees[a] = degree;
+        });
 
-        if(!finished && !cancelled())
+        coarseGraph._offsets.reserve(numAggregates + 1);
+        for(const auto& row : rows)
+            coarseGraph._offsets.push_back(coarseGraph._offsets.back() + row.size());
+
+        coarseGraph._neighbours.reserve(coarseGraph._offsets.back());
+        coarseGraph._weights.reserve(coarseGraph._offsets.back());
+
+        for(const auto& row : rows)
         {
-            relabel(graph);
-            iterations.emplace_back(communities);
+            for(auto [neighbour, weight] : row)
+            {
+                coarseGraph._neighbours.push_back(neighbour);
+                coarseGraph._weights.push_back(weight);
+            }
+        }
+
+        return coarseGraph;
+    }
+};
+} // namespace
 
-            target.setPhase(QStringLiteral("Louvain Iteration %1 Coarsening")
-                .arg(QString::number(progressIteration)));
-            coarsen(graph);
+void LouvainTransform::apply(TransformedGraph& target) const
+{
+    auto resolution = 1.0 - std::get<double>(
+        config().parameterByName(QStringLiteral("Granularity"))->_value);
+
+    const auto minResolution = 0.5;
+    const auto maxResolution = 30.0;
+
+    const auto logMin = std::log10(minResolution);
+    const auto logMax = std::log10(maxResolution);
+    const auto logRange = logMax - logMin;
+
+    resolution = std::pow(10.0f, logMin + (resolution * logRange));
+
+    const bool leiden = config().parameterHasValue(QStringLiteral("Method"), QStringLiteral("Leiden"));
+
+    EdgeArray<double> weights(target, 1.0);
+
+    if(_weighted)
+    {
+        if(config().attributeNames().empty())
+        {
+            addAlert(AlertType::Error, QObject::tr("Invalid parameter"));
+            return;
         }
 
-        progressIteration++;
+        auto attribute = _graphModel->attributeValueByName(
+            config().attributeNames().front());
+
+        for(auto edgeId : target.edgeIds())
+            weights[edgeId] = attribute.numericValueOf(edgeId);
     }
-    while(!finished && !cancelled());
 
-    if(cancelled())
-        return;
+    target.setPhase(QStringLiteral("Louvain Initialising"));
 
-    target.setPhase(QStringLiteral("Louvain Finalising"));
+    auto adjacency = target.adjacencySnapshot();
+    const auto& adjacencyOffsets = adjacency->offsets();
+    const auto& adjacencyNeighbours = adjacency->neighbourIndices();
+    const auto& adjacencyEdgeIds = adjacency->neighbourEdgeIds();
 
-    // Set each CommunityId to be the same as the NodeId, initially
-    for(auto nodeId : target.nodeIds())
+    // The tails of multi-elements take no part
+    std::vector<Index> levelIndices(static_cast<size_t>(adjacency->numNodes()), NullIndex);
+    std::vector<NodeId> nodeIds;
+    nodeIds.reserve(levelIndices.size());
+
+    for(Index index = 0; index < adjacency->numNodes(); index++)
     {
-        if(graph.typeOf(nodeId) == MultiElementType::Tail)
+        auto nodeId = adjacency->nodeIdAt(index);
+        if(target.typeOf(nodeId) == MultiElementType::Tail)
             continue;
 
-        communities[nodeId] = nodeId;
+        levelIndices[static_cast<size_t>(index)] = static_cast<Index>(nodeIds.size());
+        nodeIds.push_back(nodeId);
     }
 
-    // Walk back over our iterations to build the final communities
-    for(auto nodeId : target.nodeIds())
+    WeightedGraph graph;
+    graph._offsets.reserve(nodeIds.size() + 1);
+    graph._degrees.reserve(nodeIds.size());
+
+    for(size_t index = 0; index < levelIndices.size(); index++)
     {
-        for(const auto& iteration : iterations)
+        if(levelIndices[index] == NullIndex)
+            continue;
+
+        double degree = 0.0;
+        for(auto entry = adjacencyOffsets[index]; entry < adjacencyOffsets[index + 1]; entry++)
         {
-            auto communityId = communities[nodeId];
+            auto neighbour = levelIndices[static_cast<size_t>(adjacencyNeighbours[entry])];
+            if(neighbour == NullIndex)
+                continue;
 
-            if(!communityId.isNull())
-                communities[nodeId] = iteration.at(communities[nodeId]);
+            auto weight = weights[adjacencyEdgeIds[entry]];
+            degree += weight;
 
-            if(cancelled())
-                return;
+            // Loops appear twice, so count twice towards the degree, as they should
+            if(neighbour == levelIndices[index])
+                continue;
+
+            graph._neighbours.push_back(neighbour);
+            graph._weights.push_back(weight);
         }
+
+        graph._offsets.push_back(graph._neighbours.size());
+        graph._degrees.push_back(degree);
     }
 
-    // Sort communities by size
-    std::map<CommunityId, size_t> communityHistogram;
-    for(auto nodeId : target.nodeIds())
-        communityHistogram[communities[nodeId]]++;
-    std::vector<std::pair<CommunityId, size_t>> sortedCommunityHistogram;
-    std::copy(communityHistogram.begin(), communityHistogram.end(),
-        std::back_inserter(sortedCommunityHistogram));
-    std::sort(sortedCommunityHistogram.begin(), sortedCommunityHistogram.end(),
-        [](const auto& a, const auto& b) { return a.second > b.second; });
-
-    // Assign cluster numbers to each community
-    std::map<CommunityId, size_t> clusterNumbers;
-    size_t clusterNumber = 1;
-    for(auto [communityId, size] : sortedCommunityHistogram)
+    const auto numNodes = nodeIds.size();
+    const auto totalWeight = std::accumulate(graph._degrees.begin(), graph._degrees.end(), 0.0) * 0.5;
+
+    CommunityDetection communityDetection(target, *this, resolution, totalWeight, numNodes);
+
+    // The node at the current level, that each original node has been aggregated into
+    std::vector<Index> membership(numNodes);
+    std::iota(membership.begin(), membership.end(), 0);
+
+    std::vector<Index> communities(numNodes);
+    std::iota(communities.begin(), communities.end(), 0);
+
+    int level = 1;
+    while(totalWeight > 0.0 && !cancelled())
     {
-        if(!communityId.isNull())
-            clusterNumbers[communityId] = clusterNumber++;
+        communityDetection.moveNodes(graph, communities, level);
+
+        if(cancelled())
+            return;
+
+        auto numCommunities = relabel(communities);
+        if(numCommunities == graph.numNodes())
+            break;
+
+        auto aggregates = communities;
+        auto numAggregates = numCommunities;
+
+        if(leiden)
+        {
+            target.setPhase(QStringLiteral("Louvain Iteration %1 Refinement").arg(QString::number(level)));
+
+            aggregates = communityDetection.refine(graph, communities, numCommunities);
+            numAggregates = relabel(aggregates);
+
+            // Refinement found nothing further to merge
+            if(numAggregates == graph.numNodes())
+                break;
+        }
+
+        target.setPhase(QStringLiteral("Louvain Iteration %1 Coarsening").arg(QString::number(level)));
+        graph = communityDetection.aggregate(graph, aggregates, numAggregates);
+
+        if(cancelled())
+            return;
+
+        for(auto& member : membership)
+            member = aggregates[static_cast<size_t>(member)];
+
+        // Leiden aggregates by refined community, but starts the
+        // next level from the communities that contain them
+        std::vector<Index> nextCommunities(numAggregates);
+        if(leiden)
+        {
+            for(size_t i = 0; i < aggregates.size(); i++)
+                nextCommunities[static_cast<size_t>(aggregates[i])] = communities[i];
+        }
+        else
+            std::iota(nextCommunities.begin(), nextCommunities.end(), 0);
+
+        communities = std::move(nextCommunities);
+        level++;
     }
 
+    if(cancelled())
+        return;
+
+    target.setPhase(QStringLiteral("Louvain Finalising"));
+
+    const auto numCommunities = relabel(communities);
+
+    std::vector<int> communitySizes(numCommunities, 0);
+    for(auto member : membership)
+        communitySizes[static_cast<size_t>(communities[static_cast<size_t>(member)])]++;
+
+    // Sort communities by size, and assign cluster numbers in that order
+    std::vector<size_t> sortedCommunities(numCommunities);
+    std::iota(sortedCommunities.begin(), sortedCommunities.end(), 0);
+    std::stable_sort(sortedCommunities.begin(), sortedCommunities.end(),
+        [&communitySizes](auto a, auto b) { return communitySizes[a] > communitySizes[b]; });
+
+    std::vector<int> clusterNumbers(numCommunities);
+    for(size_t i = 0; i < sortedCommunities.size(); i++)
+        clusterNumbers[sortedCommunities[i]] = static_cast<int>(i + 1);
+
     NodeArray<QString> clusterNames(target);
     NodeArray<int> clusterSizes(target);
 
-    for(auto nodeId : target.nodeIds())
+    for(size_t i = 0; i < numNodes; i++)
     {
-        auto communityId = communities[nodeId];
-        if(communityId.isNull())
-            continue;
+        auto community = static_cast<size_t>(communities[static_cast<size_t>(membership[i])]);
 
-        clusterNumber = clusterNumbers[communityId];
-        clusterNames[nodeId] = QObject::tr("Cluster %1").arg(clusterNumber);
-        clusterSizes[nodeId] = static_cast<int>(communityHistogram.at(communityId));
+        clusterNames[nodeIds[i]] = QObject::tr("Cluster %1").arg(clusterNumbers[community]);
+        clusterSizes[nodeIds[i]] = communitySizes[community];
     }
 
     _graphModel->createAttribute(QObject::tr(_weighted ? "Weighted Louvain Cluster" : "Louvain Cluster")) // clazy:exclude=tr-non-literal
@@ -61,7 +61,13 @@ public:
                 .setDescription(QObject::tr("The size of the resultant clusters. "
                     "A larger granularity value results in smaller clusters."))
                 .setInitialValue(0.5)
-                .setRange(0.0, 1.0)
+                .setRange(0.0, 1.0),
+
+            GraphTransformParameter::create("Method")
+                .setType(ValueType::StringList)
+                .setDescription(QObject::tr("Leiden adds a refinement step to each iteration of Louvain, "
+                    "which guarantees that every cluster is connected, at a small extra cost."))
+                .setInitialValue(QStringList{"Louvain", "Leiden"})
         };
     }
 
@@ -19,443 +19,357 @@
 #include "mcltransform.h"
 #include "transform/transformedgraph.h"
 #include "graph/graphmodel.h"
+#include "graph/adjacencysnapshot.h"
 #include "shared/utils/threadpool.h"
 
-#include <blaze/Blaze.h>
-
 #include <QElapsedTimer>
 #include <QDebug>
 
-#include <map>
 #include <set>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <numeric>
 #include <algorithm>
+#include <cmath>
 
-using MatrixType = blaze::CompressedMatrix<float,blaze::columnMajor>;
-using VectorType = blaze::DynamicVector<float,blaze::columnVector>;
-
-static void normaliseColumnsColumnMajor(MatrixType &mclMatrix)
+namespace
 {
-    for(size_t column = 0; column<mclMatrix.columns(); column++)
-    {
-        MatrixType::Iterator lelem = mclMatrix.begin(column);
-        MatrixType::Iterator lend = mclMatrix.end(column);
+using Index = uint32_t;
 
-        if(lelem == lend)
-            continue;
+// Column major sparse matrix; the entries of column c are in [_offsets[c], _offsets[c + 1])
+// and within a column, the row indices are in ascending order
+struct SparseMatrix
+{
+    std::vector<size_t> _offsets{0};
+    std::vector<Index> _rows;
+    std::vector<float> _values;
 
-        float value = 0.0f;
-        for(lelem = mclMatrix.begin(column); lelem != lend; ++lelem)
-            value += lelem->value();
+    size_t columns() const { return _offsets.size() - 1; }
+    size_t nonZeros() const { return _rows.size(); }
+    size_t nonZeros(size_t column) const { return _offsets[column + 1] - _offsets[column]; }
+};
 
-        Q_ASSERT(value > 0.0f);
-        value = 1.0f / value;
+void normaliseColumn(float* values, size_t size)
+{
+    float sum = std::accumulate(values, values + size, 0.0f); // NOLINT
+    if(sum <= 0.0f)
+        return;
 
-        for(lelem = mclMatrix.begin(column); lelem != lend; ++lelem)
-            lelem->value() = lelem->value() * value;
-    }
+    for(size_t i = 0; i < size; i++)
+        values[i] /= sum; // NOLINT
 }
 
-static void sumColumns(MatrixType &mclMatrix, VectorType &output)
+// A column is converged when its (non-zero) values are all equal, i.e. its largest
+// value is equal to the sum of the squares of its values, which are normalised
+bool columnConverged(const float* values, size_t size, float limit)
 {
-    for(size_t column = 0; column<mclMatrix.columns(); column++)
+    float max = 0.0f;
+    float sumOfSquares = 0.0f;
+
+    for(size_t i = 0; i < size; i++)
     {
-        MatrixType::ConstIterator lend = mclMatrix.cend(column);
-        for(MatrixType::ConstIterator lelem = mclMatrix.cbegin(column); lelem != lend; ++lelem)
-        {
-            output[column] = output[column] + lelem->value();
-        }
+        max = std::max(max, values[i]); // NOLINT
+        sumOfSquares += values[i] * values[i]; // NOLINT
     }
+
+    return (max - sumOfSquares) * static_cast<float>(size) <= limit;
 }
 
-struct SparseMatrixEntry
+// A column whose values are all equal (to within rounding error) is unchanged by
+// expansion, provided the columns its entries refer to are the same as it
+bool columnUniform(const float* values, size_t size)
 {
-    size_t _row; size_t _column; float _value;
-    SparseMatrixEntry(size_t row, size_t column, float value)
-        : _row(row), _column(column), _value(value){}
-};
+    const float EPSILON = 1e-6f;
+    auto [min, max] = std::minmax_element(values, values + size); // NOLINT
 
-struct MCLRowData
-{
-    std::vector<float> values;
-    std::vector<bool> valid;
-    std::vector<size_t> indices;
-    explicit MCLRowData(size_t columnCount) : values(columnCount, 0.0f),
-        valid(columnCount, false), indices(columnCount, 0UL) {}
-};
+    return size == 0 || (*max - *min) <= *max * EPSILON;
+}
 
-template<typename CancelledFn>
-static void expandAndPruneRow(MatrixType& mclMatrix, size_t columnId,
-    std::vector<SparseMatrixEntry>* matrixStorage, MCLRowData& rowData,
-    float minValueCutoff, const CancelledFn& cancelledFn)
+// The working storage of a single thread; expanded columns are accumulated in a dense
+// vector, and the results for the columns the thread processes are appended to its
+// own output, so that threads never contend with one another
+struct MCLWorker
 {
-    const bool DEBUG = false;
-
-    // Perhaps make these changable parameters later
-    const int RECOVERY_COUNT = 1400;
-    const int SELECTION_COUNT = 1100;
+    std::vector<float> _values;
+    std::vector<bool> _valid;
+    std::vector<Index> _indices;
 
-    size_t nonzeros = 0;
+    std::vector<Index> _outputRows;
+    std::vector<float> _outputValues;
 
-    size_t minIndex = std::numeric_limits<size_t>::infinity();
-    size_t maxIndex = 0UL;
-    const auto* const lend = mclMatrix.cend(columnId);
+    explicit MCLWorker(size_t columnCount) :
+        _values(columnCount, 0.0f), _valid(columnCount, false)
+    {
+        _indices.reserve(columnCount);
+    }
 
-    // Perform multiply and populate prune dependant data structures
-    for(const auto* lelem = mclMatrix.cbegin(columnId); lelem != lend; ++lelem)
+    void clearOutput()
     {
-        if(cancelledFn())
-            break;
+        _outputRows.clear();
+        _outputValues.clear();
+    }
 
-        // For each column (left)
-        const auto* const rend = mclMatrix.cend(lelem->index());
-        for(const auto* relem = mclMatrix.cbegin(lelem->index()); relem != rend; ++relem)
+    // Multiplies the matrix by the given column of itself
+    void expand(const SparseMatrix& matrix, size_t column)
+    {
+        for(auto l = matrix._offsets[column]; l < matrix._offsets[column + 1]; l++)
         {
-            // For each column starting at left column index (right)
-            float mult = lelem->value() * relem->value();
+            const auto left = matrix._rows[l];
+            const auto leftValue = matrix._values[l];
 
-            if(!rowData.valid[relem->index()])
+            for(auto r = matrix._offsets[left]; r < matrix._offsets[left + 1]; r++)
             {
-                rowData.values[relem->index()] = mult;
-                rowData.valid[relem->index()] = true;
-                // Position in the rowData.values vector
-                rowData.indices[nonzeros] = relem->index();
-                ++nonzeros;
-
-                if(relem->index() < minIndex) minIndex = relem->index();
-                if(relem->index() > maxIndex) maxIndex = relem->index();
+                const auto row = matrix._rows[r];
+                const auto product = leftValue * matrix._values[r];
+
+                if(!_valid[row])
+                {
+                    _values[row] = product;
+                    _valid[row] = true;
+                    _indices.push_back(row);
+                }
+                else
+                    _values[row] += product;
             }
-            else
-                rowData.values[relem->index()] += mult;
         }
     }
 
-    if(cancelledFn())
-        return;
-
-    if(nonzeros > 0UL)
+    // Leaves the entries to keep at the start of _indices, returning how many there are
+    size_t prune(float threshold, const MCLPruning& pruning)
     {
-        Q_ASSERT(minIndex <= maxIndex);
+        const auto nonZeros = _indices.size();
+        auto first = _indices.begin();
+        auto last = _indices.end();
 
-        size_t remainCount = nonzeros;
-        float rowPruneSum = 0.0f;
-        // Mass is always normalised!
-        float targetMass = 0.9f;
+        auto sumOf = [this, first](size_t count)
+        {
+            return std::accumulate(first, first + static_cast<std::ptrdiff_t>(count), 0.0f,
+                [this](float sum, Index index) { return sum + _values[index]; });
+        };
 
-        for(size_t i = 0UL; i < nonzeros; ++i)
+        // Moves the largest entries of the first range entries to the start
+        auto selectLargest = [this, first](size_t number, size_t range)
         {
-            size_t index = rowData.indices[i];
-            if(std::abs(rowData.values[index]) <= minValueCutoff)
-            {
-                // Remove from the remainCount;
-                remainCount--;
-            }
-            else
-            {
-                // Calculate pruned sum
-                rowPruneSum += rowData.values[index];
-            }
-        }
+            std::nth_element(first, first + static_cast<std::ptrdiff_t>(number),
+                first + static_cast<std::ptrdiff_t>(range),
+                [this](Index a, Index b) { return _values[a] > _values[b]; });
+        };
 
-        if(DEBUG)
-            qDebug() << "RowPruneSum (mass?)" << rowPruneSum << "targetmass" << targetMass;
+        auto remainCount = static_cast<size_t>(std::distance(first, std::partition(first, last,
+            [this, threshold](Index index) { return _values[index] > threshold; })));
+        auto mass = sumOf(remainCount);
 
-        auto first = rowData.indices.begin();
-        auto last = rowData.indices.begin() + static_cast<std::ptrdiff_t>(nonzeros);
+        const auto selectionNumber = static_cast<size_t>(pruning._selectionNumber);
+        const auto recoveryNumber = std::min(static_cast<size_t>(pruning._recoveryNumber), nonZeros);
 
-        if(remainCount != nonzeros && rowPruneSum < targetMass && remainCount < RECOVERY_COUNT)
+        auto recover = [&]
         {
-            // Recover
-            if(DEBUG)
-                qDebug() << "RECOVERY" << "MASS:" << rowPruneSum;
-            std::nth_element(first, rowData.indices.begin() + RECOVERY_COUNT, last,
-                [&rowData](size_t i1, size_t i2) { return rowData.values[i1] > rowData.values[i2]; });
-
-            minValueCutoff = rowData.values[rowData.indices[RECOVERY_COUNT]];
-            remainCount = RECOVERY_COUNT;
-            rowPruneSum = 0;
-            for(size_t i = 0UL; i < RECOVERY_COUNT; ++i)
-                rowPruneSum += rowData.values[rowData.indices[i]];
-        }
-        else if(remainCount > SELECTION_COUNT)
-        {
-            // Selection prune
-            // Refine the cutoff so MAXIMUM SELECTION_COUNT elements remain
-            // Should speedtest this vs copy+std::greater<float>
-            std::nth_element(first, rowData.indices.begin() + SELECTION_COUNT, last,
-                [&rowData](size_t i1, size_t i2) { return rowData.values[i1] > rowData.values[i2]; });
-
-            minValueCutoff = rowData.values[rowData.indices[SELECTION_COUNT]];
-
-            if(DEBUG)
+            if(remainCount < nonZeros && remainCount < recoveryNumber && mass < pruning._recoveryMass)
             {
-                qDebug() << "Selection Cutoff" << minValueCutoff;
-                qDebug() << "Pre selection Remain" << remainCount << "mass" << rowPruneSum;
-            }
+                if(recoveryNumber < nonZeros)
+                    selectLargest(recoveryNumber, nonZeros);
 
-            // Recalculate new mass
-            remainCount = SELECTION_COUNT;
-            rowPruneSum = 0;
-            for(size_t i = 0UL; i < SELECTION_COUNT; ++i)
-                rowPruneSum += rowData.values[rowData.indices[i]];
+                remainCount = recoveryNumber;
+                return true;
+            }
 
-            if(DEBUG)
-                qDebug() << "Post selection Remain" << remainCount << "mass" << rowPruneSum;
+            return false;
+        };
 
-            Q_ASSERT(remainCount < RECOVERY_COUNT);
+        if(!recover() && remainCount > selectionNumber)
+        {
+            selectLargest(selectionNumber, remainCount);
+            remainCount = selectionNumber;
+            mass = sumOf(remainCount);
 
-            // Do Another recovery if needed
-            if(remainCount != nonzeros && rowPruneSum < targetMass)
-            {
-                if(DEBUG)
-                    qDebug() << "RECOVERY 2" << "MASS:" << rowPruneSum;
-
-                std::nth_element(first, rowData.indices.begin() + RECOVERY_COUNT, last,
-                    [&rowData](size_t i1, size_t i2) { return rowData.values[i1] > rowData.values[i2]; });
-                minValueCutoff = rowData.values[rowData.indices[RECOVERY_COUNT]];
-                remainCount = RECOVERY_COUNT;
-                rowPruneSum = 0;
-                for(size_t i = 0UL; i < RECOVERY_COUNT; ++i)
-                    rowPruneSum += rowData.values[rowData.indices[i]];
-            }
+            recover();
         }
 
-        // Finally, remove unneeded rowData.indices
-        if(remainCount < nonzeros)
+        return remainCount;
+    }
+
+    // Expands, prunes, inflates and normalises a column, appending it to the output
+    void iterate(const SparseMatrix& matrix, size_t column, float inflation,
+        float threshold, const MCLPruning& pruning)
+    {
+        const float EPSILON = 1e-8f;
+
+        expand(matrix, column);
+
+        auto keepCount = prune(threshold, pruning);
+        auto first = _indices.begin();
+        std::sort(first, first + static_cast<std::ptrdiff_t>(keepCount));
+
+        const auto outputStart = _outputRows.size();
+        for(size_t i = 0; i < keepCount; i++)
         {
-            if(DEBUG)
-            {
-                qDebug() << "Prune:" << nonzeros - remainCount;
-                qDebug() << "Raw count" << nonzeros;
-                qDebug() << "Remain Count" << remainCount;
-            }
-            for(size_t i = 0UL; i < nonzeros; ++i)
+            auto index = _indices[i];
+            if(_values[index] > EPSILON)
             {
-                if(std::abs(rowData.values[rowData.indices[i]]) <= minValueCutoff)
-                {
-                    rowData.values[rowData.indices[i]] = 0.0f;
-                    rowData.valid[rowData.indices[i]] = false;
-                }
-                else
-                {
-                    // Rescale
-                    rowData.values[rowData.indices[i]] /= rowPruneSum;
-                }
+                _outputRows.push_back(index);
+                _outputValues.push_back(std::pow(_values[index], inflation));
             }
         }
 
-        if(DEBUG)
-        {
-            qDebug() << columnId << "pruned" << nonzeros - remainCount;
-            qDebug() << rowData.values;
-        }
+        normaliseColumn(_outputValues.data() + outputStart, _outputValues.size() - outputStart); // NOLINT
 
-        // Populate new matrix
-        // If sorting is too big just brute force the whole range
-        // If the range is small just do it contiguously
-        const float EPSILON = 1e-8f;
-        if((2 * nonzeros) < (maxIndex - minIndex))
+        for(auto index : _indices)
         {
-            std::sort(first, last);
-
-            for(size_t j = 0UL; j<nonzeros; ++j)
-            {
-                const size_t index = rowData.indices[j];
-                if(rowData.values[index] > EPSILON)
-                {
-                    matrixStorage->emplace_back(index, columnId, rowData.values[index]);
-                    rowData.values[index] = 0.0f;
-                }
-                rowData.valid[index] = false;
-            }
-        }
-        else
-        {
-            for(size_t j = minIndex; j <= maxIndex; ++j)
-            {
-                if(rowData.values[j] > EPSILON)
-                {
-                    matrixStorage->emplace_back(j, columnId, rowData.values[j]);
-                    rowData.values[j] = 0.0f;
-                }
-                rowData.valid[j] = false;
-            }
+            _values[index] = 0.0f;
+            _valid[index] = false;
         }
+
+        _indices.clear();
     }
-}
+};
+} // namespace
 
 void MCLTransform::apply(TransformedGraph& target) const
 {
     auto granularity = std::get<double>(
                 config().parameterByName(QStringLiteral("Granularity"))->_value);
 
+    MCLPruning pruning;
+    pruning._selectionNumber = std::get<int>(config().parameterByName(QStringLiteral("Selection Number"))->_value);
+    pruning._recoveryNumber = std::get<int>(config().parameterByName(QStringLiteral("Recovery Number"))->_value);
+    pruning._recoveryMass = static_cast<float>(std::get<int>(
+        config().parameterByName(QStringLiteral("Recovery Percentage"))->_value)) / 100.0f;
+
     if(_debugIteration)
     {
         QElapsedTimer mclTimer;
         mclTimer.start();
-        calculateMCL(static_cast<float>(granularity), target);
+        calculateMCL(static_cast<float>(granularity), pruning, target);
         qDebug() << "MCL Elapsed Time" << mclTimer.elapsed();
     }
     else
-        calculateMCL(static_cast<float>(granularity), target);
+        calculateMCL(static_cast<float>(granularity), pruning, target);
 }
 
-template<class MatrixType>
-class ColumnsIterator
+static void debugMatrix(const QString& title, const SparseMatrix& matrix)
 {
-public:
-    class iterator
+    qDebug().noquote() << title;
+
+    for(size_t column = 0; column < matrix.columns(); column++)
     {
-    public:
-        using value_type = size_t;
-        using reference = value_type&;
-        using pointer = value_type*;
-        using iterator_category = std::input_iterator_tag;
-        using difference_type = size_t;
-
-    private:
-        size_t _num = 0;
-
-    public:
-        explicit iterator(size_t num = 0) : _num(num) {}
-        iterator& operator++() { _num = _num + 1; return *this; }
-        iterator operator++(int) { iterator retval = *this; ++(*this); return retval; }
-        bool operator==(iterator other) const { return _num == other._num; }
-        bool operator!=(iterator other) const { return !(*this == other); }
-        value_type operator*() const { return _num; }
-    };
-    MatrixType& matrix;
-    explicit ColumnsIterator(MatrixType& _matrix) : matrix(_matrix) {}
-    iterator begin() { return iterator(0); }
-    iterator end() { return iterator(matrix.columns()); }
-};
+        QStringList entries;
+        for(auto i = matrix._offsets[column]; i < matrix._offsets[column + 1]; i++)
+            entries.append(QStringLiteral("%1:%2").arg(matrix._rows[i]).arg(matrix._values[i]));
+
+        qDebug().noquote() << column << entries.join(' ');
+    }
+}
 
-void MCLTransform::calculateMCL(float inflation, TransformedGraph& target) const
+void MCLTransform::calculateMCL(float inflation, const MCLPruning& pruning, TransformedGraph& target) const
 {
     target.setPhase(QStringLiteral("MCL Initialising"));
 
-    int nodeCount = target.numNodes();
-
-    // Map NodeIds to Matrix index
-    NodeIdMap<size_t> nodeToIndexMap;
-    std::map<size_t, NodeId> indexToNodeMap;
-    for(NodeId nodeId : target.nodeIds())
-    {
-        auto index = nodeToIndexMap.size();
-        nodeToIndexMap[nodeId] = index;
-        indexToNodeMap[index] = nodeId;
-    }
+    auto adjacency = target.adjacencySnapshot();
+    const auto& adjacencyOffsets = adjacency->offsets();
+    const auto& adjacencyNeighbours = adjacency->neighbourIndices();
+    const auto nodeCount = static_cast<size_t>(adjacency->numNodes());
 
-    MatrixType clusterMatrix(nodeCount, nodeCount);
-    blaze::setNumThreads(std::thread::hardware_concurrency());
+    // Populate the matrix with the adjacency, plus a self loop for each node
+    SparseMatrix clusterMatrix;
+    clusterMatrix._offsets.reserve(nodeCount + 1);
+    clusterMatrix._rows.reserve(adjacencyNeighbours.size() + nodeCount);
 
-    clusterMatrix.reserve((target.numEdges() * 2) + nodeCount);
-
-    // Populate the Matrix
-    for(NodeId nodeId : target.nodeIds())
+    for(size_t column = 0; column < nodeCount; column++)
     {
-        auto nodeIndex = nodeToIndexMap[nodeId];
-        auto connectedEdgeIds = target.edgeIdsForNodeId(nodeId);
+        auto columnStart = clusterMatrix._rows.size();
 
-        // Add all connected node indexes to sorted set
-        std::set<size_t> sortNodeIndexes;
-        for(auto connectEdgeId : connectedEdgeIds)
-        {
-            auto connectedNodeId = target.edgeById(connectEdgeId).oppositeId(nodeId);
-            sortNodeIndexes.insert(nodeToIndexMap[connectedNodeId]);
-        }
-        // Add self loop
-        sortNodeIndexes.insert(nodeIndex);
+        clusterMatrix._rows.push_back(static_cast<Index>(column));
+        for(auto entry = adjacencyOffsets[column]; entry < adjacencyOffsets[column + 1]; entry++)
+            clusterMatrix._rows.push_back(static_cast<Index>(adjacencyNeighbours[entry]));
 
-        // Append to Compressed Matrix
-        for(auto sortedConnectIndex : sortNodeIndexes)
-            clusterMatrix.append(sortedConnectIndex, nodeIndex, 1.0f);
+        auto columnBegin = clusterMatrix._rows.begin() + static_cast<std::ptrdiff_t>(columnStart);
+        std::sort(columnBegin, clusterMatrix._rows.end());
+        clusterMatrix._rows.erase(std::unique(columnBegin, clusterMatrix._rows.end()), clusterMatrix._rows.end());
 
-        // Finalise the row
-        clusterMatrix.finalize(nodeIndex);
+        clusterMatrix._offsets.push_back(clusterMatrix._rows.size());
     }
-    clusterMatrix.trim();
 
-    std::stringstream matrixStream;
     if(_debugMatrices)
     {
-        matrixStream << clusterMatrix;
-        qDebug().noquote() << QString::fromStdString(matrixStream.str());
+        clusterMatrix._values.assign(clusterMatrix.nonZeros(), 1.0f);
+        debugMatrix(QStringLiteral("Initial Matrix"), clusterMatrix);
     }
 
-    // Normalise the columns
-    normaliseColumnsColumnMajor(clusterMatrix);
-
-    // Pre-inflation
-    clusterMatrix = pow(clusterMatrix, 3.0f);
-
-    // Normalise again...
-    normaliseColumnsColumnMajor(clusterMatrix);
+    // Normalise, pre-inflate and normalise again; each column of the
+    // adjacency is uniform, so this is simply 1 / (entries in the column)
+    clusterMatrix._values.resize(clusterMatrix.nonZeros());
+    for(size_t column = 0; column < nodeCount; column++)
+    {
+        auto size = clusterMatrix.nonZeros(column);
+        std::fill_n(clusterMatrix._values.begin() + static_cast<std::ptrdiff_t>(clusterMatrix._offsets[column]),
+            size, 1.0f / static_cast<float>(size));
+    }
 
     if(_debugIteration)
         qDebug() << "Pre nnz" << clusterMatrix.nonZeros();
 
-    clusterMatrix.erase([this](float value){ return value < MCL_PRUNE_LIMIT; } );
+    if(_debugMatrices)
+        debugMatrix(QStringLiteral("Pre-inflated Matrix"), clusterMatrix);
 
-    if(_debugIteration)
-        qDebug() << "Pre-prune nnz" << clusterMatrix.nonZeros();
+    std::vector<std::unique_ptr<MCLWorker>> workers(std::thread::hardware_concurrency());
 
-    if(_debugMatrices)
-    {
-        matrixStream << "Pre-inflated Matrix \n";
-        matrixStream << clusterMatrix;
-        qDebug().noquote() << QString::fromStdString(matrixStream.str());
-        matrixStream.clear();
-        matrixStream.str(std::string());
-    }
+    std::vector<size_t> columns(nodeCount);
+    std::iota(columns.begin(), columns.end(), 0);
+
+    // Uniform columns whose entries all correspond to identical uniform
+    // columns are at a fixed point, so there is no need to expand them again
+    std::vector<char> columnConvergences(nodeCount, 0);
+    std::vector<char> columnUniformities(nodeCount, 0);
+    std::vector<char> columnsFixed(nodeCount, 0);
+    std::vector<size_t> activeColumns = columns;
+
+    // Where each column's entries can be found, after each iteration
+    std::vector<MCLWorker*> columnWorkers(nodeCount, nullptr);
+    std::vector<size_t> columnOutputOffsets(nodeCount, 0);
+    std::vector<size_t> columnSizes(nodeCount, 0);
 
-    bool isEquiDistrubuted = true;
-    // Start the MCL loop
     int iter = 0;
-    do
+    while(!activeColumns.empty())
     {
         if(cancelled())
             return;
 
         target.setPhase(QStringLiteral("MCL Iteration %1").arg(QString::number(iter + 1)));
-        if(_debugMatrices)
-        {
-            matrixStream << "Pre-Expanded Matrix\n";
-            matrixStream << clusterMatrix;
-            qDebug().noquote() << QString::fromStdString(matrixStream.str());
-            matrixStream.clear();
-            matrixStream.str(std::string());
-        }
-
-        isEquiDistrubuted = true;
 
         if(_debugIteration)
-            qDebug() << "Iteration" << iter;
-
-        std::vector<std::vector<SparseMatrixEntry>> matrixStorage(clusterMatrix.rows());
+            qDebug() << "Iteration" << iter << "active columns" << activeColumns.size();
 
         QElapsedTimer threadedTimer;
         if(_debugIteration)
             threadedTimer.start();
 
-        // Threaded expansion
-        ColumnsIterator<MatrixType> colIterator(clusterMatrix);
-
-        // To reduce vector allocations for every row we do some magic with rowData
-        MCLRowData rowData(clusterMatrix.columns());
+        for(auto& worker : workers)
+        {
+            if(worker != nullptr)
+                worker->clearOutput();
+        }
 
         std::atomic<uint64_t> iteration(0);
-        const auto totalIterations = clusterMatrix.columns();
+        const auto totalIterations = activeColumns.size();
         target.setProgress(0);
 
-        auto cancelledFn = [this] { return cancelled(); };
-
-        // Capture rowData by value; this gives each thread a copy of rowData, rather re-allocating vectors per row (slow)
-        parallel_for(colIterator.begin(), colIterator.end(),
-        [&, rowData](const size_t iterator) mutable
+        parallel_for(activeColumns.begin(), activeColumns.end(),
+        [&](size_t column, size_t threadIndex)
         {
-            expandAndPruneRow(clusterMatrix, iterator, &matrixStorage[iterator],
-                rowData, MCL_PRUNE_LIMIT, cancelledFn);
+            if(cancelled())
+                return;
+
+            auto& worker = workers.at(threadIndex);
+            if(worker == nullptr)
+                worker = std::make_unique<MCLWorker>(nodeCount);
+
+            auto outputStart = worker->_outputRows.size();
+            worker->iterate(clusterMatrix, column, inflation, MCL_PRUNE_LIMIT, pruning);
+
+            columnWorkers[column] = worker.get();
+            columnOutputOffsets[column] = outputStart;
+            columnSizes[column] = worker->_outputRows.size() - outputStart;
 
             target.setProgress(static_cast<int>((iteration++ * 100) / totalIterations));
         });
@@ -465,89 +379,99 @@ void MCLTransform::calculateMCL(float inflation, TransformedGraph& target) const
         if(cancelled())
             return;
 
-        size_t newNNZCount = 0;
-        for(const auto& column : matrixStorage)
-            newNNZCount += column.size();
+        // Assemble the new matrix from the workers' outputs; fixed columns are copied as is
+        SparseMatrix newMatrix;
+        newMatrix._offsets.resize(nodeCount + 1);
+        newMatrix._offsets[0] = 0;
 
-        MatrixType dstMatrix(clusterMatrix.rows(), clusterMatrix.rows());
-        dstMatrix.reserve(newNNZCount);
-        int row = 0;
-        for(const auto& matrixRow : matrixStorage)
+        for(size_t column = 0; column < nodeCount; column++)
         {
-            for(auto matrixEntry: matrixRow)
-                dstMatrix.append(matrixEntry._row, matrixEntry._column, matrixEntry._value);
-
-            dstMatrix.finalize(row);
-            row++;
+            auto size = columnsFixed[column] != 0 ? clusterMatrix.nonZeros(column) : columnSizes[column];
+            newMatrix._offsets[column + 1] = newMatrix._offsets[column] + size;
         }
-        clusterMatrix = dstMatrix;
 
-        if(_debugIteration)
+        newMatrix._rows.resize(newMatrix._offsets.back());
+        newMatrix._values.resize(newMatrix._offsets.back());
+
+        parallel_for(columns.begin(), columns.end(),
+        [&](size_t column)
         {
-            auto populationTime = threadedTimer.restart();
-            qDebug() << "Threaded Expansion Population time LL ms" << populationTime;
+            auto destination = static_cast<std::ptrdiff_t>(newMatrix._offsets[column]);
+            const Index* rows = nullptr;
+            const float* values = nullptr;
 
-            qDebug() << "Expand nnz" << clusterMatrix.nonZeros();
-        }
+            // An empty column's offset may be the end of its storage, so use pointer
+            // arithmetic rather than indexing, which would be out of range
+            if(columnsFixed[column] != 0)
+            {
+                rows = clusterMatrix._rows.data() + clusterMatrix._offsets[column];
+                values = clusterMatrix._values.data() + clusterMatrix._offsets[column];
+            }
+            else
+            {
+                rows = columnWorkers[column]->_outputRows.data() + columnOutputOffsets[column];
+                values = columnWorkers[column]->_outputValues.data() + columnOutputOffsets[column];
+            }
 
-        if(_debugMatrices)
-        {
-            matrixStream << "Expanded Matrix \n";
-            matrixStream << clusterMatrix;
-            qDebug().noquote() << QString::fromStdString(matrixStream.str());
-            matrixStream.clear();
-            matrixStream.str(std::string());
-        }
+            auto size = newMatrix.nonZeros(column);
+            std::copy_n(rows, size, newMatrix._rows.begin() + destination);
+            std::copy_n(values, size, newMatrix._values.begin() + destination);
+        });
 
-        // Inflate the matrix
-        clusterMatrix = blaze::forEach(clusterMatrix, [&inflation](float d)
-            { return std::pow(d, inflation); });
+        clusterMatrix = std::move(newMatrix);
 
-        if(_debugMatrices)
+        if(_debugIteration)
         {
-            matrixStream << "Inflated Expanded Matrix \n";
-            matrixStream << clusterMatrix;
-            qDebug().noquote() << QString::fromStdString(matrixStream.str());
-            matrixStream.clear();
-            matrixStream.str(std::string());
-            qDebug() << "Inflated Expanded nnz" << clusterMatrix.nonZeros();
+            qDebug() << "Threaded Expansion Population time LL ms" << threadedTimer.restart();
+            qDebug() << "Expand nnz" << clusterMatrix.nonZeros();
         }
 
-        // Normalise
-        normaliseColumnsColumnMajor(clusterMatrix);
-
         if(_debugMatrices)
+            debugMatrix(QStringLiteral("Normalised Inflated Expanded Matrix"), clusterMatrix);
+
+        // Check which columns are idempotent
+        parallel_for(activeColumns.begin(), activeColumns.end(),
+        [&](size_t column)
         {
-            matrixStream << "Normalised Inflated Expanded Matrix \n";
-            matrixStream << clusterMatrix;
-            qDebug().noquote() << QString::fromStdString(matrixStream.str());
-            matrixStream.clear();
-            matrixStream.str(std::string());
-            qDebug() << "Normalise nnz" << clusterMatrix.nonZeros();
-        }
+            const auto* values = clusterMatrix._values.data() + clusterMatrix._offsets[column];
+            const auto size = clusterMatrix.nonZeros(column);
 
-        // Check if matrix is idempotent
-        MatrixType sqClusterMatrix = blaze::forEach(clusterMatrix, [](float d) { return d * d; });
-        VectorType colSum(nodeCount, 0);
+            columnConvergences[column] = columnConverged(values, size, MCL_CONVERGENCE_LIMIT) ? 1 : 0;
+            columnUniformities[column] = columnUniform(values, size) ? 1 : 0;
+        });
 
-        sumColumns(sqClusterMatrix, colSum);
-        for(size_t k=0; k<clusterMatrix.columns(); ++k)
+        parallel_for(activeColumns.begin(), activeColumns.end(),
+        [&](size_t column)
         {
-            float max = 0.0f;
-            for(MatrixType::ConstIterator it=clusterMatrix.cbegin(k); it!=clusterMatrix.cend(k); ++it )
-                max = std::max(it->value(),max);
+            if(columnUniformities[column] == 0)
+                return;
 
-            if((max - colSum[k]) * static_cast<float>(clusterMatrix.nonZeros(k)) > MCL_CONVERGENCE_LIMIT)
+            auto begin = clusterMatrix._rows.begin() + static_cast<std::ptrdiff_t>(clusterMatrix._offsets[column]);
+            auto end = clusterMatrix._rows.begin() + static_cast<std::ptrdiff_t>(clusterMatrix._offsets[column + 1]);
+
+            columnsFixed[column] = std::all_of(begin, end, [&](Index row)
             {
-                if(_debugIteration)
-                    qDebug() << "No Converge" << (max - colSum[k]) * static_cast<float>(clusterMatrix.nonZeros(k));
-                isEquiDistrubuted = false;
-                break;
-            }
+                auto rowBegin = clusterMatrix._rows.begin() + static_cast<std::ptrdiff_t>(clusterMatrix._offsets[row]);
+                auto rowEnd = clusterMatrix._rows.begin() + static_cast<std::ptrdiff_t>(clusterMatrix._offsets[row + 1]);
+
+                return columnUniformities[row] != 0 && std::equal(begin, end, rowBegin, rowEnd);
+            }) ? 1 : 0;
+        });
+
+        // The matrix as a whole has converged once every column has
+        if(std::all_of(activeColumns.begin(), activeColumns.end(),
+            [&](size_t column) { return columnConvergences[column] != 0; }))
+        {
+            activeColumns.clear();
+        }
+        else
+        {
+            activeColumns.erase(std::remove_if(activeColumns.begin(), activeColumns.end(),
+                [&](size_t column) { return columnsFixed[column] != 0; }), activeColumns.end());
         }
 
         iter++;
-    } while(!isEquiDistrubuted);
+    }
 
     if(_debugIteration)
         qDebug() << iter << "iterations";
@@ -560,28 +484,29 @@ void MCLTransform::calculateMCL(float inflation, TransformedGraph& target) const
     std::vector<bool> clusterGroupAssigned(nodeCount, false);
     for(size_t k = 0; k < clusterMatrix.columns(); ++k)
     {
-        for(const auto* it = clusterMatrix.cbegin(k); it != clusterMatrix.cend(k); ++it )
+        for(auto entry = clusterMatrix._offsets[k]; entry < clusterMatrix._offsets[k + 1]; ++entry)
         {
-            if(it->value() < MCL_PRUNE_LIMIT)
+            if(clusterMatrix._values[entry] < MCL_PRUNE_LIMIT)
                 continue;
 
-            auto rowCluster = clusterGroups[it->index()];
+            const size_t row = clusterMatrix._rows[entry];
+            auto rowCluster = clusterGroups[row];
             auto columnCluster = clusterGroups[k];
-            auto rowClusterAssigned = clusterGroupAssigned[it->index()];
+            auto rowClusterAssigned = clusterGroupAssigned[row];
             auto columnClusterAssigned = clusterGroupAssigned[k];
 
             // If no cluster exists, make one
             if(!rowClusterAssigned && !columnClusterAssigned)
             {
                 std::set<size_t> newClusterNodeIndex;
-                newClusterNodeIndex.insert(it->index());
+                newClusterNodeIndex.insert(row);
                 newClusterNodeIndex.insert(k);
                 clusters.emplace_back(std::move(newClusterNodeIndex));
 
                 auto index = clusters.size() - 1;
-                clusterGroups[it->index()] = index;
+                clusterGroups[row] = index;
                 clusterGroups[k] = index;
-                clusterGroupAssigned[it->index()] = true;
+                clusterGroupAssigned[row] = true;
                 clusterGroupAssigned[k] = true;
             }
             else if(rowClusterAssigned)
@@ -606,9 +531,9 @@ void MCLTransform::calculateMCL(float inflation, TransformedGraph& target) const
             else if(columnClusterAssigned)
             {
                 // Add to Column Cluster
-                clusterGroups[it->index()] = columnCluster;
-                clusterGroupAssigned[it->index()] = true;
-                clusters[columnCluster].insert(it->index());
+                clusterGroups[row] = columnCluster;
+                clusterGroupAssigned[row] = true;
+                clusters[columnCluster].insert(row);
             }
         }
     }
@@ -631,7 +556,7 @@ void MCLTransform::calculateMCL(float inflation, TransformedGraph& target) const
 
         for(auto index : cluster)
         {
-            auto nodeId = indexToNodeMap.at(index);
+            auto nodeId = adjacency->nodeIdAt(static_cast<AdjacencySnapshot::Index>(index));
             auto clusterName = QString(QObject::tr("Cluster %1")).arg(QString::number(clusterNumber));
 
             clusterNames[nodeId] = clusterName;
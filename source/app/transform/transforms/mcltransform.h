@@ -24,6 +24,19 @@
 #include "shared/utils/flags.h"
 #include "shared/utils/redirects.h"
 
+// Controls how much of each column is kept after expansion; this is
+// the same scheme as the -S, -R and -pct options of the mcl program
+struct MCLPruning
+{
+    // At most this many entries are kept in each column...
+    int _selectionNumber = 1100;
+
+    // ...unless less than this proportion of the column's mass remains, in
+    // which case up to this many of the largest entries are recovered
+    float _recoveryMass = 0.9f;
+    int _recoveryNumber = 1400;
+};
+
 class MCLTransform : public GraphTransform
 {
 public:
@@ -43,7 +56,7 @@ private:
     bool _debugIteration = false;
     bool _debugMatrices = false;
 
-    void calculateMCL(float inflation, TransformedGraph& target) const;
+    void calculateMCL(float inflation, const MCLPruning& pruning, TransformedGraph& target) const;
 
 private:
     GraphModel* _graphModel = nullptr;
@@ -73,7 +86,28 @@ public:
                 .setDescription(QObject::tr("The size of the resultant clusters. "
                     "A larger granularity value results in smaller clusters."))
                 .setInitialValue(2.0)
-                .setRange(1.1, 3.5)
+                .setRange(1.1, 3.5),
+
+            GraphTransformParameter::create("Selection Number")
+                .setType(ValueType::Int)
+                .setDescription(QObject::tr("The maximum number of entries kept in each column of the "
+                    "matrix after expansion. Lower values are faster, but less accurate."))
+                .setInitialValue(1100)
+                .setMin(1),
+
+            GraphTransformParameter::create("Recovery Number")
+                .setType(ValueType::Int)
+                .setDescription(QObject::tr("When pruning removes too much of a column, the number "
+                    "of its largest entries that are recovered."))
+                .setInitialValue(1400)
+                .setMin(1),
+
+            GraphTransformParameter::create("Recovery Percentage")
+                .setType(ValueType::Int)
+                .setDescription(QObject::tr("Recovery is performed when less than this percentage "
+                    "of a column remains after pruning."))
+                .setInitialValue(90)
+                .setRange(0, 100)
         };
     }
 
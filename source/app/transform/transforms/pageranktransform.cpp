@@ -20,18 +20,20 @@
 
 #include "transform/transformedgraph.h"
 
-#include "graph/graphcomponent.h"
 #include "graph/graphmodel.h"
-#include "graph/componentmanager.h"
+#include "graph/adjacencysnapshot.h"
 
-#include <blaze/Blaze.h>
+#include "shared/utils/threadpool.h"
 
 #include <QElapsedTimer>
 #include <QDebug>
 
-#include <map>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
 
-using VectorType = blaze::DynamicVector<float>;
+using Index = AdjacencySnapshot::Index;
 
 void PageRankTransform::apply(TransformedGraph& target) const
 {
@@ -44,122 +46,195 @@ void PageRankTransform::calculatePageRank(TransformedGraph& target) const
     // not use a matrix. This dramatically lowers the memory footprint.
     // http://www.dcs.bbk.ac.uk/~dell/teaching/cc/book/mmds/mmds_ch5_2.pdf
     // http://michaelnielsen.org/blog/using-your-laptop-to-compute-pagerank-for-millions-of-webpages/
-    NodeArray<float> pageRankScores(target);
-
     target.setPhase(QStringLiteral("PageRank"));
 
+    QElapsedTimer timer;
+    if(_debug)
+        timer.start();
+
+    auto adjacency = target.adjacencySnapshot();
+    const auto numNodes = static_cast<size_t>(adjacency->numNodes());
+    const auto& offsets = adjacency->offsets();
+    const auto& neighbours = adjacency->neighbourIndices();
+
     // We must do our own componentisation as the graph's set of components
-    // won't necessarily be up-to-date
-    ComponentManager componentManager(target);
-
-    int totalIterationCount = 0;
-    for(auto componentId : componentManager.componentIds())
-    {        
-        const IGraphComponent* component = componentManager.componentById(componentId);
-        auto componentNodeCount = static_cast<int>(component->nodeIds().size());
-
-        // Map NodeIds to Matrix index
-        NodeIdMap<int> nodeToIndexMap;
-        for(auto nodeId : component->nodeIds())
+    // won't necessarily be up-to-date; each component is ranked independently
+    const auto NoComponent = std::numeric_limits<size_t>::max();
+    std::vector<size_t> componentOf(numNodes, NoComponent);
+    std::vector<size_t> componentSizes;
+
+    std::vector<Index> queue;
+    queue.reserve(numNodes);
+
+    for(size_t root = 0; root < numNodes; root++)
+    {
+        if(componentOf[root] != NoComponent)
+            continue;
+
+        const auto component = componentSizes.size();
+        const auto queueStart = queue.size();
+
+        componentOf[root] = component;
+        queue.push_back(static_cast<Index>(root));
+
+        for(auto head = queueStart; head < queue.size(); head++)
         {
-            auto index = static_cast<int>(nodeToIndexMap.size());
-            nodeToIndexMap[nodeId] = index;
+            auto index = static_cast<size_t>(queue[head]);
+
+            for(auto entry = offsets[index]; entry < offsets[index + 1]; entry++)
+            {
+                auto neighbour = static_cast<size_t>(neighbours[entry]);
+                if(componentOf[neighbour] == NoComponent)
+                {
+                    componentOf[neighbour] = component;
+                    queue.push_back(static_cast<Index>(neighbour));
+                }
+            }
         }
 
-        QElapsedTimer timer;
-        if (_debug)
-            timer.start();
-
-        VectorType pageRankVector(componentNodeCount,
-            1.0f / static_cast<float>(componentNodeCount));
-        VectorType newPageRankVector(componentNodeCount);
-        VectorType delta(componentNodeCount);
-        float change = std::numeric_limits<float>::max();
-        int iterationCount = 0;
-        std::deque<float> changeBuffer;
-        float previousBufferChangeAverage = 0.0f;
-        float pagerankAcceleration = std::numeric_limits<float>::max();
-        while(change > PAGERANK_EPSILON &&
-              iterationCount < PAGERANK_ITERATION_LIMIT &&
-              pagerankAcceleration > PAGERANK_ACCELERATION_MINIMUM)
+        componentSizes.push_back(queue.size() - queueStart);
+    }
+
+    const auto numComponents = componentSizes.size();
+
+    std::vector<float> inverseDegrees(numNodes, 0.0f);
+    std::vector<float> teleports(numNodes);
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        auto degree = offsets[i + 1] - offsets[i];
+        if(degree > 0)
+            inverseDegrees[i] = 1.0f / static_cast<float>(degree);
+
+        teleports[i] = (1.0f - PAGERANK_DAMPING) / static_cast<float>(componentSizes[componentOf[i]]);
+    }
+
+    // Start from the previous result where there is one, and a uniform distribution otherwise
+    std::vector<float> scores(numNodes);
+    {
+        std::unique_lock<std::mutex> lock(_warmStart->_mutex);
+        const auto& previousScores = _warmStart->_scores;
+
+        for(size_t i = 0; i < numNodes; i++)
         {
-            if(cancelled())
-                return;
+            auto nodeIndex = static_cast<size_t>(static_cast<int>(adjacency->nodeIdAt(static_cast<Index>(i))));
 
-            target.setPhase(QStringLiteral("PageRank Iteration %1").arg(
-                                QString::number(totalIterationCount + 1)));
+            scores[i] = nodeIndex < previousScores.size() && previousScores[nodeIndex] > 0.0f ?
+                previousScores[nodeIndex] : 1.0f / static_cast<float>(componentSizes[componentOf[i]]);
+        }
+    }
 
-            // Calculate pagerank
-            for(auto nodeId : component->nodeIds())
-            {
-                auto matrixId = nodeToIndexMap[nodeId];
-                float prSum = 0.0f;
+    std::vector<float> componentSums(numComponents, 0.0f);
+    for(size_t i = 0; i < numNodes; i++)
+        componentSums[componentOf[i]] += scores[i];
 
-                for(auto edgeId : target.edgeIdsForNodeId(nodeId))
-                {
-                    auto oppositeNodeId = target.edgeById(edgeId).oppositeId(nodeId);
-                    prSum += pageRankVector[nodeToIndexMap[oppositeNodeId]] /
-                        static_cast<float>(target.nodeById(oppositeNodeId).degree());
-                }
+    for(size_t i = 0; i < numNodes; i++)
+        scores[i] /= componentSums[componentOf[i]];
 
-                newPageRankVector[matrixId] = (prSum * PAGERANK_DAMPING) +
-                    ((1.0f - PAGERANK_DAMPING) / static_cast<float>(componentNodeCount));
-            }
+    // Only the nodes of components that are yet to converge are iterated over
+    std::vector<Index> active(numNodes);
+    std::iota(active.begin(), active.end(), 0);
+
+    std::vector<float> contributions(numNodes);
+    std::vector<float> newScores(numNodes);
+    std::vector<float> componentChanges(numComponents);
+
+    int iterationCount = 0;
+    while(!active.empty() && iterationCount < PAGERANK_ITERATION_LIMIT)
+    {
+        if(cancelled())
+            return;
+
+        target.setPhase(QStringLiteral("PageRank Iteration %1").arg(
+            QString::number(iterationCount + 1)));
+
+        parallel_for(active.begin(), active.end(),
+        [&](Index index)
+        {
+            auto i = static_cast<size_t>(index);
+            contributions[i] = scores[i] * inverseDegrees[i];
+        });
+
+        // Neighbours are always within the same component, so any contributions
+        // from a converged component are never read, and needn't be updated
+        parallel_for(active.begin(), active.end(),
+        [&](Index index)
+        {
+            auto i = static_cast<size_t>(index);
+            float prSum = 0.0f;
 
-            // Normalise result
-            float sum = 0.0f;
-            for(auto value : newPageRankVector)
-                sum += value;
-             newPageRankVector = newPageRankVector / sum;
-
-            // Detect PR Change
-            change = 0.0f;
-            delta = blaze::abs(newPageRankVector - pageRankVector);
-            for(size_t i = 0UL; i < newPageRankVector.size(); ++i )
-                change += delta[i];
-
-            // Oscillation detection (delta avg)
-            changeBuffer.push_front(change);
-            if(changeBuffer.size() >= static_cast<size_t>(AVG_COUNT))
-                changeBuffer.pop_back();
-
-            // Average the last 10 steps
-            float bufferChangeAverage = 0.0f;
-            for(auto changes : changeBuffer)
-                bufferChangeAverage += changes;
-            bufferChangeAverage /= static_cast<float>(AVG_COUNT);
-
-            pagerankAcceleration = std::abs(previousBufferChangeAverage - bufferChangeAverage);
-
-            // Only update the previousAvg after AVG_COUNT steps
-            if(iterationCount % AVG_COUNT == 0)
-                previousBufferChangeAverage = bufferChangeAverage;
-
-            pageRankVector = newPageRankVector;
-            iterationCount++;
-            totalIterationCount++;
+            for(auto entry = offsets[i]; entry < offsets[i + 1]; entry++)
+                prSum += contributions[static_cast<size_t>(neighbours[entry])];
+
+            newScores[i] = (prSum * PAGERANK_DAMPING) + teleports[i];
+        });
+
+        for(auto index : active)
+        {
+            auto c = componentOf[static_cast<size_t>(index)];
+            componentSums[c] = 0.0f;
+            componentChanges[c] = 0.0f;
         }
-        if(_debug && iterationCount == PAGERANK_ITERATION_LIMIT)
-            qDebug() << "HIT ITERATION LIMIT ON PAGERANK. LIKELY UNSTABLE PAGERANK VECTOR";
 
-        float maxValue = blaze::max(blaze::abs(pageRankVector) );
-        pageRankVector = pageRankVector / maxValue;
+        for(auto index : active)
+            componentSums[componentOf[static_cast<size_t>(index)]] += newScores[static_cast<size_t>(index)];
 
-        for(auto nodeId : component->nodeIds())
-            pageRankScores[nodeId] = pageRankVector[nodeToIndexMap[nodeId]];
+        // Normalise result and detect PR change
+        for(auto index : active)
+        {
+            auto i = static_cast<size_t>(index);
+            auto c = componentOf[i];
+
+            auto score = newScores[i] / componentSums[c];
+            componentChanges[c] += std::abs(score - scores[i]);
+            scores[i] = score;
+        }
 
-        if (_debug)
+        active.erase(std::remove_if(active.begin(), active.end(), [&](Index index)
         {
-            std::stringstream matrixStream;
-            matrixStream << pageRankVector;
-            qDebug() << "PageRank";
-            qDebug().noquote() << QString::fromStdString(matrixStream.str());
+            return componentChanges[componentOf[static_cast<size_t>(index)]] <= PAGERANK_EPSILON;
+        }), active.end());
 
-            qDebug() << "Pagerank took" << iterationCount << "iterations";
-            qDebug() << "The efficient pagerank operation took" << timer.elapsed();
+        iterationCount++;
+    }
+
+    if(_debug && iterationCount == PAGERANK_ITERATION_LIMIT)
+        qDebug() << "HIT ITERATION LIMIT ON PAGERANK. LIKELY UNSTABLE PAGERANK VECTOR";
+
+    {
+        std::unique_lock<std::mutex> lock(_warmStart->_mutex);
+        auto& previousScores = _warmStart->_scores;
+
+        const auto& nodeIds = adjacency->nodeIds();
+        auto maxNodeId = !nodeIds.empty() ? *std::max_element(nodeIds.begin(), nodeIds.end()) : NodeId();
+
+        previousScores.assign(static_cast<size_t>(static_cast<int>(maxNodeId) + 1), 0.0f);
+        for(size_t i = 0; i < numNodes; i++)
+        {
+            auto nodeIndex = static_cast<size_t>(static_cast<int>(adjacency->nodeIdAt(static_cast<Index>(i))));
+            previousScores[nodeIndex] = scores[i];
         }
     }
 
+    std::vector<float> componentMaxima(numComponents, 0.0f);
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        auto& componentMaximum = componentMaxima[componentOf[i]];
+        componentMaximum = std::max(componentMaximum, scores[i]);
+    }
+
+    NodeArray<float> pageRankScores(target);
+    for(size_t i = 0; i < numNodes; i++)
+    {
+        pageRankScores[adjacency->nodeIdAt(static_cast<Index>(i))] =
+            scores[i] / componentMaxima[componentOf[i]];
+    }
+
+    if(_debug)
+    {
+        qDebug() << "Pagerank took" << iterationCount << "iterations over" << numComponents << "components";
+        qDebug() << "The efficient pagerank operation took" << timer.elapsed();
+    }
+
     _graphModel->createAttribute(QObject::tr("Node PageRank"))
         .setDescription(QObject::tr("A node's PageRank is a measure of relative importance in the graph."))
         .floatRange().setMin(0.0f)
@@ -170,6 +245,6 @@ void PageRankTransform::calculatePageRank(TransformedGraph& target) const
 
 std::unique_ptr<GraphTransform> PageRankTransformFactory::create(const GraphTransformConfig&) const
 {
-    return std::make_unique<PageRankTransform>(graphModel());
+    return std::make_unique<PageRankTransform>(graphModel(), _warmStart);
 }
 
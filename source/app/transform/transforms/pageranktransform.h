@@ -24,10 +24,26 @@
 #include "shared/utils/flags.h"
 #include "shared/utils/redirects.h"
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// The scores from the last application of the transform, indexed by NodeId;
+// when the transform is reapplied after an edit, these are used as the
+// initial estimate, so that far fewer iterations are needed to converge
+struct PageRankWarmStart
+{
+    std::mutex _mutex;
+    std::vector<float> _scores;
+};
+
 class PageRankTransform : public GraphTransform
 {
 public:
-    explicit PageRankTransform(GraphModel* graphModel) : _graphModel(graphModel) {}
+    PageRankTransform(GraphModel* graphModel, std::shared_ptr<PageRankWarmStart> warmStart) :
+        _graphModel(graphModel), _warmStart(std::move(warmStart))
+    {}
+
     void apply(TransformedGraph& target) const override;
 
     void enableDebug() { _debug = true; }
@@ -36,18 +52,20 @@ public:
 private:
     const float PAGERANK_DAMPING = 0.8f;
     const float PAGERANK_EPSILON = 1e-6f;
-    const float PAGERANK_ACCELERATION_MINIMUM = 1e-10f;
     const int PAGERANK_ITERATION_LIMIT = 1000;
-    const int AVG_COUNT = 10;
 
     bool _debug = false;
 
     void calculatePageRank(TransformedGraph& target) const;
     GraphModel* _graphModel = nullptr;
+    std::shared_ptr<PageRankWarmStart> _warmStart;
 };
 
 class PageRankTransformFactory : public GraphTransformFactory
 {
+private:
+    std::shared_ptr<PageRankWarmStart> _warmStart = std::make_shared<PageRankWarmStart>();
+
 public:
     explicit PageRankTransformFactory(GraphModel* graphModel) :
         GraphTransformFactory(graphModel)
@@ -0,0 +1,207 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "searchindex.h"
+
+#include "graph/graph.h"
+#include "graph/graphmodel.h"
+#include "attributes/attributecache.h"
+
+#include "shared/utils/threadpool.h"
+
+#include <QRegularExpression>
+#include <QHash>
+
+#include <algorithm>
+#include <numeric>
+
+static std::vector<uint64_t> trigramsOf(const QString& string)
+{
+    std::vector<uint64_t> trigrams;
+
+    if(string.size() < 3)
+        return trigrams;
+
+    std::vector<uint64_t> folded;
+    folded.reserve(static_cast<size_t>(string.size()));
+    for(auto c : string)
+        folded.push_back(c.toCaseFolded().unicode());
+
+    trigrams.reserve(folded.size() - 2);
+    for(size_t i = 0; i + 2 < folded.size(); i++)
+        trigrams.push_back((folded[i] << 32) | (folded[i + 1] << 16) | folded[i + 2]);
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    return trigrams;
+}
+
+SearchIndex::SearchIndex(const GraphModel& graphModel) :
+    _graphModel(&graphModel)
+{}
+
+std::shared_ptr<const SearchIndex::AttributeIndex> SearchIndex::build(
+    std::shared_ptr<const AttributeColumn> column) const
+{
+    auto attributeIndex = std::make_shared<AttributeIndex>();
+    auto& values = attributeIndex->_values;
+    const auto& graph = _graphModel->graph();
+
+    QHash<QString, int> valueIndices;
+
+    for(auto nodeId : graph.nodeIds())
+    {
+        // Tails are indexed as part of the merge set of their head
+        if(graph.typeOf(nodeId) == MultiElementType::Tail)
+            continue;
+
+        for(auto mergedNodeId : graph.mergedNodeIdsForNodeId(nodeId))
+        {
+            auto value = column->stringValueOf(mergedNodeId);
+
+            auto it = valueIndices.find(value);
+            if(it == valueIndices.end())
+            {
+                it = valueIndices.insert(value, static_cast<int>(values.size()));
+                values.emplace_back(value);
+                attributeIndex->_nodeIds.emplace_back();
+            }
+
+            auto& nodeIds = attributeIndex->_nodeIds.at(static_cast<size_t>(*it));
+
+            // Other nodes in the same merge set may have the same value
+            if(nodeIds.empty() || nodeIds.back() != nodeId)
+                nodeIds.push_back(nodeId);
+        }
+    }
+
+    if(!values.empty())
+    {
+        std::vector<size_t> indices(values.size());
+        std::iota(indices.begin(), indices.end(), 0);
+
+        std::vector<std::vector<uint64_t>> trigrams(values.size());
+        parallel_for(indices.begin(), indices.end(),
+        [&](size_t index)
+        {
+            trigrams[index] = trigramsOf(values[index]);
+        });
+
+        // Values are visited in order, so each list of value indices is sorted
+        for(size_t index = 0; index < trigrams.size(); index++)
+        {
+            for(auto trigram : trigrams[index])
+                attributeIndex->_trigramValueIndices[trigram].push_back(static_cast<int>(index));
+        }
+    }
+
+    attributeIndex->_column = std::move(column);
+
+    return attributeIndex;
+}
+
+std::shared_ptr<const SearchIndex::AttributeIndex> SearchIndex::attributeIndexFor(const QString& attributeName)
+{
+    // The model only gives out a new column when the attribute's values have changed
+    auto column = _graphModel->attributeColumn(attributeName);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if(column == nullptr)
+    {
+        _attributeIndices.erase(attributeName);
+        return nullptr;
+    }
+
+    auto it = _attributeIndices.find(attributeName);
+    if(it != _attributeIndices.end() && it->second->_column == column)
+        return it->second;
+
+    lock.unlock();
+    auto attributeIndex = build(column);
+    lock.lock();
+
+    _attributeIndices[attributeName] = attributeIndex;
+
+    return attributeIndex;
+}
+
+void SearchIndex::findNodes(const QString& attributeName, const QRegularExpression& re,
+    const QString& literal, std::vector<NodeId>& nodeIds)
+{
+    auto attributeIndex = attributeIndexFor(attributeName);
+    if(attributeIndex == nullptr)
+        return;
+
+    auto testValue = [&](size_t valueIndex)
+    {
+        if(re.match(attributeIndex->_values.at(valueIndex)).hasMatch())
+        {
+            const auto& valueNodeIds = attributeIndex->_nodeIds.at(valueIndex);
+            nodeIds.insert(nodeIds.end(), valueNodeIds.begin(), valueNodeIds.end());
+        }
+    };
+
+    auto trigrams = trigramsOf(literal);
+
+    // Characters outside the BMP aren't case folded by the index, so would
+    // be missed in a case insensitive search if they were relied upon
+    bool hasSurrogates = std::any_of(literal.begin(), literal.end(),
+        [](QChar c) { return c.isSurrogate(); });
+
+    if(trigrams.empty() || hasSurrogates)
+    {
+        // The index can't narrow the search, but values only need testing once
+        for(size_t valueIndex = 0; valueIndex < attributeIndex->_values.size(); valueIndex++)
+            testValue(valueIndex);
+
+        return;
+    }
+
+    std::vector<const std::vector<int>*> valueIndicesLists;
+    valueIndicesLists.reserve(trigrams.size());
+
+    for(auto trigram : trigrams)
+    {
+        auto it = attributeIndex->_trigramValueIndices.find(trigram);
+        if(it == attributeIndex->_trigramValueIndices.end())
+            return; // No value contains this trigram, so nothing can match
+
+        valueIndicesLists.push_back(&it->second);
+    }
+
+    // Intersect the shortest lists first, so the candidates dwindle quickly
+    std::sort(valueIndicesLists.begin(), valueIndicesLists.end(),
+        [](const auto* a, const auto* b) { return a->size() < b->size(); });
+
+    std::vector<int> candidates = *valueIndicesLists.front();
+    std::vector<int> intersection;
+
+    for(auto it = valueIndicesLists.begin() + 1; it != valueIndicesLists.end() && !candidates.empty(); ++it)
+    {
+        intersection.clear();
+        std::set_intersection(candidates.begin(), candidates.end(),
+            (*it)->begin(), (*it)->end(), std::back_inserter(intersection));
+        std::swap(candidates, intersection);
+    }
+
+    for(auto candidate : candidates)
+        testValue(static_cast<size_t>(candidate));
+}
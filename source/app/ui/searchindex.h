@@ -0,0 +1,79 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "shared/graph/elementid.h"
+
+#include <QString>
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+class GraphModel;
+class AttributeColumn;
+class QRegularExpression;
+
+// An inverted index from the trigrams of the values of node attributes to the values
+// that contain them, so that a search can skip testing those values that don't contain
+// every trigram of the term being searched for. An attribute's index is built the first
+// time the attribute is searched and rebuilt whenever its values change.
+class SearchIndex
+{
+private:
+    struct AttributeIndex
+    {
+        // The column from which the index was built; when the attribute's values
+        // change, the model has a new column, and the index is stale
+        std::shared_ptr<const AttributeColumn> _column;
+
+        // The distinct values of the attribute...
+        std::vector<QString> _values;
+
+        // ...and for each, the heads of the merge sets in which it occurs
+        std::vector<std::vector<NodeId>> _nodeIds;
+
+        // The indices of the values containing each (case folded) trigram, in ascending order
+        std::unordered_map<uint64_t, std::vector<int>> _trigramValueIndices;
+    };
+
+    const GraphModel* _graphModel = nullptr;
+
+    mutable std::mutex _mutex;
+    std::map<QString, std::shared_ptr<const AttributeIndex>> _attributeIndices;
+
+    std::shared_ptr<const AttributeIndex> build(std::shared_ptr<const AttributeColumn> column) const;
+    std::shared_ptr<const AttributeIndex> attributeIndexFor(const QString& attributeName);
+
+public:
+    explicit SearchIndex(const GraphModel& graphModel);
+
+    // Appends to nodeIds the head of each merge set that has a value of attributeName
+    // matching re; if literal isn't empty, it must be a substring of any value that
+    // re matches, when both are case folded
+    void findNodes(const QString& attributeName, const QRegularExpression& re,
+        const QString& literal, std::vector<NodeId>& nodeIds);
+};
+
+#endif // SEARCHINDEX_H
@@ -20,7 +20,6 @@
 
 #include "graph/graph.h"
 #include "graph/graphmodel.h"
-#include "attributes/conditionfncreator.h"
 
 #include "shared/utils/container.h"
 
@@ -29,7 +28,8 @@
 #include <algorithm>
 
 SearchManager::SearchManager(const GraphModel& graphModel) :
-    _graphModel(&graphModel)
+    _graphModel(&graphModel),
+    _searchIndex(graphModel)
 {}
 
 void SearchManager::findNodes(QString term, Flags<FindOptions> options,
@@ -55,7 +55,7 @@ void SearchManager::findNodes(QString term, Flags<FindOptions> options,
             _attributeNames.append(attributeName);
     }
 
-    std::vector<Attribute> attributes;
+    QStringList searchableAttributeNames;
     for(auto& attributeName : _attributeNames)
     {
         auto attribute = _graphModel->attributeValueByName(attributeName);
@@ -63,17 +63,20 @@ void SearchManager::findNodes(QString term, Flags<FindOptions> options,
         if(attribute.testFlag(AttributeFlag::Searchable) &&
             attribute.elementType() == ElementType::Node)
         {
-            attributes.emplace_back(attribute);
+            searchableAttributeNames.append(attributeName);
         }
     }
 
     // None of the given attributes are searchable
-    if(!_attributeNames.empty() && attributes.empty())
+    if(!_attributeNames.empty() && searchableAttributeNames.empty())
     {
         clearFoundNodeIds();
         return;
     }
 
+    // Unless it's a regex, the term itself must appear in anything that matches
+    QString literal = !options.test(FindOptions::MatchUsingRegex) ? term : QString();
+
     QRegularExpression::PatternOptions reOptions;
 
     if(options.test(FindOptions::MatchExact))
@@ -97,53 +100,38 @@ void SearchManager::findNodes(QString term, Flags<FindOptions> options,
 
     if(re.isValid())
     {
-        ConditionFnOp::String op = ConditionFnOp::String::MatchesRegex;
-        if(reOptions.testFlag(QRegularExpression::CaseInsensitiveOption))
-            op = ConditionFnOp::String::MatchesRegexCaseInsensitive;
+        const auto& graph = _graphModel->graph();
 
-        std::vector<NodeConditionFn> conditionFns;
-        for(auto& attribute : attributes)
+        // Fall back on a node name search if there are no attributes provided
+        if(searchableAttributeNames.empty())
         {
-            auto conditionFn = CreateConditionFnFor::node(attribute, op, term);
-
-            if(conditionFn != nullptr)
-                conditionFns.emplace_back(conditionFn);
-        }
-
-        for(auto nodeId : _graphModel->graph().nodeIds())
-        {
-            // We can't add tail nodes to the results since merge sets can only be found
-            // using head nodes... (cont.)
-            if(_graphModel->graph().typeOf(nodeId) == MultiElementType::Tail)
-                continue;
-
-            const auto& mergedNodeIds = _graphModel->graph().mergedNodeIdsForNodeId(nodeId);
-            bool match = false;
-
-            // Fall back on a node name search if there are no attributes provided
-            if(attributes.empty())
-                match = re.match(_graphModel->nodeNames().at(nodeId)).hasMatch();
-
-            if(!match)
+            for(auto nodeId : graph.nodeIds())
             {
-                match = std::any_of(conditionFns.begin(), conditionFns.end(),
-                [&mergedNodeIds](const auto& conditionFn)
+                // We can't add tail nodes to the results since merge sets can only be found
+                // using head nodes
+                if(graph.typeOf(nodeId) == MultiElementType::Tail)
+                    continue;
+
+                if(re.match(_graphModel->nodeNames().at(nodeId)).hasMatch())
                 {
-                    // ...but we still match against the tails... (cont.)
-                    return std::any_of(mergedNodeIds.begin(), mergedNodeIds.end(),
-                    [&conditionFn](auto mergedNodeId)
-                    {
-                       return conditionFn(mergedNodeId);
-                    });
-                });
+                    const auto& mergedNodeIds = graph.mergedNodeIdsForNodeId(nodeId);
+                    foundNodeIds.insert(mergedNodeIds.begin(), mergedNodeIds.end());
+                }
             }
+        }
 
-            if(match)
-            {
-                // ...so that the entire merge set of the head is found, even if
-                // it's only a subset of the merge set that actually matched
-                foundNodeIds.insert(mergedNodeIds.begin(), mergedNodeIds.end());
-            }
+        // The index finds the heads of merge sets in which any node matches,
+        // tails included... (cont.)
+        std::vector<NodeId> headNodeIds;
+        for(const auto& attributeName : searchableAttributeNames)
+            _searchIndex.findNodes(attributeName, re, literal, headNodeIds);
+
+        for(auto headNodeId : headNodeIds)
+        {
+            // ...so that the entire merge set of the head is found, even if
+            // it's only a subset of the merge set that actually matched
+            const auto& mergedNodeIds = graph.mergedNodeIdsForNodeId(headNodeId);
+            foundNodeIds.insert(mergedNodeIds.begin(), mergedNodeIds.end());
         }
     }
 
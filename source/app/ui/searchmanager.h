@@ -20,6 +20,7 @@
 #define SEARCHMANAGER_H
 
 #include "findoptions.h"
+#include "searchindex.h"
 
 #include "shared/graph/elementid.h"
 #include "shared/graph/elementid_containers.h"
@@ -62,6 +63,7 @@ private:
     FindSelectStyle _selectStyle = FindSelectStyle::None;
 
     const GraphModel* _graphModel = nullptr;
+    SearchIndex _searchIndex;
 
     mutable std::recursive_mutex _mutex;
     NodeIdSet _foundNodeIds;
@@ -28,7 +28,7 @@
 #include "shared/graph/grapharray.h"
 #include "shared/utils/utils.h"
 #include "shared/utils/container.h"
-#include "attributes/attribute.h"
+#include "attributes/attributecache.h"
 
 #include <vector>
 #include <array>
@@ -142,7 +142,7 @@ public:
         }
     }
 
-    void build(const Attribute& attribute,
+    void build(const AttributeColumn& column,
                const VisualisationChannel& channel,
                const VisualisationConfig& config,
                int index, VisualisationInfo& visualisationInfo)
@@ -156,7 +156,7 @@ public:
             return;
         }
 
-        switch(attribute.valueType())
+        switch(column.valueType())
         {
         case ValueType::Int:
         case ValueType::Float:
@@ -185,7 +185,7 @@ public:
 
                 for(auto elementId : elementIds(graph))
                 {
-                    double value = attribute.numericValueOf(elementId);
+                    double value = column.numericValueOf(elementId);
 
                     if(channel.allowsMapping())
                     {
@@ -201,14 +201,14 @@ public:
                 numApplications++;
             };
 
-            auto statistics = attribute.findStatisticsforElements(elementIds(), true);
+            auto statistics = column.findStatisticsforElements(elementIds(), true);
 
             if(perComponent)
             {
                 for(auto componentId : _graph->componentIds())
                 {
                     const auto* component = _graph->componentById(componentId);
-                    auto componentStatistics = attribute.findStatisticsforElements(elementIds(component));
+                    auto componentStatistics = column.findStatisticsforElements(elementIds(component));
                     applyTo(component, componentStatistics);
                 }
             }
@@ -228,7 +228,7 @@ public:
         {
             for(auto elementId : elementIds())
             {
-                auto stringValue = attribute.stringValueOf(elementId);
+                auto stringValue = column.stringValueOf(elementId);
                 apply(stringValue, channel, elementId, _numAppliedVisualisations);
             }
 
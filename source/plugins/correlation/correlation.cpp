@@ -18,6 +18,14 @@
 
 #include "correlation.h"
 
+#include <blaze/Blaze.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <limits>
+#include <numeric>
+
 std::unique_ptr<ContinuousCorrelation> ContinuousCorrelation::create(CorrelationType correlationType)
 {
     switch(correlationType)
@@ -45,13 +53,297 @@ std::unique_ptr<DiscreteCorrelation> DiscreteCorrelation::create(CorrelationType
     return nullptr;
 }
 
-double PearsonAlgorithm::evaluate(size_t numColumns, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB)
+size_t DiscreteCorrelation::numNonZeroTokens(const TokenisedDataRows& rows)
 {
-    double productSum = std::inner_product(rowA->begin(), rowA->end(), rowB->begin(), 0.0);
-    double numerator = (static_cast<double>(numColumns) * productSum) - (rowA->sum() * rowB->sum());
-    double denominator = rowA->variability() * rowB->variability();
+    // Tokens are allocated sequentially, from 1
+    size_t maxToken = 0;
 
-    return numerator / denominator;
+    for(const auto& row : rows)
+    {
+        for(auto token : row)
+            maxToken = std::max(maxToken, token);
+    }
+
+    return maxToken;
+}
+
+EdgeList DiscreteCorrelation::bitsetCorrelation(const TokenisedDataRows& rows, size_t numTokens,
+    bool treatAsBinary, int denominator, double minimumThreshold,
+    Cancellable* cancellable, Progressable* progressable)
+{
+    const auto numRows = rows.size();
+    const auto numColumns = rows.front().numColumns();
+    const auto numWords = (numColumns + 63) / 64;
+
+    // Plane 0 marks where any token is present; when tokens are compared individually, each
+    // subsequent plane marks where a particular token is present. With only one token, plane
+    // 0 serves for that too.
+    const bool compareTokens = !treatAsBinary && numTokens > 1;
+    const auto numPlanes = compareTokens ? numTokens + 1 : 1;
+    const auto rowStride = numPlanes * numWords;
+
+    std::vector<uint64_t> bits(numRows * rowStride, 0);
+
+    for(size_t rowIndex = 0; rowIndex < numRows; rowIndex++)
+    {
+        auto* rowBits = &bits[rowIndex * rowStride];
+
+        for(size_t column = 0; column < numColumns; column++)
+        {
+            auto token = rows[rowIndex].valueAt(column);
+            if(token == 0)
+                continue;
+
+            const auto word = column / 64;
+            const auto bit = uint64_t{1} << (column % 64);
+
+            rowBits[word] |= bit;
+
+            if(compareTokens)
+                rowBits[(token * numWords) + word] |= bit;
+        }
+    }
+
+    const size_t TileSize = 64;
+
+    struct RowTile
+    {
+        size_t _first;
+        size_t _size;
+        uint64_t _cost;
+
+        uint64_t computeCostHint() const { return _cost; }
+    };
+
+    std::vector<RowTile> rowTiles;
+    for(size_t first = 0; first < numRows; first += TileSize)
+    {
+        auto size = std::min(TileSize, numRows - first);
+        rowTiles.push_back({first, size, static_cast<uint64_t>(size * (numRows - first))});
+    }
+
+    const auto totalTiles = static_cast<uint64_t>(rowTiles.size() * (rowTiles.size() + 1)) / 2;
+    std::atomic<uint64_t> tilesDone(0);
+
+    if(progressable != nullptr)
+        progressable->setProgress(0);
+
+    auto results = ThreadPool(QStringLiteral("Correlation")).parallel_for(rowTiles.begin(), rowTiles.end(),
+    [&](const RowTile& rowTile)
+    {
+        // Edges are gathered per row, so that they end up in the same order as if
+        // each row had been compared with every subsequent row in turn
+        std::vector<EdgeList> rowEdges(rowTile._size);
+
+        // Compare against blocks of rows, so that each block is loaded
+        // into cache once for the whole tile, rather than once per row
+        for(size_t blockFirst = rowTile._first; blockFirst < numRows; blockFirst += TileSize)
+        {
+            if(cancellable != nullptr && cancellable->cancelled())
+                return EdgeList{};
+
+            const auto blockLast = std::min(blockFirst + TileSize, numRows);
+
+            for(size_t i = 0; i < rowTile._size; i++)
+            {
+                const auto rowAIndex = rowTile._first + i;
+                const auto* rowABits = &bits[rowAIndex * rowStride];
+                auto& edges = rowEdges[i];
+
+                for(auto rowBIndex = std::max(blockFirst, rowAIndex + 1); rowBIndex < blockLast; rowBIndex++)
+                {
+                    const auto* rowBBits = &bits[rowBIndex * rowStride];
+
+                    int numPresent = 0;
+                    int numMatches = 0;
+
+                    for(size_t word = 0; word < numWords; word++)
+                        numPresent += std::popcount(rowABits[word] | rowBBits[word]);
+
+                    if(compareTokens)
+                    {
+                        for(size_t word = numWords; word < rowStride; word++)
+                            numMatches += std::popcount(rowABits[word] & rowBBits[word]);
+                    }
+                    else
+                    {
+                        for(size_t word = 0; word < numWords; word++)
+                            numMatches += std::popcount(rowABits[word] & rowBBits[word]);
+                    }
+
+                    // Columns where neither row has a token contribute denominator each
+                    const int numAbsent = static_cast<int>(numColumns) - numPresent;
+                    double r = static_cast<double>(numMatches) / (numPresent + (denominator * numAbsent));
+
+                    if(std::isfinite(r) && r >= minimumThreshold)
+                        edges.push_back({rows[rowAIndex].nodeId(), rows[rowBIndex].nodeId(), r});
+                }
+            }
+
+            auto done = ++tilesDone;
+
+            if(progressable != nullptr)
+                progressable->setProgress(static_cast<int>((done * 100) / totalTiles));
+        }
+
+        EdgeList edges;
+
+        size_t numEdges = 0;
+        for(const auto& rowEdgeList : rowEdges)
+            numEdges += rowEdgeList.size();
+
+        edges.reserve(numEdges);
+        for(auto& rowEdgeList : rowEdges)
+            edges.insert(edges.end(), rowEdgeList.begin(), rowEdgeList.end());
+
+        return edges;
+    });
+
+    if(progressable != nullptr)
+    {
+        // Returning the results might take time
+        progressable->setProgress(-1);
+    }
+
+    EdgeList edges;
+    edges.reserve(std::distance(results.begin(), results.end()));
+    edges.insert(edges.end(), std::make_move_iterator(results.begin()),
+        std::make_move_iterator(results.end()));
+
+    return edges;
+}
+
+EdgeList ContinuousCorrelation::innerProductCorrelation(const std::vector<NodeId>& nodeIds, size_t numColumns,
+    const std::function<void(size_t, double*)>& normaliseRow,
+    double minimumThreshold, CorrelationPolarity polarity,
+    Cancellable* cancellable, Progressable* progressable)
+{
+    using Matrix = blaze::DynamicMatrix<double, blaze::rowMajor>;
+
+    const auto numRows = nodeIds.size();
+
+    // Padding is zeroed, so it has no effect on the products
+    Matrix normalisedRows(numRows, numColumns, 0.0);
+
+    std::vector<size_t> rowIndices(numRows);
+    std::iota(rowIndices.begin(), rowIndices.end(), 0);
+
+    ThreadPool threadPool(QStringLiteral("Correlation"));
+
+    threadPool.parallel_for(rowIndices.begin(), rowIndices.end(),
+    [&](size_t rowIndex)
+    {
+        normaliseRow(rowIndex, normalisedRows.data(rowIndex));
+    });
+
+    // Tiles are sized so that the pair of blocks of rows being multiplied fit in cache
+    const size_t TileElements = 32768;
+    const auto tileSize = std::clamp<size_t>(TileElements / std::max<size_t>(numColumns, 1), 16, 256);
+
+    struct RowTile
+    {
+        size_t _first;
+        size_t _size;
+        uint64_t _cost;
+
+        uint64_t computeCostHint() const { return _cost; }
+    };
+
+    std::vector<RowTile> rowTiles;
+    for(size_t first = 0; first < numRows; first += tileSize)
+    {
+        auto size = std::min(tileSize, numRows - first);
+        rowTiles.push_back({first, size, static_cast<uint64_t>(size * (numRows - first))});
+    }
+
+    const auto totalTiles = static_cast<uint64_t>(rowTiles.size() * (rowTiles.size() + 1)) / 2;
+    std::atomic<uint64_t> tilesDone(0);
+
+    if(progressable != nullptr)
+        progressable->setProgress(0);
+
+    auto results = threadPool.parallel_for(rowTiles.begin(), rowTiles.end(),
+    [&](const RowTile& rowTile)
+    {
+        // Edges are gathered per row, so that they end up in the same order as if
+        // each row had been correlated with every subsequent row in turn
+        std::vector<EdgeList> rowEdges(rowTile._size);
+        Matrix tile;
+
+        const auto a = blaze::submatrix(normalisedRows, rowTile._first, 0, rowTile._size, numColumns);
+
+        for(size_t columnFirst = rowTile._first; columnFirst < numRows; columnFirst += tileSize)
+        {
+            if(cancellable != nullptr && cancellable->cancelled())
+                return EdgeList{};
+
+            const auto columnSize = std::min(tileSize, numRows - columnFirst);
+            const auto b = blaze::submatrix(normalisedRows, columnFirst, 0, columnSize, numColumns);
+
+            tile = blaze::serial(a * blaze::trans(b));
+
+            for(size_t i = 0; i < rowTile._size; i++)
+            {
+                const auto rowIndex = rowTile._first + i;
+                auto& edges = rowEdges[i];
+
+                // Each pair only once, and no self correlation
+                const auto j0 = columnFirst > rowIndex ? 0 : (rowIndex - columnFirst) + 1;
+
+                for(size_t j = j0; j < columnSize; j++)
+                {
+                    const double r = tile(i, j);
+
+                    if(!std::isfinite(r))
+                        continue;
+
+                    if(exceedsThreshold(r, minimumThreshold, polarity))
+                        edges.push_back({nodeIds[rowIndex], nodeIds[columnFirst + j], r});
+                }
+            }
+
+            auto done = ++tilesDone;
+
+            if(progressable != nullptr)
+                progressable->setProgress(static_cast<int>((done * 100) / totalTiles));
+        }
+
+        EdgeList edges;
+
+        size_t numEdges = 0;
+        for(const auto& rowEdgeList : rowEdges)
+            numEdges += rowEdgeList.size();
+
+        edges.reserve(numEdges);
+        for(auto& rowEdgeList : rowEdges)
+            edges.insert(edges.end(), rowEdgeList.begin(), rowEdgeList.end());
+
+        return edges;
+    });
+
+    if(progressable != nullptr)
+    {
+        // Returning the results might take time
+        progressable->setProgress(-1);
+    }
+
+    EdgeList edges;
+    edges.reserve(std::distance(results.begin(), results.end()));
+    edges.insert(edges.end(), std::make_move_iterator(results.begin()),
+        std::make_move_iterator(results.end()));
+
+    return edges;
+}
+
+void PearsonAlgorithm::normalise(size_t numColumns, const ContinuousDataRow* row, double* normalisedRow) const
+{
+    // Scale the deviations from the mean to unit length; when there is no deviation,
+    // the correlation is undefined, so use NaN to ensure nothing is correlated with it
+    const double length = std::sqrt(static_cast<double>(numColumns) * row->variance());
+    const double scale = length > 0.0 ? 1.0 / length : std::numeric_limits<double>::quiet_NaN();
+
+    for(size_t i = 0; auto value : *row)
+        normalisedRow[i++] = (value - row->mean()) * scale;
 }
 
 double EuclideanSimilarityAlgorithm::evaluate(size_t numColumns, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB)
@@ -70,12 +362,13 @@ double EuclideanSimilarityAlgorithm::evaluate(size_t numColumns, const Continuou
     return 1.0 / (1.0 + sqrtSum);
 }
 
-double CosineSimilarityAlgorithm::evaluate(size_t, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB)
+void CosineSimilarityAlgorithm::normalise(size_t, const ContinuousDataRow* row, double* normalisedRow) const
 {
-    double productSum = std::inner_product(rowA->begin(), rowA->end(), rowB->begin(), 0.0);
-    double magnitudeProduct = rowA->magnitude() * rowB->magnitude();
+    // A zero row stays zero, giving a similarity of 0 with everything
+    const double scale = row->magnitude() > 0.0 ? 1.0 / row->magnitude() : 0.0;
 
-    return magnitudeProduct > 0.0 ? productSum / magnitudeProduct : 0.0;
+    for(size_t i = 0; auto value : *row)
+        normalisedRow[i++] = value * scale;
 }
 
 void BicorAlgorithm::preprocess(size_t numColumns, const ContinuousDataRows& rows)
@@ -114,15 +407,11 @@ void BicorAlgorithm::preprocess(size_t numColumns, const ContinuousDataRows& row
     }
 }
 
-double BicorAlgorithm::evaluate(size_t, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB)
+void BicorAlgorithm::normalise(size_t, const ContinuousDataRow* row, double* normalisedRow) const
 {
-    auto a = std::distance(_base, rowA);
-    auto b = std::distance(_base, rowB);
-    const auto& processedRowA = _processedRows.at(a);
-    const auto& processedRowB = _processedRows.at(b);
-
-    double productSum = std::inner_product(processedRowA.begin(), processedRowA.end(),
-        processedRowB.begin(), 0.0);
+    const auto& processedRow = _processedRows.at(std::distance(_base, row));
+    const double scale = 1.0 / processedRow.magnitude();
 
-    return productSum / (processedRowA.magnitude() * processedRowB.magnitude());
+    for(size_t i = 0; auto value : processedRow)
+        normalisedRow[i++] = value * scale;
 }
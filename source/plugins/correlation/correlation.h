@@ -32,6 +32,7 @@
 
 #include <vector>
 #include <cmath>
+#include <functional>
 
 #include <QObject>
 #include <QString>
@@ -49,6 +50,28 @@ public:
 
 class ContinuousCorrelation : public ICorrelation
 {
+protected:
+    static bool exceedsThreshold(double r, double minimumThreshold, CorrelationPolarity polarity)
+    {
+        switch(polarity)
+        {
+        default:
+        case CorrelationPolarity::Positive: return r >= minimumThreshold;
+        case CorrelationPolarity::Negative: return r <= -minimumThreshold;
+        case CorrelationPolarity::Both:     return std::abs(r) >= minimumThreshold;
+        }
+    }
+
+    // Correlates each pair of rows, where the rows have been normalised such that the
+    // correlation of a pair is the inner product of its rows; normaliseRow is called
+    // to write each row's numColumns normalised values. The products are computed as
+    // a blocked matrix multiplication, applying the threshold to each tile as it is
+    // computed, so the full correlation matrix is never stored.
+    static EdgeList innerProductCorrelation(const std::vector<NodeId>& nodeIds, size_t numColumns,
+        const std::function<void(size_t, double*)>& normaliseRow,
+        double minimumThreshold, CorrelationPolarity polarity,
+        Cancellable* cancellable, Progressable* progressable);
+
 public:
     virtual EdgeList process(const ContinuousDataRows& rows, double minimumThreshold,
         CorrelationPolarity polarity = CorrelationPolarity::Positive,
@@ -69,36 +92,13 @@ class CovarianceCorrelation : public ContinuousCorrelation
     template<typename A>
     using preprocess_t = decltype(std::declval<A>().preprocess(0, ContinuousDataRows{}));
 
-public:
-    EdgeList process(const ContinuousDataRows& rows,
-        double minimumThreshold, CorrelationPolarity polarity = CorrelationPolarity::Positive,
-        Cancellable* cancellable = nullptr, Progressable* progressable = nullptr) const final
-    {
-        if(rows.empty())
-            return {};
-
-        size_t numColumns = rows.front().numColumns();
-
-        if(progressable != nullptr)
-            progressable->setProgress(-1);
-
-        uint64_t totalCost = 0;
-        for(const auto& row : rows)
-        {
-            totalCost += row.computeCostHint();
-
-            if constexpr(rowType == RowType::Ranking)
-                row.generateRanking();
-        }
-
-        Algorithm algorithm;
-
-        constexpr bool AlgorithmHasPreprocess =
-            std::experimental::is_detected_v<preprocess_t, Algorithm>;
-
-        if constexpr(AlgorithmHasPreprocess)
-            algorithm.preprocess(numColumns, rows);
+    template<typename A>
+    using normalise_t = decltype(std::declval<A>().normalise(0, nullptr, nullptr));
 
+    EdgeList evaluatePairs(const ContinuousDataRows& rows, Algorithm& algorithm,
+        size_t numColumns, uint64_t totalCost, double minimumThreshold, CorrelationPolarity polarity,
+        Cancellable* cancellable, Progressable* progressable) const
+    {
         std::atomic<uint64_t> cost(0);
 
         auto results = ThreadPool(QStringLiteral("Correlation")).parallel_for(rows.begin(), rows.end(),
@@ -126,17 +126,7 @@ public:
                 if(!std::isfinite(r))
                     continue;
 
-                bool createEdge = false;
-
-                switch(polarity)
-                {
-                default:
-                case CorrelationPolarity::Positive: createEdge = (r >= minimumThreshold); break;
-                case CorrelationPolarity::Negative: createEdge = (r <= -minimumThreshold); break;
-                case CorrelationPolarity::Both:     createEdge = (std::abs(r) >= minimumThreshold); break;
-                }
-
-                if(createEdge)
+                if(exceedsThreshold(r, minimumThreshold, polarity))
                     edges.push_back({rowA->nodeId(), rowB->nodeId(), r});
             }
 
@@ -161,11 +151,72 @@ public:
 
         return edges;
     }
+
+public:
+    EdgeList process(const ContinuousDataRows& rows,
+        double minimumThreshold, CorrelationPolarity polarity = CorrelationPolarity::Positive,
+        Cancellable* cancellable = nullptr, Progressable* progressable = nullptr) const final
+    {
+        if(rows.empty())
+            return {};
+
+        size_t numColumns = rows.front().numColumns();
+
+        if(progressable != nullptr)
+            progressable->setProgress(-1);
+
+        uint64_t totalCost = 0;
+        for(const auto& row : rows)
+        {
+            totalCost += row.computeCostHint();
+
+            if constexpr(rowType == RowType::Ranking)
+                row.generateRanking();
+        }
+
+        Algorithm algorithm;
+
+        constexpr bool AlgorithmHasPreprocess =
+            std::experimental::is_detected_v<preprocess_t, Algorithm>;
+
+        if constexpr(AlgorithmHasPreprocess)
+            algorithm.preprocess(numColumns, rows);
+
+        constexpr bool AlgorithmHasNormalise =
+            std::experimental::is_detected_v<normalise_t, Algorithm>;
+
+        if constexpr(AlgorithmHasNormalise)
+        {
+            std::vector<NodeId> nodeIds;
+            nodeIds.reserve(rows.size());
+            for(const auto& row : rows)
+                nodeIds.emplace_back(row.nodeId());
+
+            return innerProductCorrelation(nodeIds, numColumns,
+            [&](size_t index, double* normalisedRow)
+            {
+                const auto* row = &rows.at(index);
+
+                if constexpr(rowType == RowType::Ranking)
+                    row = row->ranking();
+
+                algorithm.normalise(numColumns, row, normalisedRow);
+            }, minimumThreshold, polarity, cancellable, progressable);
+        }
+        else
+        {
+            return evaluatePairs(rows, algorithm, numColumns, totalCost,
+                minimumThreshold, polarity, cancellable, progressable);
+        }
+    }
 };
 
+// Algorithms either evaluate each pair of rows directly, or normalise each row such
+// that the correlation of a pair is then the inner product of their normalised rows
+
 struct PearsonAlgorithm
 {
-    double evaluate(size_t numColumns, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB);
+    void normalise(size_t numColumns, const ContinuousDataRow* row, double* normalisedRow) const;
 };
 
 class PearsonCorrelation : public CovarianceCorrelation<PearsonAlgorithm>
@@ -235,7 +286,7 @@ public:
 
 struct CosineSimilarityAlgorithm
 {
-    double evaluate(size_t, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB);
+    void normalise(size_t numColumns, const ContinuousDataRow* row, double* normalisedRow) const;
 };
 
 class CosineSimilarityCorrelation : public CovarianceCorrelation<CosineSimilarityAlgorithm>
@@ -265,7 +316,7 @@ struct BicorAlgorithm
     ContinuousDataRows _processedRows;
 
     void preprocess(size_t numColumns, const ContinuousDataRows& rows);
-    double evaluate(size_t, const ContinuousDataRow* rowA, const ContinuousDataRow* rowB);
+    void normalise(size_t numColumns, const ContinuousDataRow* row, double* normalisedRow) const;
 };
 
 class BicorCorrelation : public CovarianceCorrelation<BicorAlgorithm>
@@ -289,6 +340,20 @@ public:
 
 class DiscreteCorrelation : public ICorrelation
 {
+protected:
+    // Beyond this many distinct non-zero tokens, comparing token values
+    // directly is cheaper than comparing a bitset per token
+    static const size_t MaxBitsetTokens = 8;
+
+    static size_t numNonZeroTokens(const TokenisedDataRows& rows);
+
+    // Gives the same result as MatchingCorrelation's comparison of individual tokens,
+    // but encodes the presence of each token in a row as a bitset, so that row pairs
+    // are compared 64 columns at a time, using bitwise operations and popcount
+    static EdgeList bitsetCorrelation(const TokenisedDataRows& rows, size_t numTokens,
+        bool treatAsBinary, int denominator, double minimumThreshold,
+        Cancellable* cancellable, Progressable* progressable);
+
 public:
     virtual EdgeList process(const DiscreteDataRows& rows, double minimumThreshold, bool treatAsBinary,
         Cancellable* cancellable = nullptr, Progressable* progressable = nullptr) const = 0;
@@ -313,6 +378,15 @@ public:
 
         const auto tokenisedRows = tokeniseDataRows(rows);
 
+        // When treated as binary, only the presence of any token is significant
+        const auto numTokens = treatAsBinary ? 1 : numNonZeroTokens(tokenisedRows);
+
+        if(numTokens <= MaxBitsetTokens)
+        {
+            return bitsetCorrelation(tokenisedRows, numTokens, treatAsBinary,
+                Denominator, minimumThreshold, cancellable, progressable);
+        }
+
         uint64_t totalCost = 0;
         for(const auto& row : rows)
             totalCost += row.computeCostHint();
@@ -103,8 +103,6 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
             uint64_t dataPoint = columnIndex + rowOffset;
             parser.setProgress(static_cast<int>((dataPoint * 100) / numDataPoints));
 
-            const auto& value = tabularData.valueAt(columnIndex, rowIndex);
-
             //FIXME: If there are continuous and discrete columns, dataColumnIndex will need to change
             size_t dataColumnIndex = columnIndex - dataRect.x();
             size_t dataRowIndex = rowIndex - dataRect.y();
@@ -113,6 +111,11 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
             bool isColumnAnnotation = rowIndex < top;
             bool isRowAttribute = columnIndex < left;
 
+            // Continuous data values are read numerically, so avoid formatting them as text
+            bool isContinuousValue = rowIndex > 0 && !isColumnAnnotation && isColumnInDataRect &&
+                _correlationDataType != CorrelationDataType::Discrete;
+            const auto& value = !isContinuousValue ? tabularData.valueAt(columnIndex, rowIndex) : QString();
+
             if((isColumnInDataRect && dataColumnIndex >= numColumns) ||
                 (isRowInDataRect && dataRowIndex >= _numRows))
             {
@@ -147,10 +150,10 @@ bool CorrelationPluginInstance::loadUserData(const TabularData& tabularData,
                 {
                     double transformedValue = 0.0;
 
-                    if(!value.isEmpty())
+                    if(!tabularData.isEmptyAt(columnIndex, rowIndex))
                     {
                         bool success = false;
-                        transformedValue = value.toDouble(&success);
+                        transformedValue = tabularData.doubleAt(columnIndex, rowIndex, &success);
                         Q_ASSERT(success);
                     }
                     else
@@ -417,20 +420,27 @@ EdgeList CorrelationPluginInstance::correlation(double minimumThreshold, IParser
 
 bool CorrelationPluginInstance::createEdges(const EdgeList& edges, IParser& parser)
 {
+    if(parser.cancelled())
+        return false;
+
     parser.setProgress(-1);
-    for(auto edgeIt = edges.begin(); edgeIt != edges.end(); ++edgeIt)
-    {
-        if(parser.cancelled())
-            return false;
 
-        parser.setProgress(static_cast<int>(std::distance(edges.begin(), edgeIt)) * 100 /
-            static_cast<int>(edges.size()));
+    std::vector<NodeId> sourceIds;
+    std::vector<NodeId> targetIds;
+    sourceIds.reserve(edges.size());
+    targetIds.reserve(edges.size());
 
-        const auto& edge = *edgeIt;
-        auto edgeId = graphModel()->mutableGraph().addEdge(edge._source, edge._target);
-        _correlationValues->set(edgeId, edge._weight);
+    for(const auto& edge : edges)
+    {
+        sourceIds.push_back(edge._source);
+        targetIds.push_back(edge._target);
     }
 
+    auto edgeIds = graphModel()->mutableGraph().addEdgesBulk(sourceIds, targetIds);
+
+    for(size_t i = 0; i < edgeIds.size(); i++)
+        _correlationValues->set(edgeIds.at(i), edges.at(i)._weight);
+
     return true;
 }
 
@@ -542,7 +552,7 @@ void CorrelationPluginInstance::buildColumnAnnotations()
     for(const auto& name : _userColumnData)
     {
         const auto* values = _userColumnData.vector(name);
-        _columnAnnotations.emplace_back(name, values->begin(), values->end());
+        _columnAnnotations.emplace_back(name, values->toStrings());
     }
 
     emit columnAnnotationNamesChanged();
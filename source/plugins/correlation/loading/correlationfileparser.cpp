@@ -152,10 +152,10 @@ static bool dataRectHasDiscreteValues(const TabularData& tabularData, const QRec
     {
         for(auto row = dataRect.top(); row <= dataRect.bottom(); row++)
         {
-            const auto& value = tabularData.valueAt(
-                static_cast<size_t>(column), static_cast<size_t>(row));
+            auto columnIndex = static_cast<size_t>(column);
+            auto rowIndex = static_cast<size_t>(row);
 
-            if(!value.isEmpty() && !u::isNumeric(value))
+            if(!tabularData.isEmptyAt(columnIndex, rowIndex) && !tabularData.isNumericAt(columnIndex, rowIndex))
                 return true;
         }
     }
@@ -169,10 +169,7 @@ static bool dataRectHasMissingValues(const TabularData& tabularData, const QRect
     {
         for(auto row = dataRect.top(); row <= dataRect.bottom(); row++)
         {
-            const auto& value = tabularData.valueAt(
-                static_cast<size_t>(column), static_cast<size_t>(row));
-
-            if(value.isEmpty())
+            if(tabularData.isEmptyAt(static_cast<size_t>(column), static_cast<size_t>(row)))
                 return true;
         }
     }
@@ -244,10 +241,9 @@ double CorrelationFileParser::imputeValue(MissingDataType missingDataType,
         size_t rowCount = 0;
         for(size_t avgRowIndex = left; avgRowIndex < right; avgRowIndex++)
         {
-            const auto& value = tabularData.valueAt(columnIndex, avgRowIndex);
-            if(!value.isEmpty())
+            if(!tabularData.isEmptyAt(columnIndex, avgRowIndex))
             {
-                averageValue += value.toDouble();
+                averageValue += tabularData.doubleAt(columnIndex, avgRowIndex);
                 rowCount++;
             }
         }
@@ -270,10 +266,9 @@ double CorrelationFileParser::imputeValue(MissingDataType missingDataType,
         // Find right value
         for(size_t rightColumn = columnIndex; rightColumn < right; rightColumn++)
         {
-            const auto& value = tabularData.valueAt(rightColumn, rowIndex);
-            if(!value.isEmpty())
+            if(!tabularData.isEmptyAt(rightColumn, rowIndex))
             {
-                rightValue = value.toDouble();
+                rightValue = tabularData.doubleAt(rightColumn, rowIndex);
                 rightValueFound = true;
                 rightDistance = (rightColumn > columnIndex) ? rightColumn - columnIndex : columnIndex - rightColumn;
                 break;
@@ -282,10 +277,9 @@ double CorrelationFileParser::imputeValue(MissingDataType missingDataType,
         // Find left value
         for(size_t leftColumn = columnIndex; leftColumn-- != left;)
         {
-            const auto& value = tabularData.valueAt(leftColumn, rowIndex);
-            if(!value.isEmpty())
+            if(!tabularData.isEmptyAt(leftColumn, rowIndex))
             {
-                leftValue = value.toDouble();
+                leftValue = tabularData.doubleAt(leftColumn, rowIndex);
                 leftValueFound = true;
                 leftDistance = (leftColumn > columnIndex) ? leftColumn - columnIndex : columnIndex - leftColumn;
                 break;
@@ -24,6 +24,8 @@
 
 #include "shared/graph/igraph.h"
 
+#include <vector>
+
 class IMutableGraph : public virtual IGraph
 {
 public:
@@ -49,6 +51,11 @@ public:
         endTransaction();
     }
 
+    // Adding elements in bulk is much quicker than adding them individually; storage
+    // is sized once, and a single change notification is made for all of them
+    virtual std::vector<NodeId> addNodesBulk(size_t numNodes) = 0;
+    virtual void addNodesBulk(const std::vector<NodeId>& nodeIds) = 0;
+
     virtual void removeNode(NodeId nodeId) = 0;
     template<typename C> void removeNodes(const C& nodeIds)
     {
@@ -81,6 +88,12 @@ public:
         endTransaction();
     }
 
+    // The source and target of the edge at index i are sourceIds[i] and targetIds[i]
+    virtual std::vector<EdgeId> addEdgesBulk(const std::vector<NodeId>& sourceIds,
+        const std::vector<NodeId>& targetIds) = 0;
+    virtual void addEdgesBulk(const std::vector<EdgeId>& edgeIds,
+        const std::vector<NodeId>& sourceIds, const std::vector<NodeId>& targetIds) = 0;
+
     virtual void removeEdge(EdgeId edgeId) = 0;
     template<typename C> void removeEdges(const C& edgeIds)
     {
@@ -50,9 +50,8 @@ void addEdge(IGraphModel* graphModel, IUserEdgeData* userEdgeData,
 
     if(setWeights)
     {
-        userEdgeData->setValueBy(edgeId, QObject::tr("Edge Weight"), QString::number(edgeWeight));
-        userEdgeData->setValueBy(edgeId, QObject::tr("Absolute Edge Weight"),
-            QString::number(absEdgeWeight));
+        userEdgeData->setFloatValueBy(edgeId, QObject::tr("Edge Weight"), edgeWeight);
+        userEdgeData->setFloatValueBy(edgeId, QObject::tr("Absolute Edge Weight"), absEdgeWeight);
     }
 }
 
@@ -75,8 +74,7 @@ bool parseAdjacencyMatrix(const TabularData& tabularData,
     // Check first column for row headers
     for(size_t rowIndex = 0; rowIndex < tabularData.numRows(); rowIndex++)
     {
-        const auto& value = tabularData.valueAt(0, rowIndex);
-        if(rowIndex > 0 && !value.isEmpty() && !u::isNumeric(value))
+        if(rowIndex > 0 && !tabularData.isEmptyAt(0, rowIndex) && !tabularData.isNumericAt(0, rowIndex))
         {
             hasRowHeaders = true;
             break;
@@ -86,8 +84,7 @@ bool parseAdjacencyMatrix(const TabularData& tabularData,
     // Check first row for column headers
     for(size_t columnIndex = 0; columnIndex < tabularData.numColumns(); columnIndex++)
     {
-        const auto& value = tabularData.valueAt(columnIndex, 0);
-        if(columnIndex > 0 && !value.isEmpty() && !u::isNumeric(value))
+        if(columnIndex > 0 && !tabularData.isEmptyAt(columnIndex, 0) && !tabularData.isNumericAt(columnIndex, 0))
         {
             hasColumnHeaders = true;
             break;
@@ -119,10 +116,10 @@ bool parseAdjacencyMatrix(const TabularData& tabularData,
         {
             QString columnHeader = hasColumnHeaders ? tabularData.valueAt(columnIndex, 0) : QString();
 
-            const auto& value = tabularData.valueAt(columnIndex, rowIndex);
-            double edgeWeight = u::toNumber(value);
+            bool isNumeric = false;
+            double edgeWeight = tabularData.doubleAt(columnIndex, rowIndex, &isNumeric);
 
-            if(std::isnan(edgeWeight) || !std::isfinite(edgeWeight))
+            if(!isNumeric || std::isnan(edgeWeight) || !std::isfinite(edgeWeight))
                 edgeWeight = 0.0;
 
             auto absEdgeWeight = std::abs(edgeWeight);
@@ -173,8 +170,9 @@ bool parseEdgeList(const TabularData& tabularData,
         const auto& firstCell = tabularData.valueAt(0, rowIndex);
         const auto& secondCell = tabularData.valueAt(1, rowIndex);
 
-        auto edgeWeight = u::toNumber(tabularData.valueAt(2, rowIndex));
-        if(std::isnan(edgeWeight) || !std::isfinite(edgeWeight))
+        bool isNumeric = false;
+        auto edgeWeight = tabularData.doubleAt(2, rowIndex, &isNumeric);
+        if(!isNumeric || std::isnan(edgeWeight) || !std::isfinite(edgeWeight))
             edgeWeight = 0.0;
 
         auto absEdgeWeight = std::abs(edgeWeight);
@@ -236,7 +234,7 @@ QmlTabularDataParser::MatrixTypeResult AdjacencyMatrixTabularDataParser::onParse
         {
             NodeId source = data.valueAt(0, rowIndex).toInt();
             NodeId target = data.valueAt(1, rowIndex).toInt();
-            double weight = data.valueAt(2, rowIndex).toDouble();
+            double weight = data.doubleAt(2, rowIndex);
             EdgeListEdge edge{source, target, weight};
 
             edgeList.emplace_back(edge);
@@ -250,7 +248,7 @@ QmlTabularDataParser::MatrixTypeResult AdjacencyMatrixTabularDataParser::onParse
         {
             for(auto columnIndex = static_cast<size_t>(topLeft.x()); columnIndex < data.numColumns(); columnIndex++)
             {
-                double weight = data.valueAt(columnIndex, rowIndex).toDouble();
+                double weight = data.doubleAt(columnIndex, rowIndex);
 
                 if(weight == 0.0)
                     continue;
@@ -335,7 +333,7 @@ QmlTabularDataParser::MatrixTypeResult AdjacencyMatrixTabularDataParser::isAdjac
                 // Check non header elements are doubles
                 // This will prevent loading obviously non-matrix files
                 // We could handle non-double matrix symbols in future (X, -, I, O etc)
-                if(!u::isNumeric(value) && !value.isEmpty())
+                if(!tabularData.isNumericAt(columnIndex, rowIndex) && !tabularData.isEmptyAt(columnIndex, rowIndex))
                     return {false, tr("Matrix has non-numeric values.")};
             }
         }
@@ -375,7 +373,7 @@ QmlTabularDataParser::MatrixTypeResult AdjacencyMatrixTabularDataParser::isEdgeL
         if(!u::isInteger(tabularData.valueAt(1, rowIndex)))
             return {false, tr("2nd edge list column has a non-integral value.")};
 
-        if(!u::isNumeric(tabularData.valueAt(2, rowIndex)))
+        if(!tabularData.isNumericAt(2, rowIndex))
             return {false, tr("3rd edge list column has a non-numeric value.")};
     }
 
@@ -40,6 +40,7 @@ public:
 
     virtual QVariant value(size_t index, const QString& name) const = 0;
     virtual bool setValue(size_t index, const QString& name, const QString& value) = 0;
+    virtual bool setFloatValue(size_t index, const QString& name, double value) = 0;
 };
 
 #endif // IUSERDATA_H
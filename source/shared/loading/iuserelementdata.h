@@ -42,6 +42,7 @@ public:
 
     virtual QVariant valueBy(E elementId, const QString& name) const = 0;
     virtual bool setValueBy(E elementId, const QString& name, const QString& value) = 0;
+    virtual bool setFloatValueBy(E elementId, const QString& name, double value) = 0;
 };
 
 using IUserNodeData = IUserElementData<NodeId>;
@@ -67,6 +67,11 @@ bool PairwiseTxtFileParser::parse(const QUrl& url, IGraphModel* graphModel)
 
     std::unordered_map<std::string, NodeId> nodeIdMap;
 
+    // The edges are added in one go once the whole file has been read
+    std::vector<NodeId> sourceIds;
+    std::vector<NodeId> targetIds;
+    std::vector<std::pair<size_t, double>> edgeWeights;
+
     std::string line;
     std::string token;
     std::vector<std::string> tokens;
@@ -231,7 +236,8 @@ bool PairwiseTxtFileParser::parse(const QUrl& url, IGraphModel* graphModel)
             else
                 secondNodeId = nodeIdMap[secondToken];
 
-            auto edgeId = graphModel->mutableGraph().addEdge(firstNodeId, secondNodeId);
+            sourceIds.push_back(firstNodeId);
+            targetIds.push_back(secondNodeId);
 
             if(tokens.size() >= 3)
             {
@@ -245,7 +251,7 @@ bool PairwiseTxtFileParser::parse(const QUrl& url, IGraphModel* graphModel)
                     if(std::isnan(edgeWeight) || !std::isfinite(edgeWeight))
                         edgeWeight = 1.0;
 
-                    _userEdgeData->setValueBy(edgeId, QObject::tr("Edge Weight"), QString::number(edgeWeight));
+                    edgeWeights.emplace_back(sourceIds.size() - 1, edgeWeight);
                 }
             }
         }
@@ -255,5 +261,12 @@ bool PairwiseTxtFileParser::parse(const QUrl& url, IGraphModel* graphModel)
             setProgress(static_cast<int>(filePosition * 100 / fileSize));
     }
 
+    setProgress(-1);
+
+    auto edgeIds = graphModel->mutableGraph().addEdgesBulk(sourceIds, targetIds);
+
+    for(const auto& [index, edgeWeight] : edgeWeights)
+        _userEdgeData->setFloatValueBy(edgeIds.at(index), QObject::tr("Edge Weight"), edgeWeight);
+
     return true;
 }
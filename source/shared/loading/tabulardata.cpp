@@ -19,14 +19,461 @@
 #include "tabulardata.h"
 
 #include "shared/utils/progressable.h"
+#include "shared/utils/string.h"
+#include "shared/utils/threadpool.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QLocale>
 
 #include <set>
 #include <algorithm>
+#include <numeric>
+#include <limits>
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+const int64_t EmptyInteger = std::numeric_limits<int64_t>::min();
+const int8_t EmptyFloat = -2;
+const int8_t ShortestFloat = -1;
+const uint32_t EmptyString = 0;
+} // namespace
+
+bool TabularData::Column::setInteger(size_t row, const QString& value)
+{
+    if(value.isEmpty())
+    {
+        _integers[row] = EmptyInteger;
+        return true;
+    }
+
+    bool success = false;
+    auto integer = value.toLongLong(&success);
+
+    // Only store values that will be reproduced exactly
+    if(!success || integer == EmptyInteger || QString::number(integer) != value)
+        return false;
+
+    _integers[row] = integer;
+    return true;
+}
+
+bool TabularData::Column::setFloat(size_t row, const QString& value)
+{
+    if(value.isEmpty())
+    {
+        _floats[row] = 0.0;
+        _floatDecimals[row] = EmptyFloat;
+        return true;
+    }
+
+    bool success = false;
+    auto number = value.toDouble(&success);
+
+    if(!success)
+        return false;
+
+    // Only store values that will be reproduced exactly, either as written
+    // to a fixed number of decimal places, or as the shortest representation
+    if(!value.contains('e', Qt::CaseInsensitive))
+    {
+        auto point = value.indexOf('.');
+        auto decimals = point >= 0 ? value.size() - (point + 1) : 0;
+
+        if(decimals <= std::numeric_limits<int8_t>::max() &&
+            QString::number(number, 'f', decimals) == value)
+        {
+            _floats[row] = number;
+            _floatDecimals[row] = static_cast<int8_t>(decimals);
+            return true;
+        }
+    }
+
+    if(QString::number(number, 'g', QLocale::FloatingPointShortest) == value)
+    {
+        _floats[row] = number;
+        _floatDecimals[row] = ShortestFloat;
+        return true;
+    }
+
+    return false;
+}
+
+uint32_t TabularData::Column::codeFor(const QString& value)
+{
+    // The index is discarded by shrinkToFit, so regenerate it if necessary
+    if(_codeForString.empty())
+    {
+        for(uint32_t code = 0; code < static_cast<uint32_t>(_dictionary.size()); code++)
+            _codeForString.emplace(_dictionary.at(code), code);
+    }
+
+    auto [it, inserted] = _codeForString.emplace(value, static_cast<uint32_t>(_dictionary.size()));
+
+    if(inserted)
+        _dictionary.emplace_back(value);
+
+    return it->second;
+}
+
+void TabularData::Column::setString(size_t row, const QString& value)
+{
+    _codes[row] = !value.isEmpty() ? codeFor(value) : EmptyString;
+}
+
+void TabularData::Column::setVerbatim(size_t row, const QString& value)
+{
+    Q_ASSERT(_type == ColumnType::Integer || _type == ColumnType::Float);
+
+    if(_type == ColumnType::Integer)
+        _integers[row] = 0;
+    else
+    {
+        _floats[row] = 0.0;
+        _floatDecimals[row] = ShortestFloat;
+    }
+
+    _verbatim[row] = value;
+}
+
+bool TabularData::Column::tooManyVerbatim() const
+{
+    // When a significant proportion of the column has unusual formatting, give
+    // up on storing its values numerically, as it's no longer any saving
+    const size_t MinimumVerbatimForConversion = 64;
+    return _verbatim.size() > MinimumVerbatimForConversion && _verbatim.size() > _size / 8;
+}
+
+void TabularData::Column::resize(size_t size, size_t capacityHint)
+{
+    auto resizeVector = [size, capacityHint](auto& vector, auto emptyValue)
+    {
+        if(capacityHint > vector.capacity())
+            vector.reserve(capacityHint);
+
+        vector.resize(size, emptyValue);
+    };
+
+    switch(_type)
+    {
+    default:
+    case ColumnType::Empty:
+        break;
+
+    case ColumnType::Integer:
+        resizeVector(_integers, EmptyInteger);
+        break;
+
+    case ColumnType::Float:
+        resizeVector(_floats, 0.0);
+        resizeVector(_floatDecimals, EmptyFloat);
+        break;
+
+    case ColumnType::String:
+        resizeVector(_codes, EmptyString);
+        break;
+    }
+
+    _size = size;
+}
+
+void TabularData::Column::convertToFloat()
+{
+    Q_ASSERT(_type == ColumnType::Integer);
+
+    _floats.reserve(_integers.capacity());
+    _floatDecimals.reserve(_integers.capacity());
+    _floats.resize(_size, 0.0);
+    _floatDecimals.resize(_size, EmptyFloat);
+    _type = ColumnType::Float;
+
+    for(size_t row = 0; row < _size; row++)
+    {
+        auto integer = _integers.at(row);
+        if(integer == EmptyInteger)
+            continue;
+
+        auto number = static_cast<double>(integer);
+
+        if(static_cast<int64_t>(number) == integer)
+        {
+            _floats[row] = number;
+            _floatDecimals[row] = 0;
+        }
+        else
+            setVerbatim(row, QString::number(integer));
+    }
+
+    _integers = {};
+
+    if(tooManyVerbatim())
+        convertToString();
+}
+
+void TabularData::Column::convertToString()
+{
+    Q_ASSERT(_type != ColumnType::String);
+
+    std::vector<uint32_t> codes(_size, EmptyString);
+    _codes.swap(codes);
+    _dictionary = {QString()};
+    _codeForString = {{QString(), EmptyString}};
+
+    for(size_t row = 0; row < _size; row++)
+        setString(row, valueAt(row));
+
+    _type = ColumnType::String;
+
+    _integers = {};
+    _floats = {};
+    _floatDecimals = {};
+    _verbatim.clear();
+}
+
+bool TabularData::Column::isEmptyAt(size_t row) const
+{
+    if(row >= _size)
+        return true;
+
+    switch(_type)
+    {
+    default:
+    case ColumnType::Empty:     return true;
+    case ColumnType::Integer:   return _integers[row] == EmptyInteger;
+    case ColumnType::Float:     return _floatDecimals[row] == EmptyFloat;
+    case ColumnType::String:    return _codes[row] == EmptyString;
+    }
+}
+
+QString TabularData::Column::valueAt(size_t row) const
+{
+    if(isEmptyAt(row))
+        return {};
+
+    if(!_verbatim.empty())
+    {
+        auto it = _verbatim.find(row);
+        if(it != _verbatim.end())
+            return it->second;
+    }
+
+    switch(_type)
+    {
+    default:
+    case ColumnType::Empty:
+        return {};
+
+    case ColumnType::Integer:
+        return QString::number(_integers[row]);
+
+    case ColumnType::Float:
+    {
+        auto decimals = _floatDecimals[row];
+
+        return decimals == ShortestFloat ?
+            QString::number(_floats[row], 'g', QLocale::FloatingPointShortest) :
+            QString::number(_floats[row], 'f', decimals);
+    }
+
+    case ColumnType::String:
+        return _dictionary.at(_codes[row]);
+    }
+}
+
+bool TabularData::Column::numericAt(size_t row, double& value) const
+{
+    if(isEmptyAt(row))
+        return false;
+
+    bool success = false;
+
+    if(!_verbatim.empty())
+    {
+        auto it = _verbatim.find(row);
+        if(it != _verbatim.end())
+        {
+            value = it->second.toDouble(&success);
+            return success;
+        }
+    }
+
+    switch(_type)
+    {
+    default:
+    case ColumnType::Empty:
+        return false;
+
+    case ColumnType::Integer:
+        value = static_cast<double>(_integers[row]);
+        return true;
+
+    case ColumnType::Float:
+        value = _floats[row];
+        return true;
+
+    case ColumnType::String:
+        value = _dictionary.at(_codes[row]).toDouble(&success);
+        return success;
+    }
+}
+
+void TabularData::Column::setValueAt(size_t row, const QString& value, size_t capacityHint)
+{
+    if(row >= _size)
+        resize(row + 1, capacityHint);
+    else if(!_verbatim.empty())
+        _verbatim.erase(row);
+
+    // Columns start off as the most compact type, and are
+    // converted to more general ones as the need arises
+    if(_type == ColumnType::Empty)
+    {
+        if(value.isEmpty())
+            return;
+
+        _type = ColumnType::Integer;
+        resize(_size, capacityHint);
+    }
+
+    if(_type == ColumnType::Integer)
+    {
+        if(setInteger(row, value))
+            return;
+
+        if(u::isNumeric(value))
+            convertToFloat();
+        else
+        {
+            // Keep the odd non-numeric value, typically a header, to one side
+            // so that the remainder of the column can still be stored as numbers
+            setVerbatim(row, value);
+
+            if(tooManyVerbatim())
+                convertToString();
+
+            return;
+        }
+    }
+
+    if(_type == ColumnType::Float)
+    {
+        if(setFloat(row, value))
+            return;
+
+        setVerbatim(row, value);
+
+        if(tooManyVerbatim())
+            convertToString();
+
+        return;
+    }
+
+    if(_type == ColumnType::String)
+        setString(row, value);
+}
+
+void TabularData::Column::append(Column&& other, size_t offset, size_t capacityHint)
+{
+    Q_ASSERT(offset >= _size);
+
+    if(other._type == ColumnType::Empty)
+        return;
+
+    if(_type == ColumnType::Empty)
+    {
+        _type = other._type;
+
+        if(_type == ColumnType::String)
+        {
+            _dictionary = {QString()};
+            _codeForString = {{QString(), EmptyString}};
+        }
+    }
+
+    // Generalise this column if necessary, so that other's values can be moved in wholesale
+    if(_type != ColumnType::String && other._type == ColumnType::String)
+        convertToString();
+    else if(_type == ColumnType::Integer && other._type == ColumnType::Float)
+        convertToFloat();
+
+    if(_type != other._type)
+    {
+        // This column is more general than other, so its values need converting
+        for(size_t row = 0; row < other._size; row++)
+        {
+            if(!other.isEmptyAt(row))
+                setValueAt(offset + row, other.valueAt(row), capacityHint);
+        }
+
+        return;
+    }
+
+    resize(offset + other._size, capacityHint);
+
+    switch(_type)
+    {
+    default:
+    case ColumnType::Empty:
+        break;
+
+    case ColumnType::Integer:
+    case ColumnType::Float:
+        if(_type == ColumnType::Integer)
+            std::copy(other._integers.begin(), other._integers.end(), _integers.begin() + offset);
+        else
+        {
+            std::copy(other._floats.begin(), other._floats.end(), _floats.begin() + offset);
+            std::copy(other._floatDecimals.begin(), other._floatDecimals.end(), _floatDecimals.begin() + offset);
+        }
+
+        for(auto& [row, value] : other._verbatim)
+            _verbatim.emplace(offset + row, std::move(value));
+
+        if(tooManyVerbatim())
+            convertToString();
+
+        break;
+
+    case ColumnType::String:
+    {
+        std::vector<uint32_t> codes(other._dictionary.size(), EmptyString);
+        for(size_t code = 1; code < other._dictionary.size(); code++)
+            codes[code] = codeFor(other._dictionary.at(code));
+
+        std::transform(other._codes.begin(), other._codes.end(), _codes.begin() + offset,
+            [&codes](auto code) { return codes[code]; });
+        break;
+    }
+    }
+
+    other = {};
+}
+
+void TabularData::Column::truncate(size_t size)
+{
+    if(size >= _size)
+        return;
+
+    resize(size, 0);
+    _verbatim.erase(_verbatim.lower_bound(size), _verbatim.end());
+}
+
+void TabularData::Column::shrinkToFit()
+{
+    _integers.shrink_to_fit();
+    _floats.shrink_to_fit();
+    _floatDecimals.shrink_to_fit();
+    _codes.shrink_to_fit();
+    _dictionary.shrink_to_fit();
+    _codeForString.clear();
+}
 
 TabularData::TabularData(TabularData&& other) noexcept :
-    _data(std::move(other._data)),
-    _columns(other._columns),
+    _columns(std::move(other._columns)),
     _rows(other._rows),
+    _reservedRows(other._reservedRows),
     _transposed(other._transposed)
 
 {
@@ -37,9 +484,9 @@ TabularData& TabularData::operator=(TabularData&& other) noexcept
 {
     if(this != &other)
     {
-        _data = std::move(other._data);
-        _columns = other._columns;
+        _columns = std::move(other._columns);
         _rows = other._rows;
+        _reservedRows = other._reservedRows;
         _transposed = other._transposed;
 
         other.reset();
@@ -50,66 +497,49 @@ TabularData& TabularData::operator=(TabularData&& other) noexcept
 
 void TabularData::reserve(size_t columns, size_t rows)
 {
-    _data.reserve(columns * rows);
+    _columns.reserve(columns);
+    _reservedRows = std::max(_reservedRows, rows);
 }
 
 bool TabularData::empty() const
 {
-    return _data.empty();
+    return _columns.empty();
 }
 
-size_t TabularData::index(size_t column, size_t row) const
+const TabularData::Column* TabularData::columnAt(size_t column, size_t row, size_t& columnRow) const
 {
     Q_ASSERT(column < numColumns());
     Q_ASSERT(row < numRows());
 
-    auto index = !_transposed ?
-        column + (row * _columns) :
-        row + (column * _columns);
+    if(_transposed)
+        std::swap(column, row);
 
-    return index;
+    columnRow = row;
+    return &_columns.at(column);
 }
 
 size_t TabularData::numColumns() const
 {
-    return !_transposed ? _columns : _rows;
+    return !_transposed ? _columns.size() : _rows;
 }
 
 size_t TabularData::numRows() const
 {
-    return !_transposed ? _rows : _columns;
+    return !_transposed ? _rows : _columns.size();
 }
 
 void TabularData::setValueAt(size_t column, size_t row, QString&& value, int progressHint)
 {
-    size_t columns = column >= _columns ? column + 1 : _columns;
-    size_t rows = row >= _rows ? row + 1 : _rows;
-    auto newSize = columns * rows;
-
-    // If the column count is increasing, jiggle all the existing rows around,
-    // taking into account the new row width
-    if(_rows > 0 && rows > 1 && columns > _columns)
-    {
-        _data.resize(newSize);
-
-        for(size_t offset = _rows - 1; offset > 0; offset--)
-        {
-            auto oldPosition = _data.begin() + static_cast<std::ptrdiff_t>(offset * _columns);
-            auto newPosition = _data.begin() + static_cast<std::ptrdiff_t>(offset * columns);
+    if(_transposed)
+        std::swap(column, row);
 
-            std::move_backward(oldPosition,
-                oldPosition + static_cast<std::ptrdiff_t>(_columns),
-                newPosition + static_cast<std::ptrdiff_t>(_columns));
-        }
-    }
+    if(column >= _columns.size())
+        _columns.resize(column + 1);
 
-    _columns = columns;
-    _rows = rows;
+    _rows = std::max(_rows, row + 1);
 
-    if(newSize > _data.capacity())
+    if(_rows > _reservedRows)
     {
-        size_t reserveSize = newSize;
-
         if(progressHint >= 10)
         {
             // If we've made it some significant way through the input, we can be
@@ -119,55 +549,135 @@ void TabularData::setValueAt(size_t column, size_t row, QString&& value, int pro
             // is on the small side. Otherwise, when we hit 100, we would default to
             // reallocating for each new element -- exactly what we're trying to avoid
             const auto extraFudgeFactor = 2;
-            auto estimate = ((100 + extraFudgeFactor) * newSize) / progressHint;
+            auto estimate = ((100 + extraFudgeFactor) * _rows) / static_cast<size_t>(progressHint);
 
-            reserveSize = std::max(reserveSize, estimate);
+            _reservedRows = std::max(_rows, estimate);
         }
         else
         {
             // ...otherwise just double the reservation each time we need more space
-            reserveSize = newSize * 2;
+            _reservedRows = _rows * 2;
         }
+    }
 
-        _data.reserve(reserveSize);
+    _columns.at(column).setValueAt(row, value.trimmed(), _reservedRows);
+}
+
+void TabularData::append(std::vector<TabularData>&& parts, const std::vector<size_t>& partRows)
+{
+    Q_ASSERT(!_transposed);
+    Q_ASSERT(parts.size() == partRows.size());
+
+    std::vector<size_t> offsets;
+    offsets.reserve(parts.size());
+
+    size_t numColumns = _columns.size();
+    size_t offset = _rows;
+
+    for(size_t i = 0; i < parts.size(); i++)
+    {
+        Q_ASSERT(!parts.at(i)._transposed);
+        Q_ASSERT(parts.at(i)._rows <= partRows.at(i));
+
+        offsets.push_back(offset);
+        offset += partRows.at(i);
+        numColumns = std::max(numColumns, parts.at(i)._columns.size());
     }
 
-    _data.resize(newSize);
-    _data.at(index(column, row)) = value.trimmed();
+    const auto numRows = offset;
+
+    _columns.resize(numColumns);
+
+    std::vector<size_t> columnIndices(numColumns);
+    std::iota(columnIndices.begin(), columnIndices.end(), 0);
+
+    // Each column is independent of the others, so they can be merged concurrently
+    parallel_for(columnIndices.begin(), columnIndices.end(),
+    [&](size_t columnIndex)
+    {
+        auto& column = _columns.at(columnIndex);
+
+        for(size_t i = 0; i < parts.size(); i++)
+        {
+            auto& partColumns = parts.at(i)._columns;
+
+            if(columnIndex < partColumns.size())
+                column.append(std::move(partColumns.at(columnIndex)), offsets.at(i), numRows);
+        }
+    });
+
+    parts.clear();
+
+    _rows = numRows;
+    _reservedRows = std::max(_reservedRows, _rows);
 }
 
 void TabularData::shrinkToFit()
 {
     auto lastRowIsEmpty = [this]
     {
-        size_t column = 0;
-        while(column < _columns && valueAt(column, _rows - 1).isEmpty())
-            column++;
-
-        return column >= _columns;
+        return std::all_of(_columns.begin(), _columns.end(),
+            [row = _rows - 1](const auto& column) { return column.isEmptyAt(row); });
     };
 
     // Truncate any trailing empty rows
     while(_rows > 0 && lastRowIsEmpty())
-    {
-        _data.resize(_data.size() - _columns);
         _rows--;
+
+    for(auto& column : _columns)
+    {
+        column.truncate(_rows);
+        column.shrinkToFit();
     }
 
-    _data.shrink_to_fit();
+    _columns.shrink_to_fit();
+    _reservedRows = _rows;
 }
 
 void TabularData::reset()
 {
-    _data.clear();
-    _columns = 0;
+    _columns.clear();
     _rows = 0;
+    _reservedRows = 0;
     _transposed = false;
 }
 
-const QString& TabularData::valueAt(size_t column, size_t row) const
+QString TabularData::valueAt(size_t column, size_t row) const
+{
+    size_t columnRow = 0;
+    const auto* columnData = columnAt(column, row, columnRow);
+
+    return columnData->valueAt(columnRow);
+}
+
+bool TabularData::isEmptyAt(size_t column, size_t row) const
+{
+    size_t columnRow = 0;
+    const auto* columnData = columnAt(column, row, columnRow);
+
+    return columnData->isEmptyAt(columnRow);
+}
+
+double TabularData::doubleAt(size_t column, size_t row, bool* ok) const
 {
-    return _data.at(index(column, row));
+    size_t columnRow = 0;
+    const auto* columnData = columnAt(column, row, columnRow);
+
+    double value = 0.0;
+    bool success = columnData->numericAt(columnRow, value);
+
+    if(ok != nullptr)
+        *ok = success;
+
+    return success ? value : 0.0;
+}
+
+bool TabularData::isNumericAt(size_t column, size_t row) const
+{
+    bool success = false;
+    doubleAt(column, row, &success);
+
+    return success;
 }
 
 TypeIdentity TabularData::typeIdentity(size_t columnIndex, size_t rowIndex) const
@@ -229,3 +739,292 @@ int TabularData::columnMatchPercentage(size_t columnIndex, const QStringList& re
 
     return percent;
 }
+
+namespace
+{
+bool isTerminator(char c) { return c == '\r' || c == '\n'; }
+
+// Parses the records in [data, data + size), which must begin at the start of
+// a record, returning the number of records found. This follows the same rules
+// as aria::csv::CsvParser, so that results are identical to when it was in use.
+size_t parseRecords(const char* data, size_t size, char delimiter,
+    TabularData& tabularData, const Cancellable& cancellable, size_t rowLimit = 0)
+{
+    enum class State
+    {
+        StartOfField,
+        InField,
+        InQuotedField,
+        InEscapedQuote
+    };
+
+    auto state = State::StartOfField;
+    const auto* end = data + size;
+    const auto* position = data;
+
+    std::string field;
+    size_t columnIndex = 0;
+    size_t rowIndex = 0;
+    int progressHint = 0;
+
+    auto endField = [&]
+    {
+        tabularData.setValueAt(columnIndex++, rowIndex,
+            QString::fromUtf8(field.data(), static_cast<int>(field.size())), progressHint);
+        field.clear();
+    };
+
+    auto endRow = [&](char terminator)
+    {
+        if(terminator == '\r' && position < end && *position == '\n')
+            position++;
+
+        state = State::StartOfField;
+        columnIndex = 0;
+        rowIndex++;
+
+        progressHint = static_cast<int>(((position - data) * 100) / static_cast<ptrdiff_t>(size));
+    };
+
+    while(position < end)
+    {
+        if(state == State::StartOfField && columnIndex == 0)
+        {
+            if((rowLimit > 0 && rowIndex > rowLimit) || cancellable.cancelled())
+                return rowIndex;
+        }
+
+        const char c = *position++;
+
+        switch(state)
+        {
+        case State::StartOfField:
+            if(isTerminator(c))
+                endRow(c);
+            else if(c == '"')
+                state = State::InQuotedField;
+            else if(c == delimiter)
+                endField();
+            else
+            {
+                // Consume the rest of the field in one go
+                const auto* fieldEnd = position;
+                while(fieldEnd < end && *fieldEnd != delimiter && !isTerminator(*fieldEnd))
+                    fieldEnd++;
+
+                field.assign(position - 1, fieldEnd);
+                position = fieldEnd;
+                state = State::InField;
+            }
+            break;
+
+        case State::InField:
+            if(isTerminator(c))
+            {
+                endField();
+                endRow(c);
+            }
+            else if(c == delimiter)
+            {
+                endField();
+                state = State::StartOfField;
+            }
+            else
+                field += c;
+            break;
+
+        case State::InQuotedField:
+            if(c == '"')
+                state = State::InEscapedQuote;
+            else
+            {
+                const auto* quote = static_cast<const char*>(std::memchr(position, '"',
+                    static_cast<size_t>(end - position)));
+                const auto* fieldEnd = quote != nullptr ? quote : end;
+
+                field.append(position - 1, fieldEnd);
+                position = fieldEnd;
+            }
+            break;
+
+        case State::InEscapedQuote:
+            if(isTerminator(c))
+            {
+                endField();
+                endRow(c);
+            }
+            else if(c == '"')
+            {
+                field += c;
+                state = State::InQuotedField;
+            }
+            else if(c == delimiter)
+            {
+                endField();
+                state = State::StartOfField;
+            }
+            else
+            {
+                field += c;
+                state = State::InField;
+            }
+            break;
+        }
+    }
+
+    // An unterminated final record
+    if(!field.empty())
+        endField();
+
+    if(columnIndex > 0)
+        rowIndex++;
+
+    return rowIndex;
+}
+
+// Finds offsets into [data, data + size) at which records start, such that
+// they are roughly chunkSize apart; the first is 0 and the last is size
+std::vector<size_t> recordBoundaries(const char* data, size_t size, char delimiter, size_t chunkSize)
+{
+    std::vector<size_t> boundaries{0};
+
+    // Without quotes, every terminator ends a record, so there's no need to track state
+    const bool hasQuotes = std::memchr(data, '"', size) != nullptr;
+
+    enum class State
+    {
+        StartOfField,
+        InField,
+        InQuotedField,
+        InEscapedQuote
+    };
+
+    auto state = State::StartOfField;
+
+    auto scan = [&](char c)
+    {
+        if(state == State::InQuotedField)
+        {
+            if(c == '"')
+                state = State::InEscapedQuote;
+        }
+        else if(c == delimiter || isTerminator(c))
+            state = State::StartOfField;
+        else if(c == '"' && state != State::InField)
+            state = State::InQuotedField;
+        else
+            state = State::InField;
+    };
+
+    size_t position = 0;
+
+    while(boundaries.back() + chunkSize < size)
+    {
+        const auto target = boundaries.back() + chunkSize;
+
+        if(hasQuotes)
+        {
+            for(; position < target; position++)
+                scan(data[position]);
+        }
+        else
+            position = target;
+
+        while(position < size && (state == State::InQuotedField || !isTerminator(data[position])))
+            scan(data[position++]);
+
+        if(position >= size)
+            break;
+
+        if(data[position++] == '\r' && position < size && data[position] == '\n')
+            position++;
+
+        state = State::StartOfField;
+
+        if(position >= size)
+            break;
+
+        boundaries.push_back(position);
+    }
+
+    boundaries.push_back(size);
+
+    return boundaries;
+}
+} // namespace
+
+bool parseTextDelimitedFile(const QString& fileName, char delimiter,
+    TabularData& tabularData, IParser& parser, size_t rowLimit)
+{
+    QFile file(fileName);
+
+    if(!file.open(QFile::ReadOnly))
+        return false;
+
+    const auto fileSize = static_cast<size_t>(file.size());
+
+    if(fileSize == 0)
+    {
+        parser.setFailureReason(QObject::tr("File is empty."));
+        return false;
+    }
+
+    const char* data = nullptr;
+    QByteArray byteArray;
+
+    if(const auto* map = file.map(0, file.size()); map != nullptr)
+        data = reinterpret_cast<const char*>(map);
+    else
+    {
+        // Not everything can be mapped, so fall back to reading it all in
+        byteArray = file.readAll();
+        data = byteArray.constData();
+    }
+
+    if(rowLimit > 0)
+    {
+        // Only a small part of the file is likely to be used, so don't bother with threads
+        parseRecords(data, fileSize, delimiter, tabularData, parser, rowLimit);
+    }
+    else
+    {
+        const size_t ChunkSize = 4u << 20u;
+        const auto boundaries = recordBoundaries(data, fileSize, delimiter, ChunkSize);
+        const auto numChunks = boundaries.size() - 1;
+
+        std::vector<size_t> chunkIndices(numChunks);
+        std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+
+        std::vector<TabularData> parts(numChunks);
+        std::vector<size_t> partRows(numChunks, 0);
+        std::atomic<size_t> chunksParsed(0);
+
+        parser.setProgress(0);
+
+        parallel_for(chunkIndices.begin(), chunkIndices.end(),
+        [&](size_t chunkIndex)
+        {
+            const auto first = boundaries.at(chunkIndex);
+            const auto last = boundaries.at(chunkIndex + 1);
+
+            partRows.at(chunkIndex) = parseRecords(data + first, last - first,
+                delimiter, parts.at(chunkIndex), parser);
+
+            parser.setProgress(static_cast<int>((++chunksParsed * 100) / numChunks));
+        });
+
+        if(parser.cancelled())
+            return false;
+
+        parser.setProgress(-1);
+        tabularData.append(std::move(parts), partRows);
+    }
+
+    if(parser.cancelled())
+        return false;
+
+    // Free up any over-allocation
+    tabularData.shrinkToFit();
+
+    return true;
+}
@@ -38,19 +38,82 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <map>
 #include <cstring>
+#include <cstdint>
 
 class Progressable;
 
+// Values are stored by column, with the storage for each column chosen according
+// to the values it contains. Columns that are wholly numeric are stored as packed
+// integers or floating point values, and all others as dictionary encoded strings.
+// Either way, valueAt returns exactly the (trimmed) text that was stored, while
+// doubleAt gives numeric access to the values without formatting them as text.
 class TabularData
 {
 private:
-    std::vector<QString> _data;
-    size_t _columns = 0;
+    enum class ColumnType
+    {
+        Empty,
+        Integer,
+        Float,
+        String
+    };
+
+    class Column
+    {
+    private:
+        ColumnType _type = ColumnType::Empty;
+        size_t _size = 0;
+
+        std::vector<int64_t> _integers;
+        std::vector<double> _floats;
+
+        // The number of decimal places each float was written with,
+        // or -1 where its shortest representation was used
+        std::vector<int8_t> _floatDecimals;
+
+        std::vector<uint32_t> _codes;
+        std::vector<QString> _dictionary;
+        std::map<QString, uint32_t> _codeForString; // Only maintained until shrinkToFit
+
+        // Cells of numeric columns whose text can't be reproduced from their value,
+        // including any that aren't numbers at all, such as a header
+        std::map<size_t, QString> _verbatim;
+
+        bool setInteger(size_t row, const QString& value);
+        bool setFloat(size_t row, const QString& value);
+        uint32_t codeFor(const QString& value);
+        void setString(size_t row, const QString& value);
+        void setVerbatim(size_t row, const QString& value);
+        bool tooManyVerbatim() const;
+
+        void resize(size_t size, size_t capacityHint);
+        void convertToFloat();
+        void convertToString();
+
+    public:
+        ColumnType type() const { return _type; }
+        size_t size() const { return _size; }
+
+        bool isEmptyAt(size_t row) const;
+        QString valueAt(size_t row) const;
+        bool numericAt(size_t row, double& value) const;
+        void setValueAt(size_t row, const QString& value, size_t capacityHint);
+
+        // Moves the values of other into rows [offset, offset + other.size())
+        void append(Column&& other, size_t offset, size_t capacityHint);
+
+        void truncate(size_t size);
+        void shrinkToFit();
+    };
+
+    std::vector<Column> _columns;
     size_t _rows = 0;
+    size_t _reservedRows = 0;
     bool _transposed = false;
 
-    size_t index(size_t column, size_t row) const;
+    const Column* columnAt(size_t column, size_t row, size_t& columnRow) const;
 
 public:
     TabularData() = default;
@@ -67,11 +130,22 @@ public:
     size_t numColumns() const;
     size_t numRows() const;
     bool transposed() const { return _transposed; }
-    const QString& valueAt(size_t column, size_t row) const;
+    QString valueAt(size_t column, size_t row) const;
+
+    bool isEmptyAt(size_t column, size_t row) const;
+
+    // The value at (column, row) as a number, or 0.0 with ok set to false
+    // if it is empty or isn't numeric, as with QString::toDouble
+    double doubleAt(size_t column, size_t row, bool* ok = nullptr) const;
+    bool isNumericAt(size_t column, size_t row) const;
 
     void setTransposed(bool transposed) { _transposed = transposed; }
     void setValueAt(size_t column, size_t row, QString&& value, int progressHint = -1);
 
+    // Appends each of parts in turn, the nth of which is taken to have partRows[n]
+    // rows, which may include trailing empty rows; columns are merged in parallel
+    void append(std::vector<TabularData>&& parts, const std::vector<size_t>& partRows);
+
     void shrinkToFit();
     void reset();
 
@@ -84,6 +158,12 @@ public:
 
 Q_DECLARE_METATYPE(std::shared_ptr<TabularData>) // NOLINT performance-no-int-to-ptr
 
+// Parses delimited text from a memory mapping of fileName, splitting the file into
+// chunks at record boundaries and parsing the chunks in parallel; if rowLimit is
+// non-zero, only the first (rowLimit + 1) rows are parsed, on the calling thread
+bool parseTextDelimitedFile(const QString& fileName, char delimiter,
+    TabularData& tabularData, IParser& parser, size_t rowLimit = 0);
+
 template<const char Delimiter>
 class TextDelimitedTabularDataParser : public IParser
 {
@@ -105,53 +185,8 @@ public:
         if(graphModel != nullptr)
             graphModel->mutableGraph().setPhase(QObject::tr("Parsing"));
 
-        size_t columnIndex = 0;
-        size_t rowIndex = 0;
-
-        std::ifstream file(url.toLocalFile().toStdString());
-
-        if(!file)
-            return false;
-
-        auto fileSize = file.tellg();
-        file.seekg(0, std::ios::end);
-        fileSize = file.tellg() - fileSize;
-        file.seekg(0, std::ios::beg);
-
-        if(fileSize == 0)
-        {
-            setFailureReason(QObject::tr("File is empty."));
-            return false;
-        }
-
-        auto parser = std::make_unique<aria::csv::CsvParser>(file);
-        parser->delimiter(Delimiter);
-        for(const auto& row : *parser)
-        {
-            auto progress = file.eof() ? 100 :
-                static_cast<int>(parser->position() * 100 / fileSize);
-            setProgress(progress);
-
-            for(const auto& field : row)
-            {
-                _tabularData.setValueAt(columnIndex++, rowIndex,
-                    QString::fromStdString(field), progress);
-            }
-
-            rowIndex++;
-            columnIndex = 0;
-
-            if(_rowLimit > 0 && rowIndex > _rowLimit)
-                break;
-
-            if(cancelled())
-                return false;
-        }
-
-        // Free up any over-allocation
-        _tabularData.shrinkToFit();
-
-        return true;
+        return parseTextDelimitedFile(url.toLocalFile(), Delimiter,
+            _tabularData, *this, _rowLimit);
     }
 
     void setRowLimit(size_t rowLimit) { _rowLimit = rowLimit; }
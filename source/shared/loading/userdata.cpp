@@ -19,6 +19,7 @@
 #include "userdata.h"
 
 #include "shared/utils/container.h"
+#include "shared/utils/binarystream.h"
 
 #include <QDebug>
 
@@ -74,14 +75,26 @@ bool UserData::setValue(size_t index, const QString& name, const QString& value)
     // Make sure the vector exists first
     add(normalisedName);
 
-    auto it = std::find_if(_userDataVectors.begin(), _userDataVectors.end(),
-        [&normalisedName](const auto& it2) { return it2.first == normalisedName; });
+    auto& userDataVector = _userDataVectors.at(normalisedName);
 
-    Q_ASSERT(it != _userDataVectors.end());
+    bool changed = userDataVector.set(index, value);
+    _numValues = std::max(_numValues, userDataVector.numValues());
 
-    auto& userDataVector = it->second;
+    if(changed)
+        emit vectorValuesChanged(name);
 
-    bool changed = userDataVector.set(index, value);
+    return changed;
+}
+
+bool UserData::setFloatValue(size_t index, const QString& name, double value)
+{
+    QString normalisedName = normalise(name);
+
+    add(normalisedName);
+
+    auto& userDataVector = _userDataVectors.at(normalisedName);
+
+    bool changed = userDataVector.setFloat(index, value);
     _numValues = std::max(_numValues, userDataVector.numValues());
 
     if(changed)
@@ -92,42 +105,35 @@ bool UserData::setValue(size_t index, const QString& name, const QString& value)
 
 QVariant UserData::value(size_t index, const QString& name) const
 {
-    QString normalisedName = normalise(name);
-    auto it = std::find_if(_userDataVectors.begin(), _userDataVectors.end(),
-        [&normalisedName](const auto& it2) { return it2.first == normalisedName; });
+    const auto* userDataVector = vector(name);
 
-    if(it != _userDataVectors.end())
-    {
-        const auto& userDataVector = it->second;
-        const auto& stringValue = userDataVector.get(index);
+    if(userDataVector == nullptr || userDataVector->isEmpty(index))
+        return {};
 
-        switch(userDataVector.type())
-        {
-        default:
-        case UserDataVector::Type::Unknown:
-        case UserDataVector::Type::String:
-            return stringValue;
+    switch(userDataVector->type())
+    {
+    default:
+    case UserDataVector::Type::Unknown:
+    case UserDataVector::Type::String:
+        return userDataVector->get(index);
 
-        case UserDataVector::Type::Float:
-            return stringValue.toFloat();
+    case UserDataVector::Type::Float:
+        return userDataVector->floatAt(index);
 
-        case UserDataVector::Type::Int:
-            return stringValue.toInt();
-        }
+    case UserDataVector::Type::Int:
+        return userDataVector->intAt(index);
     }
-
-    return {};
 }
 
 UserDataVector* UserData::vector(const QString& name)
 {
-    QString normalisedName = normalise(name);
-    auto it = std::find_if(_userDataVectors.begin(), _userDataVectors.end(),
-    [&normalisedName](const auto& pair)
-    {
-        return pair.first == normalisedName;
-    });
+    auto it = _userDataVectors.find(normalise(name));
+    return it != _userDataVectors.end() ? &it->second : nullptr;
+}
 
+const UserDataVector* UserData::vector(const QString& name) const
+{
+    auto it = _userDataVectors.find(normalise(name));
     return it != _userDataVectors.end() ? &it->second : nullptr;
 }
 
@@ -212,3 +218,59 @@ bool UserData::load(const json& jsonObject, Progressable& progressable)
 
     return true;
 }
+
+void UserData::save(BinaryWriter& writer, Progressable& progressable, const std::vector<size_t>& indexes) const
+{
+    int i = 0;
+
+    writer.write(static_cast<uint64_t>(_vectorNames.size()));
+
+    for(const auto& vectorName : _vectorNames)
+    {
+        writer.write(vectorName);
+        _userDataVectors.at(vectorName).save(writer, indexes);
+        progressable.setProgress((i++ * 100) / static_cast<int>(_userDataVectors.size()));
+    }
+
+    progressable.setProgress(-1);
+}
+
+bool UserData::load(BinaryReader& reader, Progressable& progressable)
+{
+    uint64_t numVectors = 0;
+
+    if(!reader.read(numVectors))
+        return false;
+
+    for(uint64_t i = 0; i < numVectors; i++)
+    {
+        QString name;
+        if(!reader.read(name))
+            return false;
+
+        name = normalise(name);
+
+        UserDataVector userDataVector;
+        if(!userDataVector.load(name, reader))
+            return false;
+
+        if(u::contains(_vectorNames, name))
+        {
+            qDebug() << "WARNING: Duplicate vector name" << name <<
+                "encountered when loading UserData, skipping...";
+            continue;
+        }
+
+        _vectorNames.emplace_back(name);
+        _userDataVectors.emplace(name, std::move(userDataVector));
+
+        progressable.setProgress(static_cast<int>((i * 100) / numVectors));
+    }
+
+    progressable.setProgress(-1);
+
+    for(const auto& userDataVector : _userDataVectors)
+        _numValues = std::max(_numValues, userDataVector.second.numValues());
+
+    return true;
+}
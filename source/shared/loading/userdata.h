@@ -59,9 +59,11 @@ public:
 
     void add(const QString& name) override;
     bool setValue(size_t index, const QString& name, const QString& value) override;
+    bool setFloatValue(size_t index, const QString& name, double value) override;
     QVariant value(size_t index, const QString& name) const override;
 
     UserDataVector* vector(const QString& name);
+    const UserDataVector* vector(const QString& name) const;
     void setVector(UserDataVector&& other);
 
     virtual void remove(const QString& name);
@@ -69,6 +71,9 @@ public:
     json save(Progressable& progressable, const std::vector<size_t>& indexes = {}) const;
     bool load(const json& jsonObject, Progressable& progressable);
 
+    void save(BinaryWriter& writer, Progressable& progressable, const std::vector<size_t>& indexes = {}) const;
+    bool load(BinaryReader& reader, Progressable& progressable);
+
 signals:
     void vectorValuesChanged(const QString& vectorName);
 };
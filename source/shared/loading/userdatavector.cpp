@@ -19,21 +19,189 @@
 #include "userdatavector.h"
 
 #include "shared/utils/container.h"
+#include "shared/utils/binarystream.h"
+
+#include <QLocale>
+
+#include <algorithm>
+#include <cmath>
+
+void UserDataVector::resize(size_t size)
+{
+    if(size <= _numValues)
+        return;
+
+    _numValues = size;
+    _present.resize((size + 63) / 64, 0);
+    _stringIndexes.resize(size, NoString);
+
+    if(type() == Type::Int)
+        _intValues.resize(size, 0);
+    else if(type() == Type::Float)
+        _floatValues.resize(size, 0.0);
+}
+
+void UserDataVector::setPresent(size_t index, bool present)
+{
+    auto& word = _present[index >> 6];
+    auto bit = uint64_t{1} << (index & 63);
+
+    if(present)
+        word |= bit;
+    else
+        word &= ~bit;
+}
+
+int UserDataVector::stringIndexOf(const QString& value)
+{
+    auto it = _stringIndexMap.constFind(value);
+    if(it != _stringIndexMap.constEnd())
+        return it.value();
+
+    auto stringIndex = static_cast<int>(_strings.size());
+    _strings.push_back(value);
+    _stringIndexMap.insert(value, stringIndex);
+
+    return stringIndex;
+}
+
+QString UserDataVector::numericString(size_t index) const
+{
+    switch(type())
+    {
+    case Type::Int:     return QString::number(_intValues.at(index));
+    case Type::Float:   return QString::number(_floatValues.at(index), 'g', QLocale::FloatingPointShortest);
+    default:            return {};
+    }
+}
+
+void UserDataVector::changeStorageType(Type newType)
+{
+    auto previousType = type();
+    if(newType == previousType)
+        return;
+
+    switch(newType)
+    {
+    case Type::Int:
+        _intValues.assign(_numValues, 0);
+        break;
+
+    case Type::Float:
+        _floatValues.assign(_numValues, 0.0);
+
+        if(previousType == Type::Int)
+        {
+            std::copy(_intValues.begin(), _intValues.end(), _floatValues.begin());
+
+            // Values without text rely on being formatted as ints, which
+            // isn't necessarily the same as being formatted as floats
+            for(size_t index = 0; index < _numValues; index++)
+            {
+                if(isEmpty(index) || _stringIndexes[index] != NoString)
+                    continue;
+
+                auto intString = QString::number(_intValues[index]);
+                if(QString::number(_floatValues[index], 'g', QLocale::FloatingPointShortest) != intString)
+                    _stringIndexes[index] = stringIndexOf(intString);
+            }
+
+            if(_intMin <= _intMax)
+            {
+                _floatMin = std::min(_floatMin, static_cast<double>(_intMin));
+                _floatMax = std::max(_floatMax, static_cast<double>(_intMax));
+            }
+        }
+        break;
+
+    case Type::String:
+        // Values that were set numerically need their text now
+        for(size_t index = 0; index < _numValues; index++)
+        {
+            if(!isEmpty(index) && _stringIndexes[index] == NoString)
+                _stringIndexes[index] = stringIndexOf(numericString(index));
+        }
+        break;
+
+    default: break;
+    }
+
+    if(newType != Type::Int)
+        std::vector<int>().swap(_intValues);
+
+    if(newType != Type::Float)
+        std::vector<double>().swap(_floatValues);
+
+    setType(newType);
+}
+
+void UserDataVector::setNumeric(size_t index, int intValue, double floatValue)
+{
+    if(type() == Type::Int)
+    {
+        _intValues[index] = intValue;
+        _intMin = std::min(_intMin, intValue);
+        _intMax = std::max(_intMax, intValue);
+    }
+    else if(type() == Type::Float)
+    {
+        _floatValues[index] = floatValue;
+        _floatMin = std::min(_floatMin, floatValue);
+        _floatMax = std::max(_floatMax, floatValue);
+    }
+}
+
+void UserDataVector::assign(const std::vector<QString>& values, Type type)
+{
+    _numValues = 0;
+    _present.clear();
+    _stringIndexes.clear();
+    _strings.clear();
+    _stringIndexMap.clear();
+    _intValues.clear();
+    _floatValues.clear();
+    setType(Type::Unknown);
+
+    resize(values.size());
+    for(size_t index = 0; index < values.size(); index++)
+        set(index, values[index]);
+
+    // The type may have been determined by values that have since been replaced,
+    // so it can be more general than the current values alone would imply
+    auto currentType = this->type();
+    bool promote = (type == Type::String) ||
+        (type == Type::Float && currentType != Type::String) ||
+        (type == Type::Int && currentType == Type::Unknown);
+
+    if(promote)
+        changeStorageType(type);
+}
+
+std::vector<QString> UserDataVector::toStrings() const
+{
+    std::vector<QString> strings;
+    strings.reserve(_numValues);
+
+    for(size_t index = 0; index < _numValues; index++)
+        strings.emplace_back(get(index));
+
+    return strings;
+}
 
 QStringList UserDataVector::toStringList() const
 {
     QStringList list;
     list.reserve(numValues());
 
-    for(const auto& value : _values)
-        list.append(value);
+    for(size_t index = 0; index < _numValues; index++)
+        list.append(get(index));
 
     return list;
 }
 
 int UserDataVector::numUniqueValues() const
 {
-    auto v = _values;
+    auto v = toStrings();
     std::sort(v.begin(), v.end());
     auto last = std::unique(v.begin(), v.end());
     v.erase(last, v.end());
@@ -41,44 +209,117 @@ int UserDataVector::numUniqueValues() const
     return static_cast<int>(v.size());
 }
 
+void UserDataVector::reserve(int size)
+{
+    _present.reserve((static_cast<size_t>(size) + 63) / 64);
+    _stringIndexes.reserve(static_cast<size_t>(size));
+}
+
 bool UserDataVector::set(size_t index, const QString& newValue)
 {
     bool changed = false;
 
-    if(index >= _values.size())
+    if(index >= _numValues)
     {
-        _values.resize(index + 1);
+        resize(index + 1);
         changed = true;
     }
+    else
+        changed = get(index) != newValue;
 
-    auto& value = _values.at(index);
-    changed = changed || (value != newValue);
-    value = newValue;
+    if(newValue.isEmpty())
+    {
+        setPresent(index, false);
+        _stringIndexes[index] = NoString;
+        return changed;
+    }
 
-    updateType(value);
+    // Once a string, always a string, so there's no need to parse anything
+    if(type() == Type::String)
+    {
+        setPresent(index, true);
+        _stringIndexes[index] = stringIndexOf(newValue);
+        return changed;
+    }
 
-    if(type() == Type::Int)
+    // Excluded from any storage type change, as its current value is being replaced
+    setPresent(index, false);
+
+    bool isInt = false;
+    bool isFloat = false;
+    int intValue = newValue.toInt(&isInt);
+    double floatValue = 0.0;
+
+    if(isInt)
     {
-        int intValue = value.toInt();
-        _intMin = std::min(_intMin, intValue);
-        _intMax = std::max(_intMax, intValue);
+        isFloat = true;
+        floatValue = intValue;
     }
-    else if(type() == Type::Float)
+    else
+        floatValue = newValue.toDouble(&isFloat);
+
+    TypeIdentity newTypeIdentity;
+    newTypeIdentity.setType(type());
+    newTypeIdentity.updateType(isInt, isFloat);
+    changeStorageType(newTypeIdentity.type());
+
+    setPresent(index, true);
+
+    if(type() == Type::String)
     {
-        double floatValue = value.toDouble();
-        _floatMin = std::min(_floatMin, floatValue);
-        _floatMax = std::max(_floatMax, floatValue);
+        _stringIndexes[index] = stringIndexOf(newValue);
+        return changed;
     }
 
+    setNumeric(index, intValue, floatValue);
+
+    // The text is only kept if it can't be reproduced from the number, e.g. "007" or "1.50"
+    _stringIndexes[index] = numericString(index) == newValue ? NoString : stringIndexOf(newValue);
+
+    return changed;
+}
+
+bool UserDataVector::setFloat(size_t index, double newValue)
+{
+    bool changed = false;
+
+    if(index >= _numValues)
+    {
+        resize(index + 1);
+        changed = true;
+    }
+
+    bool isInt = std::nearbyint(newValue) == newValue &&
+        newValue >= std::numeric_limits<int>::lowest() &&
+        newValue <= std::numeric_limits<int>::max();
+
+    TypeIdentity newTypeIdentity;
+    newTypeIdentity.setType(type());
+    newTypeIdentity.updateType(isInt, true);
+    changeStorageType(newTypeIdentity.type());
+
+    if(type() == Type::String)
+        return set(index, QString::number(newValue, 'g', QLocale::FloatingPointShortest)) || changed;
+
+    changed = changed || isEmpty(index) || (floatAt(index) != newValue);
+
+    setPresent(index, true);
+    _stringIndexes[index] = NoString;
+    setNumeric(index, isInt ? static_cast<int>(newValue) : 0, newValue);
+
     return changed;
 }
 
 QString UserDataVector::get(size_t index) const
 {
-    if(index >= _values.size())
+    if(isEmpty(index))
         return {};
 
-    return _values.at(index);
+    auto stringIndex = _stringIndexes[index];
+    if(stringIndex != NoString)
+        return _strings[static_cast<size_t>(stringIndex)];
+
+    return numericString(index);
 }
 
 json UserDataVector::save(const std::vector<size_t>& indexes) const
@@ -112,16 +353,13 @@ json UserDataVector::save(const std::vector<size_t>& indexes) const
 
         for(auto index : indexes)
         {
-            if(index < _values.size())
-                jsonValues.push_back(_values.at(index));
-            else
-                jsonValues.push_back(QString());
+            jsonValues.push_back(get(index));
         }
 
         jsonObject["values"] = jsonValues;
     }
     else
-        jsonObject["values"] = _values;
+        jsonObject["values"] = toStrings();
 
     return jsonObject;
 }
@@ -133,14 +371,24 @@ bool UserDataVector::load(const QString& name, const json& jsonObject)
     if(!jsonObject["type"].is_string())
         return false;
 
+    auto type = Type::Unknown;
+
     if(jsonObject["type"] == "String")
-        setType(Type::String);
+        type = Type::String;
     else if(jsonObject["type"] == "Int")
-        setType(Type::Int);
+        type = Type::Int;
     else if(jsonObject["type"] == "Float")
-        setType(Type::Float);
-    else
-        setType(Type::Unknown);
+        type = Type::Float;
+
+    if(!jsonObject["values"].is_array())
+        return false;
+
+    std::vector<QString> values;
+    values.reserve(jsonObject["values"].size());
+    for(const auto& value : jsonObject["values"])
+        values.push_back(value);
+
+    assign(values, type);
 
     if(u::contains(jsonObject, "intMin") && u::contains(jsonObject, "intMax"))
     {
@@ -160,12 +408,143 @@ bool UserDataVector::load(const QString& name, const json& jsonObject)
         _floatMax = jsonObject["floatMax"];
     }
 
-    if(!jsonObject["values"].is_array())
+    return true;
+}
+
+void UserDataVector::save(BinaryWriter& writer, const std::vector<size_t>& indexes) const
+{
+    if(!indexes.empty())
+    {
+        // Gather the subset into a vector of its own, which in the
+        // process only retains the strings that the subset refers to
+        UserDataVector subset(_name);
+        subset.setType(type());
+        subset.resize(indexes.size());
+
+        for(size_t subsetIndex = 0; subsetIndex < indexes.size(); subsetIndex++)
+        {
+            auto index = indexes.at(subsetIndex);
+            if(isEmpty(index))
+                continue;
+
+            subset.setPresent(subsetIndex, true);
+
+            auto stringIndex = _stringIndexes[index];
+            if(stringIndex != NoString)
+                subset._stringIndexes[subsetIndex] = subset.stringIndexOf(_strings[static_cast<size_t>(stringIndex)]);
+
+            if(type() == Type::Int)
+                subset._intValues[subsetIndex] = _intValues[index];
+            else if(type() == Type::Float)
+                subset._floatValues[subsetIndex] = _floatValues[index];
+        }
+
+        subset._intMin = _intMin;
+        subset._intMax = _intMax;
+        subset._floatMin = _floatMin;
+        subset._floatMax = _floatMax;
+
+        subset.save(writer);
+        return;
+    }
+
+    static_assert(sizeof(int) == sizeof(int32_t));
+
+    writer.write(static_cast<uint8_t>(type()));
+    writer.write(static_cast<int32_t>(_intMin));
+    writer.write(static_cast<int32_t>(_intMax));
+    writer.write(_floatMin);
+    writer.write(_floatMax);
+
+    // The storage is written as is, so that loading it is little more than a copy
+    writer.write(static_cast<uint64_t>(_numValues));
+    writer.write(_present);
+    writer.write(_stringIndexes);
+    writer.write(_strings);
+
+    if(type() == Type::Int)
+        writer.write(_intValues);
+    else if(type() == Type::Float)
+        writer.write(_floatValues);
+}
+
+bool UserDataVector::load(const QString& name, BinaryReader& reader)
+{
+    _name = name;
+
+    uint8_t type = 0;
+    int32_t intMin = 0;
+    int32_t intMax = 0;
+
+    if(!reader.read(type) || type > static_cast<uint8_t>(Type::Float))
         return false;
 
-    _values.clear();
-    for(const auto& value : jsonObject["values"])
-        _values.push_back(value);
+    if(!reader.read(intMin) || !reader.read(intMax))
+        return false;
+
+    double floatMin = 0.0;
+    double floatMax = 0.0;
+
+    if(!reader.read(floatMin) || !reader.read(floatMax))
+        return false;
+
+    uint64_t numValues = 0;
+    std::vector<uint64_t> present;
+    std::vector<int> stringIndexes;
+    std::vector<QString> strings;
+
+    if(!reader.read(numValues) || !reader.read(present) ||
+        !reader.read(stringIndexes) || !reader.read(strings))
+    {
+        return false;
+    }
+
+    if(stringIndexes.size() != numValues || present.size() != (numValues + 63) / 64)
+        return false;
+
+    std::vector<int> intValues;
+    std::vector<double> floatValues;
+
+    auto newType = static_cast<Type>(type);
+
+    if(newType == Type::Int && (!reader.read(intValues) || intValues.size() != numValues))
+        return false;
+
+    if(newType == Type::Float && (!reader.read(floatValues) || floatValues.size() != numValues))
+        return false;
+
+    // Ensure there are no stray bits beyond the end of the vector
+    if(numValues % 64 != 0)
+        present.back() &= (uint64_t{1} << (numValues % 64)) - 1;
+
+    _numValues = static_cast<size_t>(numValues);
+    _present = std::move(present);
+    _stringIndexes = std::move(stringIndexes);
+    _strings = std::move(strings);
+    _intValues = std::move(intValues);
+    _floatValues = std::move(floatValues);
+    setType(newType);
+
+    for(size_t index = 0; index < _numValues; index++)
+    {
+        auto stringIndex = _stringIndexes[index];
+        bool valid = stringIndex == NoString ?
+            // Only numeric values can be reproduced without any text
+            (isEmpty(index) || newType == Type::Int || newType == Type::Float) :
+            (stringIndex >= 0 && static_cast<size_t>(stringIndex) < _strings.size());
+
+        if(!valid)
+            return false;
+    }
+
+    _stringIndexMap.clear();
+    for(size_t stringIndex = 0; stringIndex < _strings.size(); stringIndex++)
+        _stringIndexMap.insert(_strings[stringIndex], static_cast<int>(stringIndex));
+
+    _intMin = intMin;
+    _intMax = intMax;
+    _floatMin = floatMin;
+    _floatMax = floatMax;
 
     return true;
 }
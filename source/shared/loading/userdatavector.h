@@ -20,6 +20,7 @@
 #define USERDATAVECTOR_H
 
 #include <QString>
+#include <QHash>
 
 #include "shared/utils/typeidentity.h"
 
@@ -28,21 +29,49 @@
 #include <vector>
 #include <limits>
 #include <utility>
+#include <cstdint>
 
 #include <QStringList>
 
+class BinaryWriter;
+class BinaryReader;
+
+// While the vector's type is Int or Float, values are held in a packed numeric column,
+// so that numeric access doesn't involve any string conversion; strings are dictionary
+// encoded, as is the original text of any number that doesn't format back to it exactly
 class UserDataVector : public TypeIdentity
 {
 private:
+    // The string index of values that were set numerically, and so have no text
+    static constexpr int NoString = -1;
+
     QString _name;
 
-    std::vector<QString> _values;
+    size_t _numValues = 0;
+
+    // Bit i is set if value i is non-empty
+    std::vector<uint64_t> _present;
+
+    std::vector<int> _stringIndexes;
+    std::vector<QString> _strings;
+    QHash<QString, int> _stringIndexMap;
+
+    std::vector<int> _intValues;
+    std::vector<double> _floatValues;
 
     int _intMin = std::numeric_limits<int>::max();
     int _intMax = std::numeric_limits<int>::lowest();
     double _floatMin = std::numeric_limits<double>::max();
     double _floatMax = std::numeric_limits<double>::lowest();
 
+    void resize(size_t size);
+    void setPresent(size_t index, bool present);
+    int stringIndexOf(const QString& value);
+    QString numericString(size_t index) const;
+    void changeStorageType(Type newType);
+    void setNumeric(size_t index, int intValue, double floatValue);
+    void assign(const std::vector<QString>& values, Type type);
+
 public:
     UserDataVector() = default;
     UserDataVector(const UserDataVector&) = default;
@@ -55,15 +84,13 @@ public:
         _name(name)
     {}
 
-    auto begin() const { return _values.begin(); }
-    auto end() const { return _values.end(); }
-
+    std::vector<QString> toStrings() const;
     QStringList toStringList() const;
 
     const QString& name() const { return _name; }
-    int numValues() const { return static_cast<int>(_values.size()); }
+    int numValues() const { return static_cast<int>(_numValues); }
     int numUniqueValues() const;
-    void reserve(int size) { _values.reserve(size); }
+    void reserve(int size);
 
     int intMin() const { return _intMin; }
     int intMax() const { return _intMax; }
@@ -71,10 +98,34 @@ public:
     double floatMax() const { return _floatMax; }
 
     bool set(size_t index, const QString& value);
+    bool setFloat(size_t index, double value);
     QString get(size_t index) const;
 
+    bool isEmpty(size_t index) const
+    {
+        return index >= _numValues || (_present[index >> 6] & (uint64_t{1} << (index & 63))) == 0;
+    }
+
+    // Only valid when type() is Int
+    int intAt(size_t index) const
+    {
+        return index < _intValues.size() ? _intValues[index] : 0;
+    }
+
+    // Only valid when type() is Int or Float
+    double floatAt(size_t index) const
+    {
+        if(type() == Type::Int)
+            return intAt(index);
+
+        return index < _floatValues.size() ? _floatValues[index] : 0.0;
+    }
+
     json save(const std::vector<size_t>& indexes = {}) const;
     bool load(const QString& name, const json& jsonObject);
+
+    void save(BinaryWriter& writer, const std::vector<size_t>& indexes = {}) const;
+    bool load(const QString& name, BinaryReader& reader);
 };
 
 #endif // USERDATAVECTOR_H
@@ -26,6 +26,7 @@
 #include "shared/graph/imutablegraph.h"
 #include "shared/graph/igraphmodel.h"
 #include "shared/attributes/iattribute.h"
+#include "shared/utils/binarystream.h"
 #include "shared/utils/container.h"
 #include "shared/utils/progressable.h"
 
@@ -112,6 +113,12 @@ public:
         return setValue(indexFor(elementId), name, value);
     }
 
+    bool setFloatValueBy(E elementId, const QString& name, double value) override
+    {
+        generateElementIdMapping(elementId);
+        return setFloatValue(indexFor(elementId), name, value);
+    }
+
     QVariant valueBy(E elementId, const QString& name) const override
     {
         if(!haveIndexFor(elementId))
@@ -120,6 +127,39 @@ public:
         return value(indexFor(elementId), name);
     }
 
+    // These access the typed storage of a vector directly, avoiding any conversion
+    int intValueBy(E elementId, const UserDataVector& userDataVector) const
+    {
+        if(!haveIndexFor(elementId))
+            return 0;
+
+        return userDataVector.intAt(indexFor(elementId));
+    }
+
+    double floatValueBy(E elementId, const UserDataVector& userDataVector) const
+    {
+        if(!haveIndexFor(elementId))
+            return 0.0;
+
+        return userDataVector.floatAt(indexFor(elementId));
+    }
+
+    QString stringValueBy(E elementId, const UserDataVector& userDataVector) const
+    {
+        if(!haveIndexFor(elementId))
+            return {};
+
+        return userDataVector.get(indexFor(elementId));
+    }
+
+    bool valueMissingBy(E elementId, const UserDataVector& userDataVector) const
+    {
+        if(!haveIndexFor(elementId))
+            return false;
+
+        return userDataVector.isEmpty(indexFor(elementId));
+    }
+
     void remove(const QString& name) override
     {
         UserData::remove(name);
@@ -147,22 +187,25 @@ public:
 
             createdAttributeNames.emplace_back(attributeName);
 
+            // The vector is looked up once here rather than by name on every read; vectors
+            // are held in a std::map, so its address is stable until it's removed, which
+            // only happens along with the attribute itself
             switch(userDataVector->type())
             {
             case UserDataVector::Type::Float:
                 attribute.setFloatValueFn(
-                [this, userDataVectorName](E elementId)
+                [this, userDataVector](E elementId)
                 {
-                    return valueBy(elementId, userDataVectorName).toFloat();
+                    return floatValueBy(elementId, *userDataVector);
                 })
                 .setFlag(AttributeFlag::AutoRange);
                 break;
 
             case UserDataVector::Type::Int:
                 attribute.setIntValueFn(
-                [this, userDataVectorName](E elementId)
+                [this, userDataVector](E elementId)
                 {
-                    return valueBy(elementId, userDataVectorName).toInt();
+                    return intValueBy(elementId, *userDataVector);
                 })
                 .setFlag(AttributeFlag::AutoRange);
                 break;
@@ -172,9 +215,9 @@ public:
             // happening is if the entire vector is empty
             case UserDataVector::Type::String:
                 attribute.setStringValueFn(
-                [this, userDataVectorName](E elementId)
+                [this, userDataVector](E elementId)
                 {
-                    return valueBy(elementId, userDataVectorName).toString();
+                    return stringValueBy(elementId, *userDataVector);
                 })
                 .setFlag(AttributeFlag::FindShared);
                 break;
@@ -182,12 +225,9 @@ public:
             default: break;
             }
 
-            attribute.setValueMissingFn([this, userDataVectorName](E elementId)
+            attribute.setValueMissingFn([this, userDataVector](E elementId)
             {
-                if(!haveIndexFor(elementId))
-                    return false;
-
-                return value(indexFor(elementId), userDataVectorName).toString().isEmpty();
+                return valueMissingBy(elementId, *userDataVector);
             });
 
             attribute.setDescription(QString(QObject::tr("%1 is a user defined attribute.")).arg(userDataVectorName));
@@ -247,8 +287,55 @@ public:
                 return false;
         }
 
-        const auto& ids = jsonObject[idsKey];
+        std::vector<int32_t> ids;
+        ids.reserve(jsonObject[idsKey].size());
+
+        for(const auto& id : jsonObject[idsKey])
+            ids.push_back(id.get<int>());
+
+        mapIdsToIndexes(ids);
+
+        return true;
+    }
+
+    void save(BinaryWriter& writer, const std::vector<E>& elementIds, Progressable& progressable) const
+    {
+        std::vector<size_t> indexes;
+        std::vector<int32_t> ids;
+
+        for(auto elementId : elementIds)
+        {
+            auto index = _indexes->at(elementId);
+            if(index._set)
+            {
+                ids.push_back(static_cast<int32_t>(elementId));
+                indexes.push_back(index._value);
+            }
+        }
+
+        writer.write(ids);
+        UserData::save(writer, progressable, indexes);
+    }
+
+    bool load(BinaryReader& reader, Progressable& progressable)
+    {
+        std::vector<int32_t> ids;
+
+        if(!reader.read(ids))
+            return false;
+
+        if(!UserData::load(reader, progressable))
+            return false;
+
+        mapIdsToIndexes(ids);
 
+        return true;
+    }
+
+private:
+    // Each (saved) id is given the next index after any that are already in use
+    void mapIdsToIndexes(const std::vector<int32_t>& ids)
+    {
         size_t index = 0;
 
         if(!_indexes->empty())
@@ -266,15 +353,13 @@ public:
                 index = it->_value;
         }
 
-        for(const auto& id : ids)
+        for(auto id : ids)
         {
-            E elementId = id.get<int>();
+            E elementId = static_cast<int>(id);
 
             if(!haveIndexFor(elementId))
                 setElementIdForIndex(elementId, index++);
         }
-
-        return true;
     }
 };
 
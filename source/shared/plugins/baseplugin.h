@@ -29,6 +29,7 @@
 #include "shared/loading/urltypes.h"
 
 #include <memory>
+#include <vector>
 
 #include <QObject>
 
@@ -74,6 +75,10 @@ public:
                 this, SLOT(onEdgeAdded(const Graph*,EdgeId)), Qt::DirectConnection);
         connect(graphQObject, SIGNAL(edgeRemoved(const Graph*,EdgeId)),
                 this, SLOT(onEdgeRemoved(const Graph*,EdgeId)), Qt::DirectConnection);
+        connect(graphQObject, SIGNAL(nodesAdded(const Graph*,std::vector<NodeId>)),
+                this, SLOT(onNodesAdded(const Graph*,std::vector<NodeId>)), Qt::DirectConnection);
+        connect(graphQObject, SIGNAL(edgesAdded(const Graph*,std::vector<EdgeId>)),
+                this, SLOT(onEdgesAdded(const Graph*,std::vector<EdgeId>)), Qt::DirectConnection);
 
         connect(graphQObject, SIGNAL(graphChanged(const Graph*,bool)),
                 this, SIGNAL(graphChanged()), Qt::DirectConnection);
@@ -124,6 +129,18 @@ private slots:
     void onEdgeAdded(const Graph*, EdgeId edgeId)       { emit edgeAdded(edgeId); }
     void onEdgeRemoved(const Graph*, EdgeId edgeId)     { emit edgeRemoved(edgeId); }
 
+    void onNodesAdded(const Graph*, const std::vector<NodeId>& nodeIds)
+    {
+        for(auto nodeId : nodeIds)
+            emit nodeAdded(nodeId);
+    }
+
+    void onEdgesAdded(const Graph*, const std::vector<EdgeId>& edgeIds)
+    {
+        for(auto edgeId : edgeIds)
+            emit edgeAdded(edgeId);
+    }
+
     void onSelectionChanged(const SelectionManager*)    { emit selectionChanged(_selectionManager); }
     void onVisualsChanged(VisualChangeFlags nodeChange,
         VisualChangeFlags edgeChange)                   { emit visualsChanged(nodeChange, edgeChange); }
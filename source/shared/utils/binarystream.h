@@ -0,0 +1,214 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BINARYSTREAM_H
+#define BINARYSTREAM_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtEndian>
+
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// Little endian binary serialisation, for data that is too large to sensibly
+// go via JSON. Arrays of numbers are written as a count followed by their
+// raw bytes, so that on (little endian) hosts they can be copied in one go.
+class BinaryWriter
+{
+private:
+    QByteArray* _byteArray;
+    bool _overflowed = false;
+
+    // A QByteArray's size is an int, so anything that would take it beyond
+    // that is dropped, and the writer is marked as having overflowed
+    void append(const char* data, uint64_t size)
+    {
+        const auto maxSize = static_cast<uint64_t>(std::numeric_limits<int>::max());
+
+        if(_overflowed || size > maxSize - static_cast<uint64_t>(_byteArray->size()))
+        {
+            _overflowed = true;
+            return;
+        }
+
+        _byteArray->append(data, static_cast<int>(size));
+    }
+
+public:
+    explicit BinaryWriter(QByteArray& byteArray) :
+        _byteArray(&byteArray)
+    {}
+
+    // True if anything written didn't fit, in which case the output is incomplete
+    bool overflowed() const { return _overflowed; }
+
+    template<typename T>
+    void write(T value)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+
+        if constexpr(sizeof(T) > 1)
+            value = qToLittleEndian(value);
+
+        append(reinterpret_cast<const char*>(&value), sizeof(T)); // NOLINT
+    }
+
+    template<typename T>
+    void write(const std::vector<T>& values)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+
+        write(static_cast<uint64_t>(values.size()));
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        append(reinterpret_cast<const char*>(values.data()), // NOLINT
+            static_cast<uint64_t>(values.size()) * sizeof(T));
+#else
+        for(auto value : values)
+            write(value);
+#endif
+    }
+
+    void write(const QByteArray& byteArray)
+    {
+        write(static_cast<uint64_t>(byteArray.size()));
+        append(byteArray.constData(), static_cast<uint64_t>(byteArray.size()));
+    }
+
+    void write(const QString& string) { write(string.toUtf8()); }
+
+    void write(const std::vector<QString>& strings)
+    {
+        write(static_cast<uint64_t>(strings.size()));
+
+        for(const auto& string : strings)
+            write(string);
+    }
+};
+
+// Reads what BinaryWriter writes; every read is bounds checked
+// and returns false if there isn't enough data remaining
+class BinaryReader
+{
+private:
+    const char* _data;
+    size_t _size;
+    size_t _position = 0;
+
+    bool canRead(uint64_t numBytes) const { return numBytes <= _size - _position; }
+
+    bool readCount(uint64_t& count, size_t elementSize)
+    {
+        // Guard against a bogus count causing a huge allocation
+        return read(count) && count <= (_size - _position) / elementSize;
+    }
+
+public:
+    BinaryReader(const char* data, size_t size) :
+        _data(data), _size(size)
+    {}
+
+    bool atEnd() const { return _position >= _size; }
+
+    template<typename T>
+    bool read(T& value)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+
+        if(!canRead(sizeof(T)))
+            return false;
+
+        std::memcpy(&value, _data + _position, sizeof(T));
+        _position += sizeof(T);
+
+        if constexpr(sizeof(T) > 1)
+            value = qFromLittleEndian(value);
+
+        return true;
+    }
+
+    template<typename T>
+    bool read(std::vector<T>& values)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+
+        uint64_t count = 0;
+        if(!readCount(count, sizeof(T)))
+            return false;
+
+        values.resize(count);
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        std::memcpy(values.data(), _data + _position, count * sizeof(T));
+        _position += count * sizeof(T);
+#else
+        for(auto& value : values)
+            read(value);
+#endif
+
+        return true;
+    }
+
+    bool read(QByteArray& byteArray)
+    {
+        uint64_t numBytes = 0;
+        if(!readCount(numBytes, 1))
+            return false;
+
+        byteArray = QByteArray(_data + _position, static_cast<int>(numBytes));
+        _position += numBytes;
+
+        return true;
+    }
+
+    bool read(QString& string)
+    {
+        uint64_t numBytes = 0;
+        if(!readCount(numBytes, 1))
+            return false;
+
+        string = QString::fromUtf8(_data + _position, static_cast<int>(numBytes));
+        _position += numBytes;
+
+        return true;
+    }
+
+    bool read(std::vector<QString>& strings)
+    {
+        // Each string is at least a length
+        uint64_t count = 0;
+        if(!readCount(count, sizeof(uint64_t)))
+            return false;
+
+        strings.resize(count);
+
+        for(auto& string : strings)
+        {
+            if(!read(string))
+                return false;
+        }
+
+        return true;
+    }
+};
+
+#endif // BINARYSTREAM_H
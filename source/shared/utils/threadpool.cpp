@@ -21,22 +21,48 @@
 #include "shared/utils/thread.h"
 #include "shared/utils/fatalerror.h"
 
+#include <optional>
+
+namespace
+{
+thread_local const ThreadPool* currentThreadPool = nullptr;
+thread_local int currentThreadPoolWorkerIndex = -1;
+thread_local int serialScopeDepth = 0;
+} // namespace
+
+ThreadPool::SerialScope::SerialScope() { serialScopeDepth++; }
+ThreadPool::SerialScope::~SerialScope() { serialScopeDepth--; }
+
+bool ThreadPool::executingSerially()
+{
+    return serialScopeDepth > 0;
+}
+
 ThreadPool::ThreadPool(const QString& threadNamePrefix, unsigned int numThreads) :
-    _stop(false)
+    _numQueuedTasks(0), _stop(false)
 {
+    for(unsigned int i = 0U; i < numThreads; i++)
+        _workers.emplace_back(std::make_unique<Worker>());
+
     for(unsigned int i = 0U; i < numThreads; i++)
     {
         auto threadName = QStringLiteral("%1%2").arg(threadNamePrefix).arg(i + 1);
 
-        _threads.emplace_back([threadName, this]
+        _threads.emplace_back([threadName, i, this]
         {
             u::setCurrentThreadName(threadName);
 
+            currentThreadPool = this;
+            currentThreadPoolWorkerIndex = static_cast<int>(i);
+
             while(!_stop)
             {
+                if(tryExecuteTask())
+                    continue;
+
                 std::unique_lock<std::mutex> lock(_mutex);
 
-                while(_tasks.empty() && !_stop)
+                while(_numQueuedTasks == 0 && !_stop)
                 {
                     if(!lock.owns_lock())
                         FATAL_ERROR(ThreadPoolLockNotHeldBeforeWaiting);
@@ -44,15 +70,6 @@ ThreadPool::ThreadPool(const QString& threadNamePrefix, unsigned int numThreads)
                     // Block until a new task is queued
                     _waitForNewTask.wait(lock);
                 }
-
-                if(_stop)
-                    break;
-
-                auto task = std::move(_tasks.front());
-                _tasks.pop();
-                lock.unlock();
-
-                task();
             }
         });
     }
@@ -63,8 +80,14 @@ ThreadPool::~ThreadPool() // NOLINT modernize-use-equals-default
     // Cancel all pending tasks
     std::unique_lock<std::mutex> lock(_mutex);
     _stop = true;
-    while(!_tasks.empty())
-        _tasks.pop();
+    _tasks.clear();
+
+    for(auto& worker : _workers)
+    {
+        std::unique_lock<std::mutex> workerLock(worker->_mutex);
+        worker->_tasks.clear();
+    }
+
     lock.unlock();
 
     // Tell all idle threads to unblock
@@ -77,3 +100,92 @@ ThreadPool::~ThreadPool() // NOLINT modernize-use-equals-default
             thread.join();
     }
 }
+
+int ThreadPool::currentWorkerIndex() const
+{
+    return currentThreadPool == this ? currentThreadPoolWorkerIndex : -1;
+}
+
+void ThreadPool::enqueue(void_callable_wrapper&& task)
+{
+    auto workerIndex = currentWorkerIndex();
+
+    if(workerIndex >= 0)
+    {
+        auto& worker = *_workers.at(static_cast<size_t>(workerIndex));
+        std::unique_lock<std::mutex> lock(worker._mutex);
+        worker._tasks.emplace_back(std::move(task));
+        _numQueuedTasks++;
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _tasks.emplace_back(std::move(task));
+        _numQueuedTasks++;
+    }
+
+    // Ensure any thread that has just seen no tasks is now waiting, so that it gets woken
+    { std::unique_lock<std::mutex> lock(_mutex); }
+
+    // Wake a thread up
+    _waitForNewTask.notify_one();
+}
+
+bool ThreadPool::tryExecuteTask()
+{
+    auto popTask = [this](std::mutex& mutex, std::deque<void_callable_wrapper>& tasks,
+        bool back) -> std::optional<void_callable_wrapper>
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if(_stop || tasks.empty())
+            return std::nullopt;
+
+        std::optional<void_callable_wrapper> task;
+
+        if(back)
+        {
+            task.emplace(std::move(tasks.back()));
+            tasks.pop_back();
+        }
+        else
+        {
+            task.emplace(std::move(tasks.front()));
+            tasks.pop_front();
+        }
+
+        _numQueuedTasks--;
+        return task;
+    };
+
+    const auto workerIndex = currentWorkerIndex();
+    const auto numWorkers = static_cast<int>(_workers.size());
+    std::optional<void_callable_wrapper> task;
+
+    // Our own most recently queued task is the one most likely to be cache warm
+    if(workerIndex >= 0)
+    {
+        auto& worker = *_workers.at(static_cast<size_t>(workerIndex));
+        task = popTask(worker._mutex, worker._tasks, true);
+    }
+
+    if(!task)
+        task = popTask(_mutex, _tasks, false);
+
+    // Steal the oldest task of another worker, which is likely to be the largest
+    for(int i = 1; !task && i <= numWorkers; i++)
+    {
+        auto victimIndex = (std::max(workerIndex, 0) + i) % numWorkers;
+        if(victimIndex == workerIndex)
+            continue;
+
+        auto& victim = *_workers.at(static_cast<size_t>(victimIndex));
+        task = popTask(victim._mutex, victim._tasks, false);
+    }
+
+    if(!task)
+        return false;
+
+    (*task)();
+    return true;
+}
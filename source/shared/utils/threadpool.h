@@ -29,26 +29,82 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <exception>
 #include <future>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 #include <utility>
 #include <type_traits>
 
+// Each worker thread has its own deque of tasks. Workers push and pop the tasks
+// they create at the back of their own deque, and when it is empty, take tasks
+// that were queued from outside the pool, or steal from the front of the deques
+// of other workers. A thread waiting on the results of the pool executes tasks
+// itself, so nesting parallel_for within a task cannot starve the pool.
 class ThreadPool
 {
 private:
+    struct Worker
+    {
+        std::mutex _mutex;
+        std::deque<void_callable_wrapper> _tasks;
+    };
+
     std::vector<std::thread> _threads;
+    std::vector<std::unique_ptr<Worker>> _workers;
+
     std::mutex _mutex;
     std::condition_variable _waitForNewTask;
-    std::queue<void_callable_wrapper> _tasks;
+    std::deque<void_callable_wrapper> _tasks; // Queued from outside of the pool
+    std::atomic<size_t> _numQueuedTasks;
     std::atomic<bool> _stop;
 
+    // The worker index of the current thread, or -1 if it's not one of ours
+    int currentWorkerIndex() const;
+
+    void enqueue(void_callable_wrapper&& task);
+    bool tryExecuteTask();
+
+    template<typename T> void waitFor(std::future<T>& future)
+    {
+        if(currentWorkerIndex() < 0)
+        {
+            future.wait();
+            return;
+        }
+
+        // Workers do something useful while they wait, rather than block
+        // a thread that may be needed in order for future to become ready
+        while(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            if(!tryExecuteTask())
+                future.wait_for(std::chrono::microseconds(100));
+        }
+    }
+
 public:
+    // While one of these exists, parallel_for calls made on the thread that created it
+    // execute entirely on that thread, in a single chunk. This is for tasks that are already
+    // one of many executing concurrently, whose own loops are too small to be worth dividing.
+    class SerialScope
+    {
+    public:
+        SerialScope();
+        ~SerialScope();
+
+        SerialScope(const SerialScope&) = delete;
+        SerialScope(SerialScope&&) = delete;
+        SerialScope& operator=(const SerialScope&) = delete;
+        SerialScope& operator=(SerialScope&&) = delete;
+    };
+
+    static bool executingSerially();
+
     explicit ThreadPool(const QString& threadNamePrefix = QStringLiteral("Worker"),
         unsigned int numThreads = std::thread::hardware_concurrency());
     virtual ~ThreadPool();
@@ -68,16 +124,10 @@ public:
         auto task = std::packaged_task<ReturnType<Fn, Args...>(Args...)>(f);
         auto future = task.get_future();
 
+        enqueue(void_callable_wrapper([task = std::move(task), args...]() mutable
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-            _tasks.emplace([task = std::move(task), args...]() mutable
-            {
-                task(std::forward<Args>(args)...);
-            });
-        }
-
-        // Wake a thread up
-        _waitForNewTask.notify_one();
+            task(std::forward<Args>(args)...);
+        }));
 
         return future;
     }
@@ -98,26 +148,40 @@ private:
         mutable std::vector<ResultsVectorOrVoid> _values;
     };
 
+    // The results of each chunk of a parallel_for, in the order of the chunks
+    template<typename ResultsVectorOrVoid, bool = std::is_void_v<ResultsVectorOrVoid>>
+    struct ChunkResults {};
+
+    template<typename ResultsVectorOrVoid>
+    struct ChunkResults<ResultsVectorOrVoid, false>
+    {
+        std::vector<ResultsVectorOrVoid> _chunkResults;
+    };
+
     template<typename ResultsVectorOrVoid> class ResultsType : public ResultMember<ResultsVectorOrVoid>
     {
         friend class ThreadPool;
 
     private:
-        mutable std::vector<std::future<ResultsVectorOrVoid>> _futures;
-
-        explicit ResultsType(std::vector<std::future<ResultsVectorOrVoid>>&& futures) :
-            _futures(std::move(futures))
+        ThreadPool* _threadPool;
+        mutable std::future<void> _future;
+        std::shared_ptr<ChunkResults<ResultsVectorOrVoid>> _chunkResults;
+
+        ResultsType(ThreadPool* threadPool, std::future<void>&& future,
+            std::shared_ptr<ChunkResults<ResultsVectorOrVoid>> chunkResults) :
+            _threadPool(threadPool), _future(std::move(future)),
+            _chunkResults(std::move(chunkResults))
         {}
 
     public:
         void wait() const
         {
-            for(auto& future : _futures)
-            {
-                future.wait();
+            _threadPool->waitFor(_future);
 
-                if constexpr(!std::is_void_v<ResultsVectorOrVoid>)
-                    this->_values.emplace_back(std::move(future.get()));
+            if constexpr(!std::is_void_v<ResultsVectorOrVoid>)
+            {
+                _future.get();
+                this->_values = std::move(_chunkResults->_chunkResults);
             }
         }
 
@@ -452,6 +516,43 @@ private:
         }
     };
 
+    // A range that has been cut into chunks, which are claimed in turn by
+    // each of the threads executing the loop, until none remain
+    template<typename It, typename ResultsVectorOrVoid>
+    struct Loop : ChunkResults<ResultsVectorOrVoid>
+    {
+        std::vector<std::pair<It, It>> _chunks;
+        std::atomic<size_t> _nextChunk = 0;
+        std::atomic<size_t> _numChunksExecuted = 0;
+
+        std::mutex _exceptionMutex;
+        std::exception_ptr _exception;
+        std::promise<void> _done;
+
+        void setException(std::exception_ptr exception)
+        {
+            std::unique_lock<std::mutex> lock(_exceptionMutex);
+            if(_exception == nullptr)
+                _exception = std::move(exception);
+        }
+
+        void chunkExecuted()
+        {
+            if(++_numChunksExecuted < _chunks.size())
+                return;
+
+            std::unique_lock<std::mutex> lock(_exceptionMutex);
+            if(_exception != nullptr)
+                _done.set_exception(_exception);
+            else
+                _done.set_value();
+        }
+    };
+
+    // The number of chunks each thread's share of a range is cut into; more
+    // allows threads that finish early to relieve the stragglers
+    static const uint64_t ChunksPerThread = 8;
+
 public:
     template<typename It, typename Fn> using Results =
         ResultsType<typename Executor<It, Fn>::ResultsVectorOrVoid>;
@@ -465,12 +566,35 @@ public:
     template<typename It, typename Fn>
     auto parallel_for(It first, It last, Fn f, ResultsPolicy resultsPolicy = Blocking)
     {
+        using ResultsVectorOrVoid = typename Executor<It, Fn>::ResultsVectorOrVoid;
+
+        auto loop = std::make_shared<Loop<It, ResultsVectorOrVoid>>();
+
+        // An empty range has no chunks to complete the loop, so it's complete already
+        if(first == last)
+        {
+            auto future = loop->_done.get_future();
+            loop->_done.set_value();
+
+            auto results = Results<It, Fn>(this, std::move(future), std::move(loop));
+
+            if(resultsPolicy == Blocking)
+                results.wait();
+
+            return results;
+        }
+
         Coster<It> coster(first, last);
 
+        const bool serial = executingSerially();
+        if(serial)
+            resultsPolicy = Blocking;
+
         const auto totalCost = coster.total(); Q_ASSERT(totalCost > 0);
-        const auto numThreads = static_cast<int>(_threads.size());
-        const auto costPerThread = totalCost / numThreads +
-                ((totalCost % numThreads) ? 1 : 0);
+        const auto numThreads = serial ? uint64_t{1} : static_cast<uint64_t>(_threads.size());
+        const auto numChunks = serial ? uint64_t{1} : numThreads * ChunksPerThread;
+        const auto costPerChunk = totalCost / numChunks +
+                ((totalCost % numChunks) ? 1 : 0);
 
         static_assert(std::is_convertible_v<FirstArgumentType<Fn>, It> ||
             std::is_convertible_v<FirstArgumentType<Fn>, typename It::value_type>,
@@ -479,35 +603,74 @@ public:
         static_assert(function_traits<Fn>::arity == 1 || HasThreadIndexArgument<Fn>,
             "Fn's (optional) second index argument must be size_t");
 
-        std::vector<std::future<typename Executor<It, Fn>::ResultsVectorOrVoid>> futures;
-        size_t threadIndex = 0;
-
         for(It it = first; it != last;)
         {
-            It threadLast = it;
+            It chunkLast = it;
             uint64_t cost = 0;
             do
             {
-                cost += coster(threadLast);
-                ++threadLast;
+                cost += coster(chunkLast);
+                ++chunkLast;
             }
-            while(threadLast != last && cost < costPerThread);
+            while(chunkLast != last && cost < costPerChunk);
+
+            loop->_chunks.emplace_back(it, chunkLast);
+            it = chunkLast;
+        }
 
-            Q_ASSERT(threadIndex < _threads.size());
+        if constexpr(!std::is_void_v<ResultsVectorOrVoid>)
+            loop->_chunkResults.resize(loop->_chunks.size());
 
-            // Capture must be by value as the futures may outlive the invocation of parallel_for
-            futures.emplace_back(makeFuture([it, threadLast, threadIndex, f]() mutable
+        // Each thread gets its own copy of f, and a threadIndex
+        // that is unique amongst the threads executing the loop
+        auto executeChunks = [loop](Fn& threadF, size_t threadIndex)
+        {
+            size_t chunkIndex;
+            while((chunkIndex = loop->_nextChunk++) < loop->_chunks.size())
             {
-                return Executor<It, Fn>::execute(
-                    std::exchange(it, It()), std::exchange(threadLast, It()),
-                    threadIndex, f);
-            }));
+                const auto& [chunkFirst, chunkLast] = loop->_chunks.at(chunkIndex);
 
-            it = threadLast;
-            threadIndex++;
+                try
+                {
+                    if constexpr(std::is_void_v<ResultsVectorOrVoid>)
+                        Executor<It, Fn>::execute(chunkFirst, chunkLast, threadIndex, threadF);
+                    else
+                    {
+                        loop->_chunkResults.at(chunkIndex) =
+                            Executor<It, Fn>::execute(chunkFirst, chunkLast, threadIndex, threadF);
+                    }
+                }
+                catch(...)
+                {
+                    loop->setException(std::current_exception());
+                }
+
+                loop->chunkExecuted();
+            }
+        };
+
+        const auto numLoopThreads = std::min(static_cast<size_t>(numThreads), loop->_chunks.size());
+
+        // When blocking, the calling thread takes part in the loop, so it
+        // can always make progress, even if every worker thread is busy
+        const size_t firstQueuedThreadIndex = resultsPolicy == Blocking ? 1 : 0;
+
+        auto future = loop->_done.get_future();
+
+        for(auto threadIndex = firstQueuedThreadIndex; threadIndex < numLoopThreads; threadIndex++)
+        {
+            // Capture must be by value as the tasks may outlive the invocation of parallel_for;
+            // a task that only starts once all the chunks are claimed doesn't touch f at all
+            enqueue(void_callable_wrapper([executeChunks, threadIndex, f]() mutable
+            {
+                executeChunks(f, threadIndex);
+            }));
         }
 
-        auto results = Results<It, Fn>(std::move(futures));
+        if(resultsPolicy == Blocking)
+            executeChunks(f, 0);
+
+        auto results = Results<It, Fn>(this, std::move(future), std::move(loop));
 
         if(resultsPolicy == Blocking)
             results.wait();
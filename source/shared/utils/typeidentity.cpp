@@ -36,6 +36,11 @@ void TypeIdentity::updateType(const QString& value)
     Q_UNUSED(doubleValue); // Keep cppcheck happy
     bool isFloat = conversionSucceeded;
 
+    updateType(isInt, isFloat);
+}
+
+void TypeIdentity::updateType(bool isInt, bool isFloat)
+{
     switch(_type)
     {
     default:
@@ -37,6 +37,7 @@ private:
 
 public:
     void updateType(const QString& value);
+    void updateType(bool isInt, bool isFloat);
 
     template<typename C>
     void updateType(const C& values)
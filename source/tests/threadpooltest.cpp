@@ -0,0 +1,79 @@
+/* Copyright © 2013-2021 Graphia Technologies Ltd.
+ *
+ * This file is part of Graphia.
+ *
+ * Graphia is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Graphia is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Graphia.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared/utils/threadpool.h"
+
+#include <QtTest>
+
+#include <vector>
+
+class ThreadPoolTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void emptyRangeBlocking()
+    {
+        ThreadPool threadPool(QStringLiteral("Test"), 2);
+        std::vector<int> values;
+        size_t numCalls = 0;
+
+        threadPool.parallel_for(values.begin(), values.end(),
+            [&numCalls](int) { numCalls++; }, ThreadPool::Blocking);
+
+        QCOMPARE(numCalls, size_t{0});
+    }
+
+    void emptyRangeNonBlocking()
+    {
+        ThreadPool threadPool(QStringLiteral("Test"), 2);
+        std::vector<int> values;
+
+        auto results = threadPool.parallel_for(values.begin(), values.end(),
+            [](int value) { return value; }, ThreadPool::NonBlocking);
+
+        results.wait();
+
+        QVERIFY(results.begin() == results.end());
+    }
+
+    void nonEmptyRange()
+    {
+        ThreadPool threadPool(QStringLiteral("Test"), 2);
+        std::vector<int> values(1000, 1);
+
+        for(auto resultsPolicy : {ThreadPool::Blocking, ThreadPool::NonBlocking})
+        {
+            auto results = threadPool.parallel_for(values.begin(), values.end(),
+                [](int value) { return value; }, resultsPolicy);
+
+            if(resultsPolicy == ThreadPool::NonBlocking)
+                results.wait();
+
+            int sum = 0;
+            for(auto value : results)
+                sum += value;
+
+            QCOMPARE(sum, 1000);
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(ThreadPoolTest)
+
+#include "threadpooltest.moc"